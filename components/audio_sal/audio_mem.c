@@ -30,7 +30,10 @@
 
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_memory_utils.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "sdkconfig.h"
 #include "string.h"
 
@@ -67,6 +70,151 @@ media_lib_add_trace_mem(const char *module, void *addr, int size,
 void __attribute__((weak)) media_lib_remove_trace_mem(void *addr) {}
 #endif
 
+// where the untagged wrappers allocate, for failure counts
+#if CONFIG_SPIRAM_BOOT_INIT
+#define AUDIO_MEM_ADF_CAPS MALLOC_CAP_SPIRAM
+#else
+#define AUDIO_MEM_ADF_CAPS 0
+#endif
+
+#if CONFIG_USE_HEAP_ACCOUNTING
+/**
+ * Usage per tag and heap. Sizes are those of the heap's blocks, the same on
+ * allocation and free. The heap is taken from the pointer, failures are
+ * counted in the heap the caps ask for, malloc() fails count as internal.
+ */
+static portMUX_TYPE memStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static audio_mem_usage_t memUsage[AUDIO_MEM_TAG_MAX][AUDIO_MEM_HEAP_MAX];
+static audio_mem_frag_t memFrag[AUDIO_MEM_FRAG_SAMPLES][AUDIO_MEM_HEAP_MAX];
+static uint32_t memFragCnt = 0;
+static esp_timer_handle_t memFragTimer = NULL;
+
+static const uint32_t memHeapCaps[AUDIO_MEM_HEAP_MAX] = {
+    MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    MALLOC_CAP_32BIT | MALLOC_CAP_EXEC,
+    MALLOC_CAP_SPIRAM,
+};
+
+static audio_mem_heap_t audio_mem_heap_of(const void *ptr) {
+  if (esp_ptr_external_ram(ptr)) {
+    return AUDIO_MEM_HEAP_SPIRAM;
+  }
+
+  if (esp_ptr_in_iram(ptr)) {
+    return AUDIO_MEM_HEAP_IRAM;
+  }
+
+  return AUDIO_MEM_HEAP_INTERNAL;
+}
+
+static audio_mem_heap_t audio_mem_heap_of_caps(uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) {
+    return AUDIO_MEM_HEAP_SPIRAM;
+  }
+
+  if (caps & MALLOC_CAP_EXEC) {
+    return AUDIO_MEM_HEAP_IRAM;
+  }
+
+  return AUDIO_MEM_HEAP_INTERNAL;
+}
+
+static void audio_mem_add(audio_mem_tag_t tag, audio_mem_heap_t heap,
+                          size_t size) {
+  audio_mem_usage_t *usage = &memUsage[tag][heap];
+
+  portENTER_CRITICAL(&memStatsMux);
+  usage->current += size;
+  if (usage->current > usage->peak) {
+    usage->peak = usage->current;
+  }
+  usage->allocs++;
+  portEXIT_CRITICAL(&memStatsMux);
+}
+
+static void audio_mem_sub(audio_mem_tag_t tag, audio_mem_heap_t heap,
+                          size_t size) {
+  audio_mem_usage_t *usage = &memUsage[tag][heap];
+
+  // memory freed with another tag than it was allocated for mustn't wrap
+  portENTER_CRITICAL(&memStatsMux);
+  usage->current = (usage->current > size) ? (usage->current - size) : 0;
+  portEXIT_CRITICAL(&memStatsMux);
+}
+
+static void audio_mem_fail(audio_mem_tag_t tag, audio_mem_heap_t heap) {
+  portENTER_CRITICAL(&memStatsMux);
+  memUsage[tag][heap].fails++;
+  portEXIT_CRITICAL(&memStatsMux);
+}
+#endif
+
+/**
+ * account a fresh allocation, ptr is NULL if it failed
+ */
+static void audio_mem_account(audio_mem_tag_t tag, void *ptr, uint32_t caps) {
+#if CONFIG_USE_HEAP_ACCOUNTING
+  if (ptr == NULL) {
+    audio_mem_fail(tag, audio_mem_heap_of_caps(caps));
+  } else {
+    // size is read outside of the critical section, it takes the heap lock
+    audio_mem_add(tag, audio_mem_heap_of(ptr),
+                  heap_caps_get_allocated_size(ptr));
+  }
+#endif
+}
+
+/**
+ * account memory which is about to be freed
+ */
+static void audio_mem_release(audio_mem_tag_t tag, void *ptr) {
+#if CONFIG_USE_HEAP_ACCOUNTING
+  if (ptr != NULL) {
+    audio_mem_sub(tag, audio_mem_heap_of(ptr),
+                  heap_caps_get_allocated_size(ptr));
+  }
+#endif
+}
+
+/**
+ * realloc() if caps are 0, heap_caps_realloc() otherwise
+ */
+static void *audio_mem_realloc(audio_mem_tag_t tag, void *ptr, size_t size,
+                               uint32_t caps) {
+  void *p;
+#if CONFIG_USE_HEAP_ACCOUNTING
+  audio_mem_heap_t oldHeap = audio_mem_heap_of_caps(caps);
+  size_t oldSize = 0;
+
+  // old block is gone after a successful realloc
+  if (ptr != NULL) {
+    oldHeap = audio_mem_heap_of(ptr);
+    oldSize = heap_caps_get_allocated_size(ptr);
+  }
+#endif
+
+  if (caps == 0) {
+    p = realloc(ptr, size);
+  } else {
+    p = heap_caps_realloc(ptr, size, caps);
+  }
+
+#if CONFIG_USE_HEAP_ACCOUNTING
+  if ((p != NULL) || (size == 0)) {
+    if (ptr != NULL) {
+      audio_mem_sub(tag, oldHeap, oldSize);
+    }
+    if (p != NULL) {
+      audio_mem_add(tag, audio_mem_heap_of(p), heap_caps_get_allocated_size(p));
+    }
+  } else {
+    audio_mem_fail(tag, oldHeap);
+  }
+#endif
+
+  return p;
+}
+
 void *audio_malloc(size_t size) {
   void *data = NULL;
 #if CONFIG_SPIRAM_BOOT_INIT
@@ -74,6 +222,7 @@ void *audio_malloc(size_t size) {
 #else
   data = malloc(size);
 #endif
+  audio_mem_account(AUDIO_MEM_TAG_ADF, data, AUDIO_MEM_ADF_CAPS);
 #ifdef ENABLE_AUDIO_MEM_TRACE
   media_lib_add_trace_mem(NULL, data, size, 0);
 #endif
@@ -84,6 +233,7 @@ void audio_free(void *ptr) {
 #ifdef ENABLE_AUDIO_MEM_TRACE
   media_lib_remove_trace_mem(ptr);
 #endif
+  audio_mem_release(AUDIO_MEM_TAG_ADF, ptr);
   free(ptr);
 }
 
@@ -97,6 +247,7 @@ void *audio_calloc(size_t nmemb, size_t size) {
 #else
   data = calloc(nmemb, size);
 #endif
+  audio_mem_account(AUDIO_MEM_TAG_ADF, data, AUDIO_MEM_ADF_CAPS);
 #ifdef ENABLE_AUDIO_MEM_TRACE
   media_lib_add_trace_mem(NULL, data, nmemb * size, 0);
 #endif
@@ -110,9 +261,10 @@ void *audio_realloc(void *ptr, size_t size) {
 #endif
 
 #if CONFIG_SPIRAM_BOOT_INIT
-  p = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  p = audio_mem_realloc(AUDIO_MEM_TAG_ADF, ptr, size,
+                        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
 #else
-  p = heap_caps_realloc(ptr, size, MALLOC_CAP_8BIT);
+  p = audio_mem_realloc(AUDIO_MEM_TAG_ADF, ptr, size, MALLOC_CAP_8BIT);
 #endif
 #ifdef ENABLE_AUDIO_MEM_TRACE
   media_lib_add_trace_mem(NULL, p, size, 0);
@@ -127,6 +279,7 @@ char *audio_strdup(const char *str) {
 #else
   char *copy = malloc(size);
 #endif
+  audio_mem_account(AUDIO_MEM_TAG_ADF, copy, AUDIO_MEM_ADF_CAPS);
   if (copy) {
     strcpy(copy, str);
 #ifdef ENABLE_AUDIO_MEM_TRACE
@@ -145,12 +298,157 @@ void *audio_calloc_inner(size_t n, size_t size) {
 #else
   data = heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
 #endif
+  audio_mem_account(AUDIO_MEM_TAG_ADF, data, MALLOC_CAP_INTERNAL);
 #ifdef ENABLE_AUDIO_MEM_TRACE
   media_lib_add_trace_mem(NULL, data, n * size, MALLOC_RAM_FLAG);
 #endif
   return data;
 }
 
+void *audio_malloc_tag(audio_mem_tag_t tag, size_t size) {
+  void *data = malloc(size);
+
+  audio_mem_account(tag, data, 0);
+
+  return data;
+}
+
+void *audio_calloc_tag(audio_mem_tag_t tag, size_t nmemb, size_t size) {
+  void *data = calloc(nmemb, size);
+
+  audio_mem_account(tag, data, 0);
+
+  return data;
+}
+
+void *audio_realloc_tag(audio_mem_tag_t tag, void *ptr, size_t size) {
+  return audio_mem_realloc(tag, ptr, size, 0);
+}
+
+void *audio_malloc_caps_tag(audio_mem_tag_t tag, size_t size, uint32_t caps) {
+  void *data = heap_caps_malloc(size, caps);
+
+  audio_mem_account(tag, data, caps);
+
+  return data;
+}
+
+void audio_free_tag(audio_mem_tag_t tag, void *ptr) {
+  audio_mem_release(tag, ptr);
+  free(ptr);
+}
+
+esp_err_t audio_mem_stats_get(audio_mem_tag_t tag, audio_mem_heap_t heap,
+                              audio_mem_usage_t *usage) {
+#if CONFIG_USE_HEAP_ACCOUNTING
+  if ((tag >= AUDIO_MEM_TAG_MAX) || (heap >= AUDIO_MEM_HEAP_MAX) ||
+      (usage == NULL)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&memStatsMux);
+  *usage = memUsage[tag][heap];
+  portEXIT_CRITICAL(&memStatsMux);
+
+  return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void audio_mem_frag_sample(void) {
+#if CONFIG_USE_HEAP_ACCOUNTING
+  audio_mem_frag_t sample[AUDIO_MEM_HEAP_MAX];
+
+  for (int i = 0; i < AUDIO_MEM_HEAP_MAX; i++) {
+    sample[i].free = heap_caps_get_free_size(memHeapCaps[i]);
+    sample[i].largest = heap_caps_get_largest_free_block(memHeapCaps[i]);
+    sample[i].index = 0;
+    if ((sample[i].free > 0) && (sample[i].largest < sample[i].free)) {
+      sample[i].index =
+          1000 - (uint16_t)((uint64_t)sample[i].largest * 1000 /
+                            sample[i].free);
+    }
+  }
+
+  portENTER_CRITICAL(&memStatsMux);
+  memcpy(memFrag[memFragCnt % AUDIO_MEM_FRAG_SAMPLES], sample,
+         sizeof(sample));
+  memFragCnt++;
+  portEXIT_CRITICAL(&memStatsMux);
+#endif
+}
+
+#if CONFIG_USE_HEAP_ACCOUNTING
+static void audio_mem_frag_cb(void *arg) { audio_mem_frag_sample(); }
+#endif
+
+esp_err_t audio_mem_frag_start(uint32_t period_ms) {
+#if CONFIG_USE_HEAP_ACCOUNTING
+  const esp_timer_create_args_t args = {
+      .callback = &audio_mem_frag_cb,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "memFrag",
+      .skip_unhandled_events = true};
+  esp_err_t err;
+
+  if (memFragTimer != NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  err = esp_timer_create(&args, &memFragTimer);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  audio_mem_frag_sample();
+
+  return esp_timer_start_periodic(memFragTimer, (uint64_t)period_ms * 1000);
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t audio_mem_frag_get(audio_mem_heap_t heap, audio_mem_frag_t *frag,
+                            uint32_t max) {
+  uint32_t cnt = 0;
+#if CONFIG_USE_HEAP_ACCOUNTING
+  uint32_t first;
+
+  if ((heap >= AUDIO_MEM_HEAP_MAX) || (frag == NULL)) {
+    return 0;
+  }
+
+  portENTER_CRITICAL(&memStatsMux);
+  cnt = (memFragCnt < AUDIO_MEM_FRAG_SAMPLES) ? memFragCnt
+                                              : AUDIO_MEM_FRAG_SAMPLES;
+  if (cnt > max) {
+    cnt = max;
+  }
+  first = memFragCnt - cnt;
+  for (uint32_t i = 0; i < cnt; i++) {
+    frag[i] = memFrag[(first + i) % AUDIO_MEM_FRAG_SAMPLES][heap];
+  }
+  portEXIT_CRITICAL(&memStatsMux);
+#endif
+
+  return cnt;
+}
+
+const char *audio_mem_tag_str(audio_mem_tag_t tag) {
+  static const char *const name[AUDIO_MEM_TAG_MAX] = {
+      "adf", "decoder", "chunk", "dsp", "net", "http", "json"};
+
+  return (tag < AUDIO_MEM_TAG_MAX) ? name[tag] : "unknown";
+}
+
+const char *audio_mem_heap_str(audio_mem_heap_t heap) {
+  static const char *const name[AUDIO_MEM_HEAP_MAX] = {"internal", "iram",
+                                                       "spiram"};
+
+  return (heap < AUDIO_MEM_HEAP_MAX) ? name[heap] : "unknown";
+}
+
 void audio_mem_print(const char *tag, int line, const char *func) {
 #ifdef CONFIG_SPIRAM_BOOT_INIT
   ESP_LOGI(
@@ -4,3 +4,5 @@
 COMPONENT_ADD_INCLUDEDIRS := . ./include
 
 COMPONENT_SRCDIRS :=  .
+
+COMPONENT_ADD_LDFRAGMENTS += linker.lf
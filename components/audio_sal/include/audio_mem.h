@@ -29,6 +29,8 @@
 
 #include <esp_types.h>
 
+#include "esp_err.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -136,6 +138,175 @@ bool audio_mem_spiram_is_enabled(void);
  */
 bool audio_mem_spiram_stack_is_enabled(void);
 
+/**
+ * @brief   Owner of an allocation, heap accounting is kept per tag
+ */
+typedef enum {
+  AUDIO_MEM_TAG_ADF = 0, /*!< untagged wrappers above, board and peripherals */
+  AUDIO_MEM_TAG_DECODER, /*!< codec input and output buffers */
+  AUDIO_MEM_TAG_CHUNK,   /*!< pcm chunks waiting for playout */
+  AUDIO_MEM_TAG_DSP,     /*!< dsp_processor filters and buffers */
+  AUDIO_MEM_TAG_NET,     /*!< snapcast protocol messages */
+  AUDIO_MEM_TAG_HTTP,    /*!< UI http server and websocket */
+  AUDIO_MEM_TAG_JSON,    /*!< cJSON, allocated through its hooks */
+  AUDIO_MEM_TAG_MAX,
+} audio_mem_tag_t;
+
+/**
+ * @brief   Heap capability an allocation ended up in
+ */
+typedef enum {
+  AUDIO_MEM_HEAP_INTERNAL = 0, /*!< internal 8 bit capable RAM */
+  AUDIO_MEM_HEAP_IRAM,         /*!< IRAM, 32 bit access only */
+  AUDIO_MEM_HEAP_SPIRAM,       /*!< external SPI ram */
+  AUDIO_MEM_HEAP_MAX,
+} audio_mem_heap_t;
+
+/**
+ * @brief   Heap usage of one tag in one heap
+ */
+typedef struct {
+  size_t current;  /*!< bytes allocated now */
+  size_t peak;     /*!< most bytes allocated at once */
+  uint32_t allocs; /*!< successful allocations and reallocations */
+  uint32_t fails;  /*!< failed allocations */
+} audio_mem_usage_t;
+
+/**
+ * @brief   One fragmentation sample of a heap
+ */
+typedef struct {
+  uint32_t free;    /*!< free bytes */
+  uint32_t largest; /*!< largest free block */
+  uint16_t index;   /*!< 1000 * (1 - largest / free), 0 if not fragmented */
+} audio_mem_frag_t;
+
+/**
+ * @brief   Number of fragmentation samples kept per heap
+ */
+#define AUDIO_MEM_FRAG_SAMPLES 30
+
+/**
+ * @brief   malloc() accounted to a tag
+ *
+ * Memory of the tagged functions must be freed with audio_free_tag() and the
+ * same tag, placement is the one of malloc() and heap_caps_malloc().
+ *
+ * @param[in]  tag    owner of the memory
+ * @param[in]  size   memory size
+ *
+ * @return
+ *     - valid pointer on success
+ *     - NULL when any errors
+ */
+void *audio_malloc_tag(audio_mem_tag_t tag, size_t size);
+
+/**
+ * @brief   calloc() accounted to a tag
+ *
+ * @param[in]  tag     owner of the memory
+ * @param[in]  nmemb   number of block
+ * @param[in]  size    block memory size
+ *
+ * @return
+ *     - valid pointer on success
+ *     - NULL when any errors
+ */
+void *audio_calloc_tag(audio_mem_tag_t tag, size_t nmemb, size_t size);
+
+/**
+ * @brief   realloc() accounted to a tag
+ *
+ * @param[in]  tag    owner of the memory
+ * @param[in]  ptr    memory pointer
+ * @param[in]  size   block memory size
+ *
+ * @return
+ *     - valid pointer on success
+ *     - NULL when any errors, ptr is still valid then
+ */
+void *audio_realloc_tag(audio_mem_tag_t tag, void *ptr, size_t size);
+
+/**
+ * @brief   heap_caps_malloc() accounted to a tag
+ *
+ * @param[in]  tag    owner of the memory
+ * @param[in]  size   memory size
+ * @param[in]  caps   MALLOC_CAP_* of the memory
+ *
+ * @return
+ *     - valid pointer on success
+ *     - NULL when any errors
+ */
+void *audio_malloc_caps_tag(audio_mem_tag_t tag, size_t size, uint32_t caps);
+
+/**
+ * @brief   Free memory of the tagged functions
+ *
+ * @param[in]  tag    owner the memory was allocated for
+ * @param[in]  ptr    memory pointer, may be NULL
+ */
+void audio_free_tag(audio_mem_tag_t tag, void *ptr);
+
+/**
+ * @brief   Get heap usage of a tag
+ *
+ * @param[in]   tag     owner of the memory
+ * @param[in]   heap    heap capability
+ * @param[out]  usage   current, peak, allocation and failure count
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NOT_SUPPORTED, heap accounting is disabled
+ */
+esp_err_t audio_mem_stats_get(audio_mem_tag_t tag, audio_mem_heap_t heap,
+                              audio_mem_usage_t *usage);
+
+/**
+ * @brief   Sample free size and largest free block of all heaps now
+ *
+ * Called periodically once audio_mem_frag_start() was called, the last
+ * AUDIO_MEM_FRAG_SAMPLES samples are kept.
+ */
+void audio_mem_frag_sample(void);
+
+/**
+ * @brief   Start periodic fragmentation sampling
+ *
+ * @param[in]  period_ms   sample period
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE, already started
+ *     - ESP_ERR_NOT_SUPPORTED, heap accounting is disabled
+ *     - error of esp_timer otherwise
+ */
+esp_err_t audio_mem_frag_start(uint32_t period_ms);
+
+/**
+ * @brief   Get fragmentation samples of a heap, oldest first
+ *
+ * @param[in]   heap    heap capability
+ * @param[out]  frag    samples
+ * @param[in]   max     size of frag
+ *
+ * @return
+ *     - number of samples copied to frag
+ */
+uint32_t audio_mem_frag_get(audio_mem_heap_t heap, audio_mem_frag_t *frag,
+                            uint32_t max);
+
+/**
+ * @brief   Name of a tag, e.g. for reports
+ */
+const char *audio_mem_tag_str(audio_mem_tag_t tag);
+
+/**
+ * @brief   Name of a heap capability, e.g. for reports
+ */
+const char *audio_mem_heap_str(audio_mem_heap_t heap);
+
 #define AUDIO_MEM_SHOW(x) audio_mem_print(x, __LINE__, __func__)
 
 #ifdef __cplusplus
@@ -27,8 +27,10 @@
 #include "audio_mem.h"
 
 #include <pthread.h>
+#include <string.h>
 
 #include "esp_err.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -87,3 +89,65 @@ TEST_CASE("audio_realloc", "esp-adf") {
   audio_free(pdata);
   AUDIO_MEM_SHOW(TAG);
 }
+
+static void audio_mem_usage_sum(audio_mem_tag_t tag, audio_mem_usage_t* sum) {
+  audio_mem_usage_t usage;
+
+  memset(sum, 0, sizeof(*sum));
+  for (int i = 0; i < AUDIO_MEM_HEAP_MAX; i++) {
+    TEST_ASSERT_EQUAL(ESP_OK, audio_mem_stats_get(tag, i, &usage));
+    sum->current += usage.current;
+    sum->peak += usage.peak;
+    sum->allocs += usage.allocs;
+    sum->fails += usage.fails;
+  }
+}
+
+TEST_CASE("audio_mem tagged accounting", "esp-adf") {
+  audio_mem_usage_t before, usage;
+  audio_mem_frag_t frag[AUDIO_MEM_FRAG_SAMPLES];
+  uint32_t cnt;
+
+  if (audio_mem_stats_get(AUDIO_MEM_TAG_HTTP, AUDIO_MEM_HEAP_INTERNAL,
+                          &usage) == ESP_ERR_NOT_SUPPORTED) {
+    TEST_IGNORE_MESSAGE("CONFIG_USE_HEAP_ACCOUNTING is disabled");
+  }
+
+  audio_mem_usage_sum(AUDIO_MEM_TAG_HTTP, &before);
+
+  uint8_t* pdata = audio_malloc_caps_tag(AUDIO_MEM_TAG_HTTP, 1024,
+                                         MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  TEST_ASSERT_NOT_NULL(pdata);
+  audio_mem_usage_sum(AUDIO_MEM_TAG_HTTP, &usage);
+  TEST_ASSERT_GREATER_OR_EQUAL(before.current + 1024, usage.current);
+  TEST_ASSERT_GREATER_OR_EQUAL(usage.current, usage.peak);
+  TEST_ASSERT_EQUAL(before.allocs + 1, usage.allocs);
+
+  pdata = audio_realloc_tag(AUDIO_MEM_TAG_HTTP, pdata, 2 * 1024);
+  TEST_ASSERT_NOT_NULL(pdata);
+  audio_mem_usage_sum(AUDIO_MEM_TAG_HTTP, &usage);
+  TEST_ASSERT_GREATER_OR_EQUAL(before.current + 2 * 1024, usage.current);
+  TEST_ASSERT_LESS_THAN(before.current + 3 * 1024, usage.current);
+
+  audio_free_tag(AUDIO_MEM_TAG_HTTP, pdata);
+  audio_mem_usage_sum(AUDIO_MEM_TAG_HTTP, &usage);
+  TEST_ASSERT_EQUAL(before.current, usage.current);
+  TEST_ASSERT_EQUAL(before.fails, usage.fails);
+
+  pdata = audio_malloc_caps_tag(
+      AUDIO_MEM_TAG_HTTP,
+      heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) + 1,
+      MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  TEST_ASSERT_NULL(pdata);
+  TEST_ASSERT_EQUAL(ESP_OK,
+                    audio_mem_stats_get(AUDIO_MEM_TAG_HTTP,
+                                        AUDIO_MEM_HEAP_INTERNAL, &usage));
+  TEST_ASSERT_GREATER_THAN(0, usage.fails);
+
+  audio_mem_frag_sample();
+  cnt = audio_mem_frag_get(AUDIO_MEM_HEAP_INTERNAL, frag,
+                           AUDIO_MEM_FRAG_SAMPLES);
+  TEST_ASSERT_GREATER_THAN(0, cnt);
+  TEST_ASSERT_GREATER_OR_EQUAL(frag[cnt - 1].largest, frag[cnt - 1].free);
+  TEST_ASSERT_LESS_OR_EQUAL(1000, frag[cnt - 1].index);
+}
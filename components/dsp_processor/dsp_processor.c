@@ -7,10 +7,15 @@
 #include "freertos/FreeRTOS.h"
 
 #if CONFIG_USE_DSP_PROCESSOR
+#include "audio_mem.h"
 #include "dsps_biquad.h"
 #include "dsps_biquad_gen.h"
 #include "esp_log.h"
 #include "freertos/queue.h"
+#if CONFIG_USE_WARM_START
+#include "esp_timer.h"
+#include "nvs.h"
+#endif
 
 #include "dsp_processor.h"
 
@@ -24,6 +29,12 @@ static const char *TAG = "dspProc";
 
 #define DSP_PROCESSOR_LEN 16
 
+#define DSP_PROCESSOR_NVS_NAMESPACE "dsp_processor"
+#define DSP_PROCESSOR_NVS_KEY "filterParams"
+// filter parameters are written this long after the last change, so moving
+// a slider in the web UI doesn't wear flash
+#define DSP_PROCESSOR_NVS_STORE_DELAY_US 10000000LL
+
 static QueueHandle_t filterUpdateQHdl = NULL;
 
 static filterParams_t filterParams;
@@ -37,6 +48,12 @@ static bool init = false;
 static float *sbuffer0 = NULL;
 static float *sbufout0 = NULL;
 
+#if CONFIG_USE_WARM_START
+static esp_timer_handle_t storeTimer = NULL;
+static portMUX_TYPE storeMux = portMUX_INITIALIZER_UNLOCKED;
+static filterParams_t storeParams;
+#endif
+
 #if CONFIG_USE_DSP_PROCESSOR
 #if CONFIG_SNAPCLIENT_DSP_FLOW_STEREO
 dspFlows_t dspFlowInit = dspfStereo;
@@ -52,6 +69,93 @@ dspFlows_t dspFlowInit = dspfEQBassTreble;
 #endif
 #endif
 
+#if CONFIG_USE_WARM_START
+/**
+ * load filter parameters the user chose before reboot, only if they were made
+ * for the configured DSP flow
+ */
+static esp_err_t dsp_processor_load_filter_params(filterParams_t *params) {
+  nvs_handle_t handle;
+  filterParams_t tmp;
+  size_t len = sizeof(filterParams_t);
+  esp_err_t err;
+
+  err = nvs_open(DSP_PROCESSOR_NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = nvs_get_blob(handle, DSP_PROCESSOR_NVS_KEY, &tmp, &len);
+  nvs_close(handle);
+
+  if ((err != ESP_OK) || (len != sizeof(filterParams_t)) ||
+      (tmp.dspFlow != params->dspFlow)) {
+    return ESP_FAIL;
+  }
+
+  *params = tmp;
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+static esp_err_t dsp_processor_store_filter_params(filterParams_t *params) {
+  nvs_handle_t handle;
+  esp_err_t err;
+
+  err = nvs_open(DSP_PROCESSOR_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = nvs_set_blob(handle, DSP_PROCESSOR_NVS_KEY, params,
+                     sizeof(filterParams_t));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+
+  return err;
+}
+
+/**
+ * runs in esp_timer task once parameters didn't change for a while
+ */
+static void dsp_processor_store_cb(void *arg) {
+  filterParams_t params;
+
+  portENTER_CRITICAL(&storeMux);
+  params = storeParams;
+  portEXIT_CRITICAL(&storeMux);
+
+  if (dsp_processor_store_filter_params(&params) != ESP_OK) {
+    ESP_LOGW(TAG, "%s: couldn't store filter parameters", __func__);
+  }
+}
+
+/**
+ * (re)start store timer, only the latest parameters are written
+ */
+static void dsp_processor_schedule_store(filterParams_t *params) {
+  if (storeTimer == NULL) {
+    return;
+  }
+
+  portENTER_CRITICAL(&storeMux);
+  storeParams = *params;
+  portEXIT_CRITICAL(&storeMux);
+
+  esp_timer_stop(storeTimer);
+  if (esp_timer_start_once(storeTimer, DSP_PROCESSOR_NVS_STORE_DELAY_US) !=
+      ESP_OK) {
+    ESP_LOGW(TAG, "%s: couldn't schedule storing filter parameters",
+             __func__);
+  }
+}
+#endif
+
 /**
  *
  */
@@ -71,7 +175,6 @@ void dsp_processor_init(void) {
     return;
   }
 
-  // TODO: load this data from NVM if available
   filterParams.dspFlow = dspFlowInit;
 
   switch (filterParams.dspFlow) {
@@ -115,6 +218,25 @@ void dsp_processor_init(void) {
     default: { break; }
   }
 
+#if CONFIG_USE_WARM_START
+  if (dsp_processor_load_filter_params(&filterParams) == ESP_OK) {
+    ESP_LOGI(TAG, "%s: using stored filter parameters", __func__);
+  }
+
+  if (storeTimer == NULL) {
+    const esp_timer_create_args_t args = {
+        .callback = &dsp_processor_store_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "dspStore",
+        .skip_unhandled_events = true};
+
+    if (esp_timer_create(&args, &storeTimer) != ESP_OK) {
+      ESP_LOGW(TAG, "%s: filter parameters won't be stored", __func__);
+      storeTimer = NULL;
+    }
+  }
+#endif
+
   ESP_LOGI(TAG, "%s: init done", __func__);
 }
 
@@ -123,17 +245,17 @@ void dsp_processor_init(void) {
  */
 void dsp_processor_uninit(void) {
   if (sbuffer0) {
-    free(sbuffer0);
+    audio_free_tag(AUDIO_MEM_TAG_DSP, sbuffer0);
     sbuffer0 = NULL;
   }
 
   if (sbufout0) {
-    free(sbufout0);
+    audio_free_tag(AUDIO_MEM_TAG_DSP, sbufout0);
     sbufout0 = NULL;
   }
 
   if (filter) {
-    free(filter);
+    audio_free_tag(AUDIO_MEM_TAG_DSP, filter);
     filter = NULL;
   }
 
@@ -142,6 +264,17 @@ void dsp_processor_uninit(void) {
     filterUpdateQHdl = NULL;
   }
 
+#if CONFIG_USE_WARM_START
+  // write a pending change now
+  if (storeTimer) {
+    if (esp_timer_stop(storeTimer) == ESP_OK) {
+      dsp_processor_store_cb(NULL);
+    }
+    esp_timer_delete(storeTimer);
+    storeTimer = NULL;
+  }
+#endif
+
   init = false;
 
   ESP_LOGI(TAG, "%s: uninit done", __func__);
@@ -153,6 +286,10 @@ void dsp_processor_uninit(void) {
 esp_err_t dsp_processor_update_filter_params(filterParams_t *params) {
   if (filterUpdateQHdl) {
     if (xQueueOverwrite(filterUpdateQHdl, params) == pdTRUE) {
+#if CONFIG_USE_WARM_START
+      dsp_processor_schedule_store(params);
+#endif
+
       return ESP_OK;
     }
   }
@@ -225,7 +362,7 @@ int dsp_processor_worker(char *audio, size_t chunk_size, uint32_t samplerate) {
     uint32_t cnt = 0;
 
     if (filter) {
-      free(filter);
+      audio_free_tag(AUDIO_MEM_TAG_DSP, filter);
       filter = NULL;
     }
 
@@ -233,8 +370,8 @@ int dsp_processor_worker(char *audio, size_t chunk_size, uint32_t samplerate) {
       case dspfEQBassTreble: {
         cnt = 4;
 
-        filter =
-            (ptype_t *)heap_caps_malloc(sizeof(ptype_t) * cnt, MALLOC_CAP_8BIT);
+        filter = (ptype_t *)audio_malloc_caps_tag(
+            AUDIO_MEM_TAG_DSP, sizeof(ptype_t) * cnt, MALLOC_CAP_8BIT);
         if (filter) {
           // simple EQ control of low and high frequencies (bass, treble)
           float bass_fc = filterParams.fc_1 / samplerate;
@@ -269,8 +406,8 @@ int dsp_processor_worker(char *audio, size_t chunk_size, uint32_t samplerate) {
       case dspfBassBoost: {
         cnt = 2;
 
-        filter =
-            (ptype_t *)heap_caps_malloc(sizeof(ptype_t) * cnt, MALLOC_CAP_8BIT);
+        filter = (ptype_t *)audio_malloc_caps_tag(
+            AUDIO_MEM_TAG_DSP, sizeof(ptype_t) * cnt, MALLOC_CAP_8BIT);
         if (filter) {
           float bass_fc = filterParams.fc_1 / samplerate;
           float bass_gain = 6.0;
@@ -291,8 +428,8 @@ int dsp_processor_worker(char *audio, size_t chunk_size, uint32_t samplerate) {
       case dspfBiamp: {
         cnt = 4;
 
-        filter =
-            (ptype_t *)heap_caps_malloc(sizeof(ptype_t) * cnt, MALLOC_CAP_8BIT);
+        filter = (ptype_t *)audio_malloc_caps_tag(
+            AUDIO_MEM_TAG_DSP, sizeof(ptype_t) * cnt, MALLOC_CAP_8BIT);
         if (filter) {
           float lp_fc = filterParams.fc_1 / samplerate;
           float lp_gain = filterParams.gain_1;
@@ -342,20 +479,21 @@ int dsp_processor_worker(char *audio, size_t chunk_size, uint32_t samplerate) {
 
   // only process data if it is valid
   if (audio_tmp) {
-    sbuffer0 = (float *)heap_caps_malloc(sizeof(float) * DSP_PROCESSOR_LEN,
-                                         MALLOC_CAP_8BIT);
+    sbuffer0 = (float *)audio_malloc_caps_tag(
+        AUDIO_MEM_TAG_DSP, sizeof(float) * DSP_PROCESSOR_LEN, MALLOC_CAP_8BIT);
     if (sbuffer0 == NULL) {
       ESP_LOGE(TAG, "No Memory allocated for dsp_processor sbuffer0");
 
       return -1;
     }
 
-    sbufout0 = (float *)heap_caps_malloc(sizeof(float) * DSP_PROCESSOR_LEN,
-                                         MALLOC_CAP_8BIT);
+    sbufout0 = (float *)audio_malloc_caps_tag(
+        AUDIO_MEM_TAG_DSP, sizeof(float) * DSP_PROCESSOR_LEN, MALLOC_CAP_8BIT);
     if (sbufout0 == NULL) {
       ESP_LOGE(TAG, "No Memory allocated for dsp_processor sbufout0");
 
-      free(sbuffer0);
+      audio_free_tag(AUDIO_MEM_TAG_DSP, sbuffer0);
+      sbuffer0 = NULL;
 
       return -1;
     }
@@ -604,10 +742,10 @@ int dsp_processor_worker(char *audio, size_t chunk_size, uint32_t samplerate) {
 
       default: { } break; }
 
-    free(sbuffer0);
+    audio_free_tag(AUDIO_MEM_TAG_DSP, sbuffer0);
     sbuffer0 = NULL;
 
-    free(sbufout0);
+    audio_free_tag(AUDIO_MEM_TAG_DSP, sbufout0);
     sbufout0 = NULL;
   }
 
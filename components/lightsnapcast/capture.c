@@ -0,0 +1,180 @@
+/**
+ * Capture of the server's TCP stream
+ *
+ * Everything received on a connection is appended to a buffer in PSRAM
+ * together with its arrival time, from the start of the connection until
+ * the buffer is full. /capture of the UI http server downloads it, the host
+ * build replays it with --replay to benchmark parsing, decoding and DSP
+ * without a server, see README.
+ *
+ * Only http_get_task writes. Data already captured doesn't change while a
+ * dump is running, a connection started meanwhile isn't captured.
+ */
+
+#include "capture.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "time_sync.h"
+
+// bytes handed to dump callback at once
+#define CAPTURE_DUMP_BLOCK 4096
+
+#if CONFIG_USE_STREAM_CAPTURE
+static const char *TAG = "CAPTURE";
+
+static portMUX_TYPE captureMux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t *captureBuf = NULL;
+static size_t captureSize = 0;
+static size_t captureUsed = 0;
+static bool captureFull = false;
+static uint32_t captureReaders = 0;
+#endif
+
+/**
+ *
+ */
+int32_t capture_init(void) {
+#if CONFIG_USE_STREAM_CAPTURE
+  size_t size = CONFIG_STREAM_CAPTURE_SIZE_KB * 1024;
+
+  if (captureBuf != NULL) {
+    return 0;
+  }
+
+  captureBuf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (captureBuf == NULL) {
+    ESP_LOGE(TAG, "couldn't get %u bytes for capture", size);
+
+    return -1;
+  }
+  captureSize = size;
+#endif
+
+  return 0;
+}
+
+/**
+ * called on every new connection, capture starts over
+ */
+void capture_start(void) {
+#if CONFIG_USE_STREAM_CAPTURE
+  bool busy;
+
+  portENTER_CRITICAL(&captureMux);
+  busy = (captureReaders > 0);
+  if (busy == true) {
+    // keep the one which is downloaded consistent
+    captureFull = true;
+  } else {
+    captureUsed = 0;
+    captureFull = false;
+  }
+  portEXIT_CRITICAL(&captureMux);
+
+  if (busy == true) {
+    ESP_LOGW(TAG, "dump running, connection not captured");
+  }
+#endif
+}
+
+/**
+ * Append data which was received at stream position streamPos. Stops
+ * capturing when the buffer is full.
+ */
+void capture_write(uint64_t streamPos, const void *data, size_t len) {
+#if CONFIG_USE_STREAM_CAPTURE
+  capture_record_t rec;
+  int64_t t_us;
+  size_t pos;
+
+  if ((captureBuf == NULL) || (len == 0)) {
+    return;
+  }
+
+  portENTER_CRITICAL(&captureMux);
+  if (captureFull == true) {
+    portEXIT_CRITICAL(&captureMux);
+
+    return;
+  }
+
+  pos = captureUsed;
+  if (pos + sizeof(rec) + len > captureSize) {
+    captureFull = true;
+    portEXIT_CRITICAL(&captureMux);
+
+    ESP_LOGI(TAG, "capture full, %u bytes", pos);
+
+    return;
+  }
+  portEXIT_CRITICAL(&captureMux);
+
+  if (time_sync_rx_timestamp_get(streamPos, &t_us) < 0) {
+    t_us = esp_timer_get_time();
+  }
+  rec.t_us = t_us;
+  rec.len = len;
+
+  // beyond what readers see, no lock needed
+  memcpy(&captureBuf[pos], &rec, sizeof(rec));
+  memcpy(&captureBuf[pos + sizeof(rec)], data, len);
+
+  portENTER_CRITICAL(&captureMux);
+  captureUsed = pos + sizeof(rec) + len;
+  portEXIT_CRITICAL(&captureMux);
+#endif
+}
+
+/**
+ * Write dump header and all records captured so far
+ */
+int32_t capture_dump(capture_dump_cb_t cb, void *ctx) {
+#if CONFIG_USE_STREAM_CAPTURE
+  uint8_t hdr[8];
+  size_t used, pos;
+  int32_t ret = 0;
+
+  if (captureBuf == NULL) {
+    return -1;
+  }
+
+  portENTER_CRITICAL(&captureMux);
+  captureReaders++;
+  used = captureUsed;
+  hdr[6] = captureFull;
+  portEXIT_CRITICAL(&captureMux);
+
+  memcpy(hdr, CAPTURE_DUMP_MAGIC, 4);
+  hdr[4] = CAPTURE_VERSION;
+  hdr[5] = sizeof(capture_record_t);
+  hdr[7] = 0;
+  if (cb(hdr, sizeof(hdr), ctx) < 0) {
+    ret = -1;
+  }
+
+  for (pos = 0; (ret == 0) && (pos < used); pos += CAPTURE_DUMP_BLOCK) {
+    size_t n = used - pos;
+
+    if (n > CAPTURE_DUMP_BLOCK) {
+      n = CAPTURE_DUMP_BLOCK;
+    }
+
+    if (cb(&captureBuf[pos], n, ctx) < 0) {
+      ret = -1;
+    }
+  }
+
+  portENTER_CRITICAL(&captureMux);
+  captureReaders--;
+  portEXIT_CRITICAL(&captureMux);
+
+  return ret;
+#else
+  return -1;
+#endif
+}
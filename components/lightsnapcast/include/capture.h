@@ -0,0 +1,37 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "esp_types.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// increment if capture_record_t or dump format change. Dump header is
+// magic, version, sizeof(capture_record_t), 1 if buffer ran full, 0.
+#define CAPTURE_VERSION 1
+#define CAPTURE_DUMP_MAGIC "SCCP"
+
+/**
+ * Header of one received piece of the server's TCP stream, little endian.
+ * len bytes of data follow, records are packed back to back after the 8
+ * byte dump header.
+ */
+typedef struct capture_record_s {
+  int64_t t_us;  //!< arrival time, time since boot
+  uint32_t len;
+} __attribute__((packed)) capture_record_t;
+
+typedef int32_t (*capture_dump_cb_t)(const void *data, size_t len, void *ctx);
+
+int32_t capture_init(void);
+void capture_start(void);
+void capture_write(uint64_t streamPos, const void *data, size_t len);
+int32_t capture_dump(capture_dump_cb_t cb, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __CAPTURE_H__
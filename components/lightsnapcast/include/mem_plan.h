@@ -0,0 +1,75 @@
+#ifndef __MEM_PLAN_H__
+#define __MEM_PLAN_H__
+
+#include "esp_types.h"
+#include "player.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// internal RAM which has to stay free for wifi, lwIP and task stacks
+#define MEM_PLAN_INTERNAL_RESERVE 32768
+// PSRAM which has to stay free for everything else using it
+#define MEM_PLAN_SPIRAM_RESERVE 16384
+
+// smallest chunk queue we degrade to, in ms. If not even this fits the plan
+// is overcommitted and we try anyway
+#define MEM_PLAN_MIN_BUF_MS 300
+
+// worst case decoder state, buffers for wire chunks come on top
+#define MEM_PLAN_OPUS_STATE_BYTES 20480
+#define MEM_PLAN_FLAC_STATE_BYTES 8192
+
+// filter state and scratch buffers of dsp_processor
+#define MEM_PLAN_DSP_BYTES 1024
+
+typedef enum mem_plan_decision_e {
+  MEM_PLAN_NONE = 0,       //!< nothing planned yet
+  MEM_PLAN_ACCEPTED,       //!< requested buffer fits
+  MEM_PLAN_REDUCED,        //!< chunk queue holds less than buf_ms
+  MEM_PLAN_OVERCOMMITTED,  //!< not even the minimum fits
+} mem_plan_decision_t;
+
+typedef enum mem_plan_pool_e {
+  MEM_PLAN_POOL_INTERNAL = 0,  //!< MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT
+  MEM_PLAN_POOL_IRAM,          //!< MALLOC_CAP_32BIT | MALLOC_CAP_EXEC
+  MEM_PLAN_POOL_SPIRAM,        //!< MALLOC_CAP_SPIRAM
+  MEM_PLAN_POOL_MAX
+} mem_plan_pool_t;
+
+typedef struct mem_plan_s {
+  mem_plan_decision_t decision;
+
+  codec_type_t codec;
+  uint32_t buf_ms;         //!< buffer requested by server
+  uint32_t grantedBuf_ms;  //!< buffer covered by chunk queue and DMA
+  uint32_t entries;        //!< chunk queue entries
+  size_t chunkBytes;       //!< one decoded chunk including headers
+
+  size_t decoderBytes;  //!< decoder state and wire chunk buffer
+  size_t dmaBytes;      //!< DMA descriptors and refill buffer
+  size_t playoutBytes;  //!< decoded chunks in queue
+  size_t dspBytes;
+  size_t bounceBytes;  //!< chunks copied to internal RAM ahead of playout
+
+  size_t need[MEM_PLAN_POOL_MAX];   //!< reserved by this plan
+  size_t avail[MEM_PLAN_POOL_MAX];  //!< free + queued chunks when planned
+
+  int64_t planned_us;  //!< time since boot of this plan
+} mem_plan_t;
+
+int32_t mem_plan_run(const snapcastSetting_t *setting, uint32_t dmaFrames,
+                     uint32_t queuedChunks, mem_plan_t *plan);
+int32_t mem_plan_get(mem_plan_t *plan);
+void mem_plan_reset(void);
+
+const char *mem_plan_decision_str(mem_plan_decision_t decision);
+const char *mem_plan_pool_str(mem_plan_pool_t pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __MEM_PLAN_H__
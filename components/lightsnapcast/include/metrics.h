@@ -0,0 +1,88 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include "esp_types.h"
+#include "sdkconfig.h"
+
+#if CONFIG_USE_METRICS
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// upper bounds of histogram buckets in µs, +Inf bucket comes on top
+#define METRICS_HIST_BUCKETS 10
+#define METRICS_HIST_BOUNDS_US \
+  { 10, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000 }
+
+typedef enum metrics_counter_e {
+  METRICS_NET_RX_BYTES = 0,  //!< bytes received from server
+  METRICS_NET_RX_PACKETS,    //!< netbufs received from server
+  METRICS_ALLOC_FALLBACK,    //!< chunk memory from second choice caps
+  METRICS_ALLOC_FAIL,        //!< chunks replaced by silence, no memory
+  METRICS_SPAN_DROPPED,      //!< measurements dropped, task changed core
+  METRICS_COUNTER_MAX
+} metrics_counter_t;
+
+typedef enum metrics_hist_id_e {
+  METRICS_HIST_RX_PROCESS = 0,  //!< parse one netbuf, decode included
+  METRICS_HIST_DECODE_OPUS,     //!< decode one wire chunk
+  METRICS_HIST_DECODE_FLAC,
+  METRICS_HIST_DSP,           //!< dsp_processor_worker() per chunk
+  METRICS_HIST_INSERT_WAIT,   //!< insert_pcm_chunk() incl. queue wait
+  METRICS_HIST_I2S_WRITE,     //!< blocking in I2S write
+  METRICS_HIST_MAX
+} metrics_hist_id_t;
+
+typedef struct metrics_histogram_s {
+  uint32_t bucket[METRICS_HIST_BUCKETS + 1];  //!< not cumulative
+  uint32_t count;
+  uint64_t sum_us;
+} metrics_histogram_t;
+
+typedef struct metrics_snapshot_s {
+  uint64_t counter[METRICS_COUNTER_MAX];
+  metrics_histogram_t hist[METRICS_HIST_MAX];
+} metrics_snapshot_t;
+
+typedef struct metrics_desc_s {
+  const char *name;    //!< metric family
+  const char *labels;  //!< e.g. codec="opus", NULL if none
+  const char *help;
+} metrics_desc_t;
+
+typedef struct metrics_span_s {
+  uint32_t cycles;
+  int core;
+} metrics_span_t;
+
+#if CONFIG_USE_METRICS
+/**
+ * Time code between METRICS_SPAN_BEGIN() and METRICS_SPAN_END() with the
+ * CPU cycle counter. Everything compiles out if CONFIG_USE_METRICS is off.
+ */
+#define METRICS_SPAN_BEGIN(span)                            \
+  metrics_span_t span = {.cycles = esp_cpu_get_cycle_count(), \
+                         .core = xPortGetCoreID()}
+#define METRICS_SPAN_END(span, id) metrics_span_end(&(span), (id))
+#define METRICS_COUNT(id, n) metrics_count((id), (n))
+
+void metrics_count(metrics_counter_t id, uint32_t n);
+void metrics_span_end(const metrics_span_t *span, metrics_hist_id_t id);
+int32_t metrics_get(metrics_snapshot_t *snapshot);
+const metrics_desc_t *metrics_counter_desc(metrics_counter_t id);
+const metrics_desc_t *metrics_hist_desc(metrics_hist_id_t id);
+#else
+#define METRICS_SPAN_BEGIN(span)
+#define METRICS_SPAN_END(span, id)
+#define METRICS_COUNT(id, n)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __METRICS_H__
@@ -0,0 +1,23 @@
+#ifndef __PCM_CONVERT_H__
+#define __PCM_CONVERT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "player.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void pcm_convert_flac(uint8_t *dst, const int32_t *const src[],
+                      uint32_t frames);
+void pcm_convert_opus(char *dst, const int16_t *src, size_t bytes);
+void pcm_convert_to_chunk(pcm_chunk_message_t *pcmChunk, const uint8_t *src,
+                          size_t bytes, uint32_t frameSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __PCM_CONVERT_H__
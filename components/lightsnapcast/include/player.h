@@ -17,7 +17,11 @@ extern "C" {
 // size?!
 #define CHNK_CTRL_CNT 2
 
+// median lengths can be overridden from the build, e.g. for the host sync
+// benchmark tools/sync_bench.py
+#ifndef LATENCY_MEDIAN_FILTER_LEN
 #define LATENCY_MEDIAN_FILTER_LEN 199
+#endif
 #define LATENCY_MEDIAN_FILTER_FULL 19
 
 // set to 0 if you do not wish to be the median an average around actual
@@ -27,8 +31,49 @@ extern "C" {
 // reality n+1 samples will be averaged
 #define LATENCY_MEDIAN_AVG_DIVISOR 0
 
-#define SHORT_BUFFER_LEN 99
-#define MINI_BUFFER_LEN 19
+// window over which DAC clock deviation is measured using DMA completions
+#define DAC_PPM_WINDOW_US 10000000LL
+// measurements above this are considered bogus (e.g. missed interrupts)
+#define DAC_PPM_MAX 1000
+
+// DMA descriptors used if they are refilled from I2S ISR, rest of the buffer
+// is kept in a ring buffer
+#define I2S_REFILL_DMA_DESC_CNT 3
+// maximum frames of such a descriptor, audio written to the ring buffer is
+// played after at most I2S_REFILL_DMA_DESC_CNT of them
+#define I2S_REFILL_DMA_DESC_LEN 128
+
+// errors below this are corrected by skipping / padding audio while playing
+// if soft resync is enabled, above a hard resync is done
+#define SOFT_RESYNC_MAX_US 50000
+// frames used to crossfade at the seam of a soft resync
+#define SOFT_RESYNC_XFADE_FRAMES 64
+
+// time needed to load DMA before playback can be started, if initial sync
+// has less time left the first chunk is trimmed
+#define I2S_START_MARGIN_US 5000
+
+// time sync samples needed to start playback with the offset of the one
+// with lowest RTT, until the latency buffer is full
+#define CLOCK_COARSE_SAMPLES 4
+// hard resync threshold used until the latency buffer is full
+#define CLOCK_COARSE_RESYNC_US 10000
+// hard resync threshold once fine locked
+#define CLOCK_FINE_RESYNC_US 2000
+// interval at which server clock skew is measured
+#define CLOCK_SKEW_INTERVAL_US 60000000LL
+// keep last offset on reconnect if it isn't older than this
+#define CLOCK_KEEP_MAX_AGE_US 600000000LL
+
+// http task stops reading from the server if less than this many chunks fit
+// into the chunk queue, TCP flow control will then throttle the server. The
+// pause is bounded so time sync replies are never held back for long.
+#define PCM_QUEUE_RESERVE 2
+#define PCM_QUEUE_THROTTLE_MAX_MS 200
+
+// chunks copied from PSRAM to internal RAM ahead of playout if
+// CONFIG_USE_PSRAM_BOUNCE is enabled
+#define PSRAM_BOUNCE_CHUNKS 4
 
 typedef struct pcm_chunk_fragment pcm_chunk_fragment_t;
 struct pcm_chunk_fragment {
@@ -44,6 +89,51 @@ typedef struct pcmData {
   uint32_t caps;
 } pcm_chunk_message_t;
 
+typedef struct player_resync_stats_s {
+  uint32_t hardCnt;        //!< resyncs with muted audio
+  uint32_t softCnt;        //!< resyncs while playing
+  int64_t dropout_us;      //!< total time muted because of hard resyncs
+  int64_t softSkipped_us;  //!< total audio skipped by soft resyncs
+  int64_t softPadded_us;   //!< total audio padded by soft resyncs
+  int64_t startError_us;     //!< last playback start vs. target time
+  int64_t startErrorMax_us;  //!< max. absolute start error
+  uint32_t reconfigCnt;       //!< sample format switches while playing
+  int64_t reconfigGap_us;     //!< last gap between old and new format
+  int64_t reconfigGapMax_us;  //!< max. gap between old and new format
+  uint32_t underrunCnt;       //!< DMA descriptors sent without new data
+  uint64_t underrunBytes;     //!< bytes of those descriptors
+} player_resync_stats_t;
+
+typedef struct player_queue_stats_s {
+  uint32_t length;       //!< entries of chunk queue
+  uint32_t highWater;    //!< max. chunks queued since queue was created
+  uint32_t dropped;      //!< chunks dropped because queue was full
+  uint32_t throttleCnt;  //!< times http task stopped receiving
+  int64_t throttled_us;  //!< total time http task stopped receiving
+} player_queue_stats_t;
+
+typedef struct player_bounce_stats_s {
+  uint32_t chunks;     //!< chunks copied from PSRAM to internal RAM
+  uint32_t fallbacks;  //!< chunks played from PSRAM, no internal RAM left
+  uint64_t bytes;      //!< bytes copied
+  int64_t copy_us;     //!< total time spent copying
+  int64_t copyMax_us;  //!< longest copy of a single chunk
+} player_bounce_stats_t;
+
+typedef struct player_start_stats_s {
+  int64_t config_us;       //!< first snapcast settings received
+  int64_t clockLocked_us;  //!< first time latency buffer got full
+  int64_t firstChunk_us;   //!< first PCM chunk queued
+  int64_t firstSample_us;  //!< first sample played
+  bool warmStart;          //!< set up from cached settings before connecting
+} player_start_stats_t;
+
+typedef enum player_clock_lock_e {
+  CLOCK_UNLOCKED = 0,  //!< no estimate of server time yet
+  CLOCK_COARSE,        //!< best of a few samples or last known offset
+  CLOCK_FINE,          //!< latency buffer is full, median is used
+} player_clock_lock_t;
+
 typedef enum codec_type_e { NONE = 0, PCM, FLAC, OGG, OPUS } codec_type_t;
 
 typedef struct snapcastSetting_s {
@@ -72,16 +162,26 @@ int32_t insert_pcm_chunk(pcm_chunk_message_t *pcmChunk);
 // int8_t insert_pcm_chunk (wire_chunk_message_t *decodedWireChunk);
 int8_t free_pcm_chunk(pcm_chunk_message_t *pcmChunk);
 
-int32_t player_latency_insert(int64_t newValue);
+int32_t player_latency_insert(int64_t newValue, int64_t rtt);
 int32_t player_send_snapcast_setting(snapcastSetting_t *setting);
 int8_t player_get_snapcast_settings(snapcastSetting_t *setting);
 
 int32_t reset_latency_buffer(void);
+int32_t reset_latency_buffer_keep_offset(void);
+player_clock_lock_t player_get_clock_lock(void);
+int32_t player_get_clock_skew(float *ppm);
+int32_t player_warm_start(snapcastSetting_t *setting, float skew_ppm);
 int32_t latency_buffer_full(bool *is_full, TickType_t wait);
 int32_t get_diff_to_server(int64_t *tDiff);
 int32_t server_now(int64_t *sNow, int64_t *diff2Server);
 
 int32_t pcm_chunk_queue_msg_waiting(void);
+int32_t pcm_chunk_queue_wait_space(TickType_t maxWait);
+int32_t player_get_queue_stats(player_queue_stats_t *stats);
+int32_t player_get_bounce_stats(player_bounce_stats_t *stats);
+int32_t player_get_dac_ppm(float *ppm);
+int32_t player_get_resync_stats(player_resync_stats_t *stats);
+int32_t player_get_start_stats(player_start_stats_t *stats);
 #ifdef __cplusplus
 }
 #endif
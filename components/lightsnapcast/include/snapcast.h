@@ -71,6 +71,7 @@ typedef struct hello_message {
   int protocol_version;
 } hello_message_t;
 
+// free with audio_free_tag(AUDIO_MEM_TAG_NET, ...)
 char *hello_message_serialize(hello_message_t *msg, size_t *size);
 
 typedef struct server_settings_message {
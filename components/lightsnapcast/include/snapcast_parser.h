@@ -0,0 +1,68 @@
+#ifndef __SNAPCAST_PARSER_H__
+#define __SNAPCAST_PARSER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "snapcast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Callbacks of the stream parser. Callbacks returning int abort parsing
+ * when they return a negative value, NULL callbacks are skipped.
+ */
+typedef struct snapcast_parser_cb_s {
+  // base message header is complete, pos is the stream offset of its last
+  // byte. received time may be changed here.
+  void (*base)(void *ctx, base_message_t *base, uint64_t pos);
+  // wire chunk header is complete, return false to skip its payload
+  bool (*chunkBegin)(void *ctx, wire_chunk_message_t *chunk);
+  // piece of wire chunk payload, not called for skipped chunks
+  int (*chunkData)(void *ctx, const uint8_t *data, size_t len);
+  // wire chunk was received or skipped completely
+  int (*chunkEnd)(void *ctx, wire_chunk_message_t *chunk, bool skipped);
+  int (*codecHeader)(void *ctx, const char *codec, const char *payload,
+                     uint32_t size);
+  int (*serverSettings)(void *ctx, const char *json);
+  int (*time)(void *ctx, const base_message_t *base,
+              const time_message_t *time);
+} snapcast_parser_cb_t;
+
+/**
+ * Parser of the server's TCP stream. Data can be fed in pieces of any size,
+ * messages are never buffered completely. Wire chunk payload is handed to
+ * chunkData() as it arrives, strings of the other messages are collected
+ * in AUDIO_MEM_TAG_NET memory.
+ */
+typedef struct snapcast_parser_s {
+  const snapcast_parser_cb_t *cb;
+  void *ctx;
+  uint64_t pos;       //!< stream bytes consumed
+  uint32_t state;     //!< part of message which is parsed
+  uint32_t fill;      //!< bytes of current header or field
+  uint32_t typedPos;  //!< bytes of typed message consumed
+  uint32_t len;       //!< length of current string or payload
+  bool skip;          //!< payload of current chunk is skipped
+  base_message_t base;
+  wire_chunk_message_t chunk;
+  time_message_t time;
+  char *str;      //!< codec name or server settings
+  char *payload;  //!< codec header payload
+  uint8_t hdr[BASE_MESSAGE_SIZE];
+} snapcast_parser_t;
+
+void snapcast_parser_init(snapcast_parser_t *parser,
+                          const snapcast_parser_cb_t *cb, void *ctx);
+int snapcast_parser_feed(snapcast_parser_t *parser, const uint8_t *data,
+                         size_t len);
+void snapcast_parser_free(snapcast_parser_t *parser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __SNAPCAST_PARSER_H__
@@ -0,0 +1,132 @@
+#ifndef __SYNC_CTRL_H__
+#define __SYNC_CTRL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "MedianFilter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// median lengths can be overridden from the build, e.g. for the host sync
+// benchmark tools/sync_bench.py
+#ifndef SHORT_BUFFER_LEN
+#define SHORT_BUFFER_LEN 99
+#endif
+#ifndef MINI_BUFFER_LEN
+#define MINI_BUFFER_LEN 19
+#endif
+
+// speed change of one APLL step, see UPPER_SR_SCALER in player.c
+#define SYNC_CTRL_APLL_PPM 100
+
+// PI controller gains. Correction in ppm is KP * error in µs plus KI * error
+// integrated over seconds, the integral is limited to PI_MAX_PPM.
+#ifndef SYNC_CTRL_PI_KP
+#define SYNC_CTRL_PI_KP 0.2f
+#endif
+#ifndef SYNC_CTRL_PI_KI
+#define SYNC_CTRL_PI_KI 0.02f
+#endif
+#define SYNC_CTRL_PI_MAX_PPM 500.0f
+
+typedef enum sync_ctrl_mode_e {
+  SYNC_CTRL_MODE_INSERT = 0,  //!< insert or drop samples
+  SYNC_CTRL_MODE_APLL,        //!< slow down or speed up the DAC clock
+} sync_ctrl_mode_t;
+
+typedef enum sync_ctrl_algo_e {
+  SYNC_CTRL_ALGO_MEDIAN = 0,  //!< act if medians exceed thresholds
+  SYNC_CTRL_ALGO_PI,          //!< PI controller on the mini median
+} sync_ctrl_algo_t;
+
+typedef enum sync_ctrl_action_e {
+  SYNC_CTRL_PLAY = 0,     //!< keep playing, apply dir / insert
+  SYNC_CTRL_SOFT_RESYNC,  //!< skip or pad softResyncFrames while playing
+  SYNC_CTRL_HARD_RESYNC,  //!< stop output and start over with initial sync
+} sync_ctrl_action_t;
+
+typedef struct sync_ctrl_config_s {
+  sync_ctrl_mode_t mode;
+  sync_ctrl_algo_t algo;
+  bool softResync;              //!< soft resync may be requested
+  int64_t shortOffset_us;       //!< short median threshold
+  int64_t miniOffset_us;        //!< mini median and age threshold
+  int64_t hardResyncFine_us;    //!< hard resync threshold when fine locked
+  int64_t hardResyncCoarse_us;  //!< same while coarse locked
+  int64_t softResyncMax_us;     //!< larger errors are hard resynced
+  int64_t startMargin_us;       //!< time needed to load DMA on start
+  uint32_t insertFrames;        //!< frames inserted or dropped at once
+} sync_ctrl_config_t;
+
+/**
+ * what the player knows when it asks for a decision
+ */
+typedef struct sync_ctrl_input_s {
+  int64_t serverNow_us;      //!< estimated server time
+  int64_t chunkStart_us;     //!< server time of next frame written to DMA
+  int64_t buf_us;            //!< server buffer
+  int64_t dacLatency_us;     //!< configured client DAC latency
+  int64_t dmaDelay_us;       //!< time until what is in DMA is played out
+  int64_t chunkDuration_us;  //!< duration of current chunk
+  uint32_t sr;
+  uint32_t queueDepth;  //!< chunks waiting to be played
+  bool fineLock;        //!< server time estimate is fine locked
+  bool dacPpmValid;
+  float dacPpm;         //!< measured DAC clock deviation
+  bool softResyncBusy;  //!< earlier soft resync isn't applied completely
+} sync_ctrl_input_t;
+
+/**
+ * decision on initial sync
+ */
+typedef struct sync_ctrl_start_s {
+  sync_ctrl_action_t action;  //!< PLAY or HARD_RESYNC if late
+  int64_t age_us;             //!< < 0: start output this much later
+  uint32_t trimFrames;        //!< frames to drop from the first chunk
+  uint32_t dropChunks;        //!< queued chunks to drop if late
+} sync_ctrl_start_t;
+
+/**
+ * decision while playing
+ */
+typedef struct sync_ctrl_output_s {
+  sync_ctrl_action_t action;
+  int64_t age_us;  //!< > 0 if late
+  int64_t shortMedian_us;
+  int64_t miniMedian_us;
+  bool control;              //!< medians are valid, apply dir / insert
+  int8_t dir;                //!< APLL: -1 slow down, 1 speed up
+  int8_t insert;             //!< -1 insert, 1 drop insertFrames
+  int32_t softResyncFrames;  //!< > 0 skip, < 0 pad
+  int64_t insertedFrames;    //!< net frames inserted since start
+} sync_ctrl_output_t;
+
+typedef struct sync_ctrl_s {
+  sync_ctrl_config_t cfg;
+
+  sMedianFilter_t shortMedianFilter;
+  sMedianNode_t shortMedianBuffer[SHORT_BUFFER_LEN];
+  sMedianFilter_t miniMedianFilter;
+  sMedianNode_t miniMedianBuffer[MINI_BUFFER_LEN];
+
+  int64_t dacDrift_us;     //!< accumulated drift caused by DAC clock
+  int64_t insertedFrames;  //!< net frames inserted since start
+  float integral_ppm;      //!< PI integral part
+  float pending_us;        //!< PI correction not applied yet
+} sync_ctrl_t;
+
+void sync_ctrl_init(sync_ctrl_t *ctrl, const sync_ctrl_config_t *cfg);
+void sync_ctrl_reset(sync_ctrl_t *ctrl);
+void sync_ctrl_start(sync_ctrl_t *ctrl, const sync_ctrl_input_t *in,
+                     uint32_t availFrames, sync_ctrl_start_t *out);
+void sync_ctrl_update(sync_ctrl_t *ctrl, const sync_ctrl_input_t *in,
+                      sync_ctrl_output_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __SYNC_CTRL_H__
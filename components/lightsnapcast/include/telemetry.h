@@ -0,0 +1,56 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include "esp_types.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// samples kept, must be a power of 2. About 3s at 24ms chunks
+#define TELEMETRY_RING_LEN 128
+
+// increment if telemetry_sample_t or telemetry_frame_hdr_t change
+#define TELEMETRY_VERSION 1
+
+/**
+ * One sync control loop iteration, written by player_task for every played
+ * chunk. Packed little endian, sent as is to websocket clients.
+ */
+typedef struct __attribute__((packed)) telemetry_sample_s {
+  uint32_t seq;             //!< incremented for every sample
+  uint32_t time_ms;         //!< local time since boot
+  int32_t age_us;           //!< chunk age at DAC, 0 is in sync
+  int32_t shortMedian_us;   //!< median of last ages, long window
+  int32_t miniMedian_us;    //!< median of last ages, short window
+  int64_t diff2Server_us;   //!< offset of server clock
+  int32_t insertedSamples;  //!< frames inserted (+) or removed (-)
+  int8_t dir;               //!< control loop direction, -1 early, 1 late
+  uint8_t queueDepth;       //!< chunks waiting in chunk queue
+  uint16_t reserved;
+} telemetry_sample_t;
+
+/**
+ * binary websocket frame, followed by count samples
+ */
+typedef struct __attribute__((packed)) telemetry_frame_hdr_s {
+  uint8_t version;
+  uint8_t sampleSize;  //!< sizeof(telemetry_sample_t)
+  uint16_t count;      //!< samples in this frame
+  uint32_t lost;       //!< samples overwritten before they were sent
+} telemetry_frame_hdr_t;
+
+void telemetry_subscribe(void);
+void telemetry_unsubscribe(void);
+bool telemetry_active(void);
+
+void telemetry_push(telemetry_sample_t *sample);
+uint32_t telemetry_read(uint32_t *seq, telemetry_sample_t *samples,
+                        uint32_t max, uint32_t *lost);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __TELEMETRY_H__
@@ -0,0 +1,100 @@
+#ifndef __TIME_SYNC_H__
+#define __TIME_SYNC_H__
+
+#include "esp_timer.h"
+#include "esp_types.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// period used while the latency buffer is filled initially or after something
+// happened which made our estimate of the server time less trustworthy
+#define TIME_SYNC_PERIOD_BURST_US 10000  // in µs
+// slowest and fastest period used if we are not in a burst. The period is
+// doubled every TIME_SYNC_STABLE_CNT stable replies until it reaches max.
+// The latency median spans LATENCY_MEDIAN_FILTER_LEN periods, longer ones
+// let the offset go stale, so max can only be raised from the build, e.g.
+// for tools/sync_bench.py.
+#define TIME_SYNC_PERIOD_MIN_US 1000000  // in µs
+#ifndef TIME_SYNC_PERIOD_MAX_US
+#define TIME_SYNC_PERIOD_MAX_US 1000000  // in µs
+#endif
+
+// a time reply is considered stable if its offset differs less than this from
+// the current median and the RTT jitter is below TIME_SYNC_STABLE_JITTER_US
+#define TIME_SYNC_STABLE_ERROR_US 250
+#define TIME_SYNC_STABLE_JITTER_US 1000
+#define TIME_SYNC_STABLE_CNT 8
+
+// offset errors above this value trigger a burst, e.g. after a roam
+#define TIME_SYNC_BURST_ERROR_US 2000
+
+// replies with a RTT above smoothed RTT plus 4 times its deviation, at least
+// plus TIME_SYNC_RTT_OUTLIER_MIN_US, are dropped. After
+// TIME_SYNC_RTT_OUTLIER_MAX dropped replies in a row the RTT is assumed to
+// have really changed and the next one is taken.
+#define TIME_SYNC_RTT_OUTLIER_MIN_US 1000
+#define TIME_SYNC_RTT_OUTLIER_MAX 8
+
+// replies collected during a burst which wasn't caused by a connect
+#define TIME_SYNC_BURST_LEN 19
+
+// wifi RSSI which will trigger a burst if signal drops below
+#define TIME_SYNC_RSSI_THRESHOLD -75
+
+// interval at which sync statistics are logged
+#define TIME_SYNC_STATS_INTERVAL_US 60000000LL
+
+// number of received pbufs we remember the arrival time of
+#define TIME_SYNC_RX_TIMESTAMP_CNT 32
+
+typedef enum time_sync_burst_reason_e {
+  TIME_SYNC_BURST_NONE = 0,
+  TIME_SYNC_BURST_CONNECT,
+  TIME_SYNC_BURST_TIMEOUT,
+  TIME_SYNC_BURST_ROAM,
+  TIME_SYNC_BURST_RSSI,
+  TIME_SYNC_BURST_RESYNC,
+  TIME_SYNC_BURST_OFFSET,
+  TIME_SYNC_BURST_REASON_MAX
+} time_sync_burst_reason_t;
+
+typedef struct time_sync_stats_s {
+  uint32_t txCnt;      //!< time messages sent
+  uint32_t rxCnt;      //!< time replies received
+  uint32_t txBytes;    //!< bytes sent for time sync
+  uint32_t rxBytes;    //!< bytes received for time sync
+  uint32_t rttOutlierCnt;  //!< replies dropped because of their RTT
+  uint32_t burstCnt[TIME_SYNC_BURST_REASON_MAX];  //!< bursts by reason
+  uint64_t period_us;  //!< currently used sync period
+  int64_t rtt_us;      //!< smoothed round trip time
+  int64_t rttVar_us;   //!< smoothed round trip time deviation
+  int64_t offsetError_us;     //!< last sample minus current median
+  int64_t offsetErrorMax_us;  //!< max. absolute offset error since last log
+} time_sync_stats_t;
+
+int32_t time_sync_init(esp_timer_handle_t timer);
+void time_sync_deinit(void);
+
+int32_t time_sync_start(void);
+int32_t time_sync_stop(void);
+
+void time_sync_request_burst(time_sync_burst_reason_t reason);
+void time_sync_tx_done(size_t bytes);
+int32_t time_sync_rx(int64_t rtt_us, int64_t offset_us, size_t bytes);
+
+int32_t time_sync_get_stats(time_sync_stats_t *stats);
+const char *time_sync_burst_reason_str(time_sync_burst_reason_t reason);
+
+void time_sync_rx_timestamp_reset(void);
+void time_sync_rx_timestamp_insert(size_t len);
+int32_t time_sync_rx_timestamp_get(uint64_t streamPos, int64_t *timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __TIME_SYNC_H__
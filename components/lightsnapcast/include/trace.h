@@ -0,0 +1,77 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "esp_log.h"
+#include "esp_types.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// records per core, must be a power of 2
+#define TRACE_RING_LEN 64
+
+// increment if trace_record_t or dump format change
+#define TRACE_VERSION 1
+#define TRACE_DUMP_MAGIC "SCTR"
+
+#define TRACE_TASK_PRIORITY 1
+#define TRACE_TASK_INTERVAL_MS 200
+
+typedef enum trace_event_e {
+  TRACE_EVT_RESYNC_HARD_LATE = 0,  //!< first chunk was late already
+  TRACE_EVT_RESYNC_HARD,           //!< off too much while playing
+  TRACE_EVT_RESYNC_SOFT,
+  TRACE_EVT_INITIAL_SYNC,
+  TRACE_EVT_FIRST_CHUNK_TRIM,
+  TRACE_EVT_QUEUE_FULL,
+  TRACE_EVT_LATE_CHUNKS_SKIPPED,
+  TRACE_EVT_MAX
+} trace_event_t;
+
+/**
+ * Fixed size trace record, little endian. seq is written last, a reader
+ * can tell from it if the record is complete.
+ */
+typedef struct trace_record_s {
+  uint32_t seq;    //!< index in core's ring + 1, 0 while written
+  uint16_t id;     //!< trace_event_t
+  uint8_t core;    //!< core it was recorded on
+  uint8_t reserved;
+  int64_t ts_us;   //!< time since boot
+  int32_t arg[4];  //!< arguments of event's format string
+} trace_record_t;
+
+typedef struct trace_event_desc_s {
+  esp_log_level_t level;
+  const char *tag;
+  const char *fmt;  //!< up to four %ld
+} trace_event_desc_t;
+
+typedef int32_t (*trace_dump_cb_t)(const void *data, size_t len, void *ctx);
+
+/**
+ * Record event ev with up to four int32_t arguments. Costs a timestamp and a
+ * few stores if CONFIG_USE_TRACE is enabled, formats and logs immediately
+ * otherwise.
+ */
+#define TRACE_EVENT(ev, ...) TRACE_EVENT_ARGS(ev, __VA_ARGS__, 0, 0, 0, 0)
+#define TRACE_EVENT_ARGS(ev, a0, a1, a2, a3, ...)                \
+  trace_event((ev), (int32_t)(a0), (int32_t)(a1), (int32_t)(a2), \
+              (int32_t)(a3))
+
+void trace_event(trace_event_t ev, int32_t a0, int32_t a1, int32_t a2,
+                 int32_t a3);
+
+int32_t trace_init(void);
+uint32_t trace_read(int core, uint32_t *seq, trace_record_t *records,
+                    uint32_t max, uint32_t *lost);
+int32_t trace_dump(trace_dump_cb_t cb, void *ctx);
+const trace_event_desc_t *trace_event_desc(trace_event_t ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __TRACE_H__
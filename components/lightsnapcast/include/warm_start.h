@@ -0,0 +1,55 @@
+#ifndef __WARM_START_H__
+#define __WARM_START_H__
+
+#include "esp_types.h"
+#include "lwip/ip_addr.h"
+#include "player.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WARM_START_NVS_NAMESPACE "snapclient"
+#define WARM_START_NVS_KEY "warmstart"
+
+// increment if warm_start_t changes, old cache entries are ignored then
+#define WARM_START_VERSION 1
+
+// clock skew is only written to flash again if it changed more than this
+#define WARM_START_SKEW_HYST_PPM 1.0
+
+// minimum time between two attempts to update the cache while playing
+#define WARM_START_STORE_INTERVAL_US 300000000LL
+
+typedef struct warm_start_s {
+  uint32_t version;
+
+  ip_addr_t serverIp;  //!< snapserver we were connected to
+  uint16_t serverPort;
+
+  codec_type_t codec;
+  int32_t sr;
+  uint8_t ch;
+  uint8_t bits;
+  uint32_t chkInFrames;
+  uint32_t buf_ms;
+  int32_t cDacLat_ms;
+
+  float clockSkew_ppm;  //!< server vs. local clock drift
+} warm_start_t;
+
+int32_t warm_start_load(warm_start_t *ws);
+int32_t warm_start_store(const warm_start_t *ws);
+
+void warm_start_set(warm_start_t *ws, const ip_addr_t *serverIp,
+                    uint16_t serverPort, const snapcastSetting_t *setting,
+                    float clockSkew_ppm);
+void warm_start_get_setting(const warm_start_t *ws,
+                            snapcastSetting_t *setting);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __WARM_START_H__
@@ -0,0 +1,322 @@
+/**
+ * Memory budget planner
+ *
+ * Runs on every change of stream format or buffer size, before I2S and the
+ * chunk queue are set up. It estimates worst case memory needed by decoder,
+ * DMA, chunk queue and DSP, checks it against free heap of the capabilities
+ * these are allocated from and decides how large the chunk queue can be.
+ * Memory held by chunks which are still queued is considered available, as
+ * these are part of the new queue or played and freed before it fills up.
+ *
+ * If the requested buffer doesn't fit the chunk queue is shrunk. The http
+ * task throttles TCP receive if the queue is full, so the rest of the buffer
+ * stays at the server instead of being dropped here.
+ */
+
+#include "mem_plan.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "audio_mem.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "MEMPLAN";
+
+static mem_plan_t currentPlan = {0};
+static portMUX_TYPE memPlanMux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ *
+ */
+static size_t mem_plan_free(mem_plan_pool_t pool) {
+  switch (pool) {
+    case MEM_PLAN_POOL_INTERNAL:
+      return heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    case MEM_PLAN_POOL_IRAM:
+      return heap_caps_get_free_size(MALLOC_CAP_32BIT | MALLOC_CAP_EXEC);
+    case MEM_PLAN_POOL_SPIRAM:
+#if CONFIG_SPIRAM
+      return heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+#else
+      return 0;
+#endif
+    default:
+      return 0;
+  }
+}
+
+/**
+ * bytes held by queued chunks in pool. Without heap accounting these are
+ * estimated from the number of queued chunks and where the previous plan
+ * put them.
+ */
+static size_t mem_plan_held(mem_plan_pool_t pool, const mem_plan_t *prev,
+                            uint32_t queuedChunks) {
+  audio_mem_usage_t usage;
+  size_t held;
+
+  // pools and heaps of audio_mem are the same
+  if (audio_mem_stats_get(AUDIO_MEM_TAG_CHUNK, (audio_mem_heap_t)pool,
+                          &usage) == ESP_OK) {
+    return usage.current;
+  }
+
+  held = queuedChunks * prev->chunkBytes;
+  if (held > prev->playoutBytes) {
+    held = prev->playoutBytes;
+  }
+
+#if CONFIG_SPIRAM
+  return (pool == MEM_PLAN_POOL_SPIRAM) ? held : 0;
+#else
+  // see mem_plan_run(), chunks go to IRAM first
+  size_t iram = prev->need[MEM_PLAN_POOL_IRAM];
+  if (iram > held) {
+    iram = held;
+  }
+
+  switch (pool) {
+    case MEM_PLAN_POOL_IRAM:
+      return iram;
+    case MEM_PLAN_POOL_INTERNAL:
+      return held - iram;
+    default:
+      return 0;
+  }
+#endif
+}
+
+/**
+ *
+ */
+static size_t mem_plan_decoder_bytes(const snapcastSetting_t *setting,
+                                     size_t pcmBytes) {
+  // wire chunks are never larger than their decoded data
+  switch (setting->codec) {
+    case OPUS:
+      return MEM_PLAN_OPUS_STATE_BYTES + pcmBytes;
+    case FLAC:
+      // decoder keeps output and residual of one block per channel
+      return MEM_PLAN_FLAC_STATE_BYTES +
+             2 * sizeof(int32_t) * setting->chkInFrames * setting->ch +
+             pcmBytes;
+    case PCM:
+      return pcmBytes;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Returns chunk queue entries needed for ms of audio, chunks in DMA are
+ * subtracted
+ */
+static uint32_t mem_plan_entries(const snapcastSetting_t *setting,
+                                 uint32_t dmaFrames, uint32_t ms) {
+  int32_t entries = ceil(((float)setting->sr / (float)setting->chkInFrames) *
+                         ((float)ms / 1000));
+
+  entries -= dmaFrames / setting->chkInFrames;
+  if (entries < PCM_QUEUE_RESERVE) {
+    entries = PCM_QUEUE_RESERVE;
+  }
+
+  return entries;
+}
+
+/**
+ * dmaFrames is the number of frames held by DMA descriptors and refill
+ * buffer for this setting, queuedChunks the number of chunks waiting in the
+ * chunk queue. Returns -1 if setting is invalid.
+ */
+int32_t mem_plan_run(const snapcastSetting_t *setting, uint32_t dmaFrames,
+                     uint32_t queuedChunks, mem_plan_t *plan) {
+  mem_plan_t prev;
+  size_t pcmBytes, other;
+  int64_t budget;
+  uint32_t fullEntries, minEntries, fitEntries;
+  mem_plan_pool_t chunkPool;
+  bool otherFits;
+
+  if ((setting == NULL) || (plan == NULL) || (setting->sr <= 0) ||
+      (setting->chkInFrames == 0) || (setting->ch == 0) ||
+      (setting->bits == 0)) {
+    return -1;
+  }
+
+  mem_plan_get(&prev);
+
+  memset(plan, 0, sizeof(mem_plan_t));
+  plan->codec = setting->codec;
+  plan->buf_ms = setting->buf_ms;
+
+  for (int i = 0; i < MEM_PLAN_POOL_MAX; i++) {
+    plan->avail[i] = mem_plan_free(i) + mem_plan_held(i, &prev, queuedChunks);
+  }
+
+  pcmBytes = setting->chkInFrames * setting->ch * (setting->bits / 8);
+  plan->chunkBytes =
+      pcmBytes + sizeof(pcm_chunk_message_t) + sizeof(pcm_chunk_fragment_t);
+  plan->decoderBytes = mem_plan_decoder_bytes(setting, pcmBytes);
+  // 2 slots, stereo only. Samples > 16bit use 32bit slots
+  plan->dmaBytes = dmaFrames * 2 * ((setting->bits + 15) / 16) * 2;
+#if CONFIG_USE_DSP_PROCESSOR
+  plan->dspBytes = MEM_PLAN_DSP_BYTES;
+#endif
+#if CONFIG_USE_PSRAM_BOUNCE && CONFIG_SPIRAM
+  plan->bounceBytes = PSRAM_BOUNCE_CHUNKS * plan->chunkBytes;
+#endif
+
+  // everything but decoded chunks lives in internal RAM
+  other = plan->decoderBytes + plan->dmaBytes + plan->dspBytes +
+          plan->bounceBytes;
+  plan->need[MEM_PLAN_POOL_INTERNAL] = other;
+
+  // see allocate_pcm_chunk_memory()
+#if CONFIG_SPIRAM
+  chunkPool = MEM_PLAN_POOL_SPIRAM;
+  budget =
+      (int64_t)plan->avail[MEM_PLAN_POOL_SPIRAM] - MEM_PLAN_SPIRAM_RESERVE;
+#else
+  chunkPool = MEM_PLAN_POOL_IRAM;
+  budget = (int64_t)plan->avail[MEM_PLAN_POOL_IRAM] +
+           (int64_t)plan->avail[MEM_PLAN_POOL_INTERNAL] -
+           MEM_PLAN_INTERNAL_RESERVE - other;
+#endif
+
+  if (budget < 0) {
+    budget = 0;
+  }
+
+  fullEntries = mem_plan_entries(setting, dmaFrames, setting->buf_ms);
+  minEntries = mem_plan_entries(setting, dmaFrames, MEM_PLAN_MIN_BUF_MS);
+  if (minEntries > fullEntries) {
+    minEntries = fullEntries;
+  }
+  fitEntries = budget / plan->chunkBytes;
+  if (fitEntries > fullEntries) {
+    fitEntries = fullEntries;
+  }
+
+  otherFits = (int64_t)plan->avail[MEM_PLAN_POOL_INTERNAL] -
+                  MEM_PLAN_INTERNAL_RESERVE >=
+              (int64_t)other;
+
+  if ((otherFits == false) || (fitEntries < minEntries)) {
+    plan->decision = MEM_PLAN_OVERCOMMITTED;
+    plan->entries = (fitEntries < minEntries) ? minEntries : fitEntries;
+  } else if (fitEntries < fullEntries) {
+    plan->decision = MEM_PLAN_REDUCED;
+    plan->entries = fitEntries;
+  } else {
+    plan->decision = MEM_PLAN_ACCEPTED;
+    plan->entries = fullEntries;
+  }
+
+  plan->playoutBytes = plan->entries * plan->chunkBytes;
+
+  if (chunkPool == MEM_PLAN_POOL_IRAM) {
+    // chunks go to IRAM first, rest to internal RAM
+    size_t iram = plan->avail[MEM_PLAN_POOL_IRAM];
+
+    if (iram > plan->playoutBytes) {
+      iram = plan->playoutBytes;
+    }
+    plan->need[MEM_PLAN_POOL_IRAM] = iram;
+    plan->need[MEM_PLAN_POOL_INTERNAL] += plan->playoutBytes - iram;
+  } else {
+    plan->need[chunkPool] += plan->playoutBytes;
+  }
+
+  plan->grantedBuf_ms =
+      1000ULL * (plan->entries * setting->chkInFrames + dmaFrames) /
+      setting->sr;
+  if (plan->grantedBuf_ms > setting->buf_ms) {
+    plan->grantedBuf_ms = setting->buf_ms;
+  }
+
+  plan->planned_us = esp_timer_get_time();
+
+  portENTER_CRITICAL(&memPlanMux);
+  currentPlan = *plan;
+  portEXIT_CRITICAL(&memPlanMux);
+
+  if (plan->decision == MEM_PLAN_ACCEPTED) {
+    ESP_LOGI(TAG, "%s: buffer %ldms, %ld chunks of %d bytes", __func__,
+             plan->grantedBuf_ms, plan->entries, plan->chunkBytes);
+  } else {
+    ESP_LOGW(TAG,
+             "%s: %s, buffer %ldms of %ldms, %ld chunks of %d bytes, "
+             "decoder %d, dma %d, internal %d/%d, iram %d/%d, spiram %d/%d",
+             __func__, mem_plan_decision_str(plan->decision),
+             plan->grantedBuf_ms, plan->buf_ms, plan->entries,
+             plan->chunkBytes, plan->decoderBytes, plan->dmaBytes,
+             plan->need[MEM_PLAN_POOL_INTERNAL],
+             plan->avail[MEM_PLAN_POOL_INTERNAL],
+             plan->need[MEM_PLAN_POOL_IRAM], plan->avail[MEM_PLAN_POOL_IRAM],
+             plan->need[MEM_PLAN_POOL_SPIRAM],
+             plan->avail[MEM_PLAN_POOL_SPIRAM]);
+  }
+
+  return 0;
+}
+
+/**
+ * get last plan, decision is MEM_PLAN_NONE if nothing was planned yet
+ */
+int32_t mem_plan_get(mem_plan_t *plan) {
+  if (plan == NULL) {
+    return -1;
+  }
+
+  portENTER_CRITICAL(&memPlanMux);
+  *plan = currentPlan;
+  portEXIT_CRITICAL(&memPlanMux);
+
+  return 0;
+}
+
+/**
+ * forget last plan, called if everything it reserved was freed
+ */
+void mem_plan_reset(void) {
+  portENTER_CRITICAL(&memPlanMux);
+  memset(&currentPlan, 0, sizeof(mem_plan_t));
+  portEXIT_CRITICAL(&memPlanMux);
+}
+
+/**
+ *
+ */
+const char *mem_plan_decision_str(mem_plan_decision_t decision) {
+  switch (decision) {
+    case MEM_PLAN_ACCEPTED:
+      return "accepted";
+    case MEM_PLAN_REDUCED:
+      return "reduced";
+    case MEM_PLAN_OVERCOMMITTED:
+      return "overcommitted";
+    default:
+      return "none";
+  }
+}
+
+/**
+ *
+ */
+const char *mem_plan_pool_str(mem_plan_pool_t pool) {
+  switch (pool) {
+    case MEM_PLAN_POOL_INTERNAL:
+      return "internal";
+    case MEM_PLAN_POOL_IRAM:
+      return "iram";
+    case MEM_PLAN_POOL_SPIRAM:
+      return "spiram";
+    default:
+      return "unknown";
+  }
+}
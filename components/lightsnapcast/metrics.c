@@ -0,0 +1,139 @@
+/**
+ * Pipeline metrics
+ *
+ * Counters and latency histograms of network receive, decoder, DSP, chunk
+ * queue and I2S, served by the UI http server at /metrics. Latencies are
+ * measured with the CPU cycle counter, which is per core. If a task was
+ * moved to the other core while it was measured the value is dropped.
+ *
+ * Updates are a few compares and a short critical section, they happen at
+ * most a few times per chunk.
+ */
+
+#include "metrics.h"
+
+#if CONFIG_USE_METRICS
+
+#include <string.h>
+
+#include "esp_rom_sys.h"
+
+static const uint32_t bucketBounds_us[METRICS_HIST_BUCKETS] =
+    METRICS_HIST_BOUNDS_US;
+
+static const metrics_desc_t counterDesc[METRICS_COUNTER_MAX] = {
+    [METRICS_NET_RX_BYTES] = {"snapclient_net_rx_bytes_total", NULL,
+                              "Bytes received from snapserver"},
+    [METRICS_NET_RX_PACKETS] = {"snapclient_net_rx_packets_total", NULL,
+                                "Network buffers received from snapserver"},
+    [METRICS_ALLOC_FALLBACK] = {"snapclient_alloc_fallbacks_total", NULL,
+                                "Chunks allocated from second choice memory"},
+    [METRICS_ALLOC_FAIL] = {"snapclient_alloc_failures_total", NULL,
+                            "Chunks replaced by silence, out of memory"},
+    [METRICS_SPAN_DROPPED] = {"snapclient_metrics_spans_dropped_total", NULL,
+                              "Measurements dropped, task changed core"},
+};
+
+static const metrics_desc_t histDesc[METRICS_HIST_MAX] = {
+    [METRICS_HIST_RX_PROCESS] = {"snapclient_rx_process_seconds", NULL,
+                                 "Time to parse a network buffer, decode "
+                                 "included"},
+    [METRICS_HIST_DECODE_OPUS] = {"snapclient_decode_seconds",
+                                  "codec=\"opus\"",
+                                  "Time to decode a wire chunk"},
+    [METRICS_HIST_DECODE_FLAC] = {"snapclient_decode_seconds",
+                                  "codec=\"flac\"",
+                                  "Time to decode a wire chunk"},
+    [METRICS_HIST_DSP] = {"snapclient_dsp_seconds", NULL,
+                          "DSP processing time per chunk"},
+    [METRICS_HIST_INSERT_WAIT] = {"snapclient_insert_wait_seconds", NULL,
+                                  "Time to insert a chunk into the queue"},
+    [METRICS_HIST_I2S_WRITE] = {"snapclient_i2s_write_seconds", NULL,
+                                "Time blocked writing to I2S"},
+};
+
+static metrics_snapshot_t metrics;
+static portMUX_TYPE metricsMux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ *
+ */
+void metrics_count(metrics_counter_t id, uint32_t n) {
+  if (id >= METRICS_COUNTER_MAX) {
+    return;
+  }
+
+  portENTER_CRITICAL(&metricsMux);
+  metrics.counter[id] += n;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+/**
+ *
+ */
+void metrics_span_end(const metrics_span_t *span, metrics_hist_id_t id) {
+  uint32_t cycles = esp_cpu_get_cycle_count() - span->cycles;
+  uint32_t us, i;
+
+  if (id >= METRICS_HIST_MAX) {
+    return;
+  }
+
+  if (span->core != xPortGetCoreID()) {
+    metrics_count(METRICS_SPAN_DROPPED, 1);
+
+    return;
+  }
+
+  us = cycles / esp_rom_get_cpu_ticks_per_us();
+  for (i = 0; i < METRICS_HIST_BUCKETS; i++) {
+    if (us <= bucketBounds_us[i]) {
+      break;
+    }
+  }
+
+  portENTER_CRITICAL(&metricsMux);
+  metrics.hist[id].bucket[i]++;
+  metrics.hist[id].count++;
+  metrics.hist[id].sum_us += us;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+/**
+ *
+ */
+int32_t metrics_get(metrics_snapshot_t *snapshot) {
+  if (snapshot == NULL) {
+    return -1;
+  }
+
+  portENTER_CRITICAL(&metricsMux);
+  *snapshot = metrics;
+  portEXIT_CRITICAL(&metricsMux);
+
+  return 0;
+}
+
+/**
+ *
+ */
+const metrics_desc_t *metrics_counter_desc(metrics_counter_t id) {
+  if (id >= METRICS_COUNTER_MAX) {
+    return NULL;
+  }
+
+  return &counterDesc[id];
+}
+
+/**
+ *
+ */
+const metrics_desc_t *metrics_hist_desc(metrics_hist_id_t id) {
+  if (id >= METRICS_HIST_MAX) {
+    return NULL;
+  }
+
+  return &histDesc[id];
+}
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * Conversion of decoder output to the PCM layout of chunks
+ *
+ * Only 16 bit stereo is supported for now. Chunk payload may be in IRAM,
+ * which can only be accessed 32 bit wide, so it is written word by word.
+ */
+
+#include "pcm_convert.h"
+
+#include <string.h>
+
+/**
+ * interleave FLAC's planar output, little endian
+ */
+void pcm_convert_flac(uint8_t *dst, const int32_t *const src[],
+                      uint32_t frames) {
+  for (uint32_t i = 0; i < frames; i++) {
+    dst[4 * i] = (uint8_t)(src[0][i]);
+    dst[4 * i + 1] = (uint8_t)(src[0][i] >> 8);
+    dst[4 * i + 2] = (uint8_t)(src[1][i]);
+    dst[4 * i + 3] = (uint8_t)(src[1][i] >> 8);
+  }
+}
+
+/**
+ * pack interleaved opus output into chunk payload
+ */
+void pcm_convert_opus(char *dst, const int16_t *src, size_t bytes) {
+  volatile uint32_t *sample;
+  uint32_t tmpData;
+  uint32_t cnt = 0;
+
+  for (int i = 0; i < bytes; i += 4) {
+    sample = (volatile uint32_t *)(&(dst[i]));
+    tmpData = (((uint32_t)src[cnt] << 16) & 0xFFFF0000) |
+              (((uint32_t)src[cnt + 1] << 0) & 0x0000FFFF);
+    *sample = (volatile uint32_t)tmpData;
+
+    cnt += 2;
+  }
+}
+
+/**
+ * copy frames to a chunk's fragments
+ */
+void pcm_convert_to_chunk(pcm_chunk_message_t *pcmChunk, const uint8_t *src,
+                          size_t bytes, uint32_t frameSize) {
+  pcm_chunk_fragment_t *fragment = pcmChunk->fragment;
+  uint32_t frames = bytes / frameSize;
+  uint32_t fragmentCnt = 0;
+  uint32_t srcCnt = 0;
+
+  if ((fragment == NULL) || (fragment->payload == NULL)) {
+    return;
+  }
+
+  for (int i = 0; i < frames; i++) {
+    // TODO: for now fragmented payload is not supported and the whole chunk
+    // is expected to be in the first fragment
+    uint32_t tmpData;
+    memcpy(&tmpData, &src[srcCnt], frameSize);
+
+    if (fragment != NULL) {
+      volatile uint32_t *test =
+          (volatile uint32_t *)(&(fragment->payload[fragmentCnt]));
+      *test = (volatile uint32_t)tmpData;
+    }
+
+    srcCnt += frameSize;
+    fragmentCnt += frameSize;
+    if ((fragment != NULL) && (fragmentCnt >= fragment->size)) {
+      fragmentCnt = 0;
+
+      fragment = fragment->nextFragment;
+    }
+  }
+}
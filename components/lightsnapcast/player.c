@@ -7,6 +7,8 @@
 #include <sys/time.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/ringbuf.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 
@@ -24,16 +26,38 @@
 #include <math.h>
 
 #include "MedianFilter.h"
+#include "audio_mem.h"
 #include "driver/gptimer.h"
 #include "driver/i2s_std.h"
+#include "hal/i2s_ll.h"
+#include "mem_plan.h"
+#include "metrics.h"
 #include "player.h"
 #include "snapcast.h"
+#include "sync_ctrl.h"
+#include "telemetry.h"
+#include "time_sync.h"
+#include "trace.h"
 
 #define USE_SAMPLE_INSERTION CONFIG_USE_SAMPLE_INSERTION
+#define USE_DMA_REFILL_ISR CONFIG_USE_DMA_REFILL_ISR
+#define USE_SOFT_RESYNC CONFIG_USE_SOFT_RESYNC
+#define USE_I2S_START_FROM_ISR CONFIG_USE_I2S_START_FROM_ISR
+#define USE_PSRAM_BOUNCE (CONFIG_USE_PSRAM_BOUNCE && CONFIG_SPIRAM)
+#define USE_SYNC_TELEMETRY CONFIG_USE_SYNC_TELEMETRY
+
+#if CONFIG_SYNC_CONTROLLER_PI
+#define SYNC_CTRL_ALGO SYNC_CTRL_ALGO_PI
+#else
+#define SYNC_CTRL_ALGO SYNC_CTRL_ALGO_MEDIAN
+#endif
 
 #define SYNC_TASK_PRIORITY (configMAX_PRIORITIES - 1)
 #define SYNC_TASK_CORE_ID 1  // tskNO_AFFINITY
 
+#define BOUNCE_TASK_PRIORITY 2
+#define BOUNCE_TASK_CORE_ID tskNO_AFFINITY
+
 static const char *TAG = "PLAYER";
 
 #if USE_SAMPLE_INSERTION
@@ -41,12 +65,20 @@ static const char *TAG = "PLAYER";
 #define INSERT_SAMPLES \
   1  //!< currently only allowed to be 1 or sync algorithm will break
 
-const uint32_t SHORT_OFFSET = 128;
-const uint32_t MINI_OFFSET = 64;
+#ifndef SHORT_OFFSET
+#define SHORT_OFFSET 128
+#endif
+#ifndef MINI_OFFSET
+#define MINI_OFFSET 64
+#endif
 
 #else
-const uint32_t SHORT_OFFSET = 2;
-const uint32_t MINI_OFFSET = 1;
+#ifndef SHORT_OFFSET
+#define SHORT_OFFSET 2
+#endif
+#ifndef MINI_OFFSET
+#define MINI_OFFSET 1
+#endif
 #endif
 
 /**
@@ -56,10 +88,26 @@ const uint32_t MINI_OFFSET = 1;
  * apll_freq = xtal_freq * (4 + sdm2 + sdm1/256 + sdm0/65536)/((o_div + 2) * 2)
  * I2S bit clock is (apll_freq / 16)
  */
+#if !USE_SAMPLE_INSERTION
 static uint32_t apll_normal_predefine[6] = {0, 0, 0, 0, 0, 0};
 static uint32_t apll_corr_predefine[][6] = {{0, 0, 0, 0, 0, 0},
                                             {0, 0, 0, 0, 0, 0}};
 
+#define UPPER_SR_SCALER 1.0001
+#define LOWER_SR_SCALER 0.9999
+
+typedef struct apll_coeff_s {
+  uint32_t sr;
+  uint32_t normal[6];   //!< same layout as apll_normal_predefine
+  uint32_t corr[2][6];  //!< same layout as apll_corr_predefine
+} apll_coeff_t;
+
+// coefficients for common sample rates are calculated once in init_player(),
+// so switching between them doesn't cost anything
+static apll_coeff_t apllCoeffTable[] = {
+    {.sr = 32000}, {.sr = 44100}, {.sr = 48000}, {.sr = 88200}, {.sr = 96000}};
+#endif
+
 static SemaphoreHandle_t latencyBufSemaphoreHandle = NULL;
 
 static bool latencyBuffFull = 0;
@@ -69,24 +117,69 @@ static gptimer_handle_t gptimer = NULL;
 static sMedianFilter_t latencyMedianFilter;
 static sMedianNode_t latencyMedianLong[LATENCY_MEDIAN_FILTER_LEN];
 
-static sMedianFilter_t shortMedianFilter;
-static sMedianNode_t shortMedianBuffer[SHORT_BUFFER_LEN];
-
-static sMedianFilter_t miniMedianFilter;
-static sMedianNode_t miniMedianBuffer[MINI_BUFFER_LEN];
+// only used by player task after init_player()
+static sync_ctrl_t syncCtrl;
 
 static int64_t latencyToServer = 0;
 
+// progressive clock lock, protected by latencyBufSemaphoreHandle
+static player_clock_lock_t clockLock = CLOCK_UNLOCKED;
+static uint32_t coarseCnt = 0;        //!< samples since latency buffer reset
+static int64_t coarseBestRtt = 0;     //!< lowest RTT seen since reset
+static int64_t coarseBestOffset = 0;  //!< offset of sample with lowest RTT
+static int64_t lastLockOffset = 0;    //!< last fine locked offset to server
+static int64_t lastLockTime_us = 0;   //!< local time lastLockOffset was valid
+static float clockSkew_ppm = 0;       //!< server vs. local clock drift
+static int64_t skewRefOffset = 0;
+static int64_t skewRefTime_us = 0;
+
+#if !USE_SAMPLE_INSERTION
 static int8_t currentDir = 0;  //!< current apll direction, see apll_adjust()
+#endif
 
 static QueueHandle_t pcmChkQHdl = NULL;
 
+// pcmChkQHdl may be replaced by player_task while http task inserts chunks
+static SemaphoreHandle_t pcmChkQMux = NULL;
+
+// the first chunk inserted after a sample format change marks the point at
+// which playback switches to the new format. Protected by pcmChkQMux
+static uint32_t formatGen = 0;          //!< incremented on format change
+static uint32_t formatBoundaryGen = 0;  //!< format formatBoundary_us is for
+static int64_t formatBoundary_us = 0;   //!< timestamp of first chunk
+
+// protected by pcmChkQMux
+static player_queue_stats_t queueStats = {0};
+
 static TaskHandle_t playerTaskHandle = NULL;
 
 static QueueHandle_t snapcastSettingQueueHandle = NULL;
 
+// wake up player_task as soon as it can proceed
+static EventGroupHandle_t playerEventGroup = NULL;
+#define PLAYER_EVT_CONFIG BIT0        //!< new snapcast settings available
+#define PLAYER_EVT_CLOCK_LOCKED BIT1  //!< latency buffer is full
+#define PLAYER_EVT_QUEUE_SPACE BIT2   //!< chunk taken from pcmChkQHdl
+#define PLAYER_EVT_CHUNK_QUEUED BIT3  //!< chunk inserted to pcmChkQHdl
+#define PLAYER_EVT_BOUNCE_SPACE BIT4  //!< chunk taken from bounceQHdl
+
+#if USE_PSRAM_BOUNCE
+// chunks are moved from pcmChkQHdl in PSRAM to this queue in internal RAM
+// ahead of playout, player_task only reads from here
+static QueueHandle_t bounceQHdl = NULL;
+static TaskHandle_t bounceTaskHandle = NULL;
+// chunk the mover is copying, protected by pcmChkQMux
+static pcm_chunk_message_t *bounceChunk = NULL;
+static portMUX_TYPE bounceStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static player_bounce_stats_t bounceStats = {0};
+#endif
+
+// times since boot, measured once
+static player_start_stats_t startStats = {0};
+
 static uint32_t i2sDmaBufCnt;
-static uint32_t i2sDmaBufMaxLen;
+static uint32_t i2sDmaBufMaxLen;  //!< frames the player task writes at once
+static uint32_t i2sDmaDescLen;    //!< frames per DMA descriptor
 
 static SemaphoreHandle_t snapcastSettingsMux = NULL;
 static snapcastSetting_t currentSnapcastSetting;
@@ -96,25 +189,188 @@ static void tg0_timer_deinit(void);
 
 static bool gpTimerRunning = false;
 
+#if USE_I2S_START_FROM_ISR
+// used to start I2S from initial sync timer ISR
+static portMUX_TYPE i2sStartMux = portMUX_INITIALIZER_UNLOCKED;
+static bool i2sStartArmed = false;
+static int64_t i2sStart_us = 0;  //!< time I2S was started by ISR
+#endif
+
 static void player_task(void *pvParameters);
+#if USE_PSRAM_BOUNCE
+static void pcm_chunk_bounce_task(void *pvParameters);
+#endif
 
 extern void audio_set_mute(bool mute);
 
 static i2s_chan_handle_t tx_chan = NULL;  // I2S tx channel handler
 static bool i2sEnabled = false;
 
+// DMA descriptor completions, updated from i2s_dma_sent_cb()
+static portMUX_TYPE i2sDmaMux = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t i2sDmaBytesSent = 0;  //!< bytes sent since channel enable
+static int64_t i2sDmaLastSent_us = 0;  //!< time of last descriptor completion
+static size_t i2sDmaDescSize = 0;      //!< bytes per DMA descriptor
+static uint64_t i2sDmaBytesPadded = 0;  //!< silence inserted on underrun
+
+#if USE_DMA_REFILL_ISR
+// playout buffer, DMA descriptors are filled from this in i2s_dma_sent_cb()
+static RingbufHandle_t i2sRefillRingBuf = NULL;
+static size_t i2sRefillRingBufSize = 0;
+static StaticRingbuffer_t i2sRefillRingBufStruct;
+static uint8_t *i2sRefillRingBufStorage = NULL;
+#endif
+
+// DMA ran out of data, protected by i2sDmaMux. Not reset on channel enable.
+static uint32_t i2sUnderrunCnt = 0;
+static uint64_t i2sUnderrunBytes = 0;
+
+// frames buffered outside of DMA descriptors
+static uint32_t i2sRefillFrames = 0;
+
+// bytes written to DMA since channel enable, only touched by player task
+static uint64_t i2sBytesWritten = 0;
+
+// measured DAC clock deviation from nominal sample rate vs. CPU clock
+static int64_t dacPpmRefTime_us = 0;
+static uint64_t dacPpmRefBytes = 0;
+static float dacPpm = 0;
+static bool dacPpmValid = false;
+
+static portMUX_TYPE resyncStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static player_resync_stats_t resyncStats = {0};
+static int64_t muteStart_us = 0;  //!< time we muted for a hard resync
+
+#if USE_SOFT_RESYNC
+// used to crossfade when padding, max. 2 channels with 32bit samples
+static uint8_t softResyncBuf[SOFT_RESYNC_XFADE_FRAMES * 2 * 4];
+#endif
+
 i2s_std_gpio_config_t pin_config0;
 i2s_port_t i2sNum;
 
+/**
+ * I2S ISR handler, called every time a DMA descriptor was sent completely
+ */
+static bool IRAM_ATTR i2s_dma_sent_cb(i2s_chan_handle_t handle,
+                                      i2s_event_data_t *event,
+                                      void *user_ctx) {
+  int64_t now = esp_timer_get_time();
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  size_t padded = 0;
+
+#if USE_DMA_REFILL_ISR
+  // descriptor which just finished will be played after all others, fill it
+  // with next data from playout buffer
+  uint8_t *dmaBuf = *(uint8_t **)event->data;
+  size_t filled = 0;
+
+  while (filled < event->size) {
+    size_t len;
+    uint8_t *item = xRingbufferReceiveUpToFromISR(i2sRefillRingBuf, &len,
+                                                  event->size - filled);
+    if (item == NULL) {
+      break;
+    }
+
+    memcpy(&dmaBuf[filled], item, len);
+    vRingbufferReturnItemFromISR(i2sRefillRingBuf, item,
+                                 &xHigherPriorityTaskWoken);
+    filled += len;
+  }
+
+  if (filled < event->size) {
+    padded = event->size - filled;
+    memset(&dmaBuf[filled], 0, padded);
+  }
+#endif
+
+  portENTER_CRITICAL_ISR(&i2sDmaMux);
+  i2sDmaBytesSent += event->size;
+  i2sDmaBytesPadded += padded;
+  i2sDmaLastSent_us = now;
+  i2sDmaDescSize = event->size;
+  if (padded > 0) {
+    i2sUnderrunCnt++;
+    i2sUnderrunBytes += padded;
+  }
+  portEXIT_CRITICAL_ISR(&i2sDmaMux);
+
+  return xHigherPriorityTaskWoken == pdTRUE;
+}
+
+#if !USE_DMA_REFILL_ISR
+/**
+ * I2S ISR handler, called if DMA has to send a descriptor again because we
+ * didn't write new data in time
+ */
+static bool IRAM_ATTR i2s_dma_underrun_cb(i2s_chan_handle_t handle,
+                                          i2s_event_data_t *event,
+                                          void *user_ctx) {
+  portENTER_CRITICAL_ISR(&i2sDmaMux);
+  i2sUnderrunCnt++;
+  i2sUnderrunBytes += event->size;
+  portEXIT_CRITICAL_ISR(&i2sDmaMux);
+
+  return false;
+}
+#endif
+
+#if USE_DMA_REFILL_ISR
+/**
+ * drop everything left in playout buffer
+ */
+static void i2s_refill_flush(void) {
+  size_t len;
+  void *item;
+
+  if (i2sRefillRingBuf == NULL) {
+    return;
+  }
+
+  while ((item = xRingbufferReceiveUpTo(i2sRefillRingBuf, &len, 0,
+                                        i2sRefillRingBufSize)) != NULL) {
+    vRingbufferReturnItem(i2sRefillRingBuf, item);
+  }
+}
+#endif
+
+/**
+ * DMA restarts from first descriptor on channel enable
+ */
+static void i2s_dma_stats_reset(void) {
+#if USE_DMA_REFILL_ISR
+  i2s_refill_flush();
+#endif
+
+  portENTER_CRITICAL(&i2sDmaMux);
+  i2sDmaBytesSent = 0;
+  i2sDmaBytesPadded = 0;
+  i2sDmaLastSent_us = 0;
+  portEXIT_CRITICAL(&i2sDmaMux);
+
+  i2sBytesWritten = 0;
+
+  // keep last DAC ppm, clock doesn't change just because we restart DMA
+  dacPpmRefTime_us = 0;
+  dacPpmRefBytes = 0;
+}
+
 /**
  *
  */
 esp_err_t my_i2s_channel_disable(i2s_chan_handle_t handle) {
   if (tx_chan != NULL) {
     if (i2sEnabled == true) {
+      esp_err_t err;
+
       i2sEnabled = false;
 
-      return i2s_channel_disable(handle);
+      err = i2s_channel_disable(handle);
+
+      i2s_dma_stats_reset();
+
+      return err;
     }
   }
 
@@ -127,15 +383,191 @@ esp_err_t my_i2s_channel_disable(i2s_chan_handle_t handle) {
 esp_err_t my_i2s_channel_enable(i2s_chan_handle_t handle) {
   if (tx_chan != NULL) {
     if (i2sEnabled == false) {
+      esp_err_t err;
+
       i2sEnabled = true;
 
-      return i2s_channel_enable(handle);
+      err = i2s_channel_enable(handle);
+
+      // DMA starts sending first descriptor now, use this as reference until
+      // first descriptor completes
+      portENTER_CRITICAL(&i2sDmaMux);
+      i2sDmaLastSent_us = esp_timer_get_time();
+      portEXIT_CRITICAL(&i2sDmaMux);
+
+      return err;
     }
   }
 
   return ESP_OK;
 }
 
+/**
+ *
+ */
+static esp_err_t my_i2s_channel_write(i2s_chan_handle_t handle, const void *src,
+                                      size_t size, size_t *bytes_written,
+                                      uint32_t timeout_ms) {
+  esp_err_t err = ESP_OK;
+
+  METRICS_SPAN_BEGIN(span);
+
+#if USE_DMA_REFILL_ISR
+  TickType_t ticks = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY
+                                                   : pdMS_TO_TICKS(timeout_ms);
+  size_t done = 0;
+
+  // use half the buffer at most, so we don't wake up for every descriptor
+  while (done < size) {
+    size_t len = size - done;
+    if (len > i2sRefillRingBufSize / 2) {
+      len = i2sRefillRingBufSize / 2;
+    }
+
+    if (xRingbufferSend(i2sRefillRingBuf, (const uint8_t *)src + done, len,
+                        ticks) != pdTRUE) {
+      err = ESP_ERR_TIMEOUT;
+
+      break;
+    }
+
+    done += len;
+  }
+
+  *bytes_written = done;
+#else
+  err = i2s_channel_write(handle, src, size, bytes_written, timeout_ms);
+#endif
+  i2sBytesWritten += *bytes_written;
+
+  METRICS_SPAN_END(span, METRICS_HIST_I2S_WRITE);
+
+  return err;
+}
+
+/**
+ * write silence, used if we don't have a payload for a chunk
+ */
+static esp_err_t my_i2s_channel_write_silence(i2s_chan_handle_t handle,
+                                              size_t size,
+                                              size_t *bytes_written,
+                                              uint32_t timeout_ms) {
+  static const uint8_t silence[256] = {0};
+  esp_err_t err = ESP_OK;
+  size_t done = 0;
+
+  while (done < size) {
+    size_t len = size - done;
+    size_t written = 0;
+
+    if (len > sizeof(silence)) {
+      len = sizeof(silence);
+    }
+
+    err = my_i2s_channel_write(handle, silence, len, &written, timeout_ms);
+    done += written;
+    if (err != ESP_OK) {
+      break;
+    }
+  }
+
+  *bytes_written = done;
+
+  return err;
+}
+
+/**
+ *
+ */
+static esp_err_t my_i2s_channel_preload_data(i2s_chan_handle_t handle,
+                                             const void *src, size_t size,
+                                             size_t *bytes_loaded) {
+  esp_err_t err;
+
+  err = i2s_channel_preload_data(handle, src, size, bytes_loaded);
+  i2sBytesWritten += *bytes_loaded;
+
+  return err;
+}
+
+/**
+ * Calculate time until the last sample written to DMA will be played out.
+ * Based on the time the last DMA descriptor completed and the amount of data
+ * queued behind it. Also updates measured DAC clock deviation.
+ *
+ * @return 0 on success, -1 if channel isn't running or DMA ran dry
+ */
+static int32_t i2s_get_playout_delay(uint32_t sr, int64_t *delay_us) {
+  uint64_t sent, padded;
+  int64_t lastSent_us;
+  size_t descSize;
+  int64_t queuedFrames, queued_us;
+
+  portENTER_CRITICAL(&i2sDmaMux);
+  sent = i2sDmaBytesSent;
+  padded = i2sDmaBytesPadded;
+  lastSent_us = i2sDmaLastSent_us;
+  descSize = i2sDmaDescSize;
+  portEXIT_CRITICAL(&i2sDmaMux);
+
+  if ((lastSent_us == 0) || (descSize == 0) || (sr == 0) ||
+      (i2sBytesWritten + padded < sent)) {
+    return -1;
+  }
+
+  // skip first descriptor, its completion time includes channel start up
+  if (sent == 0) {
+    // nothing to measure yet, reference is channel enable
+  } else if (dacPpmRefTime_us == 0) {
+    dacPpmRefTime_us = lastSent_us;
+    dacPpmRefBytes = sent;
+  } else if ((lastSent_us - dacPpmRefTime_us) >= DAC_PPM_WINDOW_US) {
+    int64_t frames = (int64_t)(sent - dacPpmRefBytes) *
+                     (int64_t)i2sDmaDescLen / (int64_t)descSize;
+    int64_t nominal_us = 1000000LL * frames / (int64_t)sr;
+    int64_t measured_us = lastSent_us - dacPpmRefTime_us;
+    float ppm = 1000000.0 * (float)(nominal_us - measured_us) /
+                (float)measured_us;
+
+    if ((ppm < DAC_PPM_MAX) && (ppm > -DAC_PPM_MAX)) {
+      dacPpm = ppm;
+      dacPpmValid = true;
+
+      ESP_LOGD(TAG, "DAC clock %.1fppm", dacPpm);
+    } else {
+      ESP_LOGW(TAG, "DAC clock %.1fppm out of range, ignoring", ppm);
+    }
+
+    dacPpmRefTime_us = lastSent_us;
+    dacPpmRefBytes = sent;
+  }
+
+  queuedFrames = (int64_t)(i2sBytesWritten + padded - sent) *
+                 (int64_t)i2sDmaDescLen / (int64_t)descSize;
+  queued_us = 1000000LL * queuedFrames / (int64_t)sr;
+  if (dacPpmValid == true) {
+    queued_us -= (int64_t)((float)queued_us * dacPpm / 1000000.0);
+  }
+
+  *delay_us = lastSent_us + queued_us - esp_timer_get_time();
+
+  return 0;
+}
+
+/**
+ * get measured DAC clock deviation from nominal sample rate in ppm, positive
+ * if DAC is faster than nominal
+ */
+int32_t player_get_dac_ppm(float *ppm) {
+  if (dacPpmValid == false) {
+    return -1;
+  }
+
+  *ppm = dacPpm;
+
+  return 0;
+}
+
 /**
  * This is a dirty hack to ensure smooth audio output without pops/clicks.
  * It was originally developed to suppress es8388 noise between channel
@@ -180,22 +612,84 @@ static void ensure_noiseless(i2s_chan_handle_t tx) {
   my_i2s_channel_disable(tx);
 }
 
+#if !USE_SAMPLE_INSERTION
 /**
  *
  */
-static esp_err_t player_setup_i2s(snapcastSetting_t *setting) {
-  // ensure save setting
-  int32_t sr = setting->sr;
-  if (sr == 0) {
-    sr = 44100;
+static void apll_coeff_calc(apll_coeff_t *c) {
+  // check i2s_set_get_apll_freq() how it is done
+  int fi2s_clk = 2 * c->sr * I2S_MCLK_MULTIPLE_256;
+
+  c->normal[1] = c->sr;
+  if (rtc_clk_apll_coeff_calc(fi2s_clk, &c->normal[5], &c->normal[2],
+                              &c->normal[3], &c->normal[4]) == 0) {
+    ESP_LOGE(TAG, "ERROR, fi2s_clk");
   }
 
-  // ensure save setting
-  int bits = setting->bits;
-  if (bits == 0) {
-    bits = I2S_DATA_BIT_WIDTH_16BIT;
+  c->corr[0][1] = c->sr * UPPER_SR_SCALER;
+  if (rtc_clk_apll_coeff_calc(fi2s_clk * UPPER_SR_SCALER, &c->corr[0][5],
+                              &c->corr[0][2], &c->corr[0][3],
+                              &c->corr[0][4]) == 0) {
+    ESP_LOGE(TAG, "ERROR, fi2s_clk * %f", UPPER_SR_SCALER);
+  }
+
+  c->corr[1][1] = c->sr * LOWER_SR_SCALER;
+  if (rtc_clk_apll_coeff_calc(fi2s_clk * LOWER_SR_SCALER, &c->corr[1][5],
+                              &c->corr[1][2], &c->corr[1][3],
+                              &c->corr[1][4]) == 0) {
+    ESP_LOGE(TAG, "ERROR, fi2s_clk * %f", LOWER_SR_SCALER);
   }
+}
 
+/**
+ *
+ */
+static void apll_coeff_table_init(void) {
+  for (int i = 0; i < sizeof(apllCoeffTable) / sizeof(apllCoeffTable[0]);
+       i++) {
+    apll_coeff_calc(&apllCoeffTable[i]);
+  }
+}
+
+/**
+ * load coefficients used by adjust_apll(), from table if possible
+ */
+static void apll_coeff_set(uint32_t sr, int bits) {
+  apll_coeff_t tmp = {.sr = sr};
+  apll_coeff_t *c = NULL;
+
+  for (int i = 0; i < sizeof(apllCoeffTable) / sizeof(apllCoeffTable[0]);
+       i++) {
+    if (apllCoeffTable[i].sr == sr) {
+      c = &apllCoeffTable[i];
+
+      break;
+    }
+  }
+
+  if (c == NULL) {
+    apll_coeff_calc(&tmp);
+    c = &tmp;
+  }
+
+  memcpy(apll_normal_predefine, c->normal, sizeof(apll_normal_predefine));
+  memcpy(apll_corr_predefine, c->corr, sizeof(apll_corr_predefine));
+  apll_normal_predefine[0] = bits;
+  apll_corr_predefine[0][0] = bits;
+  apll_corr_predefine[1][0] = bits;
+}
+#endif
+
+/**
+ * DMA layout used for a setting. dmaBufMaxLen is what the player task writes
+ * at once, dmaDescLen the frames of a DMA descriptor. They only differ if
+ * USE_DMA_REFILL_ISR is enabled, descriptors are short then and refill
+ * frames are kept in a ring buffer. Returns -1 if chunk size can't be split.
+ */
+static int32_t i2s_dma_geometry(const snapcastSetting_t *setting,
+                                uint32_t *dmaBufCnt, uint32_t *dmaBufMaxLen,
+                                uint32_t *dmaDescLen,
+                                uint32_t *refillFrames) {
   // ensure save setting
   uint32_t chkInFrames = setting->chkInFrames;
   if (chkInFrames == 0) {
@@ -203,14 +697,13 @@ static esp_err_t player_setup_i2s(snapcastSetting_t *setting) {
   }
 
 #if USE_SAMPLE_INSERTION
-  i2sDmaBufCnt = 22;
+  *dmaBufCnt = 22;
   // OPUS has a minimum frame size of 120
   // with DMA buffer set to this value sync algorithm
   // works for all decoders. We set it to 100 so
   // there will be free space for sample stuffing in each round
-  i2sDmaBufMaxLen = 100;
+  *dmaBufMaxLen = 100;
 #else
-  int fi2s_clk;
   const int __dmaBufMaxLen = 1024;
   int __dmaBufCnt;
   int __dmaBufLen;
@@ -222,69 +715,72 @@ static esp_err_t player_setup_i2s(snapcastSetting_t *setting) {
       __dmaBufCnt *= 2;
       __dmaBufLen /= 2;
     } else {
-      ESP_LOGE(TAG,
-               "player_setup_i2s: Can't setup i2s with this configuration");
-
       return -1;
     }
   }
 
-  i2sDmaBufCnt = __dmaBufCnt * CHNK_CTRL_CNT;
-  i2sDmaBufMaxLen = __dmaBufLen;
+  *dmaBufCnt = __dmaBufCnt * CHNK_CTRL_CNT;
+  *dmaBufMaxLen = __dmaBufLen;
+#endif
 
-  // check i2s_set_get_apll_freq() how it is done
-  fi2s_clk = 2 * sr *
-             I2S_MCLK_MULTIPLE_256;  // setting->ch * setting->bits * m_scale;
+#if USE_DMA_REFILL_ISR
+  // keep total buffer size, but move most of it out of DMA descriptors.
+  // Short descriptors are what is played before new audio written to the
+  // ring buffer, the player task still writes dmaBufMaxLen at once.
+  uint32_t total = *dmaBufCnt * *dmaBufMaxLen;
 
-  apll_normal_predefine[0] = bits;
-  apll_normal_predefine[1] = sr;
-  if (rtc_clk_apll_coeff_calc(
-          fi2s_clk, &apll_normal_predefine[5], &apll_normal_predefine[2],
-          &apll_normal_predefine[3], &apll_normal_predefine[4]) == 0) {
-    ESP_LOGE(TAG, "ERROR, fi2s_clk");
+  *dmaDescLen = *dmaBufMaxLen;
+  if (*dmaDescLen > I2S_REFILL_DMA_DESC_LEN) {
+    *dmaDescLen = I2S_REFILL_DMA_DESC_LEN;
   }
+  *dmaBufCnt = I2S_REFILL_DMA_DESC_CNT;
 
-#define UPPER_SR_SCALER 1.0001
-#define LOWER_SR_SCALER 0.9999
-
-  apll_corr_predefine[0][0] = bits;
-  apll_corr_predefine[0][1] = sr * UPPER_SR_SCALER;
-  if (rtc_clk_apll_coeff_calc(
-          fi2s_clk * UPPER_SR_SCALER, &apll_corr_predefine[0][5],
-          &apll_corr_predefine[0][2], &apll_corr_predefine[0][3],
-          &apll_corr_predefine[0][4]) == 0) {
-    ESP_LOGE(TAG, "ERROR, fi2s_clk * %f", UPPER_SR_SCALER);
-  }
-  apll_corr_predefine[1][0] = bits;
-  apll_corr_predefine[1][1] = sr * LOWER_SR_SCALER;
-  if (rtc_clk_apll_coeff_calc(
-          fi2s_clk * LOWER_SR_SCALER, &apll_corr_predefine[1][5],
-          &apll_corr_predefine[1][2], &apll_corr_predefine[1][3],
-          &apll_corr_predefine[1][4]) == 0) {
-    ESP_LOGE(TAG, "ERROR, fi2s_clk * %f", LOWER_SR_SCALER);
+  if (total > *dmaBufCnt * *dmaDescLen + *dmaBufMaxLen) {
+    *refillFrames = total - *dmaBufCnt * *dmaDescLen;
+  } else {
+    *refillFrames = *dmaBufMaxLen;
   }
+#else
+  *dmaDescLen = *dmaBufMaxLen;
+  *refillFrames = 0;
 #endif
 
-  if (tx_chan) {
-    my_i2s_channel_disable(tx_chan);
-    i2s_del_channel(tx_chan);
-    tx_chan = NULL;
+  return 0;
+}
+
+/**
+ * Set up I2S for the given format. If DMA layout stays the same the channel
+ * is kept and only clock and slots are reprogrammed.
+ */
+static esp_err_t player_setup_i2s(snapcastSetting_t *setting) {
+  // ensure save setting
+  int32_t sr = setting->sr;
+  if (sr == 0) {
+    sr = 44100;
   }
 
-  i2s_chan_config_t tx_chan_cfg = {
-      .id = i2sNum,
-      .role = I2S_ROLE_MASTER,
-      .dma_desc_num = i2sDmaBufCnt,
-      .dma_frame_num = i2sDmaBufMaxLen,
-      .auto_clear = false,
-  };
-  ESP_ERROR_CHECK(i2s_new_channel(&tx_chan_cfg, &tx_chan, NULL));
+  // ensure save setting
+  int bits = setting->bits;
+  if (bits == 0) {
+    bits = I2S_DATA_BIT_WIDTH_16BIT;
+  }
 
+  const uint32_t prevDmaBufCnt = i2sDmaBufCnt;
+  const uint32_t prevDmaBufMaxLen = i2sDmaBufMaxLen;
+  const uint32_t prevDmaDescLen = i2sDmaDescLen;
+  const uint32_t prevRefillFrames = i2sRefillFrames;
+  bool reconfigure;
 
-  ESP_LOGI(TAG,
-           "player_setup_i2s: dma_buf_len is %ld, dma_buf_count is %ld, sample "
-           "rate: %ld, bits: %d",
-           i2sDmaBufMaxLen, i2sDmaBufCnt, sr, bits);
+  if (i2s_dma_geometry(setting, &i2sDmaBufCnt, &i2sDmaBufMaxLen,
+                       &i2sDmaDescLen, &i2sRefillFrames) < 0) {
+    ESP_LOGE(TAG, "player_setup_i2s: Can't setup i2s with this configuration");
+
+    return -1;
+  }
+
+#if !USE_SAMPLE_INSERTION
+  apll_coeff_set(sr, bits);
+#endif
 
   i2s_std_clk_config_t i2s_clkcfg = {
       .sample_rate_hz = sr,
@@ -307,9 +803,88 @@ static esp_err_t player_setup_i2s(snapcastSetting_t *setting) {
       .gpio_cfg = pin_config0,
   };
 
-  ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_chan, &tx_std_cfg));
-  // This prevents pops/clicks on some I2S codecs
-  ensure_noiseless(tx_chan);
+  reconfigure = (tx_chan != NULL) && (i2sDmaBufCnt == prevDmaBufCnt) &&
+                (i2sDmaBufMaxLen == prevDmaBufMaxLen) &&
+                (i2sDmaDescLen == prevDmaDescLen) &&
+                (i2sRefillFrames == prevRefillFrames);
+
+  if (tx_chan) {
+    my_i2s_channel_disable(tx_chan);
+
+    if (reconfigure == false) {
+      i2s_del_channel(tx_chan);
+      tx_chan = NULL;
+    }
+  }
+
+#if USE_DMA_REFILL_ISR
+  if (i2sRefillRingBuf) {
+    vRingbufferDelete(i2sRefillRingBuf);
+    i2sRefillRingBuf = NULL;
+    free(i2sRefillRingBufStorage);
+    i2sRefillRingBufStorage = NULL;
+  }
+
+  // 2 slots, stereo only. Samples > 16bit use 32bit slots
+  i2sRefillRingBufSize = i2sRefillFrames * 2 * ((bits + 15) / 16) * 2;
+  // ISR reads from this, so it must be in internal RAM. It mustn't end up in
+  // PSRAM if malloc() uses it, ISR keeps running while flash is written.
+  i2sRefillRingBufStorage = (uint8_t *)heap_caps_malloc(
+      i2sRefillRingBufSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (i2sRefillRingBufStorage != NULL) {
+    i2sRefillRingBuf = xRingbufferCreateStatic(
+        i2sRefillRingBufSize, RINGBUF_TYPE_BYTEBUF, i2sRefillRingBufStorage,
+        &i2sRefillRingBufStruct);
+  }
+  if (i2sRefillRingBuf == NULL) {
+    ESP_LOGE(TAG, "player_setup_i2s: couldn't create playout buffer");
+
+    free(i2sRefillRingBufStorage);
+    i2sRefillRingBufStorage = NULL;
+
+    return -1;
+  }
+#endif
+
+  if (reconfigure == true) {
+    // DMA buffers are reallocated by the driver if slot width changed
+    ESP_ERROR_CHECK(
+        i2s_channel_reconfig_std_clock(tx_chan, &tx_std_cfg.clk_cfg));
+    ESP_ERROR_CHECK(
+        i2s_channel_reconfig_std_slot(tx_chan, &tx_std_cfg.slot_cfg));
+  } else {
+    i2s_chan_config_t tx_chan_cfg = {
+        .id = i2sNum,
+        .role = I2S_ROLE_MASTER,
+        .dma_desc_num = i2sDmaBufCnt,
+        .dma_frame_num = i2sDmaDescLen,
+        .auto_clear = false,
+    };
+    ESP_ERROR_CHECK(i2s_new_channel(&tx_chan_cfg, &tx_chan, NULL));
+
+    i2s_event_callbacks_t i2s_cbs = {
+        .on_sent = i2s_dma_sent_cb,
+#if !USE_DMA_REFILL_ISR
+        .on_send_q_ovf = i2s_dma_underrun_cb,
+#endif
+    };
+    ESP_ERROR_CHECK(
+        i2s_channel_register_event_callback(tx_chan, &i2s_cbs, NULL));
+
+    ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_chan, &tx_std_cfg));
+    // This prevents pops/clicks on some I2S codecs
+    ensure_noiseless(tx_chan);
+  }
+
+  i2s_dma_stats_reset();
+  dacPpmValid = false;
+
+  ESP_LOGI(TAG,
+           "player_setup_i2s: dma_buf_len is %ld, dma_buf_count is %ld, "
+           "descriptor %ld frames, sample rate: %ld, bits: %d, refill frames: "
+           "%ld, reconfigured %d",
+           i2sDmaBufMaxLen, i2sDmaBufCnt, i2sDmaDescLen, sr, bits,
+           i2sRefillFrames, reconfigure);
 
   // my_i2s_channel_enable(tx_chan);
 
@@ -347,6 +922,55 @@ static int destroy_pcm_queue(QueueHandle_t *queueHandle) {
   return ret;
 }
 
+/**
+ * Replace chunk queue by one with a different length. Buffered chunks are
+ * moved over, if there are more than fit the oldest ones are dropped.
+ */
+static int resize_pcm_queue(QueueHandle_t *queueHandle, int entries) {
+  QueueHandle_t newQueue;
+  pcm_chunk_message_t *chnk = NULL;
+  int moved = 0;
+  int dropped = 0;
+
+  newQueue = xQueueCreate(entries, sizeof(pcm_chunk_message_t *));
+  if (newQueue == NULL) {
+    ESP_LOGE(TAG, "%s: couldn't create queue with %d entries", __func__,
+             entries);
+
+    return pdFAIL;
+  }
+
+  xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+
+  if (*queueHandle != NULL) {
+    while (uxQueueMessagesWaiting(*queueHandle) > entries) {
+      if (xQueueReceive(*queueHandle, &chnk, 0) == pdTRUE) {
+        free_pcm_chunk(chnk);
+        dropped++;
+      }
+    }
+
+    while (xQueueReceive(*queueHandle, &chnk, 0) == pdTRUE) {
+      xQueueSend(newQueue, &chnk, 0);
+      moved++;
+    }
+
+    vQueueDelete(*queueHandle);
+  }
+
+  *queueHandle = newQueue;
+
+  queueStats.length = entries;
+  queueStats.highWater = moved;
+
+  xSemaphoreGive(pcmChkQMux);
+
+  ESP_LOGI(TAG, "created new queue with %d, kept %d chunks, dropped %d",
+           entries, moved, dropped);
+
+  return pdPASS;
+}
+
 /**
  * ensure this is called after http_task was killed!
  */
@@ -366,7 +990,37 @@ int deinit_player(void) {
     snapcastSettingsMux = NULL;
   }
 
+  if (playerEventGroup != NULL) {
+    vEventGroupDelete(playerEventGroup);
+    playerEventGroup = NULL;
+  }
+
+  if (snapcastSettingQueueHandle != NULL) {
+    vQueueDelete(snapcastSettingQueueHandle);
+    snapcastSettingQueueHandle = NULL;
+  }
+
+#if USE_PSRAM_BOUNCE
+  if (bounceTaskHandle != NULL) {
+    // let the mover finish a copy, it holds no memory while it waits
+    xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+    while (bounceChunk != NULL) {
+      xSemaphoreGive(pcmChkQMux);
+      vTaskDelay(1);
+      xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+    }
+    vTaskDelete(bounceTaskHandle);
+    bounceTaskHandle = NULL;
+    xSemaphoreGive(pcmChkQMux);
+  }
+
+  if (bounceQHdl != NULL) {
+    destroy_pcm_queue(&bounceQHdl);
+  }
+#endif
+
   ret = destroy_pcm_queue(&pcmChkQHdl);
+  mem_plan_reset();
 
   if (latencyBufSemaphoreHandle == NULL) {
     ESP_LOGW(TAG, "no latency buffer semaphore created?");
@@ -407,6 +1061,14 @@ int init_player(i2s_std_gpio_config_t pin_config0_, i2s_port_t i2sNum_) {
     xSemaphoreGive(snapcastSettingsMux);
   }
 
+  if (pcmChkQMux == NULL) {
+    pcmChkQMux = xSemaphoreCreateMutex();
+  }
+
+#if !USE_SAMPLE_INSERTION
+  apll_coeff_table_init();
+#endif
+
   ret = player_setup_i2s(&currentSnapcastSetting);
   if (ret < 0) {
     ESP_LOGE(TAG, "player_setup_i2s failed: %d", ret);
@@ -419,21 +1081,54 @@ int init_player(i2s_std_gpio_config_t pin_config0_, i2s_port_t i2sNum_) {
     latencyBufSemaphoreHandle = xSemaphoreCreateMutex();
   }
 
+  if (playerEventGroup == NULL) {
+    playerEventGroup = xEventGroupCreate();
+  }
+
+  // create message queue to inform task of changed settings, settings may be
+  // sent before the task is running
+  if (snapcastSettingQueueHandle == NULL) {
+    snapcastSettingQueueHandle = xQueueCreate(1, sizeof(uint8_t));
+  }
+
   // init diff buff median filter
   latencyMedianFilter.numNodes = LATENCY_MEDIAN_FILTER_LEN;
   latencyMedianFilter.medianBuffer = latencyMedianLong;
   reset_latency_buffer();
 
-  shortMedianFilter.numNodes = SHORT_BUFFER_LEN;
-  shortMedianFilter.medianBuffer = shortMedianBuffer;
-  MEDIANFILTER_Init(&shortMedianFilter);
-
-  miniMedianFilter.numNodes = MINI_BUFFER_LEN;
-  miniMedianFilter.medianBuffer = miniMedianBuffer;
-  MEDIANFILTER_Init(&miniMedianFilter);
+  sync_ctrl_config_t syncCfg = {
+#if USE_SAMPLE_INSERTION
+      .mode = SYNC_CTRL_MODE_INSERT,
+      .insertFrames = INSERT_SAMPLES,
+#else
+      .mode = SYNC_CTRL_MODE_APLL,
+#endif
+      .algo = SYNC_CTRL_ALGO,
+      .softResync = USE_SOFT_RESYNC,
+      .shortOffset_us = SHORT_OFFSET,
+      .miniOffset_us = MINI_OFFSET,
+      .hardResyncFine_us = CLOCK_FINE_RESYNC_US,
+      .hardResyncCoarse_us = CLOCK_COARSE_RESYNC_US,
+      .softResyncMax_us = SOFT_RESYNC_MAX_US,
+      .startMargin_us = I2S_START_MARGIN_US,
+  };
+  sync_ctrl_init(&syncCtrl, &syncCfg);
 
   tg0_timer_init();
 
+#if USE_PSRAM_BOUNCE
+  if (bounceQHdl == NULL) {
+    bounceQHdl =
+        xQueueCreate(PSRAM_BOUNCE_CHUNKS, sizeof(pcm_chunk_message_t *));
+  }
+
+  if (bounceTaskHandle == NULL) {
+    xTaskCreatePinnedToCore(pcm_chunk_bounce_task, "bounce", 2048, NULL,
+                            BOUNCE_TASK_PRIORITY, &bounceTaskHandle,
+                            BOUNCE_TASK_CORE_ID);
+  }
+#endif
+
   if (playerTaskHandle == NULL) {
     ESP_LOGI(TAG, "Start player_task");
 
@@ -457,48 +1152,170 @@ int8_t player_set_snapcast_settings(snapcastSetting_t *setting) {
 
   memcpy(&currentSnapcastSetting, setting, sizeof(snapcastSetting_t));
 
-  xSemaphoreGive(snapcastSettingsMux);
+  xSemaphoreGive(snapcastSettingsMux);
+
+  return ret;
+}
+
+/**
+ *
+ */
+int8_t player_get_snapcast_settings(snapcastSetting_t *setting) {
+  int8_t ret = pdPASS;
+
+  xSemaphoreTake(snapcastSettingsMux, portMAX_DELAY);
+
+  memcpy(setting, &currentSnapcastSetting, sizeof(snapcastSetting_t));
+
+  xSemaphoreGive(snapcastSettingsMux);
+
+  return ret;
+}
+
+/**
+ * called with latencyBufSemaphoreHandle taken
+ */
+static void clock_lock_set(player_clock_lock_t state) {
+  if ((clockLock == CLOCK_UNLOCKED) && (state != CLOCK_UNLOCKED)) {
+    xEventGroupSetBits(playerEventGroup, PLAYER_EVT_CLOCK_LOCKED);
+
+    if (startStats.clockLocked_us == 0) {
+      startStats.clockLocked_us = esp_timer_get_time();
+    }
+  }
+
+  if (clockLock != state) {
+    ESP_LOGI(TAG, "clock lock %d -> %d", clockLock, state);
+  }
+
+  clockLock = state;
+}
+
+/**
+ * track drift of server clock against ours, called with
+ * latencyBufSemaphoreHandle taken
+ */
+static void clock_skew_update(int64_t offset, int64_t now) {
+  if (skewRefTime_us == 0) {
+    skewRefOffset = offset;
+    skewRefTime_us = now;
+  } else if ((now - skewRefTime_us) >= CLOCK_SKEW_INTERVAL_US) {
+    float skew = 1000000.0 * (float)(offset - skewRefOffset) /
+                 (float)(now - skewRefTime_us);
+
+    clockSkew_ppm += (skew - clockSkew_ppm) / 4;
+
+    skewRefOffset = offset;
+    skewRefTime_us = now;
+  }
+
+  lastLockOffset = offset;
+  lastLockTime_us = now;
+}
+
+/**
+ * Insert a new time sync result. Offset used for playback is taken from the
+ * sample with lowest RTT until the latency buffer is full, then the median
+ * is used.
+ */
+int32_t player_latency_insert(int64_t newValue, int64_t rtt) {
+  int64_t medianValue;
+
+  medianValue = MEDIANFILTER_Insert(&latencyMedianFilter, newValue);
+  if (xSemaphoreTake(latencyBufSemaphoreHandle, pdMS_TO_TICKS(0)) == pdTRUE) {
+    if ((coarseCnt == 0) || (rtt < coarseBestRtt)) {
+      coarseBestRtt = rtt;
+      coarseBestOffset = newValue;
+    }
+    coarseCnt++;
+
+    if (MEDIANFILTER_isFull(&latencyMedianFilter, LATENCY_MEDIAN_FILTER_FULL)) {
+      latencyBuffFull = true;
+
+      latencyToServer = medianValue;
+
+      clock_lock_set(CLOCK_FINE);
+      clock_skew_update(medianValue, esp_timer_get_time());
+
+      //      ESP_LOGI(TAG, "(full) latency median: %lldus", medianValue);
+    } else if (coarseCnt >= CLOCK_COARSE_SAMPLES) {
+      // good enough to start playback, tolerances are wider until we are
+      // fine locked
+      latencyToServer = coarseBestOffset;
+
+      clock_lock_set(CLOCK_COARSE);
+    }
+    //    else {
+    //      ESP_LOGI(TAG, "(not full) latency median: %lldus", medianValue);
+    //    }
+
+    xSemaphoreGive(latencyBufSemaphoreHandle);
+  } else {
+    ESP_LOGW(TAG, "couldn't set latencyToServer = medianValue");
+  }
+
+  return 0;
+}
+
+/**
+ *
+ */
+player_clock_lock_t player_get_clock_lock(void) {
+  player_clock_lock_t state = CLOCK_UNLOCKED;
+
+  if (latencyBufSemaphoreHandle == NULL) {
+    return CLOCK_UNLOCKED;
+  }
+
+  if (xSemaphoreTake(latencyBufSemaphoreHandle, portMAX_DELAY) == pdTRUE) {
+    state = clockLock;
+
+    xSemaphoreGive(latencyBufSemaphoreHandle);
+  }
 
-  return ret;
+  return state;
 }
 
 /**
  *
  */
-int8_t player_get_snapcast_settings(snapcastSetting_t *setting) {
-  int8_t ret = pdPASS;
-
-  xSemaphoreTake(snapcastSettingsMux, portMAX_DELAY);
+int32_t player_get_clock_skew(float *ppm) {
+  if (latencyBufSemaphoreHandle == NULL) {
+    return -1;
+  }
 
-  memcpy(setting, &currentSnapcastSetting, sizeof(snapcastSetting_t));
+  if (xSemaphoreTake(latencyBufSemaphoreHandle, portMAX_DELAY) == pdTRUE) {
+    *ppm = clockSkew_ppm;
 
-  xSemaphoreGive(snapcastSettingsMux);
+    xSemaphoreGive(latencyBufSemaphoreHandle);
+  }
 
-  return ret;
+  return 0;
 }
 
 /**
- *
+ * Set up player with settings remembered from last boot, so I2S and queue
+ * are ready when the stream starts. Call after init_player().
  */
-int32_t player_latency_insert(int64_t newValue) {
-  int64_t medianValue;
-
-  medianValue = MEDIANFILTER_Insert(&latencyMedianFilter, newValue);
-  if (xSemaphoreTake(latencyBufSemaphoreHandle, pdMS_TO_TICKS(0)) == pdTRUE) {
-    if (MEDIANFILTER_isFull(&latencyMedianFilter, LATENCY_MEDIAN_FILTER_FULL)) {
-      latencyBuffFull = true;
+int32_t player_warm_start(snapcastSetting_t *setting, float skew_ppm) {
+  if (latencyBufSemaphoreHandle == NULL) {
+    return -1;
+  }
 
-      //      ESP_LOGI(TAG, "(full) latency median: %lldus", medianValue);
-    }
-    //    else {
-    //      ESP_LOGI(TAG, "(not full) latency median: %lldus", medianValue);
-    //    }
+  if ((skew_ppm > DAC_PPM_MAX) || (skew_ppm < -DAC_PPM_MAX)) {
+    skew_ppm = 0;
+  }
 
-    latencyToServer = medianValue;
+  if (xSemaphoreTake(latencyBufSemaphoreHandle, portMAX_DELAY) == pdTRUE) {
+    clockSkew_ppm = skew_ppm;
 
     xSemaphoreGive(latencyBufSemaphoreHandle);
-  } else {
-    ESP_LOGW(TAG, "couldn't set latencyToServer = medianValue");
+  }
+
+  startStats.warmStart = true;
+
+  if (player_send_snapcast_setting(setting) != pdPASS) {
+    return -1;
   }
 
   return 0;
@@ -518,6 +1335,14 @@ int32_t player_send_snapcast_setting(snapcastSetting_t *setting) {
 
   ret = player_get_snapcast_settings(&curSet);
 
+  // chunks inserted from now on are in the new format
+  if ((curSet.sr != setting->sr) || (curSet.bits != setting->bits) ||
+      (curSet.ch != setting->ch)) {
+    xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+    formatGen++;
+    xSemaphoreGive(pcmChkQMux);
+  }
+
   if ((curSet.bits != setting->bits) || (curSet.buf_ms != setting->buf_ms) ||
       (curSet.ch != setting->ch) ||
       (curSet.chkInFrames != setting->chkInFrames) ||
@@ -547,6 +1372,12 @@ int32_t player_send_snapcast_setting(snapcastSetting_t *setting) {
                  "player_send_snapcast_setting: couldn't notify "
                  "snapcast setting");
       } else {
+        xEventGroupSetBits(playerEventGroup, PLAYER_EVT_CONFIG);
+
+        if (startStats.config_us == 0) {
+          startStats.config_us = esp_timer_get_time();
+        }
+
                   ESP_LOGI(TAG,
                  "got settings and notified player_task");
     }
@@ -558,7 +1389,7 @@ int32_t player_send_snapcast_setting(snapcastSetting_t *setting) {
 /**
  *
  */
-int32_t reset_latency_buffer(void) {
+static int32_t latency_buffer_reset(bool keepOffset) {
   // init diff buff median filter
   if (MEDIANFILTER_Init(&latencyMedianFilter) < 0) {
     ESP_LOGE(TAG, "reset_diff_buffer: couldn't init median filter long. STOP");
@@ -573,8 +1404,34 @@ int32_t reset_latency_buffer(void) {
   }
 
   if (xSemaphoreTake(latencyBufSemaphoreHandle, portMAX_DELAY) == pdTRUE) {
+    int64_t now = esp_timer_get_time();
+
     latencyBuffFull = false;
     latencyToServer = 0;
+    coarseCnt = 0;
+    skewRefTime_us = 0;
+
+    clockLock = CLOCK_UNLOCKED;
+    if (playerEventGroup != NULL) {
+      xEventGroupClearBits(playerEventGroup, PLAYER_EVT_CLOCK_LOCKED);
+    }
+
+    // predict offset from last lock, it will be replaced as soon as we got
+    // enough new samples
+    if ((keepOffset == true) && (lastLockTime_us != 0) &&
+        ((now - lastLockTime_us) < CLOCK_KEEP_MAX_AGE_US)) {
+      latencyToServer =
+          lastLockOffset + (int64_t)((float)(now - lastLockTime_us) *
+                                     clockSkew_ppm / 1000000.0);
+
+      clock_lock_set(CLOCK_COARSE);
+
+      ESP_LOGI(TAG, "keep offset to server %lldus, skew %.2fppm",
+               latencyToServer, clockSkew_ppm);
+    } else if (keepOffset == false) {
+      // skew of a different server is meaningless
+      clockSkew_ppm = 0;
+    }
 
     xSemaphoreGive(latencyBufSemaphoreHandle);
   } else {
@@ -586,6 +1443,19 @@ int32_t reset_latency_buffer(void) {
   return 0;
 }
 
+/**
+ *
+ */
+int32_t reset_latency_buffer(void) { return latency_buffer_reset(false); }
+
+/**
+ * Reset latency buffer but keep using the last known offset until new samples
+ * are available. Use on reconnects to the same server.
+ */
+int32_t reset_latency_buffer_keep_offset(void) {
+  return latency_buffer_reset(true);
+}
+
 /**
  *
  */
@@ -685,9 +1555,10 @@ int32_t server_now(int64_t *sNow, int64_t *diff2Server) {
  *
  * Note:
  * We don't call the timer API here because they are not declared with
- * IRAM_ATTR. If we're okay with the timer irq not being serviced while SPI
- * flash cache is disabled, we can allocate this interrupt without the
- * ESP_INTR_FLAG_IRAM flag and use the normal API.
+ * IRAM_ATTR. With CONFIG_USE_IRAM_PLAYOUT the interrupt is allocated with
+ * ESP_INTR_FLAG_IRAM (CONFIG_GPTIMER_ISR_IRAM_SAFE) and keeps being serviced
+ * while SPI flash cache is disabled, so everything called here has to be in
+ * IRAM.
  */
 static bool IRAM_ATTR timer_group0_alarm_cb(
     gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata,
@@ -698,6 +1569,17 @@ static bool IRAM_ATTR timer_group0_alarm_cb(
 
   uint64_t timer_counter_value = edata->count_value;
 
+#if USE_I2S_START_FROM_ISR
+  // DMA is already running and I2S was halted, start it now
+  portENTER_CRITICAL_ISR(&i2sStartMux);
+  if (i2sStartArmed == true) {
+    i2s_ll_tx_start(I2S_LL_GET_HW(i2sNum));
+    i2sStart_us = esp_timer_get_time();
+    i2sStartArmed = false;
+  }
+  portEXIT_CRITICAL_ISR(&i2sStartMux);
+#endif
+
   // Notify the task in the task's notification value.
   xTaskNotifyFromISR(playerTaskHandle, (uint32_t)timer_counter_value,
                      eSetValueWithOverwrite, &xHigherPriorityTaskWoken);
@@ -845,11 +1727,11 @@ int8_t free_pcm_chunk_fragments(pcm_chunk_fragment_t *fragment) {
   // free all fragments recursive
   if (fragment->nextFragment == NULL) {
     if (fragment->payload != NULL) {
-      free(fragment->payload);
+      audio_free_tag(AUDIO_MEM_TAG_CHUNK, fragment->payload);
       fragment->payload = NULL;
     }
 
-    free(fragment);
+    audio_free_tag(AUDIO_MEM_TAG_CHUNK, fragment);
     fragment = NULL;
   } else {
     free_pcm_chunk_fragments(fragment->nextFragment);
@@ -871,7 +1753,7 @@ int8_t free_pcm_chunk(pcm_chunk_message_t *pcmChunk) {
   free_pcm_chunk_fragments(pcmChunk->fragment);
   pcmChunk->fragment = NULL;  // was freed in free_pcm_chunk_fragments()
 
-  free(pcmChunk);
+  audio_free_tag(AUDIO_MEM_TAG_CHUNK, pcmChunk);
   pcmChunk = NULL;
 
   return 0;
@@ -897,7 +1779,8 @@ int32_t allocate_pcm_chunk_memory_caps(pcm_chunk_message_t *pcmChunk,
     if ((freeMem >= bytes) && (largestFreeBlock >= bytes)) {
       // ESP_LOGI(TAG, "32b f %d b %d", freeMem, largestFreeBlock);
 
-      pcmChunk->fragment->payload = (char *)heap_caps_malloc(bytes, caps);
+      pcmChunk->fragment->payload =
+          (char *)audio_malloc_caps_tag(AUDIO_MEM_TAG_CHUNK, bytes, caps);
       if (pcmChunk->fragment->payload == NULL) {
         ESP_LOGD(TAG, "Failed to allocate %d bytes of %s for pcm chunk payload",
                  bytes,
@@ -917,7 +1800,8 @@ int32_t allocate_pcm_chunk_memory_caps(pcm_chunk_message_t *pcmChunk,
       // freemem: %d blocksize %d", bytes, freeMem, largestFreeBlock);
     }
   } else {
-    pcmChunk->fragment->payload = (char *)malloc(bytes);
+    pcmChunk->fragment->payload =
+        (char *)audio_malloc_tag(AUDIO_MEM_TAG_CHUNK, bytes);
     if (pcmChunk->fragment->payload == NULL) {
       ESP_LOGE(TAG, "Failed to malloc memory for pcm chunk payload");
 
@@ -952,7 +1836,8 @@ int32_t allocate_pcm_chunk_memory_caps_fragmented(pcm_chunk_message_t *pcmChunk,
     // ESP_LOGI(TAG, "32b f %d b %d", freeMem, largestFreeBlock);
 
     if (largestFreeBlock >= bytes) {
-      pcmChunk->fragment->payload = (char *)heap_caps_malloc(bytes, caps);
+      pcmChunk->fragment->payload =
+          (char *)audio_malloc_caps_tag(AUDIO_MEM_TAG_CHUNK, bytes, caps);
       if (pcmChunk->fragment->payload == NULL) {
         ESP_LOGE(TAG, "Failed to allocate IRAM memory for pcm chunk payload");
 
@@ -972,7 +1857,8 @@ int32_t allocate_pcm_chunk_memory_caps_fragmented(pcm_chunk_message_t *pcmChunk,
       pcmChunk->totalSize = 0;
 
       while (remainingBytes) {
-        fragment->payload = (char *)heap_caps_malloc(needBytes, caps);
+        fragment->payload = (char *)audio_malloc_caps_tag(
+            AUDIO_MEM_TAG_CHUNK, needBytes, caps);
         if (fragment->payload == NULL) {
           ESP_LOGE(TAG,
                    "Failed to allocate fragmented IRAM memory for "
@@ -989,8 +1875,8 @@ int32_t allocate_pcm_chunk_memory_caps_fragmented(pcm_chunk_message_t *pcmChunk,
           pcmChunk->totalSize += needBytes;
 
           if (remainingBytes > 0) {
-            fragment->nextFragment =
-                (pcm_chunk_fragment_t *)calloc(1, sizeof(pcm_chunk_fragment_t));
+            fragment->nextFragment = (pcm_chunk_fragment_t *)audio_calloc_tag(
+                AUDIO_MEM_TAG_CHUNK, 1, sizeof(pcm_chunk_fragment_t));
             if (fragment->nextFragment == NULL) {
               ESP_LOGE(TAG,
                        "Failed to fragmented IRAM memory "
@@ -1030,15 +1916,16 @@ int32_t allocate_pcm_chunk_memory(pcm_chunk_message_t **pcmChunk,
                                   size_t bytes) {
   int ret = -3;
 
-  *pcmChunk = (pcm_chunk_message_t *)calloc(1, sizeof(pcm_chunk_message_t));
+  *pcmChunk = (pcm_chunk_message_t *)audio_calloc_tag(
+      AUDIO_MEM_TAG_CHUNK, 1, sizeof(pcm_chunk_message_t));
   if (*pcmChunk == NULL) {
     ESP_LOGE(TAG, "Failed to allocate memory for pcm chunk message");
 
     return -2;
   }
 
-  (*pcmChunk)->fragment =
-      (pcm_chunk_fragment_t *)calloc(1, sizeof(pcm_chunk_fragment_t));
+  (*pcmChunk)->fragment = (pcm_chunk_fragment_t *)audio_calloc_tag(
+      AUDIO_MEM_TAG_CHUNK, 1, sizeof(pcm_chunk_fragment_t));
   if ((*pcmChunk)->fragment == NULL) {
     ESP_LOGE(TAG, "Failed to allocate memory for pcm chunk fragment");
 
@@ -1062,6 +1949,9 @@ int32_t allocate_pcm_chunk_memory(pcm_chunk_message_t **pcmChunk,
                                          MALLOC_CAP_32BIT | MALLOC_CAP_EXEC);
     if (ret < 0) {
       ret = allocate_pcm_chunk_memory_caps(*pcmChunk, bytes, MALLOC_CAP_8BIT);
+      if (ret == 0) {
+        METRICS_COUNT(METRICS_ALLOC_FALLBACK, 1);
+      }
       //      if (ret < 0) {
       //        //      ret = allocate_pcm_chunk_memory_caps_fragmented
       //        //(*pcmChunk, bytes, MALLOC_CAP_32BIT | MALLOC_CAP_EXEC);
@@ -1073,48 +1963,384 @@ int32_t allocate_pcm_chunk_memory(pcm_chunk_message_t **pcmChunk,
       //      }
     }
 
-    if (ret < 0) {
-      vTaskDelay(pdMS_TO_TICKS(1));
-    } else {
-      break;
-    }
+    if (ret < 0) {
+      vTaskDelay(pdMS_TO_TICKS(1));
+    } else {
+      break;
+    }
+  }
+#endif
+
+  if (ret < 0) {
+    METRICS_COUNT(METRICS_ALLOC_FAIL, 1);
+
+    ESP_LOGW(TAG,
+             "couldn't get memory to insert chunk, inserting an chunk "
+             "containing just 0");
+
+    //    xSemaphoreTake(playerPcmQueueMux, portMAX_DELAY);
+    //    ESP_LOGW(
+    //        TAG, "%d, %d, %d, %d, %d",
+    //        heap_caps_get_free_size(MALLOC_CAP_8BIT),
+    //        heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+    //        uxQueueMessagesWaiting(pcmChkQHdl),
+    //        heap_caps_get_free_size(MALLOC_CAP_32BIT | MALLOC_CAP_EXEC),
+    //        heap_caps_get_largest_free_block(MALLOC_CAP_32BIT |
+    //        MALLOC_CAP_EXEC));
+    //    xSemaphoreGive(playerPcmQueueMux);
+
+    ESP_LOGW(
+        TAG, "%d, %d, %d, %d", heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+        heap_caps_get_free_size(MALLOC_CAP_32BIT | MALLOC_CAP_EXEC),
+        heap_caps_get_largest_free_block(MALLOC_CAP_32BIT | MALLOC_CAP_EXEC));
+
+    // simulate a chunk of all samples 0,
+    // player_task() will know what to do with this
+    (*pcmChunk)->fragment->payload = NULL;
+    (*pcmChunk)->totalSize = bytes;
+    (*pcmChunk)->fragment->nextFragment = NULL;
+    (*pcmChunk)->fragment->size = bytes;
+
+    ret = 0;
+  } else {
+    // ESP_LOGI (TAG, "got memory for pcm chunk %p %p %d", *pcmChunk,
+    // (*pcmChunk)->fragment->payload, bytes);
+  }
+
+  return ret;
+}
+
+/**
+ *
+ */
+int32_t insert_pcm_chunk(pcm_chunk_message_t *pcmChunk) {
+  if (pcmChunk == NULL) {
+    ESP_LOGE(TAG, "Parameter Error");
+
+    return -1;
+  }
+
+  if (player_get_clock_lock() == CLOCK_UNLOCKED) {
+    free_pcm_chunk(pcmChunk);
+
+    //    ESP_LOGW(TAG, "%s: wait for initial latency measurement to finish",
+    //    __func__);
+
+    return -3;
+  }
+
+  METRICS_SPAN_BEGIN(span);
+
+  xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+
+  if (pcmChkQHdl == NULL) {
+    xSemaphoreGive(pcmChkQMux);
+
+    ESP_LOGW(TAG, "pcm chunk queue not created");
+
+    free_pcm_chunk(pcmChunk);
+
+    return -2;
+  }
+
+  if (formatBoundaryGen != formatGen) {
+    formatBoundaryGen = formatGen;
+    formatBoundary_us = (int64_t)pcmChunk->timestamp.sec * 1000000LL +
+                        (int64_t)pcmChunk->timestamp.usec;
+  }
+
+  //  if (uxQueueSpacesAvailable(pcmChkQHdl) == 0) {
+  //    pcm_chunk_message_t *element;
+  //
+  //    xQueueReceive(pcmChkQHdl, &element, portMAX_DELAY);
+  //
+  //    free_pcm_chunk(element);
+  //  }
+
+  // if (xQueueSend(pcmChkQHdl, &pcmChunk, pdMS_TO_TICKS(10)) != pdTRUE) {
+  if (xQueueSend(pcmChkQHdl, &pcmChunk, pdMS_TO_TICKS(1)) != pdTRUE) {
+    queueStats.dropped++;
+
+    TRACE_EVENT(TRACE_EVT_QUEUE_FULL, uxQueueMessagesWaiting(pcmChkQHdl),
+                queueStats.dropped);
+
+    free_pcm_chunk(pcmChunk);
+  } else {
+    UBaseType_t waiting = uxQueueMessagesWaiting(pcmChkQHdl);
+
+    xEventGroupSetBits(playerEventGroup, PLAYER_EVT_CHUNK_QUEUED);
+
+    if (waiting > queueStats.highWater) {
+      queueStats.highWater = waiting;
+    }
+
+    if (startStats.firstChunk_us == 0) {
+      startStats.firstChunk_us = esp_timer_get_time();
+    }
+  }
+
+  xSemaphoreGive(pcmChkQMux);
+
+  METRICS_SPAN_END(span, METRICS_HIST_INSERT_WAIT);
+
+  return 0;
+}
+
+/**
+ *
+ */
+int32_t pcm_chunk_queue_msg_waiting(void) {
+  int ret = 0;
+
+  xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+  if (pcmChkQHdl) {
+    ret = uxQueueMessagesWaiting(pcmChkQHdl);
+  }
+  xSemaphoreGive(pcmChkQMux);
+
+#if USE_PSRAM_BOUNCE
+  if (bounceQHdl) {
+    ret += uxQueueMessagesWaiting(bounceQHdl);
+  }
+#endif
+
+  return ret;
+}
+
+/**
+ * Called by http task before it reads more data from the server. If the
+ * chunk queue is almost full we stop reading, so TCP flow control throttles
+ * the server instead of us dropping chunks. Time sync replies are
+ * timestamped on arrival by the netconn callback, so delaying their parsing
+ * doesn't hurt. Returns -1 if there still is no space after maxWait.
+ */
+int32_t pcm_chunk_queue_wait_space(TickType_t maxWait) {
+  TickType_t startTick = xTaskGetTickCount();
+  int64_t start_us = 0;
+  int32_t ret = 0;
+
+  while (1) {
+    UBaseType_t spaces = PCM_QUEUE_RESERVE;
+    TickType_t waited;
+
+    xEventGroupClearBits(playerEventGroup, PLAYER_EVT_QUEUE_SPACE);
+
+    xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+    if (pcmChkQHdl != NULL) {
+      spaces = uxQueueSpacesAvailable(pcmChkQHdl);
+    }
+    xSemaphoreGive(pcmChkQMux);
+
+    if (spaces >= PCM_QUEUE_RESERVE) {
+      break;
+    }
+
+    if (start_us == 0) {
+      start_us = esp_timer_get_time();
+    }
+
+    waited = xTaskGetTickCount() - startTick;
+    if (waited >= maxWait) {
+      ret = -1;
+
+      break;
+    }
+
+    xEventGroupWaitBits(playerEventGroup, PLAYER_EVT_QUEUE_SPACE, pdTRUE,
+                        pdFALSE, maxWait - waited);
+  }
+
+  if (start_us != 0) {
+    xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+    queueStats.throttleCnt++;
+    queueStats.throttled_us += esp_timer_get_time() - start_us;
+    xSemaphoreGive(pcmChkQMux);
+  }
+
+  return ret;
+}
+
+#if USE_PSRAM_BOUNCE
+/**
+ * Copy chunk payload from PSRAM to a single fragment in internal RAM. If
+ * there is no internal RAM left the chunk is returned unchanged and played
+ * from PSRAM.
+ */
+static void pcm_chunk_bounce(pcm_chunk_message_t *chnk) {
+  pcm_chunk_fragment_t *fragment = chnk->fragment;
+  pcm_chunk_fragment_t *next;
+  const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+  char *payload;
+  size_t offset = 0;
+  int64_t start_us, copy_us;
+
+  // chunk containing just 0, nothing to copy
+  if ((fragment == NULL) || (fragment->payload == NULL)) {
+    return;
+  }
+
+  payload =
+      (char *)audio_malloc_caps_tag(AUDIO_MEM_TAG_CHUNK, chnk->totalSize, caps);
+  if (payload == NULL) {
+    portENTER_CRITICAL(&bounceStatsMux);
+    bounceStats.fallbacks++;
+    portEXIT_CRITICAL(&bounceStatsMux);
+
+    return;
+  }
+
+  start_us = esp_timer_get_time();
+  while ((fragment != NULL) && (offset < chnk->totalSize)) {
+    size_t len = fragment->size;
+
+    if (offset + len > chnk->totalSize) {
+      len = chnk->totalSize - offset;
+    }
+    memcpy(&payload[offset], fragment->payload, len);
+    offset += len;
+    fragment = fragment->nextFragment;
+  }
+  copy_us = esp_timer_get_time() - start_us;
+
+  // keep first fragment, free the rest and old payload
+  fragment = chnk->fragment->nextFragment;
+  while (fragment != NULL) {
+    next = fragment->nextFragment;
+    audio_free_tag(AUDIO_MEM_TAG_CHUNK, fragment->payload);
+    audio_free_tag(AUDIO_MEM_TAG_CHUNK, fragment);
+    fragment = next;
+  }
+  audio_free_tag(AUDIO_MEM_TAG_CHUNK, chnk->fragment->payload);
+
+  chnk->fragment->payload = payload;
+  chnk->fragment->size = chnk->totalSize;
+  chnk->fragment->nextFragment = NULL;
+  chnk->caps = caps;
+
+  portENTER_CRITICAL(&bounceStatsMux);
+  bounceStats.chunks++;
+  bounceStats.bytes += chnk->totalSize;
+  bounceStats.copy_us += copy_us;
+  if (copy_us > bounceStats.copyMax_us) {
+    bounceStats.copyMax_us = copy_us;
+  }
+  portEXIT_CRITICAL(&bounceStatsMux);
+}
+
+/**
+ * Low priority mover, keeps bounceQHdl filled from pcmChkQHdl so player_task
+ * never reads PSRAM while feeding DMA
+ */
+static void pcm_chunk_bounce_task(void *pvParameters) {
+  pcm_chunk_message_t *chnk;
+  EventBits_t waitFor;
+
+  while (1) {
+    chnk = NULL;
+    waitFor = PLAYER_EVT_CHUNK_QUEUED;
+
+    xEventGroupClearBits(playerEventGroup,
+                         PLAYER_EVT_CHUNK_QUEUED | PLAYER_EVT_BOUNCE_SPACE);
+
+    // pcmChkQHdl may be replaced, so never block on it. Only take a chunk if
+    // there is room for it in bounceQHdl, we are the only sender so it is
+    // still there after the copy.
+    xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+    if (uxQueueSpacesAvailable(bounceQHdl) == 0) {
+      waitFor = PLAYER_EVT_BOUNCE_SPACE;
+    } else if ((pcmChkQHdl != NULL) &&
+               (xQueueReceive(pcmChkQHdl, &chnk, 0) == pdTRUE)) {
+      bounceChunk = chnk;
+    }
+    xSemaphoreGive(pcmChkQMux);
+
+    if (chnk == NULL) {
+      xEventGroupWaitBits(playerEventGroup, waitFor, pdTRUE, pdFALSE,
+                          portMAX_DELAY);
+
+      continue;
+    }
+
+    xEventGroupSetBits(playerEventGroup, PLAYER_EVT_QUEUE_SPACE);
+
+    // http task can queue chunks while we copy
+    pcm_chunk_bounce(chnk);
+
+    xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+    xQueueSend(bounceQHdl, &chnk, 0);
+    bounceChunk = NULL;
+    xSemaphoreGive(pcmChkQMux);
+  }
+}
+
+/**
+ *
+ */
+int32_t player_get_bounce_stats(player_bounce_stats_t *stats) {
+  if (stats == NULL) {
+    return -1;
+  }
+
+  portENTER_CRITICAL(&bounceStatsMux);
+  *stats = bounceStats;
+  portEXIT_CRITICAL(&bounceStatsMux);
+
+  return 0;
+}
+#else
+/**
+ *
+ */
+int32_t player_get_bounce_stats(player_bounce_stats_t *stats) { return -1; }
+#endif
+
+/**
+ * take next chunk from queue and let http task know there is space again
+ */
+static BaseType_t pcm_chunk_queue_receive(pcm_chunk_message_t **chnk,
+                                          TickType_t wait) {
+#if USE_PSRAM_BOUNCE
+  // mover signals free space when it takes chunks from pcmChkQHdl
+  BaseType_t ret = xQueueReceive(bounceQHdl, chnk, wait);
+
+  if (ret == pdTRUE) {
+    xEventGroupSetBits(playerEventGroup, PLAYER_EVT_BOUNCE_SPACE);
   }
-#endif
 
-  if (ret < 0) {
-    ESP_LOGW(TAG,
-             "couldn't get memory to insert chunk, inserting an chunk "
-             "containing just 0");
+  return ret;
+#else
+  BaseType_t ret = xQueueReceive(pcmChkQHdl, chnk, wait);
 
-    //    xSemaphoreTake(playerPcmQueueMux, portMAX_DELAY);
-    //    ESP_LOGW(
-    //        TAG, "%d, %d, %d, %d, %d",
-    //        heap_caps_get_free_size(MALLOC_CAP_8BIT),
-    //        heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
-    //        uxQueueMessagesWaiting(pcmChkQHdl),
-    //        heap_caps_get_free_size(MALLOC_CAP_32BIT | MALLOC_CAP_EXEC),
-    //        heap_caps_get_largest_free_block(MALLOC_CAP_32BIT |
-    //        MALLOC_CAP_EXEC));
-    //    xSemaphoreGive(playerPcmQueueMux);
+  if (ret == pdTRUE) {
+    xEventGroupSetBits(playerEventGroup, PLAYER_EVT_QUEUE_SPACE);
+  }
 
-    ESP_LOGW(
-        TAG, "%d, %d, %d, %d", heap_caps_get_free_size(MALLOC_CAP_8BIT),
-        heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
-        heap_caps_get_free_size(MALLOC_CAP_32BIT | MALLOC_CAP_EXEC),
-        heap_caps_get_largest_free_block(MALLOC_CAP_32BIT | MALLOC_CAP_EXEC));
+  return ret;
+#endif
+}
 
-    // simulate a chunk of all samples 0,
-    // player_task() will know what to do with this
-    (*pcmChunk)->fragment->payload = NULL;
-    (*pcmChunk)->totalSize = bytes;
-    (*pcmChunk)->fragment->nextFragment = NULL;
-    (*pcmChunk)->fragment->size = bytes;
+/**
+ * look at next chunk without taking it from queue
+ */
+static BaseType_t pcm_chunk_queue_peek(pcm_chunk_message_t **chnk,
+                                       TickType_t wait) {
+#if USE_PSRAM_BOUNCE
+  return xQueuePeek(bounceQHdl, chnk, wait);
+#else
+  return xQueuePeek(pcmChkQHdl, chnk, wait);
+#endif
+}
 
-    ret = 0;
-  } else {
-    // ESP_LOGI (TAG, "got memory for pcm chunk %p %p %d", *pcmChunk,
-    // (*pcmChunk)->fragment->payload, bytes);
-  }
+/**
+ * chunks waiting for playout, called by player_task only
+ */
+static UBaseType_t pcm_chunk_queue_waiting(void) {
+  UBaseType_t ret = uxQueueMessagesWaiting(pcmChkQHdl);
+
+#if USE_PSRAM_BOUNCE
+  ret += uxQueueMessagesWaiting(bounceQHdl);
+#endif
 
   return ret;
 }
@@ -1122,63 +2348,230 @@ int32_t allocate_pcm_chunk_memory(pcm_chunk_message_t **pcmChunk,
 /**
  *
  */
-int32_t insert_pcm_chunk(pcm_chunk_message_t *pcmChunk) {
-  if (pcmChunk == NULL) {
-    ESP_LOGE(TAG, "Parameter Error");
+int32_t player_get_queue_stats(player_queue_stats_t *stats) {
+  if ((stats == NULL) || (pcmChkQMux == NULL)) {
+    return -1;
+  }
+
+  xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+  *stats = queueStats;
+  xSemaphoreGive(pcmChkQMux);
+
+  return 0;
+}
 
+/**
+ * get times since boot at which the player got ready to play
+ */
+int32_t player_get_start_stats(player_start_stats_t *stats) {
+  if (stats == NULL) {
     return -1;
   }
 
-  bool isFull = false;
-  latency_buffer_full(&isFull, portMAX_DELAY);
-  if (isFull == false) {
-    free_pcm_chunk(pcmChunk);
+  *stats = startStats;
 
-    //    ESP_LOGW(TAG, "%s: wait for initial latency measurement to finish",
-    //    __func__);
+  return 0;
+}
 
-    return -3;
+/**
+ * get resync statistics
+ */
+int32_t player_get_resync_stats(player_resync_stats_t *stats) {
+  if (stats == NULL) {
+    return -1;
   }
 
-  if (pcmChkQHdl == NULL) {
-    ESP_LOGW(TAG, "pcm chunk queue not created");
+  portENTER_CRITICAL(&resyncStatsMux);
+  *stats = resyncStats;
+  portEXIT_CRITICAL(&resyncStatsMux);
 
-    free_pcm_chunk(pcmChunk);
+  portENTER_CRITICAL(&i2sDmaMux);
+  stats->underrunCnt = i2sUnderrunCnt;
+  stats->underrunBytes = i2sUnderrunBytes;
+  portEXIT_CRITICAL(&i2sDmaMux);
 
-    return -2;
+  return 0;
+}
+
+/**
+ * remember when we muted because of a hard resync
+ */
+static void resync_hard_start(void) {
+  // we may fail a few times before playback starts again, count only once
+  if (muteStart_us == 0) {
+    muteStart_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&resyncStatsMux);
+    resyncStats.hardCnt++;
+    portEXIT_CRITICAL(&resyncStatsMux);
   }
+}
 
-  //  if (uxQueueSpacesAvailable(pcmChkQHdl) == 0) {
-  //    pcm_chunk_message_t *element;
-  //
-  //    xQueueReceive(pcmChkQHdl, &element, portMAX_DELAY);
-  //
-  //    free_pcm_chunk(element);
-  //  }
+/**
+ * playback started again after a hard resync, account dropout time
+ */
+static void resync_hard_done(void) {
+  player_resync_stats_t stats;
 
-  // if (xQueueSend(pcmChkQHdl, &pcmChunk, pdMS_TO_TICKS(10)) != pdTRUE) {
-  if (xQueueSend(pcmChkQHdl, &pcmChunk, pdMS_TO_TICKS(1)) != pdTRUE) {
-    ESP_LOGW(TAG, "send: pcmChunkQueue full, messages waiting %d",
-             uxQueueMessagesWaiting(pcmChkQHdl));
+  if (muteStart_us == 0) {
+    return;
+  }
 
-    free_pcm_chunk(pcmChunk);
+  portENTER_CRITICAL(&resyncStatsMux);
+  resyncStats.dropout_us += esp_timer_get_time() - muteStart_us;
+  stats = resyncStats;
+  portEXIT_CRITICAL(&resyncStatsMux);
+
+  muteStart_us = 0;
+
+  ESP_LOGI(TAG,
+           "resync stats: hard %ld, dropout %lldms, soft %ld, skipped %lldms, "
+           "padded %lldms",
+           stats.hardCnt, stats.dropout_us / 1000, stats.softCnt,
+           stats.softSkipped_us / 1000, stats.softPadded_us / 1000);
+}
+
+/**
+ * playback of a new format started, account time without audio since old
+ * format was played out
+ */
+static void resync_reconfig_gap(int64_t gap) {
+  portENTER_CRITICAL(&resyncStatsMux);
+  resyncStats.reconfigCnt++;
+  resyncStats.reconfigGap_us = gap;
+  if (gap > resyncStats.reconfigGapMax_us) {
+    resyncStats.reconfigGapMax_us = gap;
   }
+  portEXIT_CRITICAL(&resyncStatsMux);
 
-  return 0;
+  ESP_LOGI(TAG, "format switched, gap %lldus", gap);
+}
+
+/**
+ * remember how far off we were when starting playback
+ */
+static void resync_start_error(int64_t err) {
+  portENTER_CRITICAL(&resyncStatsMux);
+  resyncStats.startError_us = err;
+  if (llabs(err) > resyncStats.startErrorMax_us) {
+    resyncStats.startErrorMax_us = llabs(err);
+  }
+  portEXIT_CRITICAL(&resyncStatsMux);
+}
+
+#if USE_SOFT_RESYNC
+/**
+ * crossfade n frames from a to b and store the result in out. out may be the
+ * same as b. 24 bit samples are packed little endian.
+ */
+static void soft_resync_crossfade(const uint8_t *a, const uint8_t *b,
+                                  uint8_t *out, uint32_t n, uint8_t ch,
+                                  uint8_t bits) {
+  for (uint32_t i = 0; i < n; i++) {
+    int64_t wb = i + 1;
+    int64_t wa = (int64_t)n + 1 - wb;
+
+    for (uint32_t c = 0; c < ch; c++) {
+      uint32_t k = i * ch + c;
+
+      if (bits == 16) {
+        ((int16_t *)out)[k] = (int16_t)((((const int16_t *)a)[k] * wa +
+                                         ((const int16_t *)b)[k] * wb) /
+                                        ((int64_t)n + 1));
+      } else if (bits == 24) {
+        const uint8_t *sa = &a[k * 3];
+        const uint8_t *sb = &b[k * 3];
+        int32_t va = (int32_t)(((uint32_t)sa[0] << 8) |
+                               ((uint32_t)sa[1] << 16) |
+                               ((uint32_t)sa[2] << 24)) >> 8;
+        int32_t vb = (int32_t)(((uint32_t)sb[0] << 8) |
+                               ((uint32_t)sb[1] << 16) |
+                               ((uint32_t)sb[2] << 24)) >> 8;
+        int32_t v = (int32_t)((va * wa + vb * wb) / ((int64_t)n + 1));
+
+        out[k * 3] = v & 0xff;
+        out[k * 3 + 1] = (v >> 8) & 0xff;
+        out[k * 3 + 2] = (v >> 16) & 0xff;
+      } else {
+        ((int32_t *)out)[k] = (int32_t)((((const int32_t *)a)[k] * wa +
+                                         ((const int32_t *)b)[k] * wb) /
+                                        ((int64_t)n + 1));
+      }
+    }
+  }
 }
 
 /**
+ * Skip (frames > 0) or pad (frames < 0) audio at the current position of a
+ * fragment while the DAC keeps running. A short crossfade is done at the
+ * seam so there are no clicks. Padded audio is written to I2S right away.
  *
+ * @param[in,out] payload current position in fragment, advanced by the
+ *                frames consumed from the fragment
+ * @param[in,out] size bytes left in fragment
+ * @param[out] consumed frames of content consumed from fragment
+ * @param[out] padWritten bytes written to I2S
+ *
+ * @return frames skipped (> 0) or padded (< 0), 0 if fragment is too short
  */
-int32_t pcm_chunk_queue_msg_waiting(void) {
-  int ret = 0;
+static int32_t soft_resync_apply(char **payload, size_t *size,
+                                 int32_t frames, snapcastSetting_t *scSet,
+                                 uint32_t *consumed, size_t *padWritten) {
+  const uint32_t xfade = SOFT_RESYNC_XFADE_FRAMES;
+  size_t frameSize = (scSet->bits >> 3) * scSet->ch;
+  uint32_t available = *size / frameSize;
+  uint32_t n = abs(frames);
+  uint8_t *p = (uint8_t *)*payload;
+
+  *consumed = 0;
+  *padWritten = 0;
+
+  if (((scSet->bits != 16) && (scSet->bits != 24) && (scSet->bits != 32)) ||
+      (frameSize * xfade > sizeof(softResyncBuf)) || (available <= xfade)) {
+    return 0;
+  }
 
-  if (pcmChkQHdl) {
-    ret = uxQueueMessagesWaiting(pcmChkQHdl);
+  if (n > available - xfade) {
+    n = available - xfade;
   }
 
-  return ret;
+  if (frames > 0) {
+    // play a[0..xfade] faded into a[n..n+xfade], continue after that
+    soft_resync_crossfade(p, &p[n * frameSize], &p[n * frameSize], xfade,
+                          scSet->ch, scSet->bits);
+
+    *payload += n * frameSize;
+    *size -= n * frameSize;
+    *consumed = n;
+
+    return n;
+  } else {
+    size_t written = 0;
+
+    // play a[0..n], then a[n..n+xfade] faded into a[0..xfade] and continue
+    // after that, so a[0..n] is played twice
+    if (my_i2s_channel_write(tx_chan, p, n * frameSize, &written,
+                             portMAX_DELAY) != ESP_OK) {
+      ESP_LOGE(TAG, "%s: I2S write error", __func__);
+    }
+    *padWritten += written;
+
+    soft_resync_crossfade(&p[n * frameSize], p, softResyncBuf, xfade,
+                          scSet->ch, scSet->bits);
+    if (my_i2s_channel_write(tx_chan, softResyncBuf, xfade * frameSize,
+                             &written, portMAX_DELAY) != ESP_OK) {
+      ESP_LOGE(TAG, "%s: I2S write error", __func__);
+    }
+    *padWritten += written;
+
+    *payload += xfade * frameSize;
+    *size -= xfade * frameSize;
+    *consumed = xfade;
+
+    return -(int32_t)n;
+  }
 }
+#endif
 
 /**
  *
@@ -1194,11 +2587,10 @@ static void player_task(void *pvParameters) {
   uint32_t notifiedValue;
   snapcastSetting_t scSet;
   uint8_t scSetChgd = 0;
-  uint64_t timer_val;
   int initialSync = 0;
-  int dir = 0;
+#if USE_SAMPLE_INSERTION
   int32_t dir_insert_sample = 0;
-  int64_t insertedSamplesCounter = 0;
+#endif
   int64_t buf_us = 0;
   pcm_chunk_fragment_t *fragment = NULL;
   size_t written;
@@ -1208,16 +2600,26 @@ static void player_task(void *pvParameters) {
   int64_t outputBufferDacTime_us = 0;
   int64_t dmaDescDuration_us = 0;
   size_t alreadyWritten = 0;
+#if USE_SOFT_RESYNC
+  int32_t softResyncFrames = 0;  //!< frames left to skip (> 0) or pad (< 0)
+#endif
+  player_clock_lock_t clockLockState = CLOCK_UNLOCKED;
+  snapcastSetting_t newScSet;
+  bool applyScSet = false;
+  bool formatChangePending = false;  //!< newScSet waits for format boundary
+  uint32_t pendingFormatGen = 0;
+  int64_t playBoundary_us = 0;  //!< chunks before this are in old format
+  int64_t reconfigStart_us = 0;  //!< old format played out completely
+  mem_plan_t memPlan;
+  uint32_t queueEntries = 0;
 
   memset(&scSet, 0, sizeof(snapcastSetting_t));
+  memset(&memPlan, 0, sizeof(mem_plan_t));
 
   ESP_LOGI(TAG, "started sync task");
 
   //  stats_init();
 
-  // create message queue to inform task of changed settings
-  snapcastSettingQueueHandle = xQueueCreate(1, sizeof(uint8_t));
-
   initialSync = 0;
 
   audio_set_mute(true);
@@ -1231,106 +2633,197 @@ static void player_task(void *pvParameters) {
     // reinitialize
     ret = xQueueReceive(snapcastSettingQueueHandle, &scSetChgd, 0);
     if (ret == pdTRUE) {
-      snapcastSetting_t __scSet;
+      player_get_snapcast_settings(&newScSet);
+
+      if ((newScSet.buf_ms > 0) && (newScSet.chkInFrames > 0) &&
+          (newScSet.sr > 0)) {
+        if (((scSet.sr != newScSet.sr) || (scSet.bits != newScSet.bits) ||
+             (scSet.ch != newScSet.ch)) &&
+            (initialSync == 1)) {
+          // keep playing what we got in old format, switch as soon as we
+          // reach the first chunk in new format
+          xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+          pendingFormatGen = formatGen;
+          xSemaphoreGive(pcmChkQMux);
+
+          formatChangePending = true;
+
+          ESP_LOGI(TAG, "format change to %ld:%d:%d pending", newScSet.sr,
+                   newScSet.bits, newScSet.ch);
+        } else {
+          formatChangePending = false;
+          applyScSet = true;
+        }
 
-      player_get_snapcast_settings(&__scSet);
+        gotSnapserverConfig = true;
+      }
+    } else if (gotSnapserverConfig == false) {
+      // ESP_LOGW(TAG, "no snapserver config yet, keep waiting");
 
-      if ((__scSet.buf_ms > 0) && (__scSet.chkInFrames > 0) &&
-          (__scSet.sr > 0)) {
-        buf_us = (int64_t)(__scSet.buf_ms) * 1000LL;
+      xEventGroupWaitBits(playerEventGroup, PLAYER_EVT_CONFIG, pdTRUE, pdFALSE,
+                          portMAX_DELAY);
 
-        clientDacLatency_us = (int64_t)__scSet.cDacLat_ms * 1000LL;
+      continue;
+    }
 
-        if ((scSet.sr != __scSet.sr) || (scSet.bits != __scSet.bits) ||
-            (scSet.ch != __scSet.ch)) {
-          my_i2s_channel_enable(tx_chan);
-          audio_set_mute(true);
-          my_i2s_channel_disable(tx_chan);
+    if ((formatChangePending == true) && (chnk == NULL)) {
+      pcm_chunk_message_t *nextChnk = NULL;
+      bool boundaryReached = (initialSync == 0);
 
-          ret = player_setup_i2s(&__scSet);
-          if (ret < 0) {
-            ESP_LOGE(TAG, "player_setup_i2s failed: %d", ret);
+      if ((boundaryReached == false) && (pcmChkQHdl != NULL)) {
+        // look at next chunk without taking it, it mustn't be played before
+        // we know which format it is in
+        if (pcm_chunk_queue_peek(&nextChnk, pdMS_TO_TICKS(100)) != pdTRUE) {
+          continue;
+        }
 
-            return;
-          }
+        int64_t nextStart = (int64_t)nextChnk->timestamp.sec * 1000000LL +
+                            (int64_t)nextChnk->timestamp.usec;
 
-          dmaDescDuration_us =
-              1000000LL * (int64_t)i2sDmaBufMaxLen / (int64_t)__scSet.sr;
+        xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+        if ((formatBoundaryGen == pendingFormatGen) &&
+            (nextStart >= formatBoundary_us)) {
+          boundaryReached = true;
+        }
+        xSemaphoreGive(pcmChkQMux);
+      }
 
-#if !USE_SAMPLE_INSERTION
-          // force adjust_apll() to set playback speed
-          currentDir = 1;
-          adjust_apll(0);
-#endif
+      if (boundaryReached == true) {
+        int64_t playoutDelay_us;
 
-          initialSync = 0;
+        xSemaphoreTake(pcmChkQMux, portMAX_DELAY);
+        if (formatBoundaryGen == pendingFormatGen) {
+          playBoundary_us = formatBoundary_us;
         }
+        xSemaphoreGive(pcmChkQMux);
 
-        static uint32_t queueCreatedWithChkInFrames = UINT32_MAX;
+        // let old format play out before clock is changed
+        if ((initialSync == 1) &&
+            (i2s_get_playout_delay(scSet.sr, &playoutDelay_us) == 0)) {
+          vTaskDelay(pdMS_TO_TICKS(playoutDelay_us / 1000) + 1);
 
-        if ((scSet.buf_ms != __scSet.buf_ms) ||
-            (queueCreatedWithChkInFrames > __scSet.chkInFrames)) {
-          destroy_pcm_queue(&pcmChkQHdl);
+          reconfigStart_us = esp_timer_get_time();
         }
 
-        if (pcmChkQHdl == NULL) {
-          int entries = ceil(((float)__scSet.sr / (float)__scSet.chkInFrames) *
-                             ((float)__scSet.buf_ms / 1000));
+        formatChangePending = false;
+        applyScSet = true;
+      }
+    }
+
+    if (applyScSet == true) {
+      applyScSet = false;
 
-          // some chunks are placed in DMA buffer
-          // so we can save a little RAM here
-          entries -= (i2sDmaBufMaxLen * i2sDmaBufCnt) / __scSet.chkInFrames;
+      buf_us = (int64_t)(newScSet.buf_ms) * 1000LL;
 
-          queueCreatedWithChkInFrames = __scSet.chkInFrames;
+      clientDacLatency_us = (int64_t)newScSet.cDacLat_ms * 1000LL;
 
-          pcmChkQHdl = xQueueCreate(entries, sizeof(pcm_chunk_message_t *));
+      // plan memory before anything is allocated for the new setting
+      if ((memPlan.decision == MEM_PLAN_NONE) ||
+          (scSet.codec != newScSet.codec) || (scSet.sr != newScSet.sr) ||
+          (scSet.bits != newScSet.bits) || (scSet.ch != newScSet.ch) ||
+          (scSet.buf_ms != newScSet.buf_ms) ||
+          (scSet.chkInFrames != newScSet.chkInFrames)) {
+        uint32_t dmaBufCnt, dmaBufMaxLen, dmaDescLen, refillFrames;
+        uint32_t queued = (pcmChkQHdl != NULL) ? pcm_chunk_queue_waiting() : 0;
 
-          ESP_LOGI(TAG, "created new queue with %d", entries);
+        if (i2s_dma_geometry(&newScSet, &dmaBufCnt, &dmaBufMaxLen,
+                             &dmaDescLen, &refillFrames) == 0) {
+          mem_plan_run(&newScSet, dmaBufCnt * dmaDescLen + refillFrames,
+                       queued, &memPlan);
         }
+      }
 
-        if ((scSet.sr != __scSet.sr) || (scSet.bits != __scSet.bits) ||
-            (scSet.ch != __scSet.ch) || (scSet.buf_ms != __scSet.buf_ms)) {
-          ESP_LOGI(TAG,
-                   "snapserver config changed, buffer %ldms, chunk %ld frames, "
-                   "sample rate %ld, ch %d, bits %d mute %d latency %ld",
-                   __scSet.buf_ms, __scSet.chkInFrames, __scSet.sr, __scSet.ch,
-                   __scSet.bits, __scSet.muted, __scSet.cDacLat_ms);
-        } else {
-          audio_set_mute(__scSet.muted);
-          ESP_LOGI(TAG, "snapserver config changed, mute: %d", __scSet.muted);
+      if ((scSet.sr != newScSet.sr) || (scSet.bits != newScSet.bits) ||
+          (scSet.ch != newScSet.ch)) {
+        // DMA doesn't keep running across the switch. Output is muted and
+        // stopped while I2S is reprogrammed, the new format then starts with
+        // an initial sync at the time of its first chunk. No chunk is
+        // dropped, but there is a short gap of silence, it is counted in
+        // reconfigGap_us.
+        my_i2s_channel_enable(tx_chan);
+        audio_set_mute(true);
+        my_i2s_channel_disable(tx_chan);
+
+        ret = player_setup_i2s(&newScSet);
+        if (ret < 0) {
+          ESP_LOGE(TAG, "player_setup_i2s failed: %d", ret);
+
+          return;
         }
 
-        scSet = __scSet;  // store for next round
+        dmaDescDuration_us =
+            1000000LL * (int64_t)i2sDmaBufMaxLen / (int64_t)newScSet.sr;
 
-        gotSnapserverConfig = true;
+#if !USE_SAMPLE_INSERTION
+        // force adjust_apll() to set playback speed
+        currentDir = 1;
+        adjust_apll(0);
+#endif
+
+#if USE_SOFT_RESYNC
+        // soft_resync_apply() can't crossfade other sample formats, a soft
+        // resync requested for them would never complete
+        syncCtrl.cfg.softResync =
+            (newScSet.bits == 16) || (newScSet.bits == 24) ||
+            (newScSet.bits == 32);
+        softResyncFrames = 0;
+#endif
+
+        initialSync = 0;
       }
 
-    } else if (gotSnapserverConfig == false) {
-      // ESP_LOGW(TAG, "no snapserver config yet, keep waiting");
+      // entries planned by mem_plan_run(), some chunks are placed in DMA
+      // buffer so this is less than buf_ms. Queue only shrinks if buffer
+      // changed or memory is short, so we don't drop buffered chunks
+      // otherwise.
+      if ((memPlan.entries > 0) &&
+          ((pcmChkQHdl == NULL) || (scSet.buf_ms != newScSet.buf_ms) ||
+           (memPlan.entries > queueEntries) ||
+           ((memPlan.decision != MEM_PLAN_ACCEPTED) &&
+            (memPlan.entries != queueEntries)))) {
+        // buffered chunks are kept
+        if (resize_pcm_queue(&pcmChkQHdl, memPlan.entries) == pdPASS) {
+          queueEntries = memPlan.entries;
+        }
+      }
 
-      vTaskDelay(pdMS_TO_TICKS(100));
+      if ((scSet.sr != newScSet.sr) || (scSet.bits != newScSet.bits) ||
+          (scSet.ch != newScSet.ch) || (scSet.buf_ms != newScSet.buf_ms)) {
+        ESP_LOGI(TAG,
+                 "snapserver config changed, buffer %ldms, chunk %ld frames, "
+                 "sample rate %ld, ch %d, bits %d mute %d latency %ld",
+                 newScSet.buf_ms, newScSet.chkInFrames, newScSet.sr,
+                 newScSet.ch, newScSet.bits, newScSet.muted,
+                 newScSet.cDacLat_ms);
+      } else {
+        audio_set_mute(newScSet.muted);
+        ESP_LOGI(TAG, "snapserver config changed, mute: %d", newScSet.muted);
+      }
 
-      continue;
+      scSet = newScSet;  // store for next round
     }
 
     // wait for early time syncs to be ready
-    bool is_full = false;
-    int tmp = latency_buffer_full(&is_full, pdMS_TO_TICKS(1));
-    if (tmp < 0) {
+    if ((xEventGroupWaitBits(playerEventGroup, PLAYER_EVT_CLOCK_LOCKED,
+                             pdFALSE, pdFALSE, portMAX_DELAY) &
+         PLAYER_EVT_CLOCK_LOCKED) == 0) {
+      // ESP_LOGW(TAG, "diff buffer not full");
+
       continue;
-    } else {
-      if (is_full == false) {
-        vTaskDelay(pdMS_TO_TICKS(10));
+    }
 
-        // ESP_LOGW(TAG, "diff buffer not full");
+    // server time estimate will jump when we get fine locked, don't mix ages
+    // from before and after
+    player_clock_lock_t lockState = player_get_clock_lock();
+    if (lockState != clockLockState) {
+      clockLockState = lockState;
 
-        continue;
-      }
+      sync_ctrl_reset(&syncCtrl);
     }
 
     if (chnk == NULL) {
       if (pcmChkQHdl != NULL) {
-        ret = xQueueReceive(pcmChkQHdl, &chnk, pdMS_TO_TICKS(2000));
+        ret = pcm_chunk_queue_receive(&chnk, pdMS_TO_TICKS(2000));
       } else {
         // ESP_LOGE (TAG, "Couldn't get PCM chunk, pcm queue not created");
 
@@ -1339,6 +2832,21 @@ static void player_task(void *pvParameters) {
         continue;
       }
 
+      if ((ret != pdFAIL) && (playBoundary_us != 0)) {
+        int64_t chnkStart = (int64_t)chnk->timestamp.sec * 1000000LL +
+                            (int64_t)chnk->timestamp.usec;
+
+        // left over from before a format switch, can't be played anymore
+        if (chnkStart < playBoundary_us) {
+          free_pcm_chunk(chnk);
+          chnk = NULL;
+
+          continue;
+        }
+
+        playBoundary_us = 0;
+      }
+
       if (ret != pdFAIL) {
         chunkDuration_us =
             1000000LL *
@@ -1357,8 +2865,12 @@ static void player_task(void *pvParameters) {
                            (int64_t)chnk->timestamp.usec;
 
       if (initialSync == 0) {
+        int64_t syncNow_us;
+        size_t frameSize = (scSet.bits >> 3) * scSet.ch;
+        sync_ctrl_start_t start;
+
         if (server_now(&serverNow, &diff2Server) >= 0) {
-          age = serverNow - chunkStart - buf_us + clientDacLatency_us;
+          syncNow_us = esp_timer_get_time();
         } else {
           // ESP_LOGW(TAG, "couldn't get server now");
 
@@ -1367,18 +2879,56 @@ static void player_task(void *pvParameters) {
             chnk = NULL;
           }
 
-          vTaskDelay(pdMS_TO_TICKS(1));
-
+          // clock lock was lost, we'll wait for it above
           continue;
         }
 
-        if (age < 0) {  // get initial sync using hardware timer
-          bool dmaFull = false;
+        fragment = chnk->fragment;
+        p_payload = fragment->payload;
+        size = fragment->size;
+
+        sync_ctrl_input_t ctrlIn = {
+            .serverNow_us = serverNow,
+            .chunkStart_us = chunkStart,
+            .buf_us = buf_us,
+            .dacLatency_us = clientDacLatency_us,
+            .chunkDuration_us = chunkDuration_us,
+            .sr = scSet.sr,
+        };
+
+        sync_ctrl_start(&syncCtrl, &ctrlIn,
+                        (p_payload != NULL) ? size / frameSize : 0, &start);
+        age = start.age_us;
+
+        // controller trims the first chunk if we are late or there isn't
+        // enough time left to load DMA
+        if (start.trimFrames > 0) {
+          p_payload += start.trimFrames * frameSize;
+          size -= start.trimFrames * frameSize;
+          chunkStart += 1000000LL * start.trimFrames / (int64_t)scSet.sr;
+
+          TRACE_EVENT(TRACE_EVT_FIRST_CHUNK_TRIM, start.trimFrames);
+        }
 
-          MEDIANFILTER_Init(&shortMedianFilter);
-          MEDIANFILTER_Init(&miniMedianFilter);
+        if (start.action == SYNC_CTRL_PLAY) {
+          // get initial sync using hardware timer
+          bool dmaFull = false;
+          int64_t start_us;
+          int64_t target_us = syncNow_us - age;
+
+#if USE_I2S_START_FROM_ISR
+          portENTER_CRITICAL(&i2sStartMux);
+          i2sStartArmed = false;
+          i2sStart_us = 0;
+          portEXIT_CRITICAL(&i2sStartMux);
+#endif
 
-          tg0_timer1_start(-age);  // timer with 1µs ticks
+          // timer with 1µs ticks
+          int64_t alarm_us = target_us - esp_timer_get_time();
+          if (alarm_us < 1) {
+            alarm_us = 1;
+          }
+          tg0_timer1_start(alarm_us);
 
           my_i2s_channel_disable(tx_chan);
 
@@ -1388,23 +2938,27 @@ static void player_task(void *pvParameters) {
           while (1) {
             if (chnk == NULL) {
               if (pcmChkQHdl != NULL) {
-                ret = xQueueReceive(pcmChkQHdl, &chnk, pdMS_TO_TICKS(100));
+                ret = pcm_chunk_queue_receive(&chnk, pdMS_TO_TICKS(100));
                 // if (ret != pdFAIL) {
                 //   ESP_LOGI(TAG, "got pcm chunk with size %d",
                 //            chnk->fragment->size);
                 // }
               }
+
+              if (chnk == NULL) {
+                continue;
+              }
+
+              fragment = chnk->fragment;
+              p_payload = fragment->payload;
+              size = fragment->size;
             } else {
               // ESP_LOGI(TAG, "got pcm chunk with size %d",
               // chnk->fragment->size);
             }
 
-            fragment = chnk->fragment;
-            p_payload = fragment->payload;
-            size = fragment->size;
-
-            ESP_ERROR_CHECK(
-                i2s_channel_preload_data(tx_chan, p_payload, size, &written));
+            ESP_ERROR_CHECK(my_i2s_channel_preload_data(tx_chan, p_payload,
+                                                        size, &written));
 
             // check if DMA is full at first try here
             if (written != size) {
@@ -1430,13 +2984,38 @@ static void player_task(void *pvParameters) {
 
               alreadyWritten = 0;
               chunkStart -=
-                  (1000000LL * (int64_t)(i2sDmaBufCnt * i2sDmaBufMaxLen) /
+                  (1000000LL * (int64_t)(i2sDmaBufCnt * i2sDmaDescLen) /
                    (int64_t)scSet.sr);
 
               break;
             }
           }
 
+#if USE_I2S_START_FROM_ISR
+          // let DMA fill I2S FIFO but hold output, timer ISR will start it.
+          // Channel enable starts TX too, as a slave without a clock coming
+          // in it can't send anything until we stopped it again.
+          i2s_ll_tx_set_slave_mod(I2S_LL_GET_HW(i2sNum), true);
+          my_i2s_channel_enable(tx_chan);
+          i2s_ll_tx_stop(I2S_LL_GET_HW(i2sNum));
+          i2s_ll_tx_set_slave_mod(I2S_LL_GET_HW(i2sNum), false);
+
+          portENTER_CRITICAL(&i2sStartMux);
+          i2sStartArmed = true;
+          portEXIT_CRITICAL(&i2sStartMux);
+
+          // alarm may have fired while we were loading DMA
+          if (esp_timer_get_time() >= target_us) {
+            portENTER_CRITICAL(&i2sStartMux);
+            if (i2sStartArmed == true) {
+              i2s_ll_tx_start(I2S_LL_GET_HW(i2sNum));
+              i2sStart_us = esp_timer_get_time();
+              i2sStartArmed = false;
+            }
+            portEXIT_CRITICAL(&i2sStartMux);
+          }
+#endif
+
           // Wait to be notified of a timer interrupt.
           xTaskNotifyWait(pdFALSE,         // Don't clear bits on entry.
                           pdFALSE,         // Don't clear bits on exit.
@@ -1447,13 +3026,43 @@ static void player_task(void *pvParameters) {
 
           my_gptimer_stop(gptimer);
 
+#if USE_I2S_START_FROM_ISR
+          portENTER_CRITICAL(&i2sStartMux);
+          start_us = i2sStart_us;
+          portEXIT_CRITICAL(&i2sStartMux);
+
+          // DMA reference is the time output really started
+          portENTER_CRITICAL(&i2sDmaMux);
+          i2sDmaLastSent_us = start_us;
+          portEXIT_CRITICAL(&i2sDmaMux);
+#else
           my_i2s_channel_enable(tx_chan);
 
-          // get timer value so we can get the real age
-          timer_val = (int64_t)notifiedValue;
+          start_us = esp_timer_get_time();
+#endif
 
           // get actual age after alarm
-          age = (int64_t)timer_val - (-age);
+          age = start_us - target_us;
+
+          resync_start_error(age);
+
+          if (reconfigStart_us != 0) {
+            resync_reconfig_gap(start_us - reconfigStart_us);
+
+            reconfigStart_us = 0;
+          }
+
+          if (startStats.firstSample_us == 0) {
+            startStats.firstSample_us = start_us;
+
+            ESP_LOGI(TAG,
+                     "boot to first sample %lldms (config %lldms, clock lock "
+                     "%lldms, first chunk %lldms, warm start %d)",
+                     startStats.firstSample_us / 1000,
+                     startStats.config_us / 1000,
+                     startStats.clockLocked_us / 1000,
+                     startStats.firstChunk_us / 1000, startStats.warmStart);
+          }
 
           initialSync = 1;
 
@@ -1461,24 +3070,26 @@ static void player_task(void *pvParameters) {
           vTaskDelay(pdMS_TO_TICKS(2));
           audio_set_mute(scSet.muted);
 
-          ESP_LOGI(TAG, "initial sync age: %lldus, chunk duration: %lldus", age,
-                   chunkDuration_us);
+          resync_hard_done();
+
+          TRACE_EVENT(TRACE_EVT_INITIAL_SYNC, age, chunkDuration_us);
 
           if (size == 0) {
             continue;
           }
-        } else if (age >= 0) {
+        } else {
           if (chnk != NULL) {
             free_pcm_chunk(chnk);
             chnk = NULL;
           }
 
-          // get count of chunks we are late for
-          uint32_t c = ceil((float)age / (float)chunkDuration_us);  // round up
+          size = 0;
+
+          // now clear all chunks we are late for
+          uint32_t c = start.dropChunks;
 
-          // now clear all those chunks which are probably late too
           while (c--) {
-            ret = xQueueReceive(pcmChkQHdl, &chnk, pdMS_TO_TICKS(1));
+            ret = pcm_chunk_queue_receive(&chnk, pdMS_TO_TICKS(1));
             if (ret == pdPASS) {
               free_pcm_chunk(chnk);
               chnk = NULL;
@@ -1487,40 +3098,62 @@ static void player_task(void *pvParameters) {
             }
           }
 
-          wifi_ap_record_t ap;
-          esp_wifi_sta_get_ap_info(&ap);
-
           my_gptimer_stop(gptimer);
 
-          ESP_LOGW(TAG,
-                   "RESYNCING HARD 1: age %lldus, latency %lldus, free %d, "
-                   "largest block %d, rssi: %d",
-                   age, diff2Server, heap_caps_get_free_size(MALLOC_CAP_32BIT),
-                   heap_caps_get_largest_free_block(MALLOC_CAP_32BIT), ap.rssi);
-
-          dir = 0;
-
-          insertedSamplesCounter = 0;
+          TRACE_EVENT(TRACE_EVT_RESYNC_HARD_LATE, age,
+                      heap_caps_get_free_size(MALLOC_CAP_32BIT));
 
           audio_set_mute(true);
 
           my_i2s_channel_disable(tx_chan);
 
+          resync_hard_start();
+
           continue;
         }
       }
 
-      const bool enableControlLoop = true;
-
-      const int64_t shortOffset = SHORT_OFFSET;  // µs, softsync
-      const int64_t miniOffset = MINI_OFFSET;    // µs, softsync
-      const int64_t hardResyncThreshold = 2000;  // µs, hard sync
-
       if (initialSync == 1) {
         if (size == 0) {
           fragment = chnk->fragment;
           p_payload = fragment->payload;
           size = fragment->size;
+
+#if USE_SOFT_RESYNC
+          if ((softResyncFrames != 0) && (p_payload != NULL)) {
+            uint32_t consumed;
+            size_t padWritten;
+            int32_t done;
+
+            done = soft_resync_apply(&p_payload, &size, softResyncFrames,
+                                     &scSet, &consumed, &padWritten);
+            if (done != 0) {
+              size_t framesToBytes = (scSet.bits >> 3) * scSet.ch;
+              size_t descBytes = i2sDmaBufMaxLen * framesToBytes;
+              int64_t done_us = 1000000LL * (int64_t)abs(done) /
+                                (int64_t)scSet.sr;
+
+              chunkStart +=
+                  1000000LL * (int64_t)consumed / (int64_t)scSet.sr;
+              alreadyWritten = (alreadyWritten + padWritten) % descBytes;
+
+              softResyncFrames -= done;
+
+              portENTER_CRITICAL(&resyncStatsMux);
+              if (done > 0) {
+                resyncStats.softSkipped_us += done_us;
+              } else {
+                resyncStats.softPadded_us += done_us;
+              }
+              portEXIT_CRITICAL(&resyncStatsMux);
+
+              if (softResyncFrames == 0) {
+                // start over with fresh values
+                sync_ctrl_reset(&syncCtrl);
+              }
+            }
+          }
+#endif
         }
 
         if (p_payload != NULL) {
@@ -1536,7 +3169,7 @@ static void player_task(void *pvParameters) {
             }
 #endif
             int64_t alreadyWrittenTime_us = 0;
-            size_t framesToBytes = (scSet.ch + (scSet.bits >> 3));
+            size_t framesToBytes = (scSet.bits >> 3) * scSet.ch;
             while (size) {
               size_t i2sWriteLen;
               size_t tmpSize = i2sDmaBufMaxLen * framesToBytes;
@@ -1550,8 +3183,8 @@ static void player_task(void *pvParameters) {
               if (size >= tmpSize) {
                 i2sWriteLen = i2sDmaBufMaxLen * framesToBytes - alreadyWritten;
 
-                i2s_channel_write(tx_chan, p_payload, i2sWriteLen, &written,
-                                  portMAX_DELAY);
+                my_i2s_channel_write(tx_chan, p_payload, i2sWriteLen, &written,
+                                     portMAX_DELAY);
 
                 alreadyWrittenTime_us =
                     1000000LL * (int64_t)(alreadyWritten / framesToBytes) /
@@ -1561,7 +3194,7 @@ static void player_task(void *pvParameters) {
                 alreadyWritten = 0;
 
                 outputBufferDacTime_us =
-                    1000000ULL * i2sDmaBufMaxLen * i2sDmaBufCnt / scSet.sr;
+                    1000000ULL * i2sDmaDescLen * i2sDmaBufCnt / scSet.sr;
               } else {  // here we are at the end of a chunk
                 i2sWriteLen = size;
 
@@ -1570,9 +3203,10 @@ static void player_task(void *pvParameters) {
 
                 if (i2sWriteLen + sampleSizeInBytes <= i2sDmaBufMaxLen) {
                   if (dir_insert_sample < 0) {
-                    if (i2s_channel_write(tx_chan, p_payload, sampleSizeInBytes,
-                                          &insertedSamplesWritten,
-                                          portMAX_DELAY) != ESP_OK) {
+                    if (my_i2s_channel_write(tx_chan, p_payload,
+                                             sampleSizeInBytes,
+                                             &insertedSamplesWritten,
+                                             portMAX_DELAY) != ESP_OK) {
                       ESP_LOGE(TAG, "i2s_playback_task:  I2S write error %d",
                                1);
                     }
@@ -1582,8 +3216,8 @@ static void player_task(void *pvParameters) {
                 }
 #endif
 
-                i2s_channel_write(tx_chan, p_payload, i2sWriteLen, &written,
-                                  portMAX_DELAY);
+                my_i2s_channel_write(tx_chan, p_payload, i2sWriteLen, &written,
+                                     portMAX_DELAY);
 
 #if USE_SAMPLE_INSERTION
                 alreadyWritten = written + insertedSamplesWritten;
@@ -1595,7 +3229,7 @@ static void player_task(void *pvParameters) {
                     (int64_t)scSet.sr;
                 chunkStart += alreadyWrittenTime_us;
 
-                outputBufferDacTime_us = (1000000ULL * i2sDmaBufMaxLen *
+                outputBufferDacTime_us = (1000000ULL * i2sDmaDescLen *
                                           (i2sDmaBufCnt - 1) / scSet.sr) +
                                          alreadyWrittenTime_us;
               }
@@ -1604,8 +3238,6 @@ static void player_task(void *pvParameters) {
               p_payload += written;
             }
 
-            dir = 0;
-
             if (size == 0) {
               if (fragment->nextFragment != NULL) {
                 fragment = fragment->nextFragment;
@@ -1616,7 +3248,6 @@ static void player_task(void *pvParameters) {
               } else {
                 free_pcm_chunk(chnk);
                 chnk = NULL;
-                dir = 0;
 
                 break;
               }
@@ -1626,57 +3257,72 @@ static void player_task(void *pvParameters) {
           // here we have an empty fragment because of memory allocation error.
           // fill DMA with zeros so we don't get out of sync
           written = 0;
-          const size_t write_size = 4;
-          uint8_t tmpBuf[write_size];
-
-          memset(tmpBuf, 0, sizeof(tmpBuf));
 
-          do {
-            if (i2s_channel_write(tx_chan, tmpBuf, write_size, &written,
-                                  portMAX_DELAY) != ESP_OK) {
-              ESP_LOGE(TAG, "i2s_playback_task: I2S write error %d/%d", written,
-                       size);
-            }
+          if (my_i2s_channel_write_silence(tx_chan, size, &written,
+                                           portMAX_DELAY) != ESP_OK) {
+            ESP_LOGE(TAG, "i2s_playback_task: I2S write error %d/%d", written,
+                     size);
+          }
 
-            size -= written;
-          } while (size);
+          size = 0;
 
           free_pcm_chunk(chnk);
           chnk = NULL;
         }
 
+        // prefer measured DMA playout over the estimate above
+        int64_t playoutDelay_us;
+        if (i2s_get_playout_delay(scSet.sr, &playoutDelay_us) == 0) {
+          outputBufferDacTime_us = playoutDelay_us;
+        }
+
         if (server_now(&serverNow, &diff2Server) >= 0) {
-          age = serverNow - chunkStart - buf_us + clientDacLatency_us +
-                outputBufferDacTime_us;
+          sync_ctrl_output_t ctrlOut;
+          sync_ctrl_input_t ctrlIn = {
+              .serverNow_us = serverNow,
+              .chunkStart_us = chunkStart,
+              .buf_us = buf_us,
+              .dacLatency_us = clientDacLatency_us,
+              .dmaDelay_us = outputBufferDacTime_us,
+              .chunkDuration_us = chunkDuration_us,
+              .sr = scSet.sr,
+              .queueDepth = pcm_chunk_queue_waiting(),
+              .fineLock = (clockLockState == CLOCK_FINE),
+              .dacPpmValid = dacPpmValid,
+              .dacPpm = dacPpm,
+#if USE_SOFT_RESYNC
+              .softResyncBusy = (softResyncFrames != 0),
+#endif
+          };
+
+          sync_ctrl_update(&syncCtrl, &ctrlIn, &ctrlOut);
+          age = ctrlOut.age_us;
 
-          int64_t shortMedian, miniMedian;
+#if USE_SOFT_RESYNC
+          // skip or pad audio while playing if we aren't off too much
+          if (ctrlOut.action == SYNC_CTRL_SOFT_RESYNC) {
+            softResyncFrames = ctrlOut.softResyncFrames;
 
-          shortMedian = MEDIANFILTER_Insert(&shortMedianFilter, age);
-          miniMedian = MEDIANFILTER_Insert(&miniMedianFilter, age);
+            portENTER_CRITICAL(&resyncStatsMux);
+            resyncStats.softCnt++;
+            portEXIT_CRITICAL(&resyncStatsMux);
 
-          int msgWaiting = uxQueueMessagesWaiting(pcmChkQHdl);
+            TRACE_EVENT(TRACE_EVT_RESYNC_SOFT, ctrlOut.shortMedian_us,
+                        softResyncFrames);
+          }
+#endif
 
           // resync hard if we are getting very late / early.
           // rest gets tuned in through apll speed control or sample insertion
-          if ((msgWaiting == 0) ||
-              (MEDIANFILTER_isFull(&shortMedianFilter, 0) &&
-               ((shortMedian > hardResyncThreshold) ||
-                (shortMedian < -hardResyncThreshold)))) {
+          if (ctrlOut.action == SYNC_CTRL_HARD_RESYNC) {
             if (chnk != NULL) {
               free_pcm_chunk(chnk);
               chnk = NULL;
             }
 
-            wifi_ap_record_t ap;
-            esp_wifi_sta_get_ap_info(&ap);
-
-            ESP_LOGW(TAG,
-                     "RESYNCING HARD 2: age %lldus, latency %lldus, free "
-                     "%d, largest block %d, %d, rssi: %d",
-                     age, diff2Server,
-                     heap_caps_get_free_size(MALLOC_CAP_32BIT),
-                     heap_caps_get_largest_free_block(MALLOC_CAP_32BIT),
-                     msgWaiting, ap.rssi);
+            TRACE_EVENT(TRACE_EVT_RESYNC_HARD, age, ctrlOut.shortMedian_us,
+                        heap_caps_get_free_size(MALLOC_CAP_32BIT),
+                        ctrlIn.queueDepth);
 
             my_gptimer_stop(gptimer);
 
@@ -1684,42 +3330,45 @@ static void player_task(void *pvParameters) {
 
             my_i2s_channel_disable(tx_chan);
 
+            // get fresh samples, our estimate of server time may be off
+            time_sync_request_burst(TIME_SYNC_BURST_RESYNC);
+
+            resync_hard_start();
+
             initialSync = 0;
 
-            insertedSamplesCounter = 0;
+#if USE_SOFT_RESYNC
+            softResyncFrames = 0;
+#endif
 
             continue;
           }
 
 #if USE_SAMPLE_INSERTION  // insert samples to adjust sync
-          if ((enableControlLoop == true) &&
-              (MEDIANFILTER_isFull(&shortMedianFilter, 0))) {
-            if ((shortMedian < -shortOffset) && (miniMedian < -miniOffset) &&
-                (age < -miniOffset)) {  // we are early
-              dir = -1;
-              dir_insert_sample = -1;
-              insertedSamplesCounter += INSERT_SAMPLES;
-            } else if ((shortMedian > shortOffset) &&
-                       (miniMedian > miniOffset) &&
-                       (age > miniOffset)) {  // we are late
-              dir = 1;
-              dir_insert_sample = 1;
-              insertedSamplesCounter -= INSERT_SAMPLES;
-            }
+          if (ctrlOut.insert != 0) {
+            dir_insert_sample = ctrlOut.insert;
           }
 #else  // use APLL to adjust sync
-          if ((enableControlLoop == true) &&
-              (MEDIANFILTER_isFull(&shortMedianFilter, 0))) {
-            if ((shortMedian < -shortOffset) && (miniMedian < -miniOffset) &&
-                (age < -miniOffset)) {  // we are early
-              dir = -1;
-            } else if ((shortMedian > shortOffset) &&
-                       (miniMedian > miniOffset) &&
-                       (age > miniOffset)) {  // we are late
-              dir = 1;
-            }
+          if (ctrlOut.control == true) {
+            adjust_apll(ctrlOut.dir);
+          }
+#endif
 
-            adjust_apll(dir);
+#if USE_SYNC_TELEMETRY
+          if (telemetry_active()) {
+            telemetry_sample_t sample = {
+                .age_us = (int32_t)age,
+                .shortMedian_us = (int32_t)ctrlOut.shortMedian_us,
+                .miniMedian_us = (int32_t)ctrlOut.miniMedian_us,
+                .diff2Server_us = diff2Server,
+                .insertedSamples = (int32_t)ctrlOut.insertedFrames,
+                .dir = ctrlOut.dir,
+                .queueDepth = (ctrlIn.queueDepth > UINT8_MAX)
+                                  ? UINT8_MAX
+                                  : ctrlIn.queueDepth,
+            };
+
+            telemetry_push(&sample);
           }
 #endif
 
@@ -1752,8 +3401,7 @@ static void player_task(void *pvParameters) {
             chnk = NULL;
           }
 
-          vTaskDelay(pdMS_TO_TICKS(1));
-
+          // clock lock was lost, we'll wait for it above
           continue;
         }
       }
@@ -1772,8 +3420,6 @@ static void player_task(void *pvParameters) {
                  uxQueueMessagesWaiting(pcmChkQHdl), sec, msec, usec);
       }
 
-      dir = 0;
-
       initialSync = 0;
 
       audio_set_mute(true);
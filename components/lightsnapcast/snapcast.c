@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "audio_mem.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
 
@@ -154,7 +155,7 @@ char *hello_message_serialize(hello_message_t *msg, size_t *size) {
 
   str_length = strlen(str);
   prefixed_length = str_length + 4;
-  prefixed_str = malloc(prefixed_length);
+  prefixed_str = audio_malloc_tag(AUDIO_MEM_TAG_NET, prefixed_length);
   if (!prefixed_str) {
     return NULL;
   }
@@ -164,7 +165,7 @@ char *hello_message_serialize(hello_message_t *msg, size_t *size) {
   prefixed_str[2] = (str_length >> 16) & 0xff;
   prefixed_str[3] = (str_length >> 24) & 0xff;
   memcpy(&(prefixed_str[4]), str, str_length);
-  free(str);
+  cJSON_free(str);
   *size = prefixed_length;
 
   return prefixed_str;
@@ -226,7 +227,7 @@ int codec_header_message_deserialize(codec_header_message_t *msg,
     return 1;
   }
 
-  msg->codec = malloc(string_size + 1);
+  msg->codec = audio_malloc_tag(AUDIO_MEM_TAG_NET, string_size + 1);
   if (!msg->codec) {
     return 2;
   }
@@ -243,7 +244,7 @@ int codec_header_message_deserialize(codec_header_message_t *msg,
     return 1;
   }
 
-  msg->payload = &data[buffer.index];
+  msg->payload = (char *)&data[buffer.index];
 
   return result;
 }
@@ -265,7 +266,7 @@ int wire_chunk_message_deserialize(wire_chunk_message_t *msg, const char *data,
     return result;
   }
 
-  msg->payload = &data[buffer.index];
+  msg->payload = (char *)&data[buffer.index];
 
   // Failed to allocate the memory
   if (!msg->payload) {
@@ -277,7 +278,7 @@ int wire_chunk_message_deserialize(wire_chunk_message_t *msg, const char *data,
 }
 
 void codec_header_message_free(codec_header_message_t *msg) {
-  free(msg->codec);
+  audio_free_tag(AUDIO_MEM_TAG_NET, msg->codec);
   msg->codec = NULL;
 }
 
@@ -0,0 +1,428 @@
+/**
+ * Parser of the snapcast stream
+ *
+ * Headers and length fields are collected byte by byte in hdr, so they may
+ * be split across TCP segments anywhere. Wire chunk payload isn't copied
+ * here, the pieces of the receive buffer are passed on as they are.
+ */
+
+#include "snapcast_parser.h"
+
+#include <string.h>
+
+#include "audio_mem.h"
+#include "esp_log.h"
+
+static const char *TAG = "PARSER";
+
+#define WIRE_CHUNK_HEADER_SIZE 12
+#define LENGTH_FIELD_SIZE 4
+
+enum {
+  PARSER_BASE = 0,
+  PARSER_CHUNK_HEADER,
+  PARSER_CHUNK_DATA,
+  PARSER_CODEC_LEN,
+  PARSER_CODEC_STR,
+  PARSER_CODEC_PAYLOAD_LEN,
+  PARSER_CODEC_PAYLOAD,
+  PARSER_SETTINGS_LEN,
+  PARSER_SETTINGS,
+  PARSER_TIME,
+  PARSER_SKIP,     //!< rest of a known message
+  PARSER_UNKNOWN,  //!< message which isn't handled
+};
+
+/**
+ *
+ */
+static uint16_t parser_le16(const uint8_t *b) {
+  return (uint16_t)b[0] | ((uint16_t)b[1] << 8);
+}
+
+/**
+ *
+ */
+static uint32_t parser_le32(const uint8_t *b) {
+  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) |
+         ((uint32_t)b[3] << 24);
+}
+
+/**
+ * collect bytes of a header or length field in hdr, typedPos is only valid
+ * for fields of typed messages
+ *
+ * @return bytes consumed
+ */
+static size_t parser_collect(snapcast_parser_t *p, const uint8_t *data,
+                             size_t len, uint32_t size) {
+  size_t n = size - p->fill;
+
+  if (n > len) {
+    n = len;
+  }
+
+  memcpy(&p->hdr[p->fill], data, n);
+  p->fill += n;
+  p->typedPos += n;
+
+  return n;
+}
+
+/**
+ *
+ */
+static void parser_release(snapcast_parser_t *p) {
+  if (p->str) {
+    audio_free_tag(AUDIO_MEM_TAG_NET, p->str);
+    p->str = NULL;
+  }
+
+  if (p->payload) {
+    audio_free_tag(AUDIO_MEM_TAG_NET, p->payload);
+    p->payload = NULL;
+  }
+}
+
+/**
+ * whole typed message was consumed
+ */
+static int parser_end(snapcast_parser_t *p) {
+  const snapcast_parser_cb_t *cb = p->cb;
+  int ret = 0;
+
+  switch (p->state) {
+    case PARSER_CHUNK_DATA:
+      if (cb->chunkEnd) {
+        ret = cb->chunkEnd(p->ctx, &p->chunk, p->skip);
+      }
+      break;
+
+    case PARSER_SKIP:
+      break;
+
+    case PARSER_UNKNOWN:
+      if (p->base.type != SNAPCAST_MESSAGE_STREAM_TAGS) {
+        ESP_LOGI(TAG, "done unknown typed message %d", p->base.type);
+      }
+      break;
+
+    default:
+      ESP_LOGE(TAG, "message %d truncated, size %ld", p->base.type,
+               (long)p->base.size);
+      break;
+  }
+
+  parser_release(p);
+  p->state = PARSER_BASE;
+  p->fill = 0;
+
+  return ret;
+}
+
+/**
+ * base message header is complete
+ */
+static int parser_base(snapcast_parser_t *p) {
+  base_message_t *base = &p->base;
+
+  base->type = parser_le16(&p->hdr[0]);
+  base->id = parser_le16(&p->hdr[2]);
+  base->refersTo = parser_le16(&p->hdr[4]);
+  base->sent.sec = (int32_t)parser_le32(&p->hdr[6]);
+  base->sent.usec = (int32_t)parser_le32(&p->hdr[10]);
+  base->received.sec = (int32_t)parser_le32(&p->hdr[14]);
+  base->received.usec = (int32_t)parser_le32(&p->hdr[18]);
+  base->size = parser_le32(&p->hdr[22]);
+
+  p->fill = 0;
+  p->typedPos = 0;
+
+  if (p->cb->base) {
+    p->cb->base(p->ctx, base, p->pos - 1);
+  }
+
+  switch (base->type) {
+    case SNAPCAST_MESSAGE_WIRE_CHUNK:
+      p->state = PARSER_CHUNK_HEADER;
+      break;
+
+    case SNAPCAST_MESSAGE_CODEC_HEADER:
+      p->state = PARSER_CODEC_LEN;
+      break;
+
+    case SNAPCAST_MESSAGE_SERVER_SETTINGS:
+      p->state = PARSER_SETTINGS_LEN;
+      break;
+
+    case SNAPCAST_MESSAGE_TIME:
+      p->state = PARSER_TIME;
+      break;
+
+    default:
+      p->state = PARSER_UNKNOWN;
+      break;
+  }
+
+  if (base->size == 0) {
+    return parser_end(p);
+  }
+
+  return 0;
+}
+
+/**
+ * length field, string or payload is complete
+ */
+static int parser_field(snapcast_parser_t *p) {
+  const snapcast_parser_cb_t *cb = p->cb;
+  int ret = 0;
+
+  p->fill = 0;
+
+  switch (p->state) {
+    case PARSER_CODEC_LEN:
+    case PARSER_CODEC_PAYLOAD_LEN:
+    case PARSER_SETTINGS_LEN: {
+      char *buf;
+
+      p->len = parser_le32(p->hdr);
+      if (p->len > p->base.size - p->typedPos) {
+        ESP_LOGE(TAG, "message %d: length %ld exceeds message",
+                 p->base.type, (long)p->len);
+
+        parser_release(p);
+        p->state = PARSER_SKIP;
+
+        return 0;
+      }
+
+      // strings are NULL terminated
+      buf = audio_malloc_tag(AUDIO_MEM_TAG_NET, p->len + 1);
+      if (buf == NULL) {
+        ESP_LOGE(TAG, "couldn't get memory for message %d", p->base.type);
+
+        // server settings are optional, go on without them
+        if (p->state != PARSER_SETTINGS_LEN) {
+          return -1;
+        }
+      }
+
+      if (p->state == PARSER_CODEC_PAYLOAD_LEN) {
+        p->payload = buf;
+      } else {
+        p->str = buf;
+      }
+      p->state++;
+
+      // empty string or payload
+      if (p->len == 0) {
+        return parser_field(p);
+      }
+
+      break;
+    }
+
+    case PARSER_CODEC_STR:
+      p->str[p->len] = 0;
+      p->state = PARSER_CODEC_PAYLOAD_LEN;
+      break;
+
+    case PARSER_CODEC_PAYLOAD:
+      if (cb->codecHeader) {
+        ret = cb->codecHeader(p->ctx, p->str, p->payload, p->len);
+      }
+
+      parser_release(p);
+      p->state = PARSER_SKIP;
+      break;
+
+    case PARSER_SETTINGS:
+      if (p->str) {
+        p->str[p->len] = 0;
+
+        if (cb->serverSettings) {
+          ret = cb->serverSettings(p->ctx, p->str);
+        }
+      }
+
+      parser_release(p);
+      p->state = PARSER_SKIP;
+      break;
+
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+/**
+ * consume len bytes of the current typed message
+ */
+static int parser_typed(snapcast_parser_t *p, const uint8_t *data,
+                        size_t len) {
+  const snapcast_parser_cb_t *cb = p->cb;
+  int ret = 0;
+
+  while ((len > 0) && (ret >= 0)) {
+    size_t n;
+
+    switch (p->state) {
+      case PARSER_CHUNK_HEADER:
+        n = parser_collect(p, data, len, WIRE_CHUNK_HEADER_SIZE);
+        if (p->fill < WIRE_CHUNK_HEADER_SIZE) {
+          break;
+        }
+
+        p->fill = 0;
+        p->chunk.timestamp.sec = (int32_t)parser_le32(&p->hdr[0]);
+        p->chunk.timestamp.usec = (int32_t)parser_le32(&p->hdr[4]);
+        p->chunk.size = parser_le32(&p->hdr[8]);
+        p->chunk.payload = NULL;
+
+        if (p->chunk.size != p->base.size - p->typedPos) {
+          ESP_LOGE(TAG, "wire chunk size %ld doesn't match message",
+                   (long)p->chunk.size);
+
+          p->state = PARSER_SKIP;
+          break;
+        }
+
+        p->skip = false;
+        if (cb->chunkBegin) {
+          p->skip = !cb->chunkBegin(p->ctx, &p->chunk);
+        }
+        p->state = PARSER_CHUNK_DATA;
+        break;
+
+      case PARSER_CHUNK_DATA:
+        n = len;
+        p->typedPos += n;
+        if ((p->skip == false) && cb->chunkData) {
+          ret = cb->chunkData(p->ctx, data, n);
+        }
+        break;
+
+      case PARSER_CODEC_LEN:
+      case PARSER_CODEC_PAYLOAD_LEN:
+      case PARSER_SETTINGS_LEN:
+        n = parser_collect(p, data, len, LENGTH_FIELD_SIZE);
+        if (p->fill == LENGTH_FIELD_SIZE) {
+          ret = parser_field(p);
+        }
+        break;
+
+      case PARSER_CODEC_STR:
+      case PARSER_CODEC_PAYLOAD:
+      case PARSER_SETTINGS: {
+        char *buf = (p->state == PARSER_CODEC_PAYLOAD) ? p->payload : p->str;
+
+        n = p->len - p->fill;
+        if (n > len) {
+          n = len;
+        }
+
+        if (buf) {
+          memcpy(&buf[p->fill], data, n);
+        }
+        p->fill += n;
+        p->typedPos += n;
+
+        if (p->fill == p->len) {
+          ret = parser_field(p);
+        }
+        break;
+      }
+
+      case PARSER_TIME:
+        n = parser_collect(p, data, len, TIME_MESSAGE_SIZE);
+        if (p->fill < TIME_MESSAGE_SIZE) {
+          break;
+        }
+
+        p->fill = 0;
+        p->time.latency.sec = (int32_t)parser_le32(&p->hdr[0]);
+        p->time.latency.usec = (int32_t)parser_le32(&p->hdr[4]);
+
+        if (cb->time) {
+          ret = cb->time(p->ctx, &p->base, &p->time);
+        }
+        p->state = PARSER_SKIP;
+        break;
+
+      default:
+        n = len;
+        p->typedPos += n;
+        break;
+    }
+
+    data += n;
+    len -= n;
+  }
+
+  return ret;
+}
+
+/**
+ *
+ */
+void snapcast_parser_init(snapcast_parser_t *parser,
+                          const snapcast_parser_cb_t *cb, void *ctx) {
+  memset(parser, 0, sizeof(snapcast_parser_t));
+
+  parser->cb = cb;
+  parser->ctx = ctx;
+  parser->state = PARSER_BASE;
+}
+
+/**
+ * Parse the next piece of the stream.
+ *
+ * @return 0 on success, -1 if a callback failed or memory ran out
+ */
+int snapcast_parser_feed(snapcast_parser_t *parser, const uint8_t *data,
+                         size_t len) {
+  int ret = 0;
+
+  while ((len > 0) && (ret >= 0)) {
+    size_t n;
+
+    if (parser->state == PARSER_BASE) {
+      n = parser_collect(parser, data, len, BASE_MESSAGE_SIZE);
+      parser->pos += n;
+
+      if (parser->fill == BASE_MESSAGE_SIZE) {
+        ret = parser_base(parser);
+      }
+    } else {
+      n = parser->base.size - parser->typedPos;
+      if (n > len) {
+        n = len;
+      }
+
+      ret = parser_typed(parser, data, n);
+      parser->pos += n;
+
+      if ((ret >= 0) && (parser->typedPos >= parser->base.size)) {
+        ret = parser_end(parser);
+      }
+    }
+
+    data += n;
+    len -= n;
+  }
+
+  return (ret < 0) ? -1 : 0;
+}
+
+/**
+ * free memory of a partly received message and start over
+ */
+void snapcast_parser_free(snapcast_parser_t *parser) {
+  parser_release(parser);
+
+  parser->state = PARSER_BASE;
+  parser->fill = 0;
+  parser->typedPos = 0;
+}
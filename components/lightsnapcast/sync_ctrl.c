@@ -0,0 +1,253 @@
+/**
+ * Sync control loop of the player
+ *
+ * Decides from timestamps, queue depth and DMA state when playback starts
+ * and how it is corrected while playing: sample insertion or APLL direction,
+ * soft and hard resyncs. Nothing here touches I2S, timers or queues, the
+ * player applies the decisions. This keeps the algorithm testable on the
+ * host, see host/sync_ctrl_sim.c, and lets alternatives be swapped in with
+ * CONFIG_SYNC_CONTROLLER_*.
+ *
+ * age is how late the frame at chunkStart_us will be played, it is > 0 if
+ * we are late.
+ */
+
+#include "sync_ctrl.h"
+
+#include <string.h>
+
+/**
+ *
+ */
+void sync_ctrl_init(sync_ctrl_t *ctrl, const sync_ctrl_config_t *cfg) {
+  memset(ctrl, 0, sizeof(sync_ctrl_t));
+  ctrl->cfg = *cfg;
+
+  ctrl->shortMedianFilter.numNodes = SHORT_BUFFER_LEN;
+  ctrl->shortMedianFilter.medianBuffer = ctrl->shortMedianBuffer;
+  ctrl->miniMedianFilter.numNodes = MINI_BUFFER_LEN;
+  ctrl->miniMedianFilter.medianBuffer = ctrl->miniMedianBuffer;
+
+  sync_ctrl_reset(ctrl);
+}
+
+/**
+ * forget ages measured so far, e.g. after the server time estimate jumped
+ */
+void sync_ctrl_reset(sync_ctrl_t *ctrl) {
+  MEDIANFILTER_Init(&ctrl->shortMedianFilter);
+  MEDIANFILTER_Init(&ctrl->miniMedianFilter);
+}
+
+/**
+ * Initial sync. If we are late or there isn't enough time left to load DMA
+ * the exact number of frames is trimmed from the first chunk instead of
+ * dropping whole chunks.
+ *
+ * @param availFrames frames in first fragment of the chunk, 0 if there is
+ *                    no payload
+ */
+void sync_ctrl_start(sync_ctrl_t *ctrl, const sync_ctrl_input_t *in,
+                     uint32_t availFrames, sync_ctrl_start_t *out) {
+  int64_t margin = ctrl->cfg.startMargin_us;
+  int64_t age =
+      in->serverNow_us - in->chunkStart_us - in->buf_us + in->dacLatency_us;
+
+  memset(out, 0, sizeof(sync_ctrl_start_t));
+
+  if ((age > -margin) && (availFrames > 0) && (in->sr > 0)) {
+    int64_t trimFrames =
+        ((age + margin) * (int64_t)in->sr + 999999LL) / 1000000LL;
+
+    if (trimFrames < availFrames) {
+      out->trimFrames = trimFrames;
+      age -= 1000000LL * trimFrames / (int64_t)in->sr;
+    }
+  }
+
+  out->age_us = age;
+
+  if (age < 0) {
+    out->action = SYNC_CTRL_PLAY;
+
+    sync_ctrl_reset(ctrl);
+    ctrl->insertedFrames = 0;
+    ctrl->integral_ppm = 0;
+    ctrl->pending_us = 0;
+  } else {
+    out->action = SYNC_CTRL_HARD_RESYNC;
+
+    // chunks we are late for, rounded up
+    if (in->chunkDuration_us > 0) {
+      out->dropChunks =
+          (age + in->chunkDuration_us - 1) / in->chunkDuration_us;
+    }
+  }
+}
+
+/**
+ * act if both medians and the latest age agree we are off by more than the
+ * offsets, sample insertion feeds forward the measured DAC deviation
+ */
+static void sync_ctrl_median(sync_ctrl_t *ctrl, const sync_ctrl_input_t *in,
+                             sync_ctrl_output_t *out) {
+  const sync_ctrl_config_t *cfg = &ctrl->cfg;
+  int64_t age = out->age_us;
+
+  out->control = MEDIANFILTER_isFull(&ctrl->shortMedianFilter, 0);
+  if (out->control == false) {
+    return;
+  }
+
+  if ((out->shortMedian_us < -cfg->shortOffset_us) &&
+      (out->miniMedian_us < -cfg->miniOffset_us) &&
+      (age < -cfg->miniOffset_us)) {  // we are early
+    out->dir = -1;
+  } else if ((out->shortMedian_us > cfg->shortOffset_us) &&
+             (out->miniMedian_us > cfg->miniOffset_us) &&
+             (age > cfg->miniOffset_us)) {  // we are late
+    out->dir = 1;
+  }
+
+  if (cfg->mode != SYNC_CTRL_MODE_INSERT) {
+    return;
+  }
+
+  if (out->dir != 0) {
+    out->insert = out->dir;
+  } else if (in->dacPpmValid == true) {
+    // feed forward measured DAC clock deviation so we don't have to wait for
+    // the error to show up in the medians, the above takes care of what's
+    // left (e.g. CPU vs. server clock)
+    int64_t insertDuration_us =
+        1000000LL * cfg->insertFrames / (int64_t)in->sr;
+
+    ctrl->dacDrift_us -=
+        (int64_t)((float)in->chunkDuration_us * in->dacPpm / 1000000.0);
+    if (ctrl->dacDrift_us <= -insertDuration_us) {  // getting early
+      out->insert = -1;
+      ctrl->dacDrift_us += insertDuration_us;
+    } else if (ctrl->dacDrift_us >= insertDuration_us) {  // getting late
+      out->insert = 1;
+      ctrl->dacDrift_us -= insertDuration_us;
+    }
+  }
+}
+
+/**
+ * PI controller on the mini median. The correction in ppm is turned into
+ * single insertions or APLL steps by accumulating it until a step is due.
+ */
+static void sync_ctrl_pi(sync_ctrl_t *ctrl, const sync_ctrl_input_t *in,
+                         sync_ctrl_output_t *out) {
+  const sync_ctrl_config_t *cfg = &ctrl->cfg;
+  float err = (float)out->miniMedian_us;
+  float dt_s = (float)in->chunkDuration_us / 1000000.0f;
+  float step_us, ppm;
+
+  out->control = MEDIANFILTER_isFull(&ctrl->miniMedianFilter, 0);
+  if (out->control == false) {
+    return;
+  }
+
+  ctrl->integral_ppm += SYNC_CTRL_PI_KI * err * dt_s;
+  if (ctrl->integral_ppm > SYNC_CTRL_PI_MAX_PPM) {
+    ctrl->integral_ppm = SYNC_CTRL_PI_MAX_PPM;
+  } else if (ctrl->integral_ppm < -SYNC_CTRL_PI_MAX_PPM) {
+    ctrl->integral_ppm = -SYNC_CTRL_PI_MAX_PPM;
+  }
+
+  // > 0 if we have to play faster
+  ppm = SYNC_CTRL_PI_KP * err + ctrl->integral_ppm;
+
+  if (cfg->mode == SYNC_CTRL_MODE_INSERT) {
+    step_us = 1000000.0f * cfg->insertFrames / (float)in->sr;
+    if (in->dacPpmValid == true) {
+      ppm -= in->dacPpm;
+    }
+  } else {
+    step_us = SYNC_CTRL_APLL_PPM * (float)in->chunkDuration_us / 1000000.0f;
+  }
+
+  ctrl->pending_us += ppm * (float)in->chunkDuration_us / 1000000.0f;
+
+  if (cfg->mode == SYNC_CTRL_MODE_INSERT) {
+    if (ctrl->pending_us >= step_us) {
+      out->dir = 1;
+    } else if (ctrl->pending_us <= -step_us) {
+      out->dir = -1;
+    }
+    out->insert = out->dir;
+  } else {
+    if (ctrl->pending_us >= step_us / 2) {
+      out->dir = 1;
+    } else if (ctrl->pending_us <= -step_us / 2) {
+      out->dir = -1;
+    }
+  }
+
+  ctrl->pending_us -= out->dir * step_us;
+
+  // one step per chunk at most, don't wind up beyond that
+  if (ctrl->pending_us > 2 * step_us) {
+    ctrl->pending_us = 2 * step_us;
+  } else if (ctrl->pending_us < -2 * step_us) {
+    ctrl->pending_us = -2 * step_us;
+  }
+}
+
+/**
+ * Called after a chunk was written to DMA. Resync hard if we are getting
+ * very late or early, or if the queue ran dry. If soft resync is enabled
+ * errors up to softResyncMax_us are skipped or padded instead. The rest is
+ * tuned in through APLL speed control or sample insertion.
+ */
+void sync_ctrl_update(sync_ctrl_t *ctrl, const sync_ctrl_input_t *in,
+                      sync_ctrl_output_t *out) {
+  const sync_ctrl_config_t *cfg = &ctrl->cfg;
+  int64_t threshold =
+      in->fineLock ? cfg->hardResyncFine_us : cfg->hardResyncCoarse_us;
+  int64_t shortMedian;
+  bool shortFull;
+
+  memset(out, 0, sizeof(sync_ctrl_output_t));
+
+  out->age_us = in->serverNow_us - in->chunkStart_us - in->buf_us +
+                in->dacLatency_us + in->dmaDelay_us;
+  out->shortMedian_us =
+      MEDIANFILTER_Insert(&ctrl->shortMedianFilter, out->age_us);
+  out->miniMedian_us =
+      MEDIANFILTER_Insert(&ctrl->miniMedianFilter, out->age_us);
+
+  shortMedian = out->shortMedian_us;
+  shortFull = MEDIANFILTER_isFull(&ctrl->shortMedianFilter, 0);
+
+  if ((cfg->softResync == true) && (in->queueDepth > 0) &&
+      (in->softResyncBusy == false) && (shortFull == true) &&
+      ((shortMedian > threshold) || (shortMedian < -threshold)) &&
+      (shortMedian < cfg->softResyncMax_us) &&
+      (shortMedian > -cfg->softResyncMax_us)) {
+    out->action = SYNC_CTRL_SOFT_RESYNC;
+    out->softResyncFrames =
+        (int32_t)(shortMedian * (int64_t)in->sr / 1000000LL);
+
+    // don't act on old values until it is applied
+    sync_ctrl_reset(ctrl);
+  } else if ((in->queueDepth == 0) ||
+             ((shortFull == true) &&
+              ((shortMedian > threshold) || (shortMedian < -threshold)))) {
+    out->action = SYNC_CTRL_HARD_RESYNC;
+  } else if (in->sr > 0) {
+    out->action = SYNC_CTRL_PLAY;
+
+    if (cfg->algo == SYNC_CTRL_ALGO_PI) {
+      sync_ctrl_pi(ctrl, in, out);
+    } else {
+      sync_ctrl_median(ctrl, in, out);
+    }
+
+    ctrl->insertedFrames -= out->insert * (int64_t)cfg->insertFrames;
+  }
+
+  out->insertedFrames = ctrl->insertedFrames;
+}
@@ -0,0 +1,102 @@
+/**
+ * Sync loop telemetry
+ *
+ * player_task pushes one sample per played chunk to a ring buffer, readers
+ * (e.g. the web UI websocket) pick them up later. There is a single writer
+ * and no lock, a reader detects if samples it copied were overwritten in the
+ * meantime and skips them.
+ *
+ * Nothing is written as long as there are no subscribers, the player only
+ * checks telemetry_active() then.
+ */
+
+#include "telemetry.h"
+
+#include <string.h>
+
+#include "esp_timer.h"
+
+#define TELEMETRY_RING_MASK (TELEMETRY_RING_LEN - 1)
+
+static telemetry_sample_t ring[TELEMETRY_RING_LEN];
+// sequence number of next sample, published after the sample was written
+static uint32_t ringHead = 0;
+static uint32_t subscribers = 0;
+
+/**
+ *
+ */
+void telemetry_subscribe(void) {
+  __atomic_add_fetch(&subscribers, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ *
+ */
+void telemetry_unsubscribe(void) {
+  __atomic_sub_fetch(&subscribers, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ *
+ */
+bool telemetry_active(void) {
+  return __atomic_load_n(&subscribers, __ATOMIC_RELAXED) > 0;
+}
+
+/**
+ * only called from player_task, seq and time_ms are set here
+ */
+void telemetry_push(telemetry_sample_t *sample) {
+  uint32_t head = __atomic_load_n(&ringHead, __ATOMIC_RELAXED);
+
+  sample->seq = head;
+  sample->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+  ring[head & TELEMETRY_RING_MASK] = *sample;
+
+  __atomic_store_n(&ringHead, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copy up to max samples starting at *seq and advance *seq past them.
+ * Samples which were overwritten before they could be read are counted in
+ * *lost. Returns the number of samples copied.
+ */
+uint32_t telemetry_read(uint32_t *seq, telemetry_sample_t *samples,
+                        uint32_t max, uint32_t *lost) {
+  uint32_t head, cnt, valid;
+
+  *lost = 0;
+
+  head = __atomic_load_n(&ringHead, __ATOMIC_ACQUIRE);
+  if ((head - *seq) > TELEMETRY_RING_LEN) {
+    *lost = head - *seq - TELEMETRY_RING_LEN;
+    *seq = head - TELEMETRY_RING_LEN;
+  }
+
+  cnt = head - *seq;
+  if (cnt > max) {
+    cnt = max;
+  }
+
+  for (uint32_t i = 0; i < cnt; i++) {
+    samples[i] = ring[(*seq + i) & TELEMETRY_RING_MASK];
+  }
+
+  // writer may have lapped us while copying. It may be writing sample head
+  // right now, so everything older than head - TELEMETRY_RING_LEN + 1 is gone
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  head = __atomic_load_n(&ringHead, __ATOMIC_ACQUIRE);
+
+  valid = 0;
+  for (uint32_t i = 0; i < cnt; i++) {
+    if ((head - (*seq + i)) < TELEMETRY_RING_LEN) {
+      samples[valid++] = samples[i];
+    }
+  }
+
+  *lost += cnt - valid;
+  *seq += cnt;
+
+  return valid;
+}
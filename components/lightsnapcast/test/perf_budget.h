@@ -0,0 +1,70 @@
+/**
+ * Cycle budgets of test_perf.c
+ *
+ * Counts are CPU cycles per call, averaged over all rounds, so they don't
+ * depend on CPU frequency. Chunks are 16 bit stereo at 48kHz, 1152 frames
+ * (24ms) for FLAC, PCM and DSP and 960 frames (20ms) for opus. A chunk has
+ * 5760000 cycles to spare at 240MHz, decoder and DSP share the core with
+ * network and player. Each budget can be overridden from the build to match
+ * a board, e.g. with PSRAM chunks.
+ */
+
+#ifndef __PERF_BUDGET_H__
+#define __PERF_BUDGET_H__
+
+// FLAC__stream_decoder_process_single() of one 1152 frame block
+#ifndef IDF_PERFORMANCE_MAX_FLAC_DECODE_CYCLES
+#define IDF_PERFORMANCE_MAX_FLAC_DECODE_CYCLES 1200000
+#endif
+
+// opus_decode() of one 20ms CELT frame at 192kbit/s
+#ifndef IDF_PERFORMANCE_MAX_OPUS_DECODE_CYCLES
+#define IDF_PERFORMANCE_MAX_OPUS_DECODE_CYCLES 2400000
+#endif
+
+// FLAC output interleaved and copied to a chunk
+#ifndef IDF_PERFORMANCE_MAX_PCM_CONVERT_FLAC_CYCLES
+#define IDF_PERFORMANCE_MAX_PCM_CONVERT_FLAC_CYCLES 120000
+#endif
+
+// opus output packed into a chunk
+#ifndef IDF_PERFORMANCE_MAX_PCM_CONVERT_OPUS_CYCLES
+#define IDF_PERFORMANCE_MAX_PCM_CONVERT_OPUS_CYCLES 60000
+#endif
+
+// dsp_processor_worker() of one chunk per DSP flow
+#ifndef IDF_PERFORMANCE_MAX_DSP_STEREO_CYCLES
+#define IDF_PERFORMANCE_MAX_DSP_STEREO_CYCLES 300000
+#endif
+#ifndef IDF_PERFORMANCE_MAX_DSP_BASSBOOST_CYCLES
+#define IDF_PERFORMANCE_MAX_DSP_BASSBOOST_CYCLES 600000
+#endif
+#ifndef IDF_PERFORMANCE_MAX_DSP_BIAMP_CYCLES
+#define IDF_PERFORMANCE_MAX_DSP_BIAMP_CYCLES 900000
+#endif
+#ifndef IDF_PERFORMANCE_MAX_DSP_BASS_TREBLE_EQ_CYCLES
+#define IDF_PERFORMANCE_MAX_DSP_BASS_TREBLE_EQ_CYCLES 900000
+#endif
+
+// MEDIANFILTER_Insert() into the player's latency and the short sync median
+#ifndef IDF_PERFORMANCE_MAX_MEDIAN_INSERT_LATENCY_CYCLES
+#define IDF_PERFORMANCE_MAX_MEDIAN_INSERT_LATENCY_CYCLES 8000
+#endif
+#ifndef IDF_PERFORMANCE_MAX_MEDIAN_INSERT_SHORT_CYCLES
+#define IDF_PERFORMANCE_MAX_MEDIAN_INSERT_SHORT_CYCLES 4000
+#endif
+
+// allocate_pcm_chunk_memory() and free_pcm_chunk() of one chunk
+#ifndef IDF_PERFORMANCE_MAX_CHUNK_ALLOC_CYCLES
+#define IDF_PERFORMANCE_MAX_CHUNK_ALLOC_CYCLES 60000
+#endif
+#ifndef IDF_PERFORMANCE_MAX_CHUNK_FREE_CYCLES
+#define IDF_PERFORMANCE_MAX_CHUNK_FREE_CYCLES 20000
+#endif
+
+// snapcast_parser_feed() of stream.cap, per wire chunk
+#ifndef IDF_PERFORMANCE_MAX_PARSER_CHUNK_CYCLES
+#define IDF_PERFORMANCE_MAX_PARSER_CHUNK_CYCLES 60000
+#endif
+
+#endif  // __PERF_BUDGET_H__
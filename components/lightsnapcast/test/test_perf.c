@@ -0,0 +1,697 @@
+/**
+ * Performance of the audio path
+ *
+ * Decoders, PCM conversion, DSP flows, median filters, chunk allocation and
+ * the stream parser are timed in CPU cycles per call and checked against
+ * the budgets in perf_budget.h. Results are printed as
+ * "[Performance][NAME]: value cycles", the format of IDF's performance test
+ * macros, tools/perf_report.py collects them from a test log and compares
+ * them to a baseline.
+ *
+ * Test data is made up when the test starts: FLAC is encoded from a
+ * synthetic signal with libFLAC, opus packets are CELT frames with random
+ * payload (snapserver encodes with OPUS_APPLICATION_RESTRICTED_LOWDELAY,
+ * which is CELT only, CELT decode time doesn't depend on content). The
+ * client's snapcast_parser reads stream.cap, the start of a capture of
+ * tools/capture_synth.py --chunk-ms 20.
+ *
+ * Runs on QEMU too, cycle counts there are emulated and can only be compared
+ * with other QEMU runs.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FLAC/stream_decoder.h"
+#include "FLAC/stream_encoder.h"
+#include "MedianFilter.h"
+#include "capture.h"
+#include "dsp_processor.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "opus.h"
+#include "pcm_convert.h"
+#include "perf_budget.h"
+#include "player.h"
+#include "snapcast.h"
+#include "snapcast_parser.h"
+#include "sync_ctrl.h"
+#include "test_utils.h"
+#include "unity.h"
+
+static const char *TAG = "TEST_PERF";
+
+#define PERF_SR 48000
+#define PERF_FRAME_BYTES 4
+#define PERF_FLAC_FRAMES 1152
+#define PERF_OPUS_FRAMES 960
+#define PERF_CHUNK_BYTES (PERF_FLAC_FRAMES * PERF_FRAME_BYTES)
+#define PERF_FLAC_CHUNKS 16
+#define PERF_OPUS_CHUNKS 16
+// 192kbit/s, snapserver's default
+#define PERF_OPUS_PACKET_BYTES 480
+// CELT only, fullband, 20ms, stereo, one frame
+#define PERF_OPUS_TOC 0xFC
+#define PERF_ALLOC_CHUNKS 16
+#define PERF_ROUNDS 8
+
+extern const uint8_t stream_cap_start[] asm("_binary_stream_cap_start");
+extern const uint8_t stream_cap_end[] asm("_binary_stream_cap_end");
+
+typedef struct perf_result_s {
+  uint32_t cnt;
+  uint64_t total;
+  uint32_t max;
+} perf_result_t;
+
+typedef struct perf_stream_s {
+  uint8_t *data;
+  size_t len;
+  size_t pos;
+  uint32_t frames;  //!< FLAC frames in data
+  uint32_t decoded;
+  uint32_t errors;
+} perf_stream_t;
+
+static uint32_t perfRand = 0x12345678;
+
+/**
+ * xorshift, same numbers on every run
+ */
+static uint32_t perf_rand(void) {
+  perfRand ^= perfRand << 13;
+  perfRand ^= perfRand >> 17;
+  perfRand ^= perfRand << 5;
+
+  return perfRand;
+}
+
+/**
+ * two tones and a bit of noise, so FLAC has something to predict
+ */
+static int16_t perf_synth(uint32_t frame, uint32_t ch) {
+  float t = (float)frame / PERF_SR;
+  float f = (ch == 0) ? 440.0f : 660.0f;
+
+  return (int16_t)(8000.0f * sinf(2.0f * (float)M_PI * f * t)) +
+         (int16_t)(perf_rand() % 512) - 256;
+}
+
+/**
+ *
+ */
+static void perf_synth_chunk(int16_t *pcm, uint32_t frames, uint32_t offset) {
+  for (uint32_t i = 0; i < frames; i++) {
+    pcm[2 * i] = perf_synth(offset + i, 0);
+    pcm[2 * i + 1] = perf_synth(offset + i, 1);
+  }
+}
+
+/**
+ *
+ */
+static void perf_add(perf_result_t *result, uint32_t cycles, uint32_t n) {
+  result->cnt += n;
+  result->total += cycles;
+  if (cycles / n > result->max) {
+    result->max = cycles / n;
+  }
+}
+
+/**
+ *
+ */
+static unsigned long perf_avg(const perf_result_t *result) {
+  if (result->cnt == 0) {
+    return 0;
+  }
+
+  return (unsigned long)(result->total / result->cnt);
+}
+
+/**
+ * worst case goes next to the average TEST_PERFORMANCE_LESS_THAN prints
+ */
+#define PERF_CHECK(name, result)                                       \
+  do {                                                                 \
+    printf("[Performance][%s_MAX]: %lu cycles\n", #name,               \
+           (unsigned long)(result)->max);                              \
+    TEST_PERFORMANCE_LESS_THAN(name, "%lu cycles", perf_avg(result)); \
+  } while (0)
+
+/**
+ * allocate a chunk the way the decoder does, so it lives where the player's
+ * chunks live
+ */
+static pcm_chunk_message_t *perf_chunk(size_t bytes) {
+  pcm_chunk_message_t *pcmChunk = NULL;
+
+  TEST_ASSERT_EQUAL(0, allocate_pcm_chunk_memory(&pcmChunk, bytes));
+  TEST_ASSERT_NOT_NULL(pcmChunk->fragment->payload);
+
+  return pcmChunk;
+}
+
+/**
+ *
+ */
+static FLAC__StreamEncoderWriteStatus perf_flac_encoder_write(
+    const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[],
+    size_t bytes, uint32_t samples, uint32_t current_frame,
+    void *client_data) {
+  perf_stream_t *stream = (perf_stream_t *)client_data;
+  uint8_t *data;
+
+  (void)encoder, (void)current_frame;
+
+  data = (uint8_t *)realloc(stream->data, stream->len + bytes);
+  if (data == NULL) {
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+  }
+
+  memcpy(&data[stream->len], buffer, bytes);
+  stream->data = data;
+  stream->len += bytes;
+  if (samples > 0) {
+    stream->frames++;
+  }
+
+  return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+/**
+ * encode like snapserver does, compression level 2 and 1152 frame blocks
+ */
+static void perf_flac_encode(perf_stream_t *stream) {
+  FLAC__StreamEncoder *encoder = FLAC__stream_encoder_new();
+  FLAC__int32 *pcm;
+  int16_t *synth;
+
+  TEST_ASSERT_NOT_NULL(encoder);
+
+  pcm = (FLAC__int32 *)malloc(PERF_FLAC_FRAMES * 2 * sizeof(FLAC__int32));
+  synth = (int16_t *)malloc(PERF_CHUNK_BYTES);
+  TEST_ASSERT_NOT_NULL(pcm);
+  TEST_ASSERT_NOT_NULL(synth);
+
+  memset(stream, 0, sizeof(perf_stream_t));
+
+  FLAC__stream_encoder_set_channels(encoder, 2);
+  FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+  FLAC__stream_encoder_set_sample_rate(encoder, PERF_SR);
+  FLAC__stream_encoder_set_compression_level(encoder, 2);
+  FLAC__stream_encoder_set_blocksize(encoder, PERF_FLAC_FRAMES);
+  TEST_ASSERT_EQUAL(FLAC__STREAM_ENCODER_INIT_STATUS_OK,
+                    FLAC__stream_encoder_init_stream(
+                        encoder, perf_flac_encoder_write, NULL, NULL, NULL,
+                        stream));
+
+  for (int n = 0; n < PERF_FLAC_CHUNKS; n++) {
+    perf_synth_chunk(synth, PERF_FLAC_FRAMES, n * PERF_FLAC_FRAMES);
+    for (int i = 0; i < PERF_FLAC_FRAMES * 2; i++) {
+      pcm[i] = synth[i];
+    }
+
+    TEST_ASSERT_TRUE(FLAC__stream_encoder_process_interleaved(
+        encoder, pcm, PERF_FLAC_FRAMES));
+  }
+
+  TEST_ASSERT_TRUE(FLAC__stream_encoder_finish(encoder));
+  FLAC__stream_encoder_delete(encoder);
+
+  free(synth);
+  free(pcm);
+
+  TEST_ASSERT_EQUAL(PERF_FLAC_CHUNKS, stream->frames);
+
+  ESP_LOGI(TAG, "FLAC: %u bytes for %d chunks", (unsigned)stream->len,
+           PERF_FLAC_CHUNKS);
+}
+
+/**
+ *
+ */
+static FLAC__StreamDecoderReadStatus perf_flac_read(
+    const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes,
+    void *client_data) {
+  perf_stream_t *stream = (perf_stream_t *)client_data;
+  size_t len = stream->len - stream->pos;
+
+  (void)decoder;
+
+  if (len == 0) {
+    *bytes = 0;
+
+    return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+  }
+
+  if (len > *bytes) {
+    len = *bytes;
+  }
+
+  memcpy(buffer, &stream->data[stream->pos], len);
+  stream->pos += len;
+  *bytes = len;
+
+  return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+/**
+ *
+ */
+static FLAC__StreamDecoderWriteStatus perf_flac_write(
+    const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame,
+    const FLAC__int32 *const buffer[], void *client_data) {
+  perf_stream_t *stream = (perf_stream_t *)client_data;
+
+  (void)decoder, (void)buffer;
+
+  stream->decoded += frame->header.blocksize;
+
+  return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+/**
+ *
+ */
+static void perf_flac_error(const FLAC__StreamDecoder *decoder,
+                            FLAC__StreamDecoderErrorStatus status,
+                            void *client_data) {
+  perf_stream_t *stream = (perf_stream_t *)client_data;
+
+  (void)decoder;
+
+  ESP_LOGE(TAG, "FLAC error: %s",
+           FLAC__StreamDecoderErrorStatusString[status]);
+
+  stream->errors++;
+}
+
+TEST_CASE("FLAC decode per chunk", "[lightsnapcast][perf]") {
+  FLAC__StreamDecoder *decoder = FLAC__stream_decoder_new();
+  perf_stream_t stream;
+  perf_result_t result = {0};
+
+  TEST_ASSERT_NOT_NULL(decoder);
+
+  perf_flac_encode(&stream);
+
+  for (int r = 0; r < PERF_ROUNDS; r++) {
+    stream.pos = 0;
+    stream.decoded = 0;
+
+    TEST_ASSERT_EQUAL(FLAC__STREAM_DECODER_INIT_STATUS_OK,
+                      FLAC__stream_decoder_init_stream(
+                          decoder, perf_flac_read, NULL, NULL, NULL, NULL,
+                          perf_flac_write, NULL, perf_flac_error, &stream));
+    TEST_ASSERT_TRUE(
+        FLAC__stream_decoder_process_until_end_of_metadata(decoder));
+
+    for (int n = 0; n < PERF_FLAC_CHUNKS; n++) {
+      uint32_t start = esp_cpu_get_cycle_count();
+      FLAC__bool ok = FLAC__stream_decoder_process_single(decoder);
+      perf_add(&result, esp_cpu_get_cycle_count() - start, 1);
+
+      TEST_ASSERT_TRUE(ok);
+    }
+
+    TEST_ASSERT_EQUAL(PERF_FLAC_CHUNKS * PERF_FLAC_FRAMES, stream.decoded);
+
+    FLAC__stream_decoder_finish(decoder);
+  }
+
+  TEST_ASSERT_EQUAL(0, stream.errors);
+
+  FLAC__stream_decoder_delete(decoder);
+  free(stream.data);
+
+  PERF_CHECK(FLAC_DECODE_CYCLES, &result);
+}
+
+TEST_CASE("Opus decode per chunk", "[lightsnapcast][perf]") {
+  OpusDecoder *decoder;
+  uint8_t *packets;
+  opus_int16 *pcm;
+  perf_result_t result = {0};
+  int error;
+
+  decoder = opus_decoder_create(PERF_SR, 2, &error);
+  TEST_ASSERT_EQUAL(OPUS_OK, error);
+
+  packets = (uint8_t *)malloc(PERF_OPUS_CHUNKS * PERF_OPUS_PACKET_BYTES);
+  pcm = (opus_int16 *)malloc(PERF_OPUS_FRAMES * PERF_FRAME_BYTES);
+  TEST_ASSERT_NOT_NULL(packets);
+  TEST_ASSERT_NOT_NULL(pcm);
+
+  for (int n = 0; n < PERF_OPUS_CHUNKS; n++) {
+    uint8_t *packet = &packets[n * PERF_OPUS_PACKET_BYTES];
+
+    packet[0] = PERF_OPUS_TOC;
+    for (int i = 1; i < PERF_OPUS_PACKET_BYTES; i++) {
+      packet[i] = (uint8_t)perf_rand();
+    }
+  }
+
+  for (int r = 0; r < PERF_ROUNDS; r++) {
+    opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+
+    for (int n = 0; n < PERF_OPUS_CHUNKS; n++) {
+      uint32_t start = esp_cpu_get_cycle_count();
+      int frames =
+          opus_decode(decoder, &packets[n * PERF_OPUS_PACKET_BYTES],
+                      PERF_OPUS_PACKET_BYTES, pcm, PERF_OPUS_FRAMES, 0);
+      perf_add(&result, esp_cpu_get_cycle_count() - start, 1);
+
+      TEST_ASSERT_EQUAL(PERF_OPUS_FRAMES, frames);
+    }
+  }
+
+  opus_decoder_destroy(decoder);
+  free(pcm);
+  free(packets);
+
+  PERF_CHECK(OPUS_DECODE_CYCLES, &result);
+}
+
+TEST_CASE("PCM conversion per chunk", "[lightsnapcast][perf]") {
+  int32_t *planar[2];
+  int16_t *interleaved;
+  uint8_t *outData;
+  pcm_chunk_message_t *pcmChunk;
+  perf_result_t flac = {0};
+  perf_result_t opus = {0};
+
+  planar[0] = (int32_t *)malloc(PERF_FLAC_FRAMES * sizeof(int32_t));
+  planar[1] = (int32_t *)malloc(PERF_FLAC_FRAMES * sizeof(int32_t));
+  interleaved = (int16_t *)malloc(PERF_CHUNK_BYTES);
+  outData = (uint8_t *)malloc(PERF_CHUNK_BYTES);
+  TEST_ASSERT_NOT_NULL(planar[0]);
+  TEST_ASSERT_NOT_NULL(planar[1]);
+  TEST_ASSERT_NOT_NULL(interleaved);
+  TEST_ASSERT_NOT_NULL(outData);
+
+  perf_synth_chunk(interleaved, PERF_FLAC_FRAMES, 0);
+  for (int i = 0; i < PERF_FLAC_FRAMES; i++) {
+    planar[0][i] = interleaved[2 * i];
+    planar[1][i] = interleaved[2 * i + 1];
+  }
+
+  pcmChunk = perf_chunk(PERF_CHUNK_BYTES);
+
+  for (int r = 0; r < PERF_ROUNDS; r++) {
+    // FLAC: write callback interleaves, then it is copied to the chunk
+    uint32_t start = esp_cpu_get_cycle_count();
+    pcm_convert_flac(outData, (const int32_t *const *)planar,
+                     PERF_FLAC_FRAMES);
+    pcm_convert_to_chunk(pcmChunk, outData, PERF_CHUNK_BYTES,
+                         PERF_FRAME_BYTES);
+    perf_add(&flac, esp_cpu_get_cycle_count() - start, 1);
+
+    start = esp_cpu_get_cycle_count();
+    pcm_convert_opus(pcmChunk->fragment->payload, interleaved,
+                     PERF_OPUS_FRAMES * PERF_FRAME_BYTES);
+    perf_add(&opus, esp_cpu_get_cycle_count() - start, 1);
+  }
+
+  // FLAC keeps sample order, opus swaps channels within a word
+  TEST_ASSERT_EQUAL_HEX16(interleaved[1],
+                          ((uint16_t *)pcmChunk->fragment->payload)[0]);
+  TEST_ASSERT_EQUAL_HEX16(interleaved[0],
+                          ((uint16_t *)pcmChunk->fragment->payload)[1]);
+  TEST_ASSERT_EQUAL_MEMORY(interleaved, outData, PERF_CHUNK_BYTES);
+
+  free_pcm_chunk(pcmChunk);
+  free(outData);
+  free(interleaved);
+  free(planar[1]);
+  free(planar[0]);
+
+  PERF_CHECK(PCM_CONVERT_FLAC_CYCLES, &flac);
+  PERF_CHECK(PCM_CONVERT_OPUS_CYCLES, &opus);
+}
+
+#if CONFIG_USE_DSP_PROCESSOR
+/**
+ * time one DSP flow with the parameters dsp_processor_init() uses for it
+ */
+static void perf_dsp_flow(const filterParams_t *params,
+                          perf_result_t *result) {
+  pcm_chunk_message_t *pcmChunk = perf_chunk(PERF_CHUNK_BYTES);
+  int16_t *pcm = (int16_t *)malloc(PERF_CHUNK_BYTES);
+  filterParams_t tmp = *params;
+
+  TEST_ASSERT_NOT_NULL(pcm);
+  perf_synth_chunk(pcm, PERF_FLAC_FRAMES, 0);
+
+  TEST_ASSERT_EQUAL(ESP_OK, dsp_processor_update_filter_params(&tmp));
+
+  // first call picks up the parameters and generates filters
+  memcpy(pcmChunk->fragment->payload, pcm, PERF_CHUNK_BYTES);
+  dsp_processor_worker(pcmChunk->fragment->payload, PERF_CHUNK_BYTES,
+                       PERF_SR);
+
+  for (int r = 0; r < PERF_ROUNDS; r++) {
+    memcpy(pcmChunk->fragment->payload, pcm, PERF_CHUNK_BYTES);
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    dsp_processor_worker(pcmChunk->fragment->payload, PERF_CHUNK_BYTES,
+                         PERF_SR);
+    perf_add(result, esp_cpu_get_cycle_count() - start, 1);
+  }
+
+  free(pcm);
+  free_pcm_chunk(pcmChunk);
+}
+#endif
+
+TEST_CASE("DSP flows per chunk", "[lightsnapcast][perf]") {
+#if CONFIG_USE_DSP_PROCESSOR
+  const filterParams_t stereo = {.dspFlow = dspfStereo};
+  const filterParams_t bassBoost = {
+      .dspFlow = dspfBassBoost, .fc_1 = 300.0, .gain_1 = 6.0};
+  const filterParams_t biamp = {.dspFlow = dspfBiamp,
+                                .fc_1 = 300.0,
+                                .gain_1 = 0.0,
+                                .fc_3 = 100.0,
+                                .gain_3 = 0.0};
+  const filterParams_t eq = {.dspFlow = dspfEQBassTreble,
+                             .fc_1 = 300.0,
+                             .gain_1 = 0.0,
+                             .fc_3 = 4000.0,
+                             .gain_3 = 0.0};
+  perf_result_t result[4] = {0};
+
+  dsp_processor_init();
+
+  perf_dsp_flow(&stereo, &result[0]);
+  perf_dsp_flow(&bassBoost, &result[1]);
+  perf_dsp_flow(&biamp, &result[2]);
+  perf_dsp_flow(&eq, &result[3]);
+
+  dsp_processor_uninit();
+
+  PERF_CHECK(DSP_STEREO_CYCLES, &result[0]);
+  PERF_CHECK(DSP_BASSBOOST_CYCLES, &result[1]);
+  PERF_CHECK(DSP_BIAMP_CYCLES, &result[2]);
+  PERF_CHECK(DSP_BASS_TREBLE_EQ_CYCLES, &result[3]);
+#else
+  TEST_IGNORE_MESSAGE("needs CONFIG_USE_DSP_PROCESSOR");
+#endif
+}
+
+/**
+ * fill the filter, then time inserts of ages jittering around 0
+ */
+static void perf_median(sMedianFilter_t *filter, perf_result_t *result) {
+  MEDIANFILTER_Init(filter);
+
+  for (uint32_t i = 0; i < filter->numNodes; i++) {
+    MEDIANFILTER_Insert(filter, (int64_t)(perf_rand() % 2000) - 1000);
+  }
+
+  for (uint32_t i = 0; i < 4 * filter->numNodes; i++) {
+    int64_t age = (int64_t)(perf_rand() % 2000) - 1000;
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    MEDIANFILTER_Insert(filter, age);
+    perf_add(result, esp_cpu_get_cycle_count() - start, 1);
+  }
+}
+
+TEST_CASE("median filter insert", "[lightsnapcast][perf]") {
+  static sMedianNode_t latencyBuffer[LATENCY_MEDIAN_FILTER_LEN];
+  static sMedianNode_t shortBuffer[SHORT_BUFFER_LEN];
+  sMedianFilter_t latencyFilter = {.numNodes = LATENCY_MEDIAN_FILTER_LEN,
+                                   .medianBuffer = latencyBuffer};
+  sMedianFilter_t shortFilter = {.numNodes = SHORT_BUFFER_LEN,
+                                 .medianBuffer = shortBuffer};
+  perf_result_t latency = {0};
+  perf_result_t shortMedian = {0};
+
+  perf_median(&latencyFilter, &latency);
+  perf_median(&shortFilter, &shortMedian);
+
+  PERF_CHECK(MEDIAN_INSERT_LATENCY_CYCLES, &latency);
+  PERF_CHECK(MEDIAN_INSERT_SHORT_CYCLES, &shortMedian);
+}
+
+TEST_CASE("chunk alloc and free", "[lightsnapcast][perf]") {
+  pcm_chunk_message_t *pcmChunk[PERF_ALLOC_CHUNKS];
+  perf_result_t alloc = {0};
+  perf_result_t release = {0};
+
+  // a few chunks are queued at any time, like in the player
+  for (int r = 0; r < PERF_ROUNDS; r++) {
+    for (int i = 0; i < PERF_ALLOC_CHUNKS; i++) {
+      uint32_t start = esp_cpu_get_cycle_count();
+      int32_t ret = allocate_pcm_chunk_memory(&pcmChunk[i], PERF_CHUNK_BYTES);
+      perf_add(&alloc, esp_cpu_get_cycle_count() - start, 1);
+
+      TEST_ASSERT_EQUAL(0, ret);
+    }
+
+    for (int i = 0; i < PERF_ALLOC_CHUNKS; i++) {
+      uint32_t start = esp_cpu_get_cycle_count();
+      free_pcm_chunk(pcmChunk[i]);
+      perf_add(&release, esp_cpu_get_cycle_count() - start, 1);
+    }
+  }
+
+  PERF_CHECK(CHUNK_ALLOC_CYCLES, &alloc);
+  PERF_CHECK(CHUNK_FREE_CYCLES, &release);
+}
+
+typedef struct perf_parse_s {
+  char *payload;
+  size_t fill;
+  int chunks;
+} perf_parse_t;
+
+/**
+ *
+ */
+static bool perf_parse_chunk_begin(void *ctx, wire_chunk_message_t *chunk) {
+  perf_parse_t *parse = (perf_parse_t *)ctx;
+
+  parse->fill = 0;
+
+  return chunk->size <= PERF_CHUNK_BYTES;
+}
+
+/**
+ * copy wire chunk payload out of the receive buffer, as the client does when
+ * it moves it into a chunk
+ */
+static int perf_parse_chunk_data(void *ctx, const uint8_t *data, size_t len) {
+  perf_parse_t *parse = (perf_parse_t *)ctx;
+
+  memcpy(&parse->payload[parse->fill], data, len);
+  parse->fill += len;
+
+  return 0;
+}
+
+/**
+ *
+ */
+static int perf_parse_chunk_end(void *ctx, wire_chunk_message_t *chunk,
+                                bool skipped) {
+  perf_parse_t *parse = (perf_parse_t *)ctx;
+
+  // only chunks which don't fit are skipped
+  if (skipped) {
+    return -1;
+  }
+
+  parse->chunks++;
+
+  return 0;
+}
+
+/**
+ *
+ */
+static int perf_parse_server_settings(void *ctx, const char *json) {
+  server_settings_message_t msg;
+
+  return (server_settings_message_deserialize(&msg, json) == 0) ? 0 : -1;
+}
+
+static const snapcast_parser_cb_t perfParseCb = {
+    .chunkBegin = perf_parse_chunk_begin,
+    .chunkData = perf_parse_chunk_data,
+    .chunkEnd = perf_parse_chunk_end,
+    .serverSettings = perf_parse_server_settings,
+};
+
+/**
+ * Feed captured TCP segments to the client's parser, pieces are at most
+ * maxPiece bytes.
+ *
+ * @return wire chunks parsed, -1 on error
+ */
+static int perf_parse_stream(const uint8_t *cap, size_t len, char *payload,
+                             size_t maxPiece) {
+  snapcast_parser_t parser;
+  perf_parse_t parse = {.payload = payload};
+  size_t pos = 8;  // dump header
+  int ret = 0;
+
+  snapcast_parser_init(&parser, &perfParseCb, &parse);
+
+  while ((ret == 0) && (pos + sizeof(capture_record_t) <= len)) {
+    capture_record_t rec;
+
+    memcpy(&rec, &cap[pos], sizeof(rec));
+    pos += sizeof(rec);
+    if (pos + rec.len > len) {
+      ret = -1;
+      break;
+    }
+
+    for (size_t i = 0; (ret == 0) && (i < rec.len); i += maxPiece) {
+      size_t n = (rec.len - i < maxPiece) ? rec.len - i : maxPiece;
+
+      ret = snapcast_parser_feed(&parser, &cap[pos + i], n);
+    }
+    pos += rec.len;
+  }
+
+  snapcast_parser_free(&parser);
+
+  return (ret == 0) ? parse.chunks : -1;
+}
+
+TEST_CASE("parser on captured stream", "[lightsnapcast][perf]") {
+  const uint8_t *cap = stream_cap_start;
+  size_t len = stream_cap_end - stream_cap_start;
+  char *payload = (char *)malloc(PERF_CHUNK_BYTES);
+  perf_result_t result = {0};
+  int chunks = 0;
+
+  TEST_ASSERT_NOT_NULL(payload);
+
+  TEST_ASSERT_GREATER_THAN(8, len);
+  TEST_ASSERT_EQUAL_MEMORY(CAPTURE_DUMP_MAGIC, cap, 4);
+  TEST_ASSERT_EQUAL(CAPTURE_VERSION, cap[4]);
+  TEST_ASSERT_EQUAL(sizeof(capture_record_t), cap[5]);
+
+  for (int r = 0; r < PERF_ROUNDS; r++) {
+    uint32_t start = esp_cpu_get_cycle_count();
+    chunks = perf_parse_stream(cap, len, payload, SIZE_MAX);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    TEST_ASSERT_GREATER_THAN(0, chunks);
+    perf_add(&result, cycles, chunks);
+  }
+
+  // headers split anywhere give the same result
+  TEST_ASSERT_EQUAL(chunks, perf_parse_stream(cap, len, payload, 1));
+  TEST_ASSERT_EQUAL(chunks, perf_parse_stream(cap, len, payload, 7));
+
+  free(payload);
+
+  PERF_CHECK(PARSER_CHUNK_CYCLES, &result);
+}
@@ -0,0 +1,214 @@
+/**
+ * Benchmark for CONFIG_USE_PSRAM_BOUNCE
+ *
+ * Chunks are allocated with allocate_pcm_chunk_memory(), so they live in
+ * PSRAM, and played by the player like the stream's chunks are. With
+ * CONFIG_USE_PSRAM_BOUNCE they go through pcm_chunk_bounce_task() on their
+ * way to player_task. Meanwhile another task keeps PSRAM busy like decoder
+ * and DSP do. Once playback runs, I2S underruns and hard resyncs of the
+ * player are counted for BENCH_PLAY_MS, the copies from
+ * player_get_bounce_stats() are reported too.
+ *
+ * Run the test app with and without CONFIG_USE_PSRAM_BOUNCE and compare the
+ * logs with tools/perf_report.py, the build without bouncing is the
+ * baseline:
+ *
+ *   tools/perf_report.py direct.log --out direct.json
+ *   tools/perf_report.py bounced.log --baseline direct.json
+ *
+ * Pins are left unconnected, only DMA timing matters.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/i2s_std.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "player.h"
+#include "unity.h"
+
+static const char *TAG = "TEST_PSRAM_BOUNCE";
+
+// 24ms of 48kHz, 16bit, stereo, like FLAC chunks of snapserver
+#define BENCH_SR 48000
+#define BENCH_CHUNK_FRAMES 1152
+#define BENCH_CHUNK_BYTES (BENCH_CHUNK_FRAMES * 2 * 2)
+#define BENCH_CHUNK_DURATION_US (1000000LL * BENCH_CHUNK_FRAMES / BENCH_SR)
+#define BENCH_BUF_MS 400
+// made up offset to the server's clock, 0 means not known to the player
+#define BENCH_SERVER_DIFF_US 1000000LL
+#define BENCH_START_TIMEOUT_MS 5000
+#define BENCH_PLAY_MS 20000
+#define BENCH_LOAD_BYTES (32 * 1024)
+
+static volatile bool loadRunning = false;
+
+/**
+ * main.c mutes the DAC, there is none here
+ */
+void audio_set_mute(bool mute) { (void)mute; }
+
+#if CONFIG_SPIRAM
+/**
+ * keep PSRAM busy like decoder and DSP do
+ */
+static void psram_load_task(void *pvParameters) {
+  TaskHandle_t parent = (TaskHandle_t)pvParameters;
+  uint8_t *buf =
+      (uint8_t *)heap_caps_malloc(2 * BENCH_LOAD_BYTES, MALLOC_CAP_SPIRAM);
+
+  while ((buf != NULL) && loadRunning) {
+    memcpy(buf, &buf[BENCH_LOAD_BYTES], BENCH_LOAD_BYTES);
+  }
+
+  free(buf);
+
+  xTaskNotifyGive(parent);
+  vTaskDelete(NULL);
+}
+
+/**
+ * set up the player for PCM and let it believe its clock is locked
+ */
+static void bench_player_start(void) {
+  i2s_std_gpio_config_t pins = {
+      .mclk = I2S_GPIO_UNUSED,
+      .bclk = I2S_GPIO_UNUSED,
+      .ws = I2S_GPIO_UNUSED,
+      .dout = I2S_GPIO_UNUSED,
+      .din = I2S_GPIO_UNUSED,
+  };
+  snapcastSetting_t setting = {
+      .buf_ms = BENCH_BUF_MS,
+      .chkInFrames = BENCH_CHUNK_FRAMES,
+      .cDacLat_ms = 0,
+      .codec = PCM,
+      .sr = BENCH_SR,
+      .ch = 2,
+      .bits = I2S_DATA_BIT_WIDTH_16BIT,
+      .muted = false,
+      .volume = 100,
+  };
+  bool full = false;
+
+  TEST_ASSERT_EQUAL(0, init_player(pins, I2S_NUM_0));
+  TEST_ASSERT_EQUAL(pdPASS, player_send_snapcast_setting(&setting));
+
+  for (int i = 0; i < LATENCY_MEDIAN_FILTER_LEN; i++) {
+    player_latency_insert(BENCH_SERVER_DIFF_US, 1000);
+  }
+  TEST_ASSERT_EQUAL(0, latency_buffer_full(&full, portMAX_DELAY));
+  TEST_ASSERT_TRUE(full);
+}
+
+/**
+ * queue chunks like the decoder does until end_us, the queue throttles us to
+ * real time once it is full
+ */
+static void bench_feed(int64_t *timestamp_us, int64_t end_us) {
+  while (esp_timer_get_time() < end_us) {
+    pcm_chunk_message_t *chnk = NULL;
+    pcm_chunk_fragment_t *fragment;
+
+    pcm_chunk_queue_wait_space(portMAX_DELAY);
+
+    TEST_ASSERT_EQUAL(0,
+                      allocate_pcm_chunk_memory(&chnk, BENCH_CHUNK_BYTES));
+    for (fragment = chnk->fragment; fragment != NULL;
+         fragment = fragment->nextFragment) {
+      memset(fragment->payload, 0x55, fragment->size);
+    }
+    chnk->timestamp.sec = *timestamp_us / 1000000LL;
+    chnk->timestamp.usec = *timestamp_us % 1000000LL;
+
+    TEST_ASSERT_EQUAL(0, insert_pcm_chunk(chnk));
+
+    *timestamp_us += BENCH_CHUNK_DURATION_US;
+  }
+}
+
+/**
+ * machine readable, same format as IDF's performance test macros
+ */
+static void bench_report(const player_resync_stats_t *start,
+                         const player_resync_stats_t *end,
+                         const player_bounce_stats_t *bounce) {
+  printf("[Performance][PLAYOUT_UNDERRUNS]: %lu\n",
+         (unsigned long)(end->underrunCnt - start->underrunCnt));
+  printf("[Performance][PLAYOUT_UNDERRUN_BYTES]: %llu bytes\n",
+         (unsigned long long)(end->underrunBytes - start->underrunBytes));
+  printf("[Performance][PLAYOUT_HARD_RESYNCS]: %lu\n",
+         (unsigned long)(end->hardCnt - start->hardCnt));
+  printf("[Performance][BOUNCE_COPY_MAX_US]: %lld us\n",
+         (long long)bounce->copyMax_us);
+  printf("[Performance][BOUNCE_FALLBACKS]: %lu\n",
+         (unsigned long)bounce->fallbacks);
+}
+#endif
+
+TEST_CASE("PSRAM bounce playout underruns", "[lightsnapcast][perf]") {
+#if CONFIG_SPIRAM
+  player_resync_stats_t start, end;
+  player_bounce_stats_t bounce = {0};
+  player_start_stats_t startStats;
+  int64_t timestamp_us, now_us;
+  int64_t deadline_us;
+
+  bench_player_start();
+
+  // load runs on the other core, like decoder and DSP do in the player
+  loadRunning = true;
+  xTaskCreatePinnedToCore(psram_load_task, "psramLoad", 2048,
+                          xTaskGetCurrentTaskHandle(), uxTaskPriorityGet(NULL),
+                          NULL, (xPortGetCoreID() + 1) % portNUM_PROCESSORS);
+
+  TEST_ASSERT_EQUAL(0, server_now(&timestamp_us, NULL));
+
+  // initial sync, only count what happens while playing
+  deadline_us = esp_timer_get_time() + 1000LL * BENCH_START_TIMEOUT_MS;
+  do {
+    now_us = esp_timer_get_time();
+    bench_feed(&timestamp_us, now_us + BENCH_CHUNK_DURATION_US);
+    player_get_start_stats(&startStats);
+  } while ((startStats.firstSample_us == 0) && (now_us < deadline_us));
+  TEST_ASSERT_NOT_EQUAL(0, startStats.firstSample_us);
+
+  player_get_resync_stats(&start);
+  bench_feed(&timestamp_us, esp_timer_get_time() + 1000LL * BENCH_PLAY_MS);
+  player_get_resync_stats(&end);
+
+  loadRunning = false;
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  // -1 if CONFIG_USE_PSRAM_BOUNCE is disabled, nothing bounced then
+  player_get_bounce_stats(&bounce);
+
+  deinit_player();
+
+  ESP_LOGI(TAG,
+           "%lu underruns (%llu bytes), %lu hard resyncs, bounced %lu "
+           "chunks in %lldus (max %lldus), %lu fallbacks",
+           (unsigned long)(end.underrunCnt - start.underrunCnt),
+           (unsigned long long)(end.underrunBytes - start.underrunBytes),
+           (unsigned long)(end.hardCnt - start.hardCnt),
+           (unsigned long)bounce.chunks, (long long)bounce.copy_us,
+           (long long)bounce.copyMax_us, (unsigned long)bounce.fallbacks);
+
+  bench_report(&start, &end, &bounce);
+
+#if CONFIG_USE_PSRAM_BOUNCE
+  // every chunk was played from internal RAM without a gap
+  TEST_ASSERT_GREATER_THAN(0, bounce.chunks);
+  TEST_ASSERT_EQUAL(0, bounce.fallbacks);
+  TEST_ASSERT_EQUAL(0, end.underrunCnt - start.underrunCnt);
+  TEST_ASSERT_EQUAL(0, end.hardCnt - start.hardCnt);
+#endif
+#else
+  TEST_IGNORE_MESSAGE("needs PSRAM");
+#endif
+}
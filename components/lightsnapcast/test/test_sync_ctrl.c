@@ -0,0 +1,210 @@
+/**
+ * Tests of the sync controller
+ *
+ * sync_ctrl has no side effects, so it is driven here with made up
+ * timestamps the same way the player task does.
+ */
+
+#include <string.h>
+
+#include "sync_ctrl.h"
+#include "unity.h"
+
+#define TEST_SR 48000
+#define TEST_CHUNK_US 20000
+#define TEST_BUF_US 1000000
+
+static sync_ctrl_t ctrl;
+
+/**
+ *
+ */
+static void test_ctrl_init(sync_ctrl_mode_t mode, sync_ctrl_algo_t algo) {
+  sync_ctrl_config_t cfg = {
+      .mode = mode,
+      .algo = algo,
+      .softResync = true,
+      .shortOffset_us = 128,
+      .miniOffset_us = 64,
+      .hardResyncFine_us = 2000,
+      .hardResyncCoarse_us = 10000,
+      .softResyncMax_us = 50000,
+      .startMargin_us = 5000,
+      .insertFrames = (mode == SYNC_CTRL_MODE_INSERT) ? 1 : 0,
+  };
+
+  sync_ctrl_init(&ctrl, &cfg);
+}
+
+/**
+ * input for a frame which is played age_us late
+ */
+static void test_input(sync_ctrl_input_t *in, int64_t age_us) {
+  memset(in, 0, sizeof(sync_ctrl_input_t));
+  in->serverNow_us = 50000000 + age_us;
+  in->chunkStart_us = 50000000 - TEST_BUF_US;
+  in->buf_us = TEST_BUF_US;
+  in->chunkDuration_us = TEST_CHUNK_US;
+  in->sr = TEST_SR;
+  in->queueDepth = 10;
+  in->fineLock = true;
+}
+
+/**
+ * feed a constant age until medians are full, return last output
+ */
+static void test_feed(int64_t age_us, uint32_t n, sync_ctrl_output_t *out) {
+  sync_ctrl_input_t in;
+
+  test_input(&in, age_us);
+  for (uint32_t i = 0; i < n; i++) {
+    sync_ctrl_update(&ctrl, &in, out);
+  }
+}
+
+TEST_CASE("sync_ctrl start waits, trims or drops", "[sync_ctrl]") {
+  sync_ctrl_input_t in;
+  sync_ctrl_start_t start;
+
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+
+  // plenty of time, start 100ms from now
+  test_input(&in, -100000);
+  sync_ctrl_start(&ctrl, &in, 960, &start);
+  TEST_ASSERT_EQUAL(SYNC_CTRL_PLAY, start.action);
+  TEST_ASSERT_EQUAL(0, start.trimFrames);
+  TEST_ASSERT_EQUAL(-100000, (int)start.age_us);
+
+  // 1ms late, trim 1ms plus start margin from first chunk
+  test_input(&in, 1000);
+  sync_ctrl_start(&ctrl, &in, 960, &start);
+  TEST_ASSERT_EQUAL(SYNC_CTRL_PLAY, start.action);
+  TEST_ASSERT_EQUAL(288, start.trimFrames);
+  TEST_ASSERT_LESS_THAN(0, (int)start.age_us);
+
+  // chunk too short to trim, three chunks late
+  test_input(&in, 50000);
+  sync_ctrl_start(&ctrl, &in, 960, &start);
+  TEST_ASSERT_EQUAL(SYNC_CTRL_HARD_RESYNC, start.action);
+  TEST_ASSERT_EQUAL(0, start.trimFrames);
+  TEST_ASSERT_EQUAL(3, start.dropChunks);
+}
+
+TEST_CASE("sync_ctrl median inserts and drops samples", "[sync_ctrl]") {
+  sync_ctrl_output_t out;
+
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+
+  // nothing happens until short median is full
+  test_feed(500, SHORT_BUFFER_LEN - 1, &out);
+  TEST_ASSERT_FALSE(out.control);
+  TEST_ASSERT_EQUAL(0, out.insert);
+
+  test_feed(500, 1, &out);
+  TEST_ASSERT_EQUAL(SYNC_CTRL_PLAY, out.action);
+  TEST_ASSERT_TRUE(out.control);
+  TEST_ASSERT_EQUAL(1, out.insert);
+  TEST_ASSERT_EQUAL(-1, (int)out.insertedFrames);
+
+  // within offsets
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+  test_feed(50, SHORT_BUFFER_LEN, &out);
+  TEST_ASSERT_EQUAL(0, out.insert);
+
+  // early
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+  test_feed(-500, SHORT_BUFFER_LEN, &out);
+  TEST_ASSERT_EQUAL(-1, out.insert);
+  TEST_ASSERT_EQUAL(-1, out.dir);
+}
+
+TEST_CASE("sync_ctrl median steers APLL", "[sync_ctrl]") {
+  sync_ctrl_output_t out;
+
+  test_ctrl_init(SYNC_CTRL_MODE_APLL, SYNC_CTRL_ALGO_MEDIAN);
+
+  test_feed(500, SHORT_BUFFER_LEN, &out);
+  TEST_ASSERT_TRUE(out.control);
+  TEST_ASSERT_EQUAL(1, out.dir);
+  TEST_ASSERT_EQUAL(0, out.insert);
+}
+
+TEST_CASE("sync_ctrl soft and hard resync", "[sync_ctrl]") {
+  sync_ctrl_input_t in;
+  sync_ctrl_output_t out;
+
+  // 10ms off is skipped while playing, medians start over
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+  test_feed(10000, SHORT_BUFFER_LEN, &out);
+  TEST_ASSERT_EQUAL(SYNC_CTRL_SOFT_RESYNC, out.action);
+  TEST_ASSERT_EQUAL(480, out.softResyncFrames);
+  test_feed(10000, 1, &out);
+  TEST_ASSERT_EQUAL(SYNC_CTRL_PLAY, out.action);
+
+  // not while an earlier one is applied
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+  test_input(&in, 10000);
+  in.softResyncBusy = true;
+  for (int i = 0; i < SHORT_BUFFER_LEN; i++) {
+    sync_ctrl_update(&ctrl, &in, &out);
+  }
+  TEST_ASSERT_EQUAL(SYNC_CTRL_HARD_RESYNC, out.action);
+
+  // too far off
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+  test_feed(-80000, SHORT_BUFFER_LEN, &out);
+  TEST_ASSERT_EQUAL(SYNC_CTRL_HARD_RESYNC, out.action);
+
+  // queue ran dry
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+  test_input(&in, 0);
+  in.queueDepth = 0;
+  sync_ctrl_update(&ctrl, &in, &out);
+  TEST_ASSERT_EQUAL(SYNC_CTRL_HARD_RESYNC, out.action);
+
+  // coarse lock tolerates more
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, SYNC_CTRL_ALGO_MEDIAN);
+  test_input(&in, 5000);
+  in.fineLock = false;
+  for (int i = 0; i < SHORT_BUFFER_LEN; i++) {
+    sync_ctrl_update(&ctrl, &in, &out);
+  }
+  TEST_ASSERT_EQUAL(SYNC_CTRL_PLAY, out.action);
+}
+
+/**
+ * closed loop: DAC is 80ppm fast, each insertion delays playback by a frame
+ */
+static int64_t test_closed_loop(sync_ctrl_algo_t algo) {
+  sync_ctrl_input_t in;
+  sync_ctrl_output_t out;
+  double err = 0;
+  double maxErr = 0;
+
+  test_ctrl_init(SYNC_CTRL_MODE_INSERT, algo);
+
+  for (int i = 0; i < 120000000 / TEST_CHUNK_US; i++) {
+    err -= 80.0 * TEST_CHUNK_US / 1000000.0;
+
+    test_input(&in, (int64_t)err);
+    sync_ctrl_update(&ctrl, &in, &out);
+    TEST_ASSERT_EQUAL(SYNC_CTRL_PLAY, out.action);
+
+    err -= out.insert * 1000000.0 / TEST_SR;
+
+    // once settled
+    if ((i > 30000000 / TEST_CHUNK_US) && (err * err > maxErr * maxErr)) {
+      maxErr = err;
+    }
+  }
+
+  return (int64_t)maxErr;
+}
+
+TEST_CASE("sync_ctrl keeps up with DAC drift", "[sync_ctrl]") {
+  int64_t median = test_closed_loop(SYNC_CTRL_ALGO_MEDIAN);
+  int64_t pi = test_closed_loop(SYNC_CTRL_ALGO_PI);
+
+  TEST_ASSERT_INT_WITHIN(300, 0, (int)median);
+  TEST_ASSERT_INT_WITHIN(100, 0, (int)pi);
+}
@@ -0,0 +1,484 @@
+/**
+ * Time sync message scheduling
+ *
+ * Chooses the period at which time messages are sent to the server. While
+ * the latency buffer isn't filled or after an event which makes our estimate
+ * of the server's time less trustworthy (reconnect, wifi roam, RSSI drop, hard
+ * resync in player) we send in bursts. If replies are stable the period is
+ * increased step by step to save network wakeups and CPU time.
+ *
+ * Also keeps track of the arrival time of received TCP data so time replies
+ * can be timestamped independent of parser latency.
+ */
+
+#include "time_sync.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "player.h"
+
+static const char *TAG = "TSYNC";
+
+static const char *burstReasonString[TIME_SYNC_BURST_REASON_MAX] = {
+    "none", "connect", "timeout", "roam", "rssi", "resync", "offset"};
+
+static SemaphoreHandle_t timeSyncMux = NULL;
+static esp_timer_handle_t timeSyncTimer = NULL;
+static bool timeSyncRunning = false;
+static uint32_t burstRemaining = 0;
+static uint32_t stableCnt = 0;
+static uint32_t rttOutlierRun = 0;
+static bool rssiThresholdArmed = false;
+static int64_t lastStatsLog = 0;
+static time_sync_stats_t stats;
+
+typedef struct rxTimestamp_s {
+  int64_t time;        //!< esp_timer_get_time() when pbuf was received
+  uint64_t streamPos;  //!< stream position of first byte in pbuf
+  uint64_t streamEnd;  //!< stream position after last byte in pbuf
+} rxTimestamp_t;
+
+static portMUX_TYPE rxTimestampMux = portMUX_INITIALIZER_UNLOCKED;
+static rxTimestamp_t rxTimestamp[TIME_SYNC_RX_TIMESTAMP_CNT];
+static uint32_t rxTimestampHead = 0;
+static uint64_t rxTimestampStreamPos = 0;
+
+/**
+ * (re)start timer with new period, must be called with timeSyncMux taken
+ */
+static void time_sync_apply_period(uint64_t period_us) {
+  if (stats.period_us == period_us) {
+    return;
+  }
+
+  stats.period_us = period_us;
+
+  if ((timeSyncRunning == true) && (timeSyncTimer != NULL)) {
+    if (esp_timer_is_active(timeSyncTimer)) {
+      esp_timer_stop(timeSyncTimer);
+    }
+    esp_timer_start_periodic(timeSyncTimer, stats.period_us);
+  }
+}
+
+/**
+ * must be called with timeSyncMux taken
+ */
+static void time_sync_start_burst(time_sync_burst_reason_t reason) {
+  if ((burstRemaining == 0) || (reason == TIME_SYNC_BURST_CONNECT) ||
+      (reason == TIME_SYNC_BURST_TIMEOUT)) {
+    stats.burstCnt[reason]++;
+
+    ESP_LOGI(TAG, "start time sync burst, reason: %s",
+             burstReasonString[reason]);
+  }
+
+  // on connect and timeout the latency buffer is reset, time_sync_rx() will
+  // keep bursting until it is filled again
+  if ((reason == TIME_SYNC_BURST_CONNECT) ||
+      (reason == TIME_SYNC_BURST_TIMEOUT)) {
+    burstRemaining = 0;
+  } else {
+    burstRemaining = TIME_SYNC_BURST_LEN;
+  }
+  stableCnt = 0;
+
+  time_sync_apply_period(TIME_SYNC_PERIOD_BURST_US);
+}
+
+/**
+ *
+ */
+static void time_sync_wifi_event_handler(void *arg,
+                                         esp_event_base_t event_base,
+                                         int32_t event_id, void *event_data) {
+  if (event_base != WIFI_EVENT) {
+    return;
+  }
+
+  if (event_id == WIFI_EVENT_STA_CONNECTED) {
+    time_sync_request_burst(TIME_SYNC_BURST_ROAM);
+  } else if (event_id == WIFI_EVENT_STA_BSS_RSSI_LOW) {
+    // event fires only once, so it gets armed again if we are stable
+    rssiThresholdArmed = false;
+
+    time_sync_request_burst(TIME_SYNC_BURST_RSSI);
+  }
+}
+
+/**
+ *
+ */
+static void time_sync_log_stats(int64_t now) {
+  if ((now - lastStatsLog) < TIME_SYNC_STATS_INTERVAL_US) {
+    return;
+  }
+
+  lastStatsLog = now;
+
+  ESP_LOGI(TAG,
+           "tx %lu (%lu B), rx %lu (%lu B), period %llums, rtt %lldus +/- "
+           "%lldus (%lu outliers), offset error %lldus (max %lldus), bursts "
+           "c:%lu t:%lu ro:%lu rs:%lu rh:%lu o:%lu",
+           stats.txCnt, stats.txBytes, stats.rxCnt, stats.rxBytes,
+           stats.period_us / 1000, stats.rtt_us, stats.rttVar_us,
+           stats.rttOutlierCnt,
+           stats.offsetError_us, stats.offsetErrorMax_us,
+           stats.burstCnt[TIME_SYNC_BURST_CONNECT],
+           stats.burstCnt[TIME_SYNC_BURST_TIMEOUT],
+           stats.burstCnt[TIME_SYNC_BURST_ROAM],
+           stats.burstCnt[TIME_SYNC_BURST_RSSI],
+           stats.burstCnt[TIME_SYNC_BURST_RESYNC],
+           stats.burstCnt[TIME_SYNC_BURST_OFFSET]);
+
+  stats.offsetErrorMax_us = 0;
+}
+
+/**
+ *  timer has to be created by caller, its callback sends the actual message
+ */
+int32_t time_sync_init(esp_timer_handle_t timer) {
+  if (timer == NULL) {
+    ESP_LOGE(TAG, "%s: no timer", __func__);
+
+    return -1;
+  }
+
+  time_sync_deinit();
+
+  if (timeSyncMux == NULL) {
+    timeSyncMux = xSemaphoreCreateMutex();
+    if (timeSyncMux == NULL) {
+      ESP_LOGE(TAG, "%s: couldn't create mutex", __func__);
+
+      return -2;
+    }
+  }
+
+  timeSyncTimer = timer;
+  timeSyncRunning = false;
+  burstRemaining = 0;
+  stableCnt = 0;
+  rttOutlierRun = 0;
+  memset(&stats, 0, sizeof(stats));
+  stats.period_us = TIME_SYNC_PERIOD_BURST_US;
+  lastStatsLog = esp_timer_get_time();
+
+  esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED,
+                             &time_sync_wifi_event_handler, NULL);
+  esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_BSS_RSSI_LOW,
+                             &time_sync_wifi_event_handler, NULL);
+
+  // will fail on ethernet only builds, that's ok
+  rssiThresholdArmed =
+      (esp_wifi_set_rssi_threshold(TIME_SYNC_RSSI_THRESHOLD) == ESP_OK);
+
+  return 0;
+}
+
+/**
+ *
+ */
+void time_sync_deinit(void) {
+  if (timeSyncTimer == NULL) {
+    return;
+  }
+
+  time_sync_stop();
+
+  esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED,
+                               &time_sync_wifi_event_handler);
+  esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_STA_BSS_RSSI_LOW,
+                               &time_sync_wifi_event_handler);
+
+  timeSyncTimer = NULL;
+}
+
+/**
+ *
+ */
+int32_t time_sync_start(void) {
+  if ((timeSyncMux == NULL) || (timeSyncTimer == NULL)) {
+    return -1;
+  }
+
+  xSemaphoreTake(timeSyncMux, portMAX_DELAY);
+
+  timeSyncRunning = true;
+  if (!esp_timer_is_active(timeSyncTimer)) {
+    esp_timer_start_periodic(timeSyncTimer, stats.period_us);
+  }
+
+  xSemaphoreGive(timeSyncMux);
+
+  return 0;
+}
+
+/**
+ *
+ */
+int32_t time_sync_stop(void) {
+  if ((timeSyncMux == NULL) || (timeSyncTimer == NULL)) {
+    return -1;
+  }
+
+  xSemaphoreTake(timeSyncMux, portMAX_DELAY);
+
+  timeSyncRunning = false;
+  if (esp_timer_is_active(timeSyncTimer)) {
+    esp_timer_stop(timeSyncTimer);
+  }
+
+  xSemaphoreGive(timeSyncMux);
+
+  return 0;
+}
+
+/**
+ * can be called from any task to signal we need fresh time sync samples
+ */
+void time_sync_request_burst(time_sync_burst_reason_t reason) {
+  if ((timeSyncMux == NULL) || (reason <= TIME_SYNC_BURST_NONE) ||
+      (reason >= TIME_SYNC_BURST_REASON_MAX)) {
+    return;
+  }
+
+  xSemaphoreTake(timeSyncMux, portMAX_DELAY);
+
+  time_sync_start_burst(reason);
+
+  xSemaphoreGive(timeSyncMux);
+}
+
+/**
+ *
+ */
+void time_sync_tx_done(size_t bytes) {
+  if (timeSyncMux == NULL) {
+    return;
+  }
+
+  xSemaphoreTake(timeSyncMux, portMAX_DELAY);
+
+  stats.txCnt++;
+  stats.txBytes += bytes;
+
+  xSemaphoreGive(timeSyncMux);
+}
+
+/**
+ * call before the new offset is inserted to the latency buffer, decides which
+ * period will be used from now on.
+ *
+ * @return 1 if the reply is an RTT outlier and must not be used, 0 if it can
+ * be inserted, -1 if not initialized
+ */
+int32_t time_sync_rx(int64_t rtt_us, int64_t offset_us, size_t bytes) {
+  int64_t median = 0;
+  int64_t rttErr;
+  int64_t rttLimit;
+  bool is_full = false;
+
+  if (timeSyncMux == NULL) {
+    return -1;
+  }
+
+  get_diff_to_server(&median);
+  latency_buffer_full(&is_full, portMAX_DELAY);
+
+  xSemaphoreTake(timeSyncMux, portMAX_DELAY);
+
+  stats.rxCnt++;
+  stats.rxBytes += bytes;
+
+  // a reply which waited in the socket, e.g. while the chunk queue was full
+  // and we didn't read, says nothing about the server's time
+  if ((stats.rtt_us != 0) || (stats.rttVar_us != 0)) {
+    rttLimit = 4 * stats.rttVar_us;
+    if (rttLimit < TIME_SYNC_RTT_OUTLIER_MIN_US) {
+      rttLimit = TIME_SYNC_RTT_OUTLIER_MIN_US;
+    }
+
+    if ((rtt_us > stats.rtt_us + rttLimit) &&
+        (rttOutlierRun < TIME_SYNC_RTT_OUTLIER_MAX)) {
+      rttOutlierRun++;
+      stats.rttOutlierCnt++;
+
+      xSemaphoreGive(timeSyncMux);
+
+      return 1;
+    }
+  }
+  rttOutlierRun = 0;
+
+  // smoothed RTT and its deviation, same as TCP does it (RFC 6298)
+  if ((stats.rtt_us == 0) && (stats.rttVar_us == 0)) {
+    stats.rtt_us = rtt_us;
+    stats.rttVar_us = rtt_us / 2;
+  } else {
+    rttErr = rtt_us - stats.rtt_us;
+    stats.rtt_us += rttErr / 8;
+    stats.rttVar_us += (llabs(rttErr) - stats.rttVar_us) / 4;
+  }
+
+  stats.offsetError_us = offset_us - median;
+  if (llabs(stats.offsetError_us) > stats.offsetErrorMax_us) {
+    stats.offsetErrorMax_us = llabs(stats.offsetError_us);
+  }
+
+  if (is_full == false) {
+    // initial fill of latency buffer
+    stableCnt = 0;
+    time_sync_apply_period(TIME_SYNC_PERIOD_BURST_US);
+  } else if (burstRemaining > 0) {
+    burstRemaining--;
+    if (burstRemaining == 0) {
+      time_sync_apply_period(TIME_SYNC_PERIOD_MIN_US);
+    }
+  } else if (llabs(stats.offsetError_us) > TIME_SYNC_BURST_ERROR_US) {
+    time_sync_start_burst(TIME_SYNC_BURST_OFFSET);
+  } else {
+    uint64_t period = stats.period_us;
+
+    if (period < TIME_SYNC_PERIOD_MIN_US) {
+      period = TIME_SYNC_PERIOD_MIN_US;
+    }
+
+    if ((llabs(stats.offsetError_us) < TIME_SYNC_STABLE_ERROR_US) &&
+        (stats.rttVar_us < TIME_SYNC_STABLE_JITTER_US)) {
+      stableCnt++;
+      if (stableCnt >= TIME_SYNC_STABLE_CNT) {
+        stableCnt = 0;
+
+        period *= 2;
+        if (period > TIME_SYNC_PERIOD_MAX_US) {
+          period = TIME_SYNC_PERIOD_MAX_US;
+        }
+      }
+
+      if (rssiThresholdArmed == false) {
+        rssiThresholdArmed =
+            (esp_wifi_set_rssi_threshold(TIME_SYNC_RSSI_THRESHOLD) == ESP_OK);
+      }
+    } else {
+      // confidence dropped, fall back to fastest non burst period
+      stableCnt = 0;
+      period = TIME_SYNC_PERIOD_MIN_US;
+    }
+
+    time_sync_apply_period(period);
+  }
+
+  time_sync_log_stats(esp_timer_get_time());
+
+  xSemaphoreGive(timeSyncMux);
+
+  return 0;
+}
+
+/**
+ *
+ */
+int32_t time_sync_get_stats(time_sync_stats_t *stats_) {
+  if ((stats_ == NULL) || (timeSyncMux == NULL)) {
+    return -1;
+  }
+
+  xSemaphoreTake(timeSyncMux, portMAX_DELAY);
+
+  memcpy(stats_, &stats, sizeof(time_sync_stats_t));
+
+  xSemaphoreGive(timeSyncMux);
+
+  return 0;
+}
+
+/**
+ *
+ */
+const char *time_sync_burst_reason_str(time_sync_burst_reason_t reason) {
+  if (reason >= TIME_SYNC_BURST_REASON_MAX) {
+    return "unknown";
+  }
+
+  return burstReasonString[reason];
+}
+
+/**
+ * call on every new connection before any data is received
+ */
+void time_sync_rx_timestamp_reset(void) {
+  portENTER_CRITICAL(&rxTimestampMux);
+
+  rxTimestampHead = 0;
+  rxTimestampStreamPos = 0;
+
+  portEXIT_CRITICAL(&rxTimestampMux);
+}
+
+/**
+ * Called from lwIP's tcpip thread as soon as a pbuf was received on our
+ * connection, so the arrival time doesn't depend on how busy http_get_task
+ * is with decoding.
+ */
+void time_sync_rx_timestamp_insert(size_t len) {
+  int64_t now = esp_timer_get_time();
+  rxTimestamp_t *ts;
+
+  portENTER_CRITICAL(&rxTimestampMux);
+
+  ts = &rxTimestamp[rxTimestampHead % TIME_SYNC_RX_TIMESTAMP_CNT];
+  ts->time = now;
+  ts->streamPos = rxTimestampStreamPos;
+  rxTimestampStreamPos += len;
+  ts->streamEnd = rxTimestampStreamPos;
+
+  rxTimestampHead++;
+
+  portEXIT_CRITICAL(&rxTimestampMux);
+}
+
+/**
+ * get arrival time of the pbuf which contained the byte at streamPos.
+ * Returns -1 if it isn't known (anymore), caller should use current time then.
+ */
+int32_t time_sync_rx_timestamp_get(uint64_t streamPos, int64_t *timestamp) {
+  int32_t ret = -1;
+  uint32_t i, oldest;
+  rxTimestamp_t *ts;
+
+  if (timestamp == NULL) {
+    return -2;
+  }
+
+  portENTER_CRITICAL(&rxTimestampMux);
+
+  if (rxTimestampHead > TIME_SYNC_RX_TIMESTAMP_CNT) {
+    oldest = rxTimestampHead - TIME_SYNC_RX_TIMESTAMP_CNT;
+  } else {
+    oldest = 0;
+  }
+
+  // search newest first, parser is usually only a few pbufs behind
+  for (i = rxTimestampHead; i > oldest; i--) {
+    ts = &rxTimestamp[(i - 1) % TIME_SYNC_RX_TIMESTAMP_CNT];
+    if ((streamPos >= ts->streamPos) && (streamPos < ts->streamEnd)) {
+      *timestamp = ts->time;
+      ret = 0;
+
+      break;
+    }
+  }
+
+  portEXIT_CRITICAL(&rxTimestampMux);
+
+  return ret;
+}
@@ -0,0 +1,304 @@
+/**
+ * Binary event trace
+ *
+ * Hot paths record fixed size events instead of logging them. Each core has
+ * its own ring, a writer reserves a slot with an atomic increment, fills it
+ * and sets the record's sequence number last. Readers skip records which
+ * aren't complete yet or were overwritten while they were copied.
+ *
+ * A low priority task formats new events to the console, /trace of the UI
+ * http server dumps both rings for tools/trace_decode.py.
+ */
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TRACE_RING_MASK (TRACE_RING_LEN - 1)
+// records per core and round of trace_task()
+#define TRACE_TASK_BATCH 8
+
+static const char *TAG = "TRACE";
+
+static const trace_event_desc_t eventDesc[TRACE_EVT_MAX] = {
+    [TRACE_EVT_RESYNC_HARD_LATE] = {ESP_LOG_WARN, "PLAYER",
+                                    "RESYNCING HARD 1: age %ldus, free %ld"},
+    [TRACE_EVT_RESYNC_HARD] = {ESP_LOG_WARN, "PLAYER",
+                               "RESYNCING HARD 2: age %ldus, short median "
+                               "%ldus, free %ld, %ld chunks queued"},
+    [TRACE_EVT_RESYNC_SOFT] = {ESP_LOG_WARN, "PLAYER",
+                               "RESYNCING SOFT: age %ldus, skip (pad if "
+                               "negative) %ld frames"},
+    [TRACE_EVT_INITIAL_SYNC] = {ESP_LOG_INFO, "PLAYER",
+                                "initial sync age: %ldus, chunk duration: "
+                                "%ldus"},
+    [TRACE_EVT_FIRST_CHUNK_TRIM] = {ESP_LOG_INFO, "PLAYER",
+                                    "trimmed %ld frames from first chunk"},
+    [TRACE_EVT_QUEUE_FULL] = {ESP_LOG_WARN, "PLAYER",
+                              "send: pcmChunkQueue full, messages waiting "
+                              "%ld, dropped %ld"},
+    [TRACE_EVT_LATE_CHUNKS_SKIPPED] = {ESP_LOG_INFO, "SC",
+                                       "skipped %ld late chunks"},
+};
+
+#if CONFIG_USE_TRACE
+typedef struct trace_ring_s {
+  uint32_t head;  //!< next slot to reserve
+  trace_record_t record[TRACE_RING_LEN];
+} trace_ring_t;
+
+static trace_ring_t ring[portNUM_PROCESSORS];
+#endif
+
+/**
+ *
+ */
+const trace_event_desc_t *trace_event_desc(trace_event_t ev) {
+  if (ev >= TRACE_EVT_MAX) {
+    return NULL;
+  }
+
+  return &eventDesc[ev];
+}
+
+#if !CONFIG_USE_TRACE || CONFIG_TRACE_CONSOLE
+/**
+ *
+ */
+static void trace_format(const trace_record_t *rec) {
+  const trace_event_desc_t *desc = trace_event_desc(rec->id);
+  char msg[128];
+
+  if (desc == NULL) {
+    ESP_LOGW(TAG, "unknown event %d", rec->id);
+
+    return;
+  }
+
+  snprintf(msg, sizeof(msg), desc->fmt, (long)rec->arg[0], (long)rec->arg[1],
+           (long)rec->arg[2], (long)rec->arg[3]);
+  ESP_LOG_LEVEL(desc->level, desc->tag, "%s (at %lldms)", msg,
+                rec->ts_us / 1000);
+}
+#endif
+
+/**
+ *
+ */
+void trace_event(trace_event_t ev, int32_t a0, int32_t a1, int32_t a2,
+                 int32_t a3) {
+#if CONFIG_USE_TRACE
+  int core = xPortGetCoreID();
+  trace_ring_t *r = &ring[core];
+  uint32_t seq = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED);
+  trace_record_t *rec = &r->record[seq & TRACE_RING_MASK];
+
+  __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  rec->id = ev;
+  rec->core = core;
+  rec->ts_us = esp_timer_get_time();
+  rec->arg[0] = a0;
+  rec->arg[1] = a1;
+  rec->arg[2] = a2;
+  rec->arg[3] = a3;
+
+  __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+#else
+  trace_record_t rec = {
+      .id = ev,
+      .core = xPortGetCoreID(),
+      .ts_us = esp_timer_get_time(),
+      .arg = {a0, a1, a2, a3},
+  };
+
+  trace_format(&rec);
+#endif
+}
+
+/**
+ * Copy up to max complete records of core's ring starting at *seq, which is
+ * advanced past them. Records overwritten before they could be copied are
+ * counted in *lost. Returns the number of records copied.
+ */
+uint32_t trace_read(int core, uint32_t *seq, trace_record_t *records,
+                    uint32_t max, uint32_t *lost) {
+#if CONFIG_USE_TRACE
+  trace_ring_t *r;
+  uint32_t head, cnt = 0;
+
+  *lost = 0;
+
+  if ((core < 0) || (core >= portNUM_PROCESSORS)) {
+    return 0;
+  }
+  r = &ring[core];
+
+  head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  if ((head - *seq) > TRACE_RING_LEN) {
+    *lost = head - *seq - TRACE_RING_LEN;
+    *seq = head - TRACE_RING_LEN;
+  }
+
+  while ((*seq != head) && (cnt < max)) {
+    const trace_record_t *rec = &r->record[*seq & TRACE_RING_MASK];
+    uint32_t s1, s2;
+
+    s1 = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+    if ((s1 == 0) || ((int32_t)(s1 - (*seq + 1)) < 0)) {
+      // still being written, try again next time
+      break;
+    }
+
+    if (s1 == *seq + 1) {
+      records[cnt] = *rec;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      s2 = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED);
+    } else {
+      s2 = 0;
+    }
+
+    if (s2 == s1) {
+      cnt++;
+    } else {
+      (*lost)++;
+    }
+    (*seq)++;
+  }
+
+  return cnt;
+#else
+  *lost = 0;
+
+  return 0;
+#endif
+}
+
+/**
+ * Write both rings in dump format, see tools/trace_decode.py
+ */
+int32_t trace_dump(trace_dump_cb_t cb, void *ctx) {
+  uint8_t hdr[8];
+
+  memcpy(hdr, TRACE_DUMP_MAGIC, 4);
+  hdr[4] = TRACE_VERSION;
+  hdr[5] = sizeof(trace_record_t);
+  hdr[6] = portNUM_PROCESSORS;
+  hdr[7] = TRACE_EVT_MAX;
+  if (cb(hdr, sizeof(hdr), ctx) < 0) {
+    return -1;
+  }
+
+  for (int i = 0; i < TRACE_EVT_MAX; i++) {
+    uint8_t ev[4];
+
+    ev[0] = i;
+    ev[1] = eventDesc[i].level;
+    ev[2] = strlen(eventDesc[i].tag);
+    ev[3] = strlen(eventDesc[i].fmt);
+    if ((cb(ev, sizeof(ev), ctx) < 0) ||
+        (cb(eventDesc[i].tag, ev[2], ctx) < 0) ||
+        (cb(eventDesc[i].fmt, ev[3], ctx) < 0)) {
+      return -1;
+    }
+  }
+
+#if CONFIG_USE_TRACE
+  trace_record_t records[TRACE_TASK_BATCH];
+
+  for (int core = 0; core < portNUM_PROCESSORS; core++) {
+    uint32_t head = __atomic_load_n(&ring[core].head, __ATOMIC_ACQUIRE);
+    uint32_t seq = head - TRACE_RING_LEN;
+    uint32_t cnt, lost;
+
+    // ring wasn't full yet
+    if (head < TRACE_RING_LEN) {
+      seq = 0;
+    }
+
+    do {
+      cnt = trace_read(core, &seq, records, TRACE_TASK_BATCH, &lost);
+      if ((cnt > 0) &&
+          (cb(records, cnt * sizeof(trace_record_t), ctx) < 0)) {
+        return -1;
+      }
+    } while ((seq != head) && ((cnt > 0) || (lost > 0)));
+  }
+#endif
+
+  return 0;
+}
+
+#if CONFIG_USE_TRACE && CONFIG_TRACE_CONSOLE
+/**
+ * format new events of all cores to console, oldest first
+ */
+static void trace_task(void *pvParameters) {
+  static trace_record_t records[portNUM_PROCESSORS][TRACE_TASK_BATCH];
+  uint32_t seq[portNUM_PROCESSORS] = {0};
+  uint32_t cnt[portNUM_PROCESSORS], pos[portNUM_PROCESSORS];
+  uint32_t lost;
+
+  while (1) {
+    vTaskDelay(pdMS_TO_TICKS(TRACE_TASK_INTERVAL_MS));
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+      cnt[core] = trace_read(core, &seq[core], records[core],
+                             TRACE_TASK_BATCH, &lost);
+      pos[core] = 0;
+
+      if (lost > 0) {
+        ESP_LOGW(TAG, "%lu events of core %d lost", lost, core);
+      }
+    }
+
+    while (1) {
+      int next = -1;
+
+      for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if ((pos[core] < cnt[core]) &&
+            ((next < 0) || (records[core][pos[core]].ts_us <
+                            records[next][pos[next]].ts_us))) {
+          next = core;
+        }
+      }
+
+      if (next < 0) {
+        break;
+      }
+
+      trace_format(&records[next][pos[next]]);
+      pos[next]++;
+    }
+  }
+}
+#endif
+
+/**
+ *
+ */
+int32_t trace_init(void) {
+#if CONFIG_USE_TRACE && CONFIG_TRACE_CONSOLE
+  static TaskHandle_t traceTaskHandle = NULL;
+
+  if (traceTaskHandle != NULL) {
+    return 0;
+  }
+
+  if (xTaskCreatePinnedToCore(trace_task, "trace", 3 * 1024, NULL,
+                              TRACE_TASK_PRIORITY, &traceTaskHandle,
+                              tskNO_AFFINITY) != pdPASS) {
+    ESP_LOGE(TAG, "couldn't create trace task");
+
+    return -1;
+  }
+#endif
+
+  return 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * Warm start cache
+ *
+ * Remembers the snapserver we were connected to, the stream's sample format
+ * and buffer settings and the measured server clock skew in NVS. On the next
+ * boot I2S and the chunk queue can be set up before we are connected and the
+ * server can be contacted directly instead of waiting for mDNS.
+ *
+ * Flash is only written if something relevant changed.
+ */
+
+#include "warm_start.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "WARMSTART";
+
+static warm_start_t stored;
+static bool storedValid = false;
+
+/**
+ *
+ */
+static bool warm_start_equal(const warm_start_t *a, const warm_start_t *b) {
+  return (a->serverPort == b->serverPort) &&
+         ip_addr_cmp(&a->serverIp, &b->serverIp) && (a->codec == b->codec) &&
+         (a->sr == b->sr) && (a->ch == b->ch) && (a->bits == b->bits) &&
+         (a->chkInFrames == b->chkInFrames) && (a->buf_ms == b->buf_ms) &&
+         (a->cDacLat_ms == b->cDacLat_ms) &&
+         (fabsf(a->clockSkew_ppm - b->clockSkew_ppm) <
+          WARM_START_SKEW_HYST_PPM);
+}
+
+/**
+ * returns 0 if a valid cache entry was found, -1 otherwise
+ */
+int32_t warm_start_load(warm_start_t *ws) {
+  nvs_handle_t handle;
+  size_t len = sizeof(warm_start_t);
+  esp_err_t err;
+
+  err = nvs_open(WARM_START_NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGI(TAG, "no cached stream state");
+
+    return -1;
+  }
+
+  err = nvs_get_blob(handle, WARM_START_NVS_KEY, ws, &len);
+  nvs_close(handle);
+
+  if ((err != ESP_OK) || (len != sizeof(warm_start_t)) ||
+      (ws->version != WARM_START_VERSION) || (ws->sr <= 0) ||
+      (ws->chkInFrames == 0) || (ws->buf_ms == 0)) {
+    ESP_LOGI(TAG, "no valid cached stream state");
+
+    return -1;
+  }
+
+  stored = *ws;
+  storedValid = true;
+
+  ESP_LOGI(TAG,
+           "cached stream state: server %s:%d, codec %d, %ld:%d:%d, chunk "
+           "%ld frames, buffer %ldms, skew %.2fppm",
+           ipaddr_ntoa(&ws->serverIp), ws->serverPort, ws->codec, ws->sr,
+           ws->bits, ws->ch, ws->chkInFrames, ws->buf_ms, ws->clockSkew_ppm);
+
+  return 0;
+}
+
+/**
+ * write cache entry to NVS if it differs from what is stored already
+ */
+int32_t warm_start_store(const warm_start_t *ws) {
+  nvs_handle_t handle;
+  esp_err_t err;
+
+  if ((storedValid == true) && warm_start_equal(ws, &stored)) {
+    return 0;
+  }
+
+  err = nvs_open(WARM_START_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "can't open NVS: %d", err);
+
+    return -1;
+  }
+
+  err = nvs_set_blob(handle, WARM_START_NVS_KEY, ws, sizeof(warm_start_t));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "can't store stream state: %d", err);
+
+    return -1;
+  }
+
+  stored = *ws;
+  storedValid = true;
+
+  ESP_LOGI(TAG, "stored stream state");
+
+  return 0;
+}
+
+/**
+ *
+ */
+void warm_start_set(warm_start_t *ws, const ip_addr_t *serverIp,
+                    uint16_t serverPort, const snapcastSetting_t *setting,
+                    float clockSkew_ppm) {
+  memset(ws, 0, sizeof(warm_start_t));
+
+  ws->version = WARM_START_VERSION;
+  ip_addr_copy(ws->serverIp, *serverIp);
+  ws->serverPort = serverPort;
+  ws->codec = setting->codec;
+  ws->sr = setting->sr;
+  ws->ch = setting->ch;
+  ws->bits = setting->bits;
+  ws->chkInFrames = setting->chkInFrames;
+  ws->buf_ms = setting->buf_ms;
+  ws->cDacLat_ms = setting->cDacLat_ms;
+  ws->clockSkew_ppm = clockSkew_ppm;
+}
+
+/**
+ * volume and mute aren't cached, we stay muted until the server told us
+ */
+void warm_start_get_setting(const warm_start_t *ws,
+                            snapcastSetting_t *setting) {
+  setting->codec = ws->codec;
+  setting->sr = ws->sr;
+  setting->ch = ws->ch;
+  setting->bits = ws->bits;
+  setting->chkInFrames = ws->chkInFrames;
+  setting->buf_ms = ws->buf_ms;
+  setting->cDacLat_ms = ws->cDacLat_ms;
+  setting->muted = true;
+  setting->volume = 0;
+}
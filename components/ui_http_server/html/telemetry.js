@@ -0,0 +1,114 @@
+// Live graphs of the player's sync loop. Samples come as binary websocket
+// frames, layout is telemetry_frame_hdr_t followed by telemetry_sample_t,
+// see components/lightsnapcast/include/telemetry.h
+'use strict';
+/* global TimelineDataSeries, TimelineGraphView */
+
+const TELEMETRY_VERSION = 1;
+const TELEMETRY_HDR_SIZE = 8;
+// ms per pixel
+const TELEMETRY_SCALE = 100;
+
+let telemetryWs = null;
+// device time_ms to browser time
+let telemetryTimeOffset = null;
+// first server offset, later ones are graphed relative to it
+let telemetryDiff2Server = null;
+let telemetryLost = 0;
+
+const telemetryGraphs = {};
+
+function telemetrySeries(color) {
+  const series = new TimelineDataSeries();
+  series.setColor(color);
+  return series;
+}
+
+function telemetryGraph(name, series) {
+  const graph = new TimelineGraphView(name + 'Graph', name + 'Canvas');
+  graph.setScale(TELEMETRY_SCALE);
+  graph.setDataSeries(Object.values(series));
+  telemetryGraphs[name] = {graph: graph, series: series};
+}
+
+function telemetryAddSample(view, offset) {
+  const time = view.getUint32(offset + 4, true) + telemetryTimeOffset;
+  const diff2Server = view.getBigInt64(offset + 20, true);
+
+  if (telemetryDiff2Server === null) {
+    telemetryDiff2Server = diff2Server;
+  }
+
+  const age = telemetryGraphs.age.series;
+  age.age.addPoint(time, view.getInt32(offset + 8, true) / 1000);
+  age.shortMedian.addPoint(time, view.getInt32(offset + 12, true) / 1000);
+  age.miniMedian.addPoint(time, view.getInt32(offset + 16, true) / 1000);
+
+  const control = telemetryGraphs.control.series;
+  control.inserted.addPoint(time, view.getInt32(offset + 28, true));
+  control.dir.addPoint(time, view.getInt8(offset + 32));
+  control.queue.addPoint(time, view.getUint8(offset + 33));
+
+  telemetryGraphs.server.series.diff2Server.addPoint(
+      time, Number(diff2Server - telemetryDiff2Server));
+}
+
+function telemetryOnMessage(evt) {
+  const view = new DataView(evt.data);
+
+  if ((view.byteLength < TELEMETRY_HDR_SIZE) ||
+      (view.getUint8(0) !== TELEMETRY_VERSION)) {
+    console.log('unknown telemetry frame');
+    return;
+  }
+
+  const sampleSize = view.getUint8(1);
+  const count = view.getUint16(2, true);
+  telemetryLost += view.getUint32(4, true);
+
+  for (let i = 0; i < count; i++) {
+    const offset = TELEMETRY_HDR_SIZE + i * sampleSize;
+
+    if (offset + sampleSize > view.byteLength) {
+      break;
+    }
+    if (telemetryTimeOffset === null) {
+      telemetryTimeOffset = Date.now() - view.getUint32(offset + 4, true);
+    }
+    telemetryAddSample(view, offset);
+  }
+
+  document.getElementById('telemetryLost').innerHTML = telemetryLost;
+
+  for (const name in telemetryGraphs) {
+    telemetryGraphs[name].graph.updateEndDate();
+  }
+}
+
+function initTelemetry() {
+  telemetryGraph('age', {
+    age: telemetrySeries('red'),
+    shortMedian: telemetrySeries('blue'),
+    miniMedian: telemetrySeries('green'),
+  });
+  telemetryGraph('control', {
+    inserted: telemetrySeries('red'),
+    dir: telemetrySeries('blue'),
+    queue: telemetrySeries('green'),
+  });
+  telemetryGraph('server', {
+    diff2Server: telemetrySeries('red'),
+  });
+
+  telemetryWs = new WebSocket('ws://' + window.location.host + '/ws/telemetry');
+  telemetryWs.binaryType = 'arraybuffer';
+  telemetryWs.onmessage = telemetryOnMessage;
+  telemetryWs.onclose = function() {
+    document.getElementById('telemetry').style.display = 'none';
+  };
+  telemetryWs.onopen = function() {
+    document.getElementById('telemetry').style.display = 'block';
+  };
+}
+
+window.addEventListener('load', initTelemetry);
@@ -10,6 +10,7 @@
 
 #include "ui_http_server.h"
 
+#include <cJSON.h>
 #include <inttypes.h>
 #include <math.h>
 #include <mbedtls/base64.h>
@@ -17,8 +18,11 @@
 #include <string.h>
 #include <sys/stat.h>
 
+#include "audio_mem.h"
+#include "capture.h"
 #include "dsp_processor.h"
 #include "esp_err.h"
+#include "esp_heap_caps.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "esp_spiffs.h"
@@ -27,6 +31,22 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "mem_plan.h"
+#include "metrics.h"
+#include "player.h"
+#if CONFIG_USE_SYNC_TELEMETRY
+#include "telemetry.h"
+#endif
+#include "time_sync.h"
+#include "trace.h"
+
+#if CONFIG_USE_SYNC_TELEMETRY
+#define TELEMETRY_WS_MAX_CLIENTS 2
+#define TELEMETRY_WS_INTERVAL_MS 100
+// samples per frame, the rest goes with the next one
+#define TELEMETRY_WS_MAX_SAMPLES 32
+#define TELEMETRY_WS_TASK_PRIORITY 2
+#endif
 
 static const char *TAG = "HTTP";
 
@@ -34,6 +54,12 @@ static QueueHandle_t xQueueHttp;
 
 static esp_netif_t *netInterface = NULL;
 
+#if CONFIG_USE_SYNC_TELEMETRY
+static httpd_handle_t uiServer = NULL;
+// websocket clients, only accessed from httpd task
+static int telemetryFds[TELEMETRY_WS_MAX_CLIENTS] = {-1, -1};
+#endif
+
 /**
  *
  */
@@ -265,6 +291,663 @@ static esp_err_t root_post_handler(httpd_req_t *req) {
   return ESP_OK;
 }
 
+/**
+ *
+ */
+static cJSON *mem_plan_to_json(void) {
+  cJSON *root, *pools, *pool;
+  mem_plan_t plan;
+
+  mem_plan_get(&plan);
+
+  root = cJSON_CreateObject();
+  if (root == NULL) {
+    return NULL;
+  }
+
+  cJSON_AddStringToObject(root, "decision",
+                          mem_plan_decision_str(plan.decision));
+  cJSON_AddNumberToObject(root, "codec", plan.codec);
+  cJSON_AddNumberToObject(root, "bufferMs", plan.buf_ms);
+  cJSON_AddNumberToObject(root, "grantedBufferMs", plan.grantedBuf_ms);
+  cJSON_AddNumberToObject(root, "entries", plan.entries);
+  cJSON_AddNumberToObject(root, "chunkBytes", plan.chunkBytes);
+  cJSON_AddNumberToObject(root, "decoderBytes", plan.decoderBytes);
+  cJSON_AddNumberToObject(root, "dmaBytes", plan.dmaBytes);
+  cJSON_AddNumberToObject(root, "playoutBytes", plan.playoutBytes);
+  cJSON_AddNumberToObject(root, "dspBytes", plan.dspBytes);
+  cJSON_AddNumberToObject(root, "bounceBytes", plan.bounceBytes);
+  cJSON_AddNumberToObject(root, "plannedUs", plan.planned_us);
+
+  pools = cJSON_AddObjectToObject(root, "pools");
+  for (int i = 0; (pools != NULL) && (i < MEM_PLAN_POOL_MAX); i++) {
+    pool = cJSON_AddObjectToObject(pools, mem_plan_pool_str(i));
+    if (pool != NULL) {
+      cJSON_AddNumberToObject(pool, "need", plan.need[i]);
+      cJSON_AddNumberToObject(pool, "avail", plan.avail[i]);
+    }
+  }
+
+  return root;
+}
+
+/**
+ *
+ */
+static cJSON *queue_stats_to_json(void) {
+  cJSON *root;
+  player_queue_stats_t stats;
+
+  memset(&stats, 0, sizeof(stats));
+  player_get_queue_stats(&stats);
+
+  root = cJSON_CreateObject();
+  if (root == NULL) {
+    return NULL;
+  }
+
+  cJSON_AddNumberToObject(root, "length", stats.length);
+  cJSON_AddNumberToObject(root, "highWater", stats.highWater);
+  cJSON_AddNumberToObject(root, "dropped", stats.dropped);
+  cJSON_AddNumberToObject(root, "throttleCnt", stats.throttleCnt);
+  cJSON_AddNumberToObject(root, "throttledUs", stats.throttled_us);
+
+  return root;
+}
+
+/**
+ *
+ */
+static cJSON *bounce_stats_to_json(void) {
+  cJSON *root;
+  player_bounce_stats_t stats;
+
+  if (player_get_bounce_stats(&stats) < 0) {
+    return NULL;
+  }
+
+  root = cJSON_CreateObject();
+  if (root == NULL) {
+    return NULL;
+  }
+
+  cJSON_AddNumberToObject(root, "chunks", stats.chunks);
+  cJSON_AddNumberToObject(root, "fallbacks", stats.fallbacks);
+  cJSON_AddNumberToObject(root, "bytes", stats.bytes);
+  cJSON_AddNumberToObject(root, "copyUs", stats.copy_us);
+  cJSON_AddNumberToObject(root, "copyMaxUs", stats.copyMax_us);
+
+  return root;
+}
+
+/**
+ * usage per tag and heap, heaps a tag never used are left out, and
+ * fragmentation index per heap, oldest sample first
+ */
+static cJSON *heap_stats_to_json(void) {
+#if CONFIG_USE_HEAP_ACCOUNTING
+  cJSON *root, *tags, *tag, *heaps, *heap, *index;
+  audio_mem_usage_t usage;
+  audio_mem_frag_t frag[AUDIO_MEM_FRAG_SAMPLES];
+  uint32_t cnt;
+
+  root = cJSON_CreateObject();
+  if (root == NULL) {
+    return NULL;
+  }
+
+  tags = cJSON_AddObjectToObject(root, "tags");
+  for (int i = 0; (tags != NULL) && (i < AUDIO_MEM_TAG_MAX); i++) {
+    tag = cJSON_AddObjectToObject(tags, audio_mem_tag_str(i));
+    for (int j = 0; (tag != NULL) && (j < AUDIO_MEM_HEAP_MAX); j++) {
+      audio_mem_stats_get(i, j, &usage);
+      if ((usage.allocs == 0) && (usage.fails == 0)) {
+        continue;
+      }
+
+      heap = cJSON_AddObjectToObject(tag, audio_mem_heap_str(j));
+      if (heap != NULL) {
+        cJSON_AddNumberToObject(heap, "current", usage.current);
+        cJSON_AddNumberToObject(heap, "peak", usage.peak);
+        cJSON_AddNumberToObject(heap, "allocs", usage.allocs);
+        cJSON_AddNumberToObject(heap, "fails", usage.fails);
+      }
+    }
+  }
+
+  cJSON_AddNumberToObject(root, "fragPeriodS",
+                          CONFIG_HEAP_FRAG_SAMPLE_PERIOD_S);
+  heaps = cJSON_AddObjectToObject(root, "frag");
+  for (int j = 0; (heaps != NULL) && (j < AUDIO_MEM_HEAP_MAX); j++) {
+    cnt = audio_mem_frag_get(j, frag, AUDIO_MEM_FRAG_SAMPLES);
+    if (cnt == 0) {
+      continue;
+    }
+
+    heap = cJSON_AddObjectToObject(heaps, audio_mem_heap_str(j));
+    if (heap == NULL) {
+      continue;
+    }
+
+    // latest sample
+    cJSON_AddNumberToObject(heap, "free", frag[cnt - 1].free);
+    cJSON_AddNumberToObject(heap, "largest", frag[cnt - 1].largest);
+    index = cJSON_AddArrayToObject(heap, "index");
+    for (uint32_t k = 0; (index != NULL) && (k < cnt); k++) {
+      cJSON_AddItemToArray(index, cJSON_CreateNumber(frag[k].index));
+    }
+  }
+
+  return root;
+#else
+  return NULL;
+#endif
+}
+
+/*
+ * status get handler, reports player state as JSON
+ */
+static esp_err_t status_get_handler(httpd_req_t *req) {
+  cJSON *root;
+  char *str;
+
+  root = cJSON_CreateObject();
+  if (root == NULL) {
+    return httpd_resp_send_500(req);
+  }
+
+  cJSON_AddItemToObject(root, "memPlan", mem_plan_to_json());
+  cJSON_AddItemToObject(root, "queue", queue_stats_to_json());
+  // NULL items, e.g. of disabled features, aren't added
+  cJSON_AddItemToObject(root, "bounce", bounce_stats_to_json());
+  cJSON_AddItemToObject(root, "heap", heap_stats_to_json());
+
+  str = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  if (str == NULL) {
+    return httpd_resp_send_500(req);
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, str);
+  cJSON_free(str);
+
+  return ESP_OK;
+}
+
+#if CONFIG_USE_METRICS
+/**
+ * send one metric in text exposition format, type and help are skipped if
+ * NULL, e.g. for further samples of the same family
+ */
+static void metrics_send(httpd_req_t *req, const char *name,
+                         const char *labels, const char *type,
+                         const char *help, const char *value) {
+  char line[192];
+
+  if (type != NULL) {
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help,
+             name, type);
+    httpd_resp_sendstr_chunk(req, line);
+  }
+
+  snprintf(line, sizeof(line), "%s%s%s%s %s\n", name,
+           (labels != NULL) ? "{" : "", (labels != NULL) ? labels : "",
+           (labels != NULL) ? "}" : "", value);
+  httpd_resp_sendstr_chunk(req, line);
+}
+
+/**
+ *
+ */
+static void metrics_send_u64(httpd_req_t *req, const char *name,
+                             const char *labels, const char *type,
+                             const char *help, uint64_t value) {
+  char str[24];
+
+  snprintf(str, sizeof(str), "%llu", value);
+  metrics_send(req, name, labels, type, help, str);
+}
+
+/**
+ *
+ */
+static void metrics_send_i64(httpd_req_t *req, const char *name,
+                             const char *labels, const char *type,
+                             const char *help, int64_t value) {
+  char str[24];
+
+  snprintf(str, sizeof(str), "%lld", value);
+  metrics_send(req, name, labels, type, help, str);
+}
+
+/**
+ * time sync message counts, bursts and path quality
+ */
+static void metrics_send_time_sync(httpd_req_t *req) {
+  time_sync_stats_t sync;
+  char labels[32];
+
+  if (time_sync_get_stats(&sync) < 0) {
+    return;
+  }
+
+  metrics_send_u64(req, "snapclient_time_sync_messages_total", "dir=\"tx\"",
+                   "counter", "Time sync messages sent and received",
+                   sync.txCnt);
+  metrics_send_u64(req, "snapclient_time_sync_messages_total", "dir=\"rx\"",
+                   NULL, NULL, sync.rxCnt);
+  metrics_send_u64(req, "snapclient_time_sync_bytes_total", "dir=\"tx\"",
+                   "counter", "Bytes sent and received for time sync",
+                   sync.txBytes);
+  metrics_send_u64(req, "snapclient_time_sync_bytes_total", "dir=\"rx\"",
+                   NULL, NULL, sync.rxBytes);
+  metrics_send_u64(req, "snapclient_time_sync_rtt_outliers_total", NULL,
+                   "counter", "Time replies dropped because of their RTT",
+                   sync.rttOutlierCnt);
+
+  for (int i = TIME_SYNC_BURST_CONNECT; i < TIME_SYNC_BURST_REASON_MAX; i++) {
+    snprintf(labels, sizeof(labels), "reason=\"%s\"",
+             time_sync_burst_reason_str(i));
+    metrics_send_u64(req, "snapclient_time_sync_bursts_total", labels,
+                     (i == TIME_SYNC_BURST_CONNECT) ? "counter" : NULL,
+                     "Time sync bursts by reason", sync.burstCnt[i]);
+  }
+
+  metrics_send_u64(req, "snapclient_time_sync_period_us", NULL, "gauge",
+                   "Current time sync period", sync.period_us);
+  metrics_send_i64(req, "snapclient_time_sync_rtt_us", NULL, "gauge",
+                   "Smoothed round trip time", sync.rtt_us);
+  metrics_send_i64(req, "snapclient_time_sync_rtt_var_us", NULL, "gauge",
+                   "Smoothed round trip time deviation", sync.rttVar_us);
+  metrics_send_i64(req, "snapclient_time_sync_offset_error_us", NULL,
+                   "gauge", "Last server offset sample minus median",
+                   sync.offsetError_us);
+  metrics_send_i64(req, "snapclient_time_sync_offset_error_max_us", NULL,
+                   "gauge", "Max. absolute offset error since last log",
+                   sync.offsetErrorMax_us);
+}
+
+/**
+ *
+ */
+static void metrics_send_hist(httpd_req_t *req, const metrics_desc_t *desc,
+                              const metrics_histogram_t *hist, bool header) {
+  static const uint32_t bounds_us[METRICS_HIST_BUCKETS] =
+      METRICS_HIST_BOUNDS_US;
+  char name[64], labels[64], str[24];
+  uint64_t cumulative = 0;
+
+  if (header == true) {
+    char line[192];
+
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n",
+             desc->name, desc->help, desc->name);
+    httpd_resp_sendstr_chunk(req, line);
+  }
+
+  snprintf(name, sizeof(name), "%s_bucket", desc->name);
+  for (int i = 0; i <= METRICS_HIST_BUCKETS; i++) {
+    cumulative += hist->bucket[i];
+
+    if (i < METRICS_HIST_BUCKETS) {
+      snprintf(labels, sizeof(labels), "%s%sle=\"%g\"",
+               (desc->labels != NULL) ? desc->labels : "",
+               (desc->labels != NULL) ? "," : "", bounds_us[i] / 1000000.0);
+    } else {
+      snprintf(labels, sizeof(labels), "%s%sle=\"+Inf\"",
+               (desc->labels != NULL) ? desc->labels : "",
+               (desc->labels != NULL) ? "," : "");
+    }
+    metrics_send_u64(req, name, labels, NULL, NULL, cumulative);
+  }
+
+  snprintf(name, sizeof(name), "%s_sum", desc->name);
+  snprintf(str, sizeof(str), "%.6f", hist->sum_us / 1000000.0);
+  metrics_send(req, name, desc->labels, NULL, NULL, str);
+
+  snprintf(name, sizeof(name), "%s_count", desc->name);
+  metrics_send_u64(req, name, desc->labels, NULL, NULL, hist->count);
+}
+
+/*
+ * metrics get handler, Prometheus text exposition format
+ */
+static esp_err_t metrics_get_handler(httpd_req_t *req) {
+  static const struct {
+    const char *label;
+    uint32_t caps;
+  } heaps[] = {
+      {"caps=\"internal\"", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT},
+      {"caps=\"iram\"", MALLOC_CAP_32BIT | MALLOC_CAP_EXEC},
+      {"caps=\"dma\"", MALLOC_CAP_DMA},
+#if CONFIG_SPIRAM
+      {"caps=\"spiram\"", MALLOC_CAP_SPIRAM},
+#endif
+  };
+  metrics_snapshot_t *snapshot;
+  player_resync_stats_t resync;
+  player_queue_stats_t queue;
+  player_bounce_stats_t bounce;
+  const metrics_desc_t *desc, *prev;
+
+  // too large for httpd stack
+  snapshot = (metrics_snapshot_t *)audio_malloc_tag(AUDIO_MEM_TAG_HTTP,
+                                                    sizeof(metrics_snapshot_t));
+  if (snapshot == NULL) {
+    return httpd_resp_send_500(req);
+  }
+
+  metrics_get(snapshot);
+  memset(&resync, 0, sizeof(resync));
+  player_get_resync_stats(&resync);
+  memset(&queue, 0, sizeof(queue));
+  player_get_queue_stats(&queue);
+
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+  for (int i = 0; i < METRICS_COUNTER_MAX; i++) {
+    desc = metrics_counter_desc(i);
+    metrics_send_u64(req, desc->name, desc->labels, "counter", desc->help,
+                     snapshot->counter[i]);
+  }
+
+  prev = NULL;
+  for (int i = 0; i < METRICS_HIST_MAX; i++) {
+    desc = metrics_hist_desc(i);
+    metrics_send_hist(req, desc, &snapshot->hist[i],
+                      (prev == NULL) || (strcmp(prev->name, desc->name) != 0));
+    prev = desc;
+  }
+
+  audio_free_tag(AUDIO_MEM_TAG_HTTP, snapshot);
+
+  metrics_send_u64(req, "snapclient_chunks_dropped_total", NULL, "counter",
+                   "Chunks dropped because the queue was full", queue.dropped);
+  metrics_send_u64(req, "snapclient_rx_throttled_total", NULL, "counter",
+                   "Times network receive waited for queue space",
+                   queue.throttleCnt);
+  metrics_send_u64(req, "snapclient_queue_high_water", NULL, "gauge",
+                   "Max. chunks queued", queue.highWater);
+
+  metrics_send_u64(req, "snapclient_resyncs_total", "type=\"hard\"",
+                   "counter", "Playback resyncs by type", resync.hardCnt);
+  metrics_send_u64(req, "snapclient_resyncs_total", "type=\"soft\"", NULL,
+                   NULL, resync.softCnt);
+  metrics_send_u64(req, "snapclient_resyncs_total", "type=\"reconfig\"",
+                   NULL, NULL, resync.reconfigCnt);
+  metrics_send_u64(req, "snapclient_dma_underruns_total", NULL, "counter",
+                   "I2S DMA descriptors sent without new data",
+                   resync.underrunCnt);
+  metrics_send_u64(req, "snapclient_dropout_us_total", NULL, "counter",
+                   "Time muted because of hard resyncs", resync.dropout_us);
+  metrics_send_u64(req, "snapclient_soft_resync_us_total", "op=\"skip\"",
+                   "counter", "Audio skipped and padded by soft resyncs",
+                   resync.softSkipped_us);
+  metrics_send_u64(req, "snapclient_soft_resync_us_total", "op=\"pad\"",
+                   NULL, NULL, resync.softPadded_us);
+  metrics_send_i64(req, "snapclient_start_error_us", NULL, "gauge",
+                   "Last playback start vs. target time",
+                   resync.startError_us);
+  metrics_send_i64(req, "snapclient_start_error_max_us", NULL, "gauge",
+                   "Max. absolute playback start error",
+                   resync.startErrorMax_us);
+  metrics_send_i64(req, "snapclient_reconfig_gap_us", NULL, "gauge",
+                   "Last gap between old and new sample format",
+                   resync.reconfigGap_us);
+  metrics_send_i64(req, "snapclient_reconfig_gap_max_us", NULL, "gauge",
+                   "Max. gap between old and new sample format",
+                   resync.reconfigGapMax_us);
+
+  if (player_get_bounce_stats(&bounce) == 0) {
+    metrics_send_u64(req, "snapclient_bounce_fallbacks_total", NULL,
+                     "counter", "Chunks played from PSRAM directly",
+                     bounce.fallbacks);
+  }
+
+  metrics_send_time_sync(req);
+
+  for (int i = 0; i < sizeof(heaps) / sizeof(heaps[0]); i++) {
+    metrics_send_u64(req, "snapclient_heap_free_bytes", heaps[i].label,
+                     (i == 0) ? "gauge" : NULL, "Free heap by capability",
+                     heap_caps_get_free_size(heaps[i].caps));
+  }
+  for (int i = 0; i < sizeof(heaps) / sizeof(heaps[0]); i++) {
+    metrics_send_u64(req, "snapclient_heap_largest_free_block_bytes",
+                     heaps[i].label, (i == 0) ? "gauge" : NULL,
+                     "Largest free heap block by capability",
+                     heap_caps_get_largest_free_block(heaps[i].caps));
+  }
+
+  /* Send empty chunk to signal HTTP response completion */
+  httpd_resp_sendstr_chunk(req, NULL);
+
+  return ESP_OK;
+}
+#endif
+
+#if CONFIG_USE_TRACE
+/*
+ * trace_dump() callback
+ */
+static int32_t trace_send(const void *data, size_t len, void *ctx) {
+  httpd_req_t *req = (httpd_req_t *)ctx;
+
+  if (httpd_resp_send_chunk(req, data, len) != ESP_OK) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * trace get handler, binary dump for tools/trace_decode.py
+ */
+static esp_err_t trace_get_handler(httpd_req_t *req) {
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition",
+                     "attachment; filename=\"snapclient.trace\"");
+
+  if (trace_dump(trace_send, req) < 0) {
+    ESP_LOGW(TAG, "trace dump failed");
+
+    return ESP_FAIL;
+  }
+
+  /* Send empty chunk to signal HTTP response completion */
+  httpd_resp_send_chunk(req, NULL, 0);
+
+  return ESP_OK;
+}
+#endif
+
+#if CONFIG_USE_STREAM_CAPTURE
+/*
+ * capture_dump() callback
+ */
+static int32_t capture_send(const void *data, size_t len, void *ctx) {
+  httpd_req_t *req = (httpd_req_t *)ctx;
+
+  if (httpd_resp_send_chunk(req, data, len) != ESP_OK) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * capture get handler, received stream for --replay of the host build
+ */
+static esp_err_t capture_get_handler(httpd_req_t *req) {
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition",
+                     "attachment; filename=\"snapclient.cap\"");
+
+  if (capture_dump(capture_send, req) < 0) {
+    ESP_LOGW(TAG, "capture dump failed");
+
+    return ESP_FAIL;
+  }
+
+  /* Send empty chunk to signal HTTP response completion */
+  httpd_resp_send_chunk(req, NULL, 0);
+
+  return ESP_OK;
+}
+#endif
+
+/*
+ * static file get handler, sends files from SPIFFS as they are
+ */
+static esp_err_t file_get_handler(httpd_req_t *req) {
+  char path[48];
+  char buffer[256];
+  size_t len;
+  FILE *f;
+
+  snprintf(path, sizeof(path), "/html%s", req->uri);
+  f = fopen(path, "r");
+  if (f == NULL) {
+    ESP_LOGE(TAG, "fopen fail. [%s]", path);
+    return httpd_resp_send_404(req);
+  }
+
+  len = strlen(path);
+  if ((len > 3) && (strcmp(&path[len - 3], ".js") == 0)) {
+    httpd_resp_set_type(req, "application/javascript");
+  } else if ((len > 4) && (strcmp(&path[len - 4], ".css") == 0)) {
+    httpd_resp_set_type(req, "text/css");
+  }
+
+  while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    if (httpd_resp_send_chunk(req, buffer, len) != ESP_OK) {
+      break;
+    }
+  }
+  fclose(f);
+
+  /* Send empty chunk to signal HTTP response completion */
+  httpd_resp_send_chunk(req, NULL, 0);
+
+  return ESP_OK;
+}
+
+#if CONFIG_USE_SYNC_TELEMETRY
+/*
+ * telemetry websocket handler, clients only receive
+ */
+static esp_err_t telemetry_ws_handler(httpd_req_t *req) {
+  httpd_ws_frame_t frame;
+  esp_err_t ret;
+
+  if (req->method == HTTP_GET) {
+    int fd = httpd_req_to_sockfd(req);
+
+    for (int i = 0; i < TELEMETRY_WS_MAX_CLIENTS; i++) {
+      if (telemetryFds[i] < 0) {
+        telemetryFds[i] = fd;
+        telemetry_subscribe();
+
+        ESP_LOGI(TAG, "telemetry client %d connected", fd);
+
+        return ESP_OK;
+      }
+    }
+
+    ESP_LOGW(TAG, "too many telemetry clients");
+
+    return ESP_FAIL;
+  }
+
+  // drop anything clients send us
+  memset(&frame, 0, sizeof(frame));
+  ret = httpd_ws_recv_frame(req, &frame, 0);
+  if ((ret == ESP_OK) && (frame.len > 0)) {
+    frame.payload =
+        (uint8_t *)audio_malloc_tag(AUDIO_MEM_TAG_HTTP, frame.len);
+    if (frame.payload == NULL) {
+      return ESP_ERR_NO_MEM;
+    }
+    ret = httpd_ws_recv_frame(req, &frame, frame.len);
+    audio_free_tag(AUDIO_MEM_TAG_HTTP, frame.payload);
+  }
+
+  return ret;
+}
+
+/**
+ * runs in httpd task, arg is a frame from telemetry_ws_task()
+ */
+static void telemetry_ws_send(void *arg) {
+  telemetry_frame_hdr_t *hdr = (telemetry_frame_hdr_t *)arg;
+  httpd_ws_frame_t frame = {
+      .final = true,
+      .fragmented = false,
+      .type = HTTPD_WS_TYPE_BINARY,
+      .payload = (uint8_t *)arg,
+      .len = sizeof(telemetry_frame_hdr_t) +
+             hdr->count * sizeof(telemetry_sample_t),
+  };
+
+  for (int i = 0; i < TELEMETRY_WS_MAX_CLIENTS; i++) {
+    if (telemetryFds[i] < 0) {
+      continue;
+    }
+
+    if ((httpd_ws_get_fd_info(uiServer, telemetryFds[i]) !=
+         HTTPD_WS_CLIENT_WEBSOCKET) ||
+        (httpd_ws_send_frame_async(uiServer, telemetryFds[i], &frame) !=
+         ESP_OK)) {
+      ESP_LOGI(TAG, "telemetry client %d disconnected", telemetryFds[i]);
+
+      telemetryFds[i] = -1;
+      telemetry_unsubscribe();
+    }
+  }
+
+  audio_free_tag(AUDIO_MEM_TAG_HTTP, arg);
+}
+
+/**
+ * collect samples from player and hand them to httpd task
+ */
+static void telemetry_ws_task(void *pvParameters) {
+  uint32_t seq = 0, lost;
+  telemetry_frame_hdr_t *hdr;
+  telemetry_sample_t *samples;
+  uint32_t cnt;
+
+  while (1) {
+    vTaskDelay(pdMS_TO_TICKS(TELEMETRY_WS_INTERVAL_MS));
+
+    if (telemetry_active() == false) {
+      continue;
+    }
+
+    hdr = (telemetry_frame_hdr_t *)audio_malloc_tag(
+        AUDIO_MEM_TAG_HTTP,
+        sizeof(telemetry_frame_hdr_t) +
+            TELEMETRY_WS_MAX_SAMPLES * sizeof(telemetry_sample_t));
+    if (hdr == NULL) {
+      continue;
+    }
+    samples = (telemetry_sample_t *)&hdr[1];
+
+    cnt = telemetry_read(&seq, samples, TELEMETRY_WS_MAX_SAMPLES, &lost);
+
+    hdr->version = TELEMETRY_VERSION;
+    hdr->sampleSize = sizeof(telemetry_sample_t);
+    hdr->count = cnt;
+    hdr->lost = lost;
+
+    // empty frames are sent too, so we notice disconnected clients
+    if (httpd_queue_work(uiServer, telemetry_ws_send, hdr) != ESP_OK) {
+      audio_free_tag(AUDIO_MEM_TAG_HTTP, hdr);
+    }
+  }
+}
+#endif
+
 /*
  * favicon get handler
  */
@@ -281,6 +964,12 @@ esp_err_t start_server(const char *base_path, int port) {
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.server_port = port;
   config.max_open_sockets = 2;
+#if CONFIG_USE_SYNC_TELEMETRY
+  // httpd needs 3 sockets on its own, the Kconfig dependency of
+  // USE_SYNC_TELEMETRY leaves the rest for the snapcast connection
+  config.max_open_sockets += TELEMETRY_WS_MAX_CLIENTS;
+#endif
+  config.max_uri_handlers = 12;
 
   /* Use the URI wildcard matching function in order to
    * allow the same handler to respond to multiple different
@@ -314,6 +1003,63 @@ esp_err_t start_server(const char *base_path, int port) {
   };
   httpd_register_uri_handler(server, &_favicon_get_handler);
 
+  /* URI handler for status */
+  httpd_uri_t _status_get_handler = {
+      .uri = "/status", .method = HTTP_GET, .handler = status_get_handler,
+  };
+  httpd_register_uri_handler(server, &_status_get_handler);
+
+#if CONFIG_USE_METRICS
+  /* URI handler for metrics */
+  httpd_uri_t _metrics_get_handler = {
+      .uri = "/metrics", .method = HTTP_GET, .handler = metrics_get_handler,
+  };
+  httpd_register_uri_handler(server, &_metrics_get_handler);
+#endif
+
+#if CONFIG_USE_TRACE
+  /* URI handler for trace dump */
+  httpd_uri_t _trace_get_handler = {
+      .uri = "/trace", .method = HTTP_GET, .handler = trace_get_handler,
+  };
+  httpd_register_uri_handler(server, &_trace_get_handler);
+#endif
+
+#if CONFIG_USE_STREAM_CAPTURE
+  /* URI handler for stream capture */
+  httpd_uri_t _capture_get_handler = {
+      .uri = "/capture", .method = HTTP_GET, .handler = capture_get_handler,
+  };
+  httpd_register_uri_handler(server, &_capture_get_handler);
+#endif
+
+  /* URI handler for scripts used by index.html */
+  httpd_uri_t _graph_get_handler = {
+      .uri = "/graph.js", .method = HTTP_GET, .handler = file_get_handler,
+  };
+  httpd_register_uri_handler(server, &_graph_get_handler);
+
+  httpd_uri_t _telemetry_get_handler = {
+      .uri = "/telemetry.js", .method = HTTP_GET, .handler = file_get_handler,
+  };
+  httpd_register_uri_handler(server, &_telemetry_get_handler);
+
+#if CONFIG_USE_SYNC_TELEMETRY
+  /* URI handler for telemetry websocket */
+  httpd_uri_t _telemetry_ws_handler = {
+      .uri = "/ws/telemetry",
+      .method = HTTP_GET,
+      .handler = telemetry_ws_handler,
+      .is_websocket = true,
+  };
+  httpd_register_uri_handler(server, &_telemetry_ws_handler);
+
+  uiServer = server;
+
+  xTaskCreatePinnedToCore(telemetry_ws_task, "telemetry", 2048, NULL,
+                          TELEMETRY_WS_TASK_PRIORITY, NULL, tskNO_AFFINITY);
+#endif
+
   return ESP_OK;
 }
 
@@ -0,0 +1,238 @@
+/**
+ * Entry point of the host build
+ *
+ * Runs the firmware's app_main() against a snapserver reachable through
+ * BSD sockets or a replayed stream capture, audio goes to the virtual I2S
+ * sink of port/i2s_sink.c.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "freertos/FreeRTOS.h"
+#include "host_config.h"
+#include "replay.h"
+
+void app_main(void);
+
+host_config_t hostConfig = {
+    .serverHost = "127.0.0.1",
+    .serverPort = 1704,
+    .clientName = "snapclient-host",
+    .instance = 1,
+    .dacPpm = 0,
+    .dacWanderPpm = 0,
+    .dacWanderPeriod_s = 60,
+    .playoutLog = NULL,
+    .duration_s = 0,
+    .capture = NULL,
+    .replay = NULL,
+    .replaySpeed = 1,
+};
+
+static char serverAddr[INET_ADDRSTRLEN];
+
+static const struct option longOpts[] = {
+    {"server", required_argument, NULL, 's'},
+    {"port", required_argument, NULL, 'p'},
+    {"name", required_argument, NULL, 'n'},
+    {"instance", required_argument, NULL, 'i'},
+    {"dac-ppm", required_argument, NULL, 'd'},
+    {"dac-wander-ppm", required_argument, NULL, 'w'},
+    {"dac-wander-period", required_argument, NULL, 'W'},
+    {"playout-log", required_argument, NULL, 'l'},
+    {"duration", required_argument, NULL, 't'},
+    {"capture", required_argument, NULL, 'c'},
+    {"replay", required_argument, NULL, 'r'},
+    {"replay-speed", required_argument, NULL, 'x'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0},
+};
+
+/**
+ *
+ */
+static void usage(const char *prog) {
+  printf(
+      "usage: %s [options]\n"
+      "  -s, --server HOST            snapserver (%s)\n"
+      "  -p, --port PORT              snapserver stream port (%u)\n"
+      "  -n, --name NAME              client name (%s)\n"
+      "  -i, --instance N             last byte of MAC, 0..255 (%u)\n"
+      "  -d, --dac-ppm PPM            DAC clock error\n"
+      "  -w, --dac-wander-ppm PPM     amplitude of DAC clock wander\n"
+      "  -W, --dac-wander-period SEC  period of DAC clock wander (%.0f)\n"
+      "  -l, --playout-log FILE       record playout timestamps\n"
+      "  -t, --duration SEC           exit after SEC seconds\n"
+      "  -c, --capture FILE           write received stream on exit\n"
+      "  -r, --replay FILE            replay capture instead of connecting\n"
+      "  -x, --replay-speed N         replay N times as fast (%.0f)\n",
+      prog, hostConfig.serverHost, hostConfig.serverPort,
+      hostConfig.clientName, hostConfig.instance,
+      hostConfig.dacWanderPeriod_s, hostConfig.replaySpeed);
+}
+
+/**
+ * app_main() expects a numeric IPv4 address
+ */
+static int resolve_server(const char *host) {
+  struct addrinfo hints, *res;
+  int err;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  err = getaddrinfo(host, NULL, &hints, &res);
+  if (err != 0) {
+    fprintf(stderr, "can't resolve %s: %s\n", host, gai_strerror(err));
+
+    return -1;
+  }
+
+  inet_ntop(AF_INET, &((struct sockaddr_in *)res->ai_addr)->sin_addr,
+            serverAddr, sizeof(serverAddr));
+  freeaddrinfo(res);
+  hostConfig.serverHost = serverAddr;
+
+  return 0;
+}
+
+/**
+ * capture_dump() callback
+ */
+static int32_t capture_write_file(const void *data, size_t len, void *ctx) {
+  if (fwrite(data, 1, len, (FILE *)ctx) != len) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ *
+ */
+static void capture_save(void) {
+  FILE *f = fopen(hostConfig.capture, "wb");
+
+  if ((f == NULL) || (capture_dump(capture_write_file, f) < 0)) {
+    fprintf(stderr, "can't write capture to %s\n", hostConfig.capture);
+  }
+
+  if (f != NULL) {
+    fclose(f);
+  }
+}
+
+/**
+ * duration is in host_time_ns(), it passes faster with --replay-speed
+ */
+static void *duration_task(void *arg) {
+  struct timespec ts;
+
+  (void)arg;
+
+  host_time_to_timespec(
+      host_time_ns() + (int64_t)(hostConfig.duration_s * 1e9), &ts);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+         EINTR) {
+  }
+
+  // flushes the playout log
+  exit(EXIT_SUCCESS);
+
+  return NULL;
+}
+
+/**
+ *
+ */
+int main(int argc, char **argv) {
+  pthread_t thread;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "s:p:n:i:d:w:W:l:t:c:r:x:h", longOpts,
+                            NULL)) != -1) {
+    switch (opt) {
+      case 's':
+        hostConfig.serverHost = optarg;
+        break;
+      case 'p':
+        hostConfig.serverPort = atoi(optarg);
+        break;
+      case 'n':
+        hostConfig.clientName = optarg;
+        break;
+      case 'i':
+        hostConfig.instance = atoi(optarg);
+        break;
+      case 'd':
+        hostConfig.dacPpm = atof(optarg);
+        break;
+      case 'w':
+        hostConfig.dacWanderPpm = atof(optarg);
+        break;
+      case 'W':
+        hostConfig.dacWanderPeriod_s = atof(optarg);
+        break;
+      case 'l':
+        hostConfig.playoutLog = optarg;
+        break;
+      case 't':
+        hostConfig.duration_s = atof(optarg);
+        break;
+      case 'c':
+        hostConfig.capture = optarg;
+        break;
+      case 'r':
+        hostConfig.replay = optarg;
+        break;
+      case 'x':
+        hostConfig.replaySpeed = atof(optarg);
+        break;
+      case 'h':
+        usage(argv[0]);
+        return EXIT_SUCCESS;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (hostConfig.replay != NULL) {
+    if ((hostConfig.replaySpeed <= 0) ||
+        (replay_load(hostConfig.replay) < 0)) {
+      return EXIT_FAILURE;
+    }
+
+    host_time_scale_set(hostConfig.replaySpeed);
+  } else if (resolve_server(hostConfig.serverHost) < 0) {
+    return EXIT_FAILURE;
+  }
+
+  if (hostConfig.capture != NULL) {
+    atexit(capture_save);
+  }
+
+  // a server closing the connection must not kill us
+  signal(SIGPIPE, SIG_IGN);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  if (hostConfig.duration_s > 0) {
+    pthread_create(&thread, NULL, duration_task, NULL);
+    pthread_detach(thread);
+  }
+
+  app_main();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/**
+ * Board, network and service stubs of the host build
+ *
+ * The host is always connected, there is no codec and the UI http server,
+ * OTA and mDNS aren't available.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_hal.h"
+#include "board.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "net_functions.h"
+#include "ota_server.h"
+#include "ui_http_server.h"
+#include "wifi_interface.h"
+
+static const char *TAG = "board";
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+
+static struct audio_hal dacHal = {
+    .mute = true,
+    .volume = 0,
+};
+
+static struct audio_board_handle boardHandle = {
+    .audio_hal = &dacHal,
+    .adc_hal = NULL,
+};
+
+/**
+ *
+ */
+audio_board_handle_t audio_board_init(void) { return &boardHandle; }
+
+/**
+ *
+ */
+esp_err_t get_i2s_pins(i2s_port_t port, board_i2s_pin_t *i2s_config) {
+  (void)port;
+
+  i2s_config->mck_io_num = I2S_GPIO_UNUSED;
+  i2s_config->bck_io_num = I2S_GPIO_UNUSED;
+  i2s_config->ws_io_num = I2S_GPIO_UNUSED;
+  i2s_config->data_out_num = I2S_GPIO_UNUSED;
+  i2s_config->data_in_num = I2S_GPIO_UNUSED;
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t audio_hal_ctrl_codec(audio_hal_handle_t audio_hal,
+                               audio_hal_codec_mode_t mode,
+                               audio_hal_ctrl_t audio_hal_ctrl) {
+  (void)audio_hal;
+  (void)mode;
+  (void)audio_hal_ctrl;
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t audio_hal_set_mute(audio_hal_handle_t audio_hal, bool mute) {
+  audio_hal->mute = mute;
+  ESP_LOGI(TAG, "DAC %smuted", mute ? "" : "un");
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t audio_hal_set_volume(audio_hal_handle_t audio_hal, int volume) {
+  audio_hal->volume = volume;
+  ESP_LOGI(TAG, "DAC volume %d", volume);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+void wifi_init(void) {}
+
+/**
+ *
+ */
+void init_http_server_task(char *key) { (void)key; }
+
+/**
+ *
+ */
+void ota_server_task(void *param) {
+  (void)param;
+
+  vTaskDelete(NULL);
+}
+
+/**
+ *
+ */
+void ota_server_start_my(void) {}
+
+/**
+ *
+ */
+void net_mdns_register(const char *clientname) { (void)clientname; }
+
+/**
+ *
+ */
+void mdns_print_results(mdns_result_t *results) { (void)results; }
+
+/**
+ *
+ */
+uint32_t find_mdns_service(const char *service_name, const char *proto) {
+  (void)service_name;
+  (void)proto;
+
+  return 0;
+}
+
+/**
+ *
+ */
+void set_time_from_sntp(void) {}
@@ -0,0 +1,114 @@
+/**
+ * Biquad filter and coefficient generators of esp-dsp, plain C
+ */
+
+#include <math.h>
+
+#include "dsps_biquad.h"
+#include "dsps_biquad_gen.h"
+
+/**
+ * coeffs are b0, b1, b2, a1, a2 normalized to a0
+ */
+static void biquad_norm(float *coeffs, float b0, float b1, float b2, float a0,
+                        float a1, float a2) {
+  coeffs[0] = b0 / a0;
+  coeffs[1] = b1 / a0;
+  coeffs[2] = b2 / a0;
+  coeffs[3] = a1 / a0;
+  coeffs[4] = a2 / a0;
+}
+
+/**
+ *
+ */
+esp_err_t dsps_biquad_gen_lpf_f32(float *coeffs, float f, float qFactor) {
+  float w0, c, alpha;
+
+  if (qFactor <= 0.0001f) {
+    qFactor = 0.0001f;
+  }
+
+  w0 = 2 * M_PI * f;
+  c = cosf(w0);
+  alpha = sinf(w0) / (2 * qFactor);
+
+  biquad_norm(coeffs, (1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c,
+              1 - alpha);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t dsps_biquad_gen_hpf_f32(float *coeffs, float f, float qFactor) {
+  float w0, c, alpha;
+
+  if (qFactor <= 0.0001f) {
+    qFactor = 0.0001f;
+  }
+
+  w0 = 2 * M_PI * f;
+  c = cosf(w0);
+  alpha = sinf(w0) / (2 * qFactor);
+
+  biquad_norm(coeffs, (1 + c) / 2, -(1 + c), (1 + c) / 2, 1 + alpha, -2 * c,
+              1 - alpha);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t dsps_biquad_gen_lowShelf_f32(float *coeffs, float f, float gain,
+                                       float qFactor) {
+  float A = sqrtf(powf(10, gain / 20));
+  float w0 = 2 * M_PI * f;
+  float c = cosf(w0);
+  float alpha = sinf(w0) / (2 * qFactor);
+  float sa = 2 * sqrtf(A) * alpha;
+
+  biquad_norm(coeffs, A * ((A + 1) - (A - 1) * c + sa),
+              2 * A * ((A - 1) - (A + 1) * c),
+              A * ((A + 1) - (A - 1) * c - sa), (A + 1) + (A - 1) * c + sa,
+              -2 * ((A - 1) + (A + 1) * c), (A + 1) + (A - 1) * c - sa);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t dsps_biquad_gen_highShelf_f32(float *coeffs, float f, float gain,
+                                        float qFactor) {
+  float A = sqrtf(powf(10, gain / 20));
+  float w0 = 2 * M_PI * f;
+  float c = cosf(w0);
+  float alpha = sinf(w0) / (2 * qFactor);
+  float sa = 2 * sqrtf(A) * alpha;
+
+  biquad_norm(coeffs, A * ((A + 1) + (A - 1) * c + sa),
+              -2 * A * ((A - 1) + (A + 1) * c),
+              A * ((A + 1) + (A - 1) * c - sa), (A + 1) - (A - 1) * c + sa,
+              2 * ((A - 1) - (A + 1) * c), (A + 1) - (A - 1) * c - sa);
+
+  return ESP_OK;
+}
+
+/**
+ * direct form II, w holds the two delay elements
+ */
+esp_err_t dsps_biquad_f32_ansi(const float *input, float *output, int len,
+                               float *coef, float *w) {
+  for (int i = 0; i < len; i++) {
+    float d0 = input[i] - coef[3] * w[0] - coef[4] * w[1];
+
+    output[i] = coef[0] * d0 + coef[1] * w[0] + coef[2] * w[1];
+    w[1] = w[0];
+    w[0] = d0;
+  }
+
+  return ESP_OK;
+}
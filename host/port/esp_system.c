@@ -0,0 +1,218 @@
+/**
+ * Logging, heap capabilities, MAC address and restart
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "host_config.h"
+
+#define LOG_TAG_LEVELS_MAX 32
+
+// free sizes reported, close to an ESP32 with 4MB PSRAM while streaming
+#define HEAP_INTERNAL_FREE (160 * 1024)
+#define HEAP_IRAM_FREE (64 * 1024)
+#define HEAP_SPIRAM_FREE (4000 * 1024)
+
+typedef struct log_tag_level_s {
+  char tag[16];
+  esp_log_level_t level;
+} log_tag_level_t;
+
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+static esp_log_level_t logLevelDefault = ESP_LOG_INFO;
+static log_tag_level_t logLevel[LOG_TAG_LEVELS_MAX];
+static uint32_t logLevelCnt = 0;
+
+/**
+ *
+ */
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+  pthread_mutex_lock(&logLock);
+
+  if (strcmp(tag, "*") == 0) {
+    logLevelDefault = level;
+    logLevelCnt = 0;
+  } else {
+    uint32_t i;
+
+    for (i = 0; i < logLevelCnt; i++) {
+      if (strncmp(logLevel[i].tag, tag, sizeof(logLevel[i].tag) - 1) == 0) {
+        break;
+      }
+    }
+
+    if (i < LOG_TAG_LEVELS_MAX) {
+      snprintf(logLevel[i].tag, sizeof(logLevel[i].tag), "%s", tag);
+      logLevel[i].level = level;
+      if (i == logLevelCnt) {
+        logLevelCnt++;
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&logLock);
+}
+
+/**
+ *
+ */
+static esp_log_level_t log_level_get(const char *tag) {
+  esp_log_level_t level = logLevelDefault;
+
+  for (uint32_t i = 0; i < logLevelCnt; i++) {
+    if (strncmp(logLevel[i].tag, tag, sizeof(logLevel[i].tag) - 1) == 0) {
+      level = logLevel[i].level;
+
+      break;
+    }
+  }
+
+  return level;
+}
+
+/**
+ * same line format as ESP-IDF without colors, time is ms since start
+ */
+void esp_log_write(esp_log_level_t level, const char *tag, const char *fmt,
+                   ...) {
+  static const char letter[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+  va_list args;
+
+  pthread_mutex_lock(&logLock);
+
+  if ((level != ESP_LOG_NONE) && (level <= log_level_get(tag))) {
+    fprintf(stdout, "%c (%lld) %s: ", letter[level],
+            (long long)(esp_timer_get_time() / 1000), tag);
+    va_start(args, fmt);
+    vfprintf(stdout, fmt, args);
+    va_end(args);
+    fputc('\n', stdout);
+    fflush(stdout);
+  }
+
+  pthread_mutex_unlock(&logLock);
+}
+
+/**
+ *
+ */
+void *heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+
+/**
+ *
+ */
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+  return calloc(n, size);
+}
+
+/**
+ *
+ */
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps) {
+  return realloc(ptr, size);
+}
+
+/**
+ * caps are ignored, so the first ones will do
+ */
+void *heap_caps_calloc_prefer(size_t n, size_t size, size_t num, ...) {
+  return calloc(n, size);
+}
+
+/**
+ *
+ */
+void heap_caps_free(void *ptr) { free(ptr); }
+
+/**
+ *
+ */
+size_t heap_caps_get_allocated_size(void *ptr) {
+  return malloc_usable_size(ptr);
+}
+
+/**
+ * a capability set is served by the first region which has all of them
+ */
+size_t heap_caps_get_free_size(uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) {
+    return HEAP_SPIRAM_FREE;
+  }
+
+  if (caps & MALLOC_CAP_EXEC) {
+    return HEAP_IRAM_FREE;
+  }
+
+  if (caps & MALLOC_CAP_INTERNAL) {
+    return HEAP_INTERNAL_FREE;
+  }
+
+  // malloc() falls back to PSRAM
+  return HEAP_INTERNAL_FREE + HEAP_SPIRAM_FREE;
+}
+
+/**
+ *
+ */
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  if (caps & (MALLOC_CAP_SPIRAM | MALLOC_CAP_EXEC | MALLOC_CAP_INTERNAL)) {
+    return heap_caps_get_free_size(caps);
+  }
+
+  return HEAP_SPIRAM_FREE;
+}
+
+/**
+ *
+ */
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+  return heap_caps_get_free_size(caps);
+}
+
+/**
+ *
+ */
+size_t heap_caps_get_total_size(uint32_t caps) {
+  return heap_caps_get_free_size(caps);
+}
+
+/**
+ *
+ */
+uint32_t esp_get_free_heap_size(void) {
+  return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+/**
+ * there is no reboot, end the process and let the caller start it again
+ */
+void esp_restart(void) {
+  fprintf(stderr, "esp_restart() called, exiting\n");
+  fflush(stdout);
+
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * locally administered, last byte tells clients on one host apart
+ */
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+  mac[0] = 0x02;
+  mac[1] = 0x53;
+  mac[2] = 0x43;
+  mac[3] = 0x00;
+  mac[4] = (uint8_t)type;
+  mac[5] = hostConfig.instance;
+
+  return ESP_OK;
+}
@@ -0,0 +1,257 @@
+/**
+ * esp_timer on one dispatch thread
+ *
+ * Timers are kept in a list, the thread sleeps until the earliest one
+ * expires and calls its callback without the lock held, so callbacks may
+ * start and stop timers.
+ */
+
+#include "esp_timer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void *arg;
+  const char *name;
+  bool skipUnhandled;
+  bool active;
+  int64_t alarm_us;   //!< next expiry in esp_timer_get_time() time base
+  uint64_t period_us;  //!< 0 for one shot timers
+  struct esp_timer *next;
+};
+
+static pthread_mutex_t timerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timerCond;
+static pthread_once_t timerOnce = PTHREAD_ONCE_INIT;
+static struct esp_timer *timerList = NULL;
+
+/**
+ *
+ */
+int64_t esp_timer_get_time(void) { return host_time_us(); }
+
+/**
+ * earliest active timer, called with lock taken
+ */
+static struct esp_timer *timer_next(void) {
+  struct esp_timer *next = NULL;
+
+  for (struct esp_timer *t = timerList; t != NULL; t = t->next) {
+    if ((t->active == true) &&
+        ((next == NULL) || (t->alarm_us < next->alarm_us))) {
+      next = t;
+    }
+  }
+
+  return next;
+}
+
+/**
+ *
+ */
+static void *timer_task(void *arg) {
+  pthread_mutex_lock(&timerLock);
+
+  while (1) {
+    struct esp_timer *t = timer_next();
+    int64_t now = esp_timer_get_time();
+    esp_timer_cb_t cb;
+    void *cbArg;
+
+    if (t == NULL) {
+      pthread_cond_wait(&timerCond, &timerLock);
+
+      continue;
+    }
+
+    if (t->alarm_us > now) {
+      struct timespec deadline;
+      int64_t wait_us = t->alarm_us - now;
+
+      host_time_to_timespec(host_time_ns() + wait_us * 1000, &deadline);
+      pthread_cond_timedwait(&timerCond, &timerLock, &deadline);
+
+      // list may have changed meanwhile
+      continue;
+    }
+
+    if (t->period_us > 0) {
+      t->alarm_us += t->period_us;
+      if ((t->skipUnhandled == true) && (t->alarm_us <= now)) {
+        t->alarm_us = now + t->period_us;
+      }
+    } else {
+      t->active = false;
+    }
+
+    cb = t->callback;
+    cbArg = t->arg;
+
+    pthread_mutex_unlock(&timerLock);
+    cb(cbArg);
+    pthread_mutex_lock(&timerLock);
+  }
+
+  return NULL;
+}
+
+/**
+ *
+ */
+static void timer_task_start(void) {
+  pthread_condattr_t attr;
+  pthread_t thread;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&timerCond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  pthread_create(&thread, NULL, timer_task, NULL);
+  pthread_setname_np(thread, "esp_timer");
+  pthread_detach(thread);
+}
+
+/**
+ *
+ */
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args,
+                           esp_timer_handle_t *handle) {
+  struct esp_timer *t;
+
+  if ((args == NULL) || (args->callback == NULL) || (handle == NULL)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_once(&timerOnce, timer_task_start);
+
+  t = calloc(1, sizeof(struct esp_timer));
+  if (t == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  t->callback = args->callback;
+  t->arg = args->arg;
+  t->name = args->name;
+  t->skipUnhandled = args->skip_unhandled_events;
+
+  pthread_mutex_lock(&timerLock);
+  t->next = timerList;
+  timerList = t;
+  pthread_mutex_unlock(&timerLock);
+
+  *handle = t;
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us,
+                             uint64_t period_us) {
+  esp_err_t err = ESP_OK;
+
+  if (timer == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&timerLock);
+  if (timer->active == true) {
+    err = ESP_ERR_INVALID_STATE;
+  } else {
+    timer->alarm_us = esp_timer_get_time() + timeout_us;
+    timer->period_us = period_us;
+    timer->active = true;
+    pthread_cond_signal(&timerCond);
+  }
+  pthread_mutex_unlock(&timerLock);
+
+  return err;
+}
+
+/**
+ *
+ */
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  return timer_start(timer, timeout_us, 0);
+}
+
+/**
+ *
+ */
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer,
+                                   uint64_t period_us) {
+  return timer_start(timer, period_us, period_us);
+}
+
+/**
+ *
+ */
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  esp_err_t err = ESP_OK;
+
+  if (timer == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&timerLock);
+  if (timer->active == false) {
+    err = ESP_ERR_INVALID_STATE;
+  }
+  timer->active = false;
+  pthread_cond_signal(&timerCond);
+  pthread_mutex_unlock(&timerLock);
+
+  return err;
+}
+
+/**
+ *
+ */
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+  bool active;
+
+  pthread_mutex_lock(&timerLock);
+  active = timer->active;
+  pthread_mutex_unlock(&timerLock);
+
+  return active;
+}
+
+/**
+ *
+ */
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  struct esp_timer **p;
+
+  if (timer == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&timerLock);
+  if (timer->active == true) {
+    pthread_mutex_unlock(&timerLock);
+
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  for (p = &timerList; *p != NULL; p = &(*p)->next) {
+    if (*p == timer) {
+      *p = timer->next;
+
+      break;
+    }
+  }
+  pthread_mutex_unlock(&timerLock);
+
+  free(timer);
+
+  return ESP_OK;
+}
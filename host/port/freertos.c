@@ -0,0 +1,760 @@
+/**
+ * FreeRTOS tasks, queues, semaphores and event groups on POSIX threads
+ *
+ * All waits use host_time_ns(), the same clock esp_timer_get_time() is
+ * based on. It is CLOCK_MONOTONIC unless --replay-speed speeds it up. A
+ * task deleted by another one is cancelled while it blocks in one of the
+ * functions here, cleanup handlers release the locks it held.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct host_task_s {
+  pthread_t thread;
+  char name[16];
+  TaskFunction_t fn;
+  void *param;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t notifyValue;
+  bool notifyPending;
+};
+
+struct host_queue_s {
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+  uint32_t length;
+  uint32_t itemSize;
+  uint32_t count;
+  uint32_t head;  //!< index of oldest item
+  uint8_t *items;
+};
+
+struct host_event_group_s {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  EventBits_t bits;
+};
+
+static __thread struct host_task_s *currentTask = NULL;
+
+static int64_t bootTime_us = 0;
+
+// virtual time runs timeScale times as fast as CLOCK_MONOTONIC since
+// scaleBase_ns, when both were equal
+static int64_t scaleBase_ns = 0;
+static double timeScale = 1.0;
+
+/**
+ *
+ */
+static int64_t monotonic_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ *
+ */
+int64_t host_time_ns(void) {
+  int64_t now = monotonic_ns();
+
+  if (timeScale == 1.0) {
+    return now;
+  }
+
+  return scaleBase_ns + (int64_t)((double)(now - scaleBase_ns) * timeScale);
+}
+
+/**
+ * CLOCK_MONOTONIC deadline at which host_time_ns() reaches ns
+ */
+void host_time_to_timespec(int64_t ns, struct timespec *ts) {
+  if (timeScale != 1.0) {
+    ns = scaleBase_ns + (int64_t)((double)(ns - scaleBase_ns) / timeScale);
+  }
+
+  ts->tv_sec = ns / 1000000000LL;
+  ts->tv_nsec = ns % 1000000000LL;
+}
+
+/**
+ * Let time pass scale times as fast, before any task is started
+ */
+void host_time_scale_set(double scale) {
+  scaleBase_ns = monotonic_ns();
+  timeScale = scale;
+}
+
+/**
+ * time since process start, like esp_timer_get_time() since boot
+ */
+int64_t host_time_us(void) { return host_time_ns() / 1000 - bootTime_us; }
+
+__attribute__((constructor)) static void host_time_init(void) {
+  bootTime_us = 0;
+  bootTime_us = host_time_us();
+}
+
+/**
+ *
+ */
+void vPortEnterCritical(portMUX_TYPE *mux) {
+  pthread_mutex_lock(&mux->mutex);
+}
+
+/**
+ *
+ */
+void vPortExitCritical(portMUX_TYPE *mux) {
+  pthread_mutex_unlock(&mux->mutex);
+}
+
+/**
+ *
+ */
+static void cond_init(pthread_cond_t *cond) {
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+/**
+ * absolute CLOCK_MONOTONIC deadline ticks from now
+ */
+static void deadline_get(TickType_t ticks, struct timespec *deadline) {
+  uint64_t ns = (uint64_t)ticks * 1000000000ULL / configTICK_RATE_HZ;
+
+  host_time_to_timespec(host_time_ns() + (int64_t)ns, deadline);
+}
+
+static void unlock_cleanup(void *mutex) {
+  pthread_mutex_unlock((pthread_mutex_t *)mutex);
+}
+
+/**
+ * Wait on cond until deadline. Returns false on timeout. Call with mutex
+ * taken, deadline NULL waits forever.
+ */
+static bool cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                      const struct timespec *deadline) {
+  int err;
+
+  pthread_cleanup_push(unlock_cleanup, mutex);
+  if (deadline == NULL) {
+    err = pthread_cond_wait(cond, mutex);
+  } else {
+    err = pthread_cond_timedwait(cond, mutex, deadline);
+  }
+  pthread_cleanup_pop(0);
+
+  return err != ETIMEDOUT;
+}
+
+/**
+ * Wait until ready() returns true, false if ticks passed before. Called
+ * with lock taken.
+ */
+static bool wait_until(bool (*ready)(const void *), const void *ctx,
+                       pthread_cond_t *cond, pthread_mutex_t *lock,
+                       TickType_t ticks) {
+  struct timespec deadline;
+
+  deadline_get(ticks, &deadline);
+
+  while (ready(ctx) == false) {
+    if (ticks == 0) {
+      return false;
+    }
+
+    if ((cond_wait(cond, lock, (ticks == portMAX_DELAY) ? NULL : &deadline) ==
+         false) &&
+        (ready(ctx) == false)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ *
+ */
+static struct host_task_s *task_alloc(const char *name) {
+  struct host_task_s *task = calloc(1, sizeof(struct host_task_s));
+
+  if (task == NULL) {
+    return NULL;
+  }
+
+  snprintf(task->name, sizeof(task->name), "%s", name);
+  pthread_mutex_init(&task->lock, NULL);
+  cond_init(&task->cond);
+
+  return task;
+}
+
+/**
+ *
+ */
+static void *task_entry(void *arg) {
+  struct host_task_s *task = (struct host_task_s *)arg;
+
+  currentTask = task;
+  pthread_setname_np(pthread_self(), task->name);
+
+  task->fn(task->param);
+
+  // FreeRTOS tasks must not return, but be forgiving
+  return NULL;
+}
+
+/**
+ * stack size, priority and core are ignored, host threads get the default
+ * stack which is a lot larger than what we have on target
+ */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t coreId) {
+  struct host_task_s *task = task_alloc(name);
+  pthread_attr_t attr;
+
+  (void)stackDepth, (void)priority, (void)coreId;
+
+  if (task == NULL) {
+    return pdFAIL;
+  }
+
+  task->fn = fn;
+  task->param = param;
+
+  // new task may be notified right away
+  if (handle != NULL) {
+    *handle = task;
+  }
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&task->thread, &attr, task_entry, task) != 0) {
+    pthread_attr_destroy(&attr);
+    free(task);
+
+    if (handle != NULL) {
+      *handle = NULL;
+    }
+
+    return pdFAIL;
+  }
+  pthread_attr_destroy(&attr);
+
+  return pdPASS;
+}
+
+/**
+ * handles aren't freed, someone might still notify a deleted task
+ */
+void vTaskDelete(TaskHandle_t task) {
+  if ((task == NULL) || (task == currentTask)) {
+    pthread_exit(NULL);
+  }
+
+  pthread_cancel(task->thread);
+}
+
+/**
+ *
+ */
+void vTaskDelay(TickType_t ticks) {
+  struct timespec deadline;
+
+  if (ticks == 0) {
+    sched_yield();
+
+    return;
+  }
+
+  deadline_get(ticks, &deadline);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) ==
+         EINTR) {
+  }
+}
+
+/**
+ *
+ */
+TickType_t xTaskGetTickCount(void) {
+  return (TickType_t)(host_time_us() * configTICK_RATE_HZ / 1000000LL);
+}
+
+/**
+ * threads not created by xTaskCreatePinnedToCore(), e.g. main, get a handle
+ * on first use
+ */
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  if (currentTask == NULL) {
+    currentTask = task_alloc("main");
+    currentTask->thread = pthread_self();
+  }
+
+  return currentTask;
+}
+
+/**
+ *
+ */
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  (void)task;
+
+  return 0;
+}
+
+/**
+ *
+ */
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value,
+                       eNotifyAction action) {
+  BaseType_t ret = pdPASS;
+
+  if (task == NULL) {
+    return pdFAIL;
+  }
+
+  pthread_mutex_lock(&task->lock);
+  switch (action) {
+    case eSetBits:
+      task->notifyValue |= value;
+      break;
+    case eIncrement:
+      task->notifyValue++;
+      break;
+    case eSetValueWithOverwrite:
+      task->notifyValue = value;
+      break;
+    case eSetValueWithoutOverwrite:
+      if (task->notifyPending == true) {
+        ret = pdFAIL;
+      } else {
+        task->notifyValue = value;
+      }
+      break;
+    default:
+      break;
+  }
+  task->notifyPending = true;
+  pthread_cond_broadcast(&task->cond);
+  pthread_mutex_unlock(&task->lock);
+
+  return ret;
+}
+
+/**
+ *
+ */
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value,
+                              eNotifyAction action, BaseType_t *woken) {
+  if (woken != NULL) {
+    *woken = pdFALSE;
+  }
+
+  return xTaskNotify(task, value, action);
+}
+
+static bool task_notified(const void *ctx) {
+  return ((const struct host_task_s *)ctx)->notifyPending;
+}
+
+/**
+ *
+ */
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit,
+                           uint32_t *value, TickType_t ticks) {
+  struct host_task_s *task = xTaskGetCurrentTaskHandle();
+  bool ok;
+
+  pthread_mutex_lock(&task->lock);
+  if (task->notifyPending == false) {
+    task->notifyValue &= ~clearOnEntry;
+  }
+
+  ok = wait_until(task_notified, task, &task->cond, &task->lock, ticks);
+
+  if (value != NULL) {
+    *value = task->notifyValue;
+  }
+
+  if (ok == true) {
+    task->notifyValue &= ~clearOnExit;
+    task->notifyPending = false;
+  }
+  pthread_mutex_unlock(&task->lock);
+
+  return ok ? pdTRUE : pdFALSE;
+}
+
+/**
+ *
+ */
+static QueueHandle_t queue_create(UBaseType_t length, UBaseType_t itemSize,
+                                  UBaseType_t count) {
+  struct host_queue_s *q = calloc(1, sizeof(struct host_queue_s));
+
+  if (q == NULL) {
+    return NULL;
+  }
+
+  if (itemSize > 0) {
+    q->items = malloc(length * itemSize);
+    if (q->items == NULL) {
+      free(q);
+
+      return NULL;
+    }
+  }
+
+  q->length = length;
+  q->itemSize = itemSize;
+  q->count = count;
+  pthread_mutex_init(&q->lock, NULL);
+  cond_init(&q->notEmpty);
+  cond_init(&q->notFull);
+
+  return q;
+}
+
+/**
+ *
+ */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  return queue_create(length, itemSize, 0);
+}
+
+/**
+ *
+ */
+void vQueueDelete(QueueHandle_t q) {
+  if (q == NULL) {
+    return;
+  }
+
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->notEmpty);
+  pthread_cond_destroy(&q->notFull);
+  free(q->items);
+  free(q);
+}
+
+/**
+ *
+ */
+static bool queue_not_full(const void *ctx) {
+  const struct host_queue_s *q = (const struct host_queue_s *)ctx;
+
+  return q->count < q->length;
+}
+
+static bool queue_not_empty(const void *ctx) {
+  const struct host_queue_s *q = (const struct host_queue_s *)ctx;
+
+  return q->count > 0;
+}
+
+/**
+ *
+ */
+static BaseType_t queue_send(QueueHandle_t q, const void *item,
+                             TickType_t ticks, bool front) {
+  bool ok;
+
+  if (q == NULL) {
+    return pdFAIL;
+  }
+
+  pthread_mutex_lock(&q->lock);
+  ok = wait_until(queue_not_full, q, &q->notFull, &q->lock, ticks);
+  if (ok == true) {
+    if (q->itemSize > 0) {
+      uint32_t idx;
+
+      if (front == true) {
+        q->head = (q->head + q->length - 1) % q->length;
+        idx = q->head;
+      } else {
+        idx = (q->head + q->count) % q->length;
+      }
+      memcpy(&q->items[idx * q->itemSize], item, q->itemSize);
+    }
+    q->count++;
+    pthread_cond_signal(&q->notEmpty);
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return ok ? pdPASS : pdFAIL;
+}
+
+/**
+ *
+ */
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks) {
+  return queue_send(q, item, ticks, false);
+}
+
+/**
+ *
+ */
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item,
+                             TickType_t ticks) {
+  return queue_send(q, item, ticks, true);
+}
+
+/**
+ * only meant for queues of length 1, like in FreeRTOS
+ */
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void *item) {
+  if (q == NULL) {
+    return pdFAIL;
+  }
+
+  pthread_mutex_lock(&q->lock);
+  if (q->itemSize > 0) {
+    memcpy(&q->items[q->head * q->itemSize], item, q->itemSize);
+  }
+  q->count = 1;
+  pthread_cond_signal(&q->notEmpty);
+  pthread_mutex_unlock(&q->lock);
+
+  return pdPASS;
+}
+
+/**
+ *
+ */
+static BaseType_t queue_receive(QueueHandle_t q, void *item, TickType_t ticks,
+                                bool peek) {
+  bool ok;
+
+  if (q == NULL) {
+    return pdFAIL;
+  }
+
+  pthread_mutex_lock(&q->lock);
+  ok = wait_until(queue_not_empty, q, &q->notEmpty, &q->lock, ticks);
+  if (ok == true) {
+    if ((q->itemSize > 0) && (item != NULL)) {
+      memcpy(item, &q->items[q->head * q->itemSize], q->itemSize);
+    }
+
+    if (peek == false) {
+      q->head = (q->head + 1) % q->length;
+      q->count--;
+      pthread_cond_signal(&q->notFull);
+    } else {
+      // let other peekers and receivers see it too
+      pthread_cond_signal(&q->notEmpty);
+    }
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return ok ? pdPASS : pdFAIL;
+}
+
+/**
+ *
+ */
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks) {
+  return queue_receive(q, item, ticks, false);
+}
+
+/**
+ *
+ */
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t ticks) {
+  return queue_receive(q, item, ticks, true);
+}
+
+/**
+ *
+ */
+BaseType_t xQueueReset(QueueHandle_t q) {
+  pthread_mutex_lock(&q->lock);
+  q->count = 0;
+  q->head = 0;
+  pthread_cond_broadcast(&q->notFull);
+  pthread_mutex_unlock(&q->lock);
+
+  return pdPASS;
+}
+
+/**
+ *
+ */
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  UBaseType_t cnt;
+
+  pthread_mutex_lock(&q->lock);
+  cnt = q->count;
+  pthread_mutex_unlock(&q->lock);
+
+  return cnt;
+}
+
+/**
+ *
+ */
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+  UBaseType_t cnt;
+
+  pthread_mutex_lock(&q->lock);
+  cnt = q->length - q->count;
+  pthread_mutex_unlock(&q->lock);
+
+  return cnt;
+}
+
+/**
+ * no priority inheritance and no owner check
+ */
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return queue_create(1, 0, 1); }
+
+/**
+ *
+ */
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+  return queue_create(1, 0, 0);
+}
+
+/**
+ *
+ */
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max,
+                                           UBaseType_t initial) {
+  return queue_create(max, 0, initial);
+}
+
+/**
+ *
+ */
+EventGroupHandle_t xEventGroupCreate(void) {
+  struct host_event_group_s *group =
+      calloc(1, sizeof(struct host_event_group_s));
+
+  if (group == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_init(&group->lock, NULL);
+  cond_init(&group->cond);
+
+  return group;
+}
+
+/**
+ *
+ */
+void vEventGroupDelete(EventGroupHandle_t group) {
+  if (group == NULL) {
+    return;
+  }
+
+  pthread_mutex_destroy(&group->lock);
+  pthread_cond_destroy(&group->cond);
+  free(group);
+}
+
+/**
+ *
+ */
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+  EventBits_t ret;
+
+  pthread_mutex_lock(&group->lock);
+  group->bits |= bits;
+  ret = group->bits;
+  pthread_cond_broadcast(&group->cond);
+  pthread_mutex_unlock(&group->lock);
+
+  return ret;
+}
+
+/**
+ * returns bits before they were cleared
+ */
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+  EventBits_t ret;
+
+  pthread_mutex_lock(&group->lock);
+  ret = group->bits;
+  group->bits &= ~bits;
+  pthread_mutex_unlock(&group->lock);
+
+  return ret;
+}
+
+/**
+ *
+ */
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+  EventBits_t ret;
+
+  pthread_mutex_lock(&group->lock);
+  ret = group->bits;
+  pthread_mutex_unlock(&group->lock);
+
+  return ret;
+}
+
+typedef struct event_group_wait_s {
+  const struct host_event_group_s *group;
+  EventBits_t bits;
+  bool all;
+} event_group_wait_t;
+
+static bool event_group_match(const void *ctx) {
+  const event_group_wait_t *w = (const event_group_wait_t *)ctx;
+
+  if (w->all == true) {
+    return (w->group->bits & w->bits) == w->bits;
+  }
+
+  return (w->group->bits & w->bits) != 0;
+}
+
+/**
+ *
+ */
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clearOnExit, BaseType_t waitForAll,
+                                TickType_t ticks) {
+  event_group_wait_t w = {
+      .group = group, .bits = bits, .all = (waitForAll == pdTRUE)};
+  EventBits_t ret;
+  bool ok;
+
+  pthread_mutex_lock(&group->lock);
+  ok = wait_until(event_group_match, &w, &group->cond, &group->lock, ticks);
+  ret = group->bits;
+  if ((ok == true) && (clearOnExit == pdTRUE)) {
+    group->bits &= ~bits;
+  }
+  pthread_mutex_unlock(&group->lock);
+
+  return ret;
+}
@@ -0,0 +1,302 @@
+/**
+ * General purpose timer with an alarm thread per timer
+ *
+ * The count is derived from host_time_ns(). The alarm thread sleeps until
+ * the alarm is due and calls on_alarm from there, so "ISR" latency is the
+ * wake up latency of the host scheduler.
+ */
+
+#include "driver/gptimer.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+  GPTIMER_STATE_INIT = 0,
+  GPTIMER_STATE_ENABLED,
+  GPTIMER_STATE_RUNNING,
+} gptimer_state_t;
+
+struct gptimer_t {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  bool exit;
+  gptimer_state_t state;
+  uint32_t resolution_hz;
+  uint64_t count;     //!< count when it was set or timer was stopped
+  int64_t start_ns;   //!< time of start, valid if running
+  gptimer_alarm_config_t alarm;
+  bool alarmEnabled;
+  gptimer_event_callbacks_t cbs;
+  void *userData;
+};
+
+/**
+ *
+ */
+static int64_t gptimer_now_ns(void) { return host_time_ns(); }
+
+/**
+ * called with lock taken
+ */
+static uint64_t gptimer_count_get(struct gptimer_t *timer, int64_t now_ns) {
+  if (timer->state != GPTIMER_STATE_RUNNING) {
+    return timer->count;
+  }
+
+  return timer->count + (uint64_t)(now_ns - timer->start_ns) *
+                            timer->resolution_hz / 1000000000ULL;
+}
+
+/**
+ *
+ */
+static void *gptimer_task(void *arg) {
+  struct gptimer_t *timer = arg;
+
+  pthread_mutex_lock(&timer->lock);
+
+  while (timer->exit == false) {
+    int64_t now_ns = gptimer_now_ns();
+    uint64_t count;
+    int64_t alarm_ns;
+    struct timespec deadline;
+    gptimer_alarm_event_data_t edata;
+
+    if ((timer->state != GPTIMER_STATE_RUNNING) ||
+        (timer->alarmEnabled == false)) {
+      pthread_cond_wait(&timer->cond, &timer->lock);
+
+      continue;
+    }
+
+    count = gptimer_count_get(timer, now_ns);
+    if (count < timer->alarm.alarm_count) {
+      alarm_ns = timer->start_ns +
+                 (int64_t)((timer->alarm.alarm_count - timer->count) *
+                           1000000000ULL / timer->resolution_hz);
+      host_time_to_timespec(alarm_ns, &deadline);
+      pthread_cond_timedwait(&timer->cond, &timer->lock, &deadline);
+
+      // timer may have been reconfigured meanwhile
+      continue;
+    }
+
+    edata.count_value = count;
+    edata.alarm_value = timer->alarm.alarm_count;
+
+    if (timer->alarm.flags.auto_reload_on_alarm) {
+      timer->count = timer->alarm.reload_count;
+      timer->start_ns = now_ns;
+    } else {
+      // fires once until alarm action is set again
+      timer->alarmEnabled = false;
+    }
+
+    if (timer->cbs.on_alarm != NULL) {
+      gptimer_alarm_cb_t cb = timer->cbs.on_alarm;
+      void *userData = timer->userData;
+
+      pthread_mutex_unlock(&timer->lock);
+      cb(timer, &edata, userData);
+      pthread_mutex_lock(&timer->lock);
+    }
+  }
+
+  pthread_mutex_unlock(&timer->lock);
+
+  return NULL;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_new_timer(const gptimer_config_t *config,
+                            gptimer_handle_t *ret_timer) {
+  struct gptimer_t *timer;
+  pthread_condattr_t attr;
+
+  if ((config == NULL) || (config->resolution_hz == 0) ||
+      (config->direction != GPTIMER_COUNT_UP)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  timer = calloc(1, sizeof(struct gptimer_t));
+  if (timer == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  timer->resolution_hz = config->resolution_hz;
+
+  pthread_mutex_init(&timer->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&timer->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_create(&timer->thread, NULL, gptimer_task, timer) != 0) {
+    free(timer);
+
+    return ESP_ERR_NO_MEM;
+  }
+  pthread_setname_np(timer->thread, "gptimer");
+
+  *ret_timer = timer;
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_del_timer(gptimer_handle_t timer) {
+  pthread_mutex_lock(&timer->lock);
+  if (timer->state != GPTIMER_STATE_INIT) {
+    pthread_mutex_unlock(&timer->lock);
+
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->exit = true;
+  pthread_cond_signal(&timer->cond);
+  pthread_mutex_unlock(&timer->lock);
+
+  pthread_join(timer->thread, NULL);
+
+  pthread_mutex_destroy(&timer->lock);
+  pthread_cond_destroy(&timer->cond);
+  free(timer);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_set_raw_count(gptimer_handle_t timer, uint64_t value) {
+  pthread_mutex_lock(&timer->lock);
+  timer->count = value;
+  timer->start_ns = gptimer_now_ns();
+  pthread_cond_signal(&timer->cond);
+  pthread_mutex_unlock(&timer->lock);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_get_raw_count(gptimer_handle_t timer, uint64_t *value) {
+  pthread_mutex_lock(&timer->lock);
+  *value = gptimer_count_get(timer, gptimer_now_ns());
+  pthread_mutex_unlock(&timer->lock);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_register_event_callbacks(
+    gptimer_handle_t timer, const gptimer_event_callbacks_t *cbs,
+    void *user_data) {
+  pthread_mutex_lock(&timer->lock);
+  timer->cbs = *cbs;
+  timer->userData = user_data;
+  pthread_mutex_unlock(&timer->lock);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer,
+                                   const gptimer_alarm_config_t *config) {
+  pthread_mutex_lock(&timer->lock);
+  if (config != NULL) {
+    timer->alarm = *config;
+    timer->alarmEnabled = true;
+  } else {
+    timer->alarmEnabled = false;
+  }
+  pthread_cond_signal(&timer->cond);
+  pthread_mutex_unlock(&timer->lock);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_enable(gptimer_handle_t timer) {
+  esp_err_t err = ESP_OK;
+
+  pthread_mutex_lock(&timer->lock);
+  if (timer->state != GPTIMER_STATE_INIT) {
+    err = ESP_ERR_INVALID_STATE;
+  } else {
+    timer->state = GPTIMER_STATE_ENABLED;
+  }
+  pthread_mutex_unlock(&timer->lock);
+
+  return err;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_disable(gptimer_handle_t timer) {
+  esp_err_t err = ESP_OK;
+
+  pthread_mutex_lock(&timer->lock);
+  if (timer->state != GPTIMER_STATE_ENABLED) {
+    err = ESP_ERR_INVALID_STATE;
+  } else {
+    timer->state = GPTIMER_STATE_INIT;
+  }
+  pthread_mutex_unlock(&timer->lock);
+
+  return err;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_start(gptimer_handle_t timer) {
+  esp_err_t err = ESP_OK;
+
+  pthread_mutex_lock(&timer->lock);
+  if (timer->state != GPTIMER_STATE_ENABLED) {
+    err = ESP_ERR_INVALID_STATE;
+  } else {
+    timer->start_ns = gptimer_now_ns();
+    timer->state = GPTIMER_STATE_RUNNING;
+    pthread_cond_signal(&timer->cond);
+  }
+  pthread_mutex_unlock(&timer->lock);
+
+  return err;
+}
+
+/**
+ *
+ */
+esp_err_t gptimer_stop(gptimer_handle_t timer) {
+  esp_err_t err = ESP_OK;
+
+  pthread_mutex_lock(&timer->lock);
+  if (timer->state != GPTIMER_STATE_RUNNING) {
+    err = ESP_ERR_INVALID_STATE;
+  } else {
+    timer->count = gptimer_count_get(timer, gptimer_now_ns());
+    timer->state = GPTIMER_STATE_ENABLED;
+    pthread_cond_signal(&timer->cond);
+  }
+  pthread_mutex_unlock(&timer->lock);
+
+  return err;
+}
@@ -0,0 +1,659 @@
+/**
+ * Virtual I2S sink with the ESP-IDF 5.1 channel API
+ *
+ * Mimics the driver's DMA handling: descriptors are played in a ring, each
+ * completed descriptor is reported with on_sent and handed to writers
+ * through a queue of dma_desc_num - 1 entries. If writers are too slow the
+ * oldest entry is dropped and on_send_q_ovf is called, the DMA plays
+ * whatever is in the descriptor again.
+ *
+ * A DMA thread per enabled channel sleeps until each descriptor is played
+ * completely. Descriptor start times are computed from the virtual DAC
+ * clock, so wake up latency of the host doesn't add up.
+ */
+
+#include "i2s_sink.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "driver/i2s_std.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "hal/i2s_ll.h"
+#include "host_config.h"
+#include "soc/rtc.h"
+
+#define PLAYOUT_LOG_FLUSH_CNT 64
+
+struct i2s_channel_obj_t {
+  i2s_port_t id;
+  uint32_t descNum;
+  uint32_t frameNum;
+  bool autoClear;
+  bool init;  //!< std mode was configured
+
+  i2s_std_clk_config_t clk;
+  i2s_std_slot_config_t slot;
+  uint32_t frameBytes;
+  size_t bufSize;      //!< bytes per descriptor
+  uint8_t **desc;      //!< descriptor buffers
+  bool *descWritten;   //!< written since it was played last
+  double apllNominal;  //!< APLL frequency for clk, 0 if not APLL
+
+  i2s_event_callbacks_t cbs;
+  void *userData;
+
+  QueueHandle_t msgQueue;  //!< uint32_t, descriptors free for writing
+  int32_t currIdx;         //!< descriptor written to, -1 if none
+  size_t rwPos;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t dmaThread;
+  bool enabled;
+  bool halted;  //!< by i2s_ll_tx_stop()
+  bool slave;   //!< by i2s_ll_tx_set_slave_mod(), no clock comes in
+  bool dmaExit;
+};
+
+struct host_i2s_dev_s {
+  i2s_chan_handle_t tx;
+};
+
+static const char *TAG = "i2s_sink";
+
+static struct host_i2s_dev_s i2sDev[SOC_I2S_NUM];
+
+static pthread_mutex_t playoutLogLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *playoutLog = NULL;
+static uint32_t playoutLogCnt = 0;
+
+/**
+ *
+ */
+static int64_t i2s_now_ns(void) { return host_time_ns(); }
+
+/**
+ *
+ */
+static void i2s_ns_to_timespec(int64_t ns, struct timespec *ts) {
+  host_time_to_timespec(ns, ts);
+}
+
+/**
+ * open log on first use, header is written once
+ */
+static void i2s_playout_log(const host_playout_record_t *rec) {
+  if (hostConfig.playoutLog == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&playoutLogLock);
+
+  if (playoutLog == NULL) {
+    uint8_t hdr[8];
+
+    playoutLog = fopen(hostConfig.playoutLog, "wb");
+    if (playoutLog == NULL) {
+      ESP_LOGE(TAG, "can't open playout log %s", hostConfig.playoutLog);
+      hostConfig.playoutLog = NULL;
+      pthread_mutex_unlock(&playoutLogLock);
+
+      return;
+    }
+
+    memcpy(hdr, HOST_PLAYOUT_MAGIC, 4);
+    hdr[4] = HOST_PLAYOUT_VERSION;
+    hdr[5] = sizeof(host_playout_record_t);
+    hdr[6] = 0;
+    hdr[7] = 0;
+    fwrite(hdr, sizeof(hdr), 1, playoutLog);
+  }
+
+  fwrite(rec, sizeof(host_playout_record_t), 1, playoutLog);
+  if ((++playoutLogCnt % PLAYOUT_LOG_FLUSH_CNT) == 0) {
+    fflush(playoutLog);
+  }
+
+  pthread_mutex_unlock(&playoutLogLock);
+}
+
+/**
+ * frame rate of the virtual DAC at time t_ns
+ */
+static double i2s_rate_get(struct i2s_channel_obj_t *ch, int64_t t_ns) {
+  double ppm = hostConfig.dacPpm;
+  double rate;
+
+  if ((hostConfig.dacWanderPpm != 0) && (hostConfig.dacWanderPeriod_s > 0)) {
+    ppm += hostConfig.dacWanderPpm *
+           sin(2.0 * M_PI * (double)t_ns * 1e-9 /
+               hostConfig.dacWanderPeriod_s);
+  }
+
+  rate = (double)ch->clk.sample_rate_hz * (1.0 + ppm * 1e-6);
+
+  if (ch->apllNominal > 0) {
+    double apll = host_apll_freq();
+
+    if (apll > 0) {
+      rate *= apll / ch->apllNominal;
+    }
+  }
+
+  return rate;
+}
+
+/**
+ * descriptor idx was played completely, like the EOF interrupt of the driver
+ */
+static void i2s_dma_eof(struct i2s_channel_obj_t *ch, uint32_t idx) {
+  i2s_event_data_t evt = {
+      .data = &ch->desc[idx],
+      .size = ch->bufSize,
+  };
+  uint32_t dummy;
+
+  if (ch->cbs.on_sent != NULL) {
+    ch->cbs.on_sent(ch, &evt, ch->userData);
+  }
+
+  if (uxQueueSpacesAvailable(ch->msgQueue) == 0) {
+    xQueueReceive(ch->msgQueue, &dummy, 0);
+    if (ch->cbs.on_send_q_ovf != NULL) {
+      ch->cbs.on_send_q_ovf(ch, &evt, ch->userData);
+    }
+  }
+
+  if (ch->autoClear == true) {
+    memset(ch->desc[idx], 0, ch->bufSize);
+  }
+
+  ch->descWritten[idx] = false;
+  xQueueSend(ch->msgQueue, &idx, 0);
+}
+
+/**
+ *
+ */
+static void *i2s_dma_task(void *arg) {
+  struct i2s_channel_obj_t *ch = arg;
+  struct timespec ts;
+  uint32_t idx = 0;
+  uint8_t flags = HOST_PLAYOUT_FLAG_START;
+  int64_t t_ns = i2s_now_ns() + HOST_I2S_START_LATENCY_US * 1000LL;
+
+  pthread_mutex_lock(&ch->lock);
+
+  // FIFO is filled, i2s_ll_tx_stop() may come in meanwhile
+  i2s_ns_to_timespec(t_ns, &ts);
+  while ((ch->dmaExit == false) && (i2s_now_ns() < t_ns)) {
+    pthread_cond_timedwait(&ch->cond, &ch->lock, &ts);
+  }
+
+  while (ch->dmaExit == false) {
+    host_playout_record_t rec;
+    int64_t end_ns;
+
+    if ((ch->halted == true) || (ch->slave == true)) {
+      pthread_cond_wait(&ch->cond, &ch->lock);
+
+      // output starts right when it is released
+      t_ns = i2s_now_ns();
+      flags |= HOST_PLAYOUT_FLAG_START;
+
+      continue;
+    }
+
+    rec.t_ns = t_ns;
+    rec.rate_hz = i2s_rate_get(ch, t_ns);
+    rec.frames = ch->frameNum;
+    rec.sr = ch->clk.sample_rate_hz;
+    rec.frameBytes = ch->frameBytes;
+    rec.flags = flags;
+    rec.reserved = 0;
+    memcpy(&rec.first, ch->desc[idx], sizeof(rec.first));
+    if (ch->descWritten[idx] == false) {
+      rec.flags |= HOST_PLAYOUT_FLAG_STALE;
+    }
+    flags = 0;
+
+    i2s_playout_log(&rec);
+
+    end_ns = t_ns + (int64_t)llround((double)ch->frameNum * 1e9 / rec.rate_hz);
+    i2s_ns_to_timespec(end_ns, &ts);
+    while ((ch->dmaExit == false) && (i2s_now_ns() < end_ns)) {
+      pthread_cond_timedwait(&ch->cond, &ch->lock, &ts);
+    }
+    if (ch->dmaExit == true) {
+      break;
+    }
+    t_ns = end_ns;
+
+    pthread_mutex_unlock(&ch->lock);
+    i2s_dma_eof(ch, idx);
+    pthread_mutex_lock(&ch->lock);
+
+    idx = (idx + 1) % ch->descNum;
+  }
+
+  pthread_mutex_unlock(&ch->lock);
+
+  return NULL;
+}
+
+/**
+ *
+ */
+static void i2s_desc_free(struct i2s_channel_obj_t *ch) {
+  if (ch->desc != NULL) {
+    for (uint32_t i = 0; i < ch->descNum; i++) {
+      free(ch->desc[i]);
+    }
+  }
+  free(ch->desc);
+  free(ch->descWritten);
+  ch->desc = NULL;
+  ch->descWritten = NULL;
+}
+
+/**
+ * (re)allocate descriptor buffers for current slot config
+ */
+static esp_err_t i2s_desc_alloc(struct i2s_channel_obj_t *ch) {
+  uint32_t slotBytes = (ch->slot.data_bit_width <= 16) ? 2 : 4;
+  size_t bufSize;
+
+  if (ch->slot.slot_bit_width != I2S_SLOT_BIT_WIDTH_AUTO) {
+    slotBytes = ch->slot.slot_bit_width / 8;
+  }
+
+  ch->frameBytes = slotBytes * 2;
+  bufSize = ch->frameNum * ch->frameBytes;
+  if ((ch->desc != NULL) && (bufSize == ch->bufSize)) {
+    return ESP_OK;
+  }
+
+  i2s_desc_free(ch);
+
+  ch->bufSize = bufSize;
+  ch->desc = calloc(ch->descNum, sizeof(uint8_t *));
+  ch->descWritten = calloc(ch->descNum, sizeof(bool));
+  if ((ch->desc == NULL) || (ch->descWritten == NULL)) {
+    i2s_desc_free(ch);
+
+    return ESP_ERR_NO_MEM;
+  }
+
+  for (uint32_t i = 0; i < ch->descNum; i++) {
+    ch->desc[i] = calloc(1, bufSize);
+    if (ch->desc[i] == NULL) {
+      i2s_desc_free(ch);
+
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  return ESP_OK;
+}
+
+/**
+ * the driver programs the APLL for the sample rate
+ */
+static void i2s_clk_set(struct i2s_channel_obj_t *ch,
+                        const i2s_std_clk_config_t *clk) {
+  ch->clk = *clk;
+  ch->apllNominal = 0;
+
+  if (clk->clk_src == I2S_CLK_SRC_APLL) {
+    uint32_t o_div, sdm0, sdm1, sdm2;
+    uint32_t freq = rtc_clk_apll_coeff_calc(
+        2 * clk->sample_rate_hz * clk->mclk_multiple, &o_div, &sdm0, &sdm1,
+        &sdm2);
+
+    if (freq > 0) {
+      rtc_clk_apll_coeff_set(o_div, sdm0, sdm1, sdm2);
+      ch->apllNominal = host_apll_freq();
+    }
+  }
+}
+
+/**
+ *
+ */
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg,
+                          i2s_chan_handle_t *tx_handle,
+                          i2s_chan_handle_t *rx_handle) {
+  struct i2s_channel_obj_t *ch;
+  pthread_condattr_t attr;
+
+  if ((chan_cfg == NULL) || (tx_handle == NULL) || (rx_handle != NULL) ||
+      (chan_cfg->id >= SOC_I2S_NUM) || (chan_cfg->dma_desc_num < 2) ||
+      (chan_cfg->dma_frame_num == 0)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (i2sDev[chan_cfg->id].tx != NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  ch = calloc(1, sizeof(struct i2s_channel_obj_t));
+  if (ch == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  ch->id = chan_cfg->id;
+  ch->descNum = chan_cfg->dma_desc_num;
+  ch->frameNum = chan_cfg->dma_frame_num;
+  ch->autoClear = chan_cfg->auto_clear;
+  ch->currIdx = -1;
+
+  ch->msgQueue = xQueueCreate(ch->descNum - 1, sizeof(uint32_t));
+  if (ch->msgQueue == NULL) {
+    free(ch);
+
+    return ESP_ERR_NO_MEM;
+  }
+
+  pthread_mutex_init(&ch->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&ch->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  i2sDev[ch->id].tx = ch;
+  *tx_handle = ch;
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle) {
+  if (handle->enabled == true) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  i2sDev[handle->id].tx = NULL;
+
+  vQueueDelete(handle->msgQueue);
+  i2s_desc_free(handle);
+  pthread_mutex_destroy(&handle->lock);
+  pthread_cond_destroy(&handle->cond);
+  free(handle);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle,
+                                    const i2s_std_config_t *std_cfg) {
+  esp_err_t err;
+
+  if ((handle->enabled == true) || (handle->init == true)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  handle->slot = std_cfg->slot_cfg;
+  err = i2s_desc_alloc(handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  i2s_clk_set(handle, &std_cfg->clk_cfg);
+  handle->init = true;
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t i2s_channel_reconfig_std_clock(i2s_chan_handle_t handle,
+                                         const i2s_std_clk_config_t *clk_cfg) {
+  if ((handle->enabled == true) || (handle->init == false)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  i2s_clk_set(handle, clk_cfg);
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t i2s_channel_reconfig_std_slot(
+    i2s_chan_handle_t handle, const i2s_std_slot_config_t *slot_cfg) {
+  if ((handle->enabled == true) || (handle->init == false)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  handle->slot = *slot_cfg;
+
+  return i2s_desc_alloc(handle);
+}
+
+/**
+ *
+ */
+esp_err_t i2s_channel_register_event_callback(
+    i2s_chan_handle_t handle, const i2s_event_callbacks_t *callbacks,
+    void *user_data) {
+  if (handle->enabled == true) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  handle->cbs = *callbacks;
+  handle->userData = user_data;
+
+  return ESP_OK;
+}
+
+/**
+ * DMA starts with the first descriptor
+ */
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+  if ((handle->enabled == true) || (handle->init == false)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  handle->dmaExit = false;
+  handle->halted = false;
+  handle->enabled = true;
+
+  if (pthread_create(&handle->dmaThread, NULL, i2s_dma_task, handle) != 0) {
+    handle->enabled = false;
+
+    return ESP_FAIL;
+  }
+  pthread_setname_np(handle->dmaThread, "i2s_dma");
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) {
+  if (handle->enabled == false) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  pthread_mutex_lock(&handle->lock);
+  handle->dmaExit = true;
+  pthread_cond_signal(&handle->cond);
+  pthread_mutex_unlock(&handle->lock);
+
+  pthread_join(handle->dmaThread, NULL);
+
+  handle->enabled = false;
+  handle->currIdx = -1;
+  handle->rwPos = 0;
+  xQueueReset(handle->msgQueue);
+
+  return ESP_OK;
+}
+
+/**
+ * load descriptors from the first one on before the channel is enabled
+ */
+esp_err_t i2s_channel_preload_data(i2s_chan_handle_t tx_handle,
+                                   const void *src, size_t size,
+                                   size_t *bytes_loaded) {
+  const uint8_t *p = src;
+  size_t remain = size;
+
+  if ((tx_handle->enabled == true) || (tx_handle->init == false)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (tx_handle->currIdx < 0) {
+    tx_handle->currIdx = 0;
+    tx_handle->rwPos = 0;
+  }
+
+  while (remain > 0) {
+    size_t n = tx_handle->bufSize - tx_handle->rwPos;
+
+    if (n == 0) {
+      // all descriptors are loaded
+      break;
+    }
+    if (n > remain) {
+      n = remain;
+    }
+
+    memcpy(&tx_handle->desc[tx_handle->currIdx][tx_handle->rwPos], p, n);
+    tx_handle->descWritten[tx_handle->currIdx] = true;
+    tx_handle->rwPos += n;
+    p += n;
+    remain -= n;
+
+    if ((tx_handle->rwPos == tx_handle->bufSize) &&
+        (tx_handle->currIdx + 1 < (int32_t)tx_handle->descNum)) {
+      tx_handle->currIdx++;
+      tx_handle->rwPos = 0;
+    }
+  }
+
+  *bytes_loaded = size - remain;
+
+  return ESP_OK;
+}
+
+/**
+ *
+ */
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void *src,
+                            size_t size, size_t *bytes_written,
+                            uint32_t timeout_ms) {
+  const uint8_t *p = src;
+  size_t remain = size;
+  esp_err_t err = ESP_OK;
+
+  if (handle->enabled == false) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  while (remain > 0) {
+    size_t n;
+
+    if ((handle->currIdx < 0) || (handle->rwPos == handle->bufSize)) {
+      uint32_t idx;
+
+      if (xQueueReceive(handle->msgQueue, &idx, pdMS_TO_TICKS(timeout_ms)) ==
+          pdFALSE) {
+        err = ESP_ERR_TIMEOUT;
+
+        break;
+      }
+
+      handle->currIdx = idx;
+      handle->rwPos = 0;
+    }
+
+    n = handle->bufSize - handle->rwPos;
+    if (n > remain) {
+      n = remain;
+    }
+
+    memcpy(&handle->desc[handle->currIdx][handle->rwPos], p, n);
+    handle->descWritten[handle->currIdx] = true;
+    handle->rwPos += n;
+    p += n;
+    remain -= n;
+  }
+
+  if (bytes_written != NULL) {
+    *bytes_written = size - remain;
+  }
+
+  return err;
+}
+
+/**
+ *
+ */
+i2s_dev_t *host_i2s_ll_get_hw(int port) {
+  if ((port < 0) || (port >= SOC_I2S_NUM)) {
+    return NULL;
+  }
+
+  return &i2sDev[port];
+}
+
+/**
+ * hold output, DMA keeps the FIFO filled
+ */
+void i2s_ll_tx_stop(i2s_dev_t *hw) {
+  i2s_chan_handle_t ch = hw->tx;
+
+  if (ch == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&ch->lock);
+  ch->halted = true;
+  pthread_mutex_unlock(&ch->lock);
+}
+
+/**
+ * a slave waits for a clock which never comes, so nothing is sent
+ */
+void i2s_ll_tx_set_slave_mod(i2s_dev_t *hw, bool slave_en) {
+  i2s_chan_handle_t ch = hw->tx;
+
+  if (ch == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&ch->lock);
+  ch->slave = slave_en;
+  pthread_cond_signal(&ch->cond);
+  pthread_mutex_unlock(&ch->lock);
+}
+
+/**
+ *
+ */
+void i2s_ll_tx_start(i2s_dev_t *hw) {
+  i2s_chan_handle_t ch = hw->tx;
+
+  if (ch == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&ch->lock);
+  ch->halted = false;
+  pthread_cond_signal(&ch->cond);
+  pthread_mutex_unlock(&ch->lock);
+}
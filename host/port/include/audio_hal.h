@@ -0,0 +1,40 @@
+#ifndef __HOST_AUDIO_HAL_H__
+#define __HOST_AUDIO_HAL_H__
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  AUDIO_HAL_CODEC_MODE_ENCODE = 1,
+  AUDIO_HAL_CODEC_MODE_DECODE,
+  AUDIO_HAL_CODEC_MODE_BOTH,
+  AUDIO_HAL_CODEC_MODE_LINE_IN,
+} audio_hal_codec_mode_t;
+
+typedef enum {
+  AUDIO_HAL_CTRL_STOP = 0x00,
+  AUDIO_HAL_CTRL_START = 0x01,
+} audio_hal_ctrl_t;
+
+// the virtual DAC has no codec, mute and volume are only logged
+typedef struct audio_hal {
+  bool mute;
+  int volume;
+} *audio_hal_handle_t;
+
+esp_err_t audio_hal_ctrl_codec(audio_hal_handle_t audio_hal,
+                               audio_hal_codec_mode_t mode,
+                               audio_hal_ctrl_t audio_hal_ctrl);
+esp_err_t audio_hal_set_mute(audio_hal_handle_t audio_hal, bool mute);
+esp_err_t audio_hal_set_volume(audio_hal_handle_t audio_hal, int volume);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_AUDIO_HAL_H__
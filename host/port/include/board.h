@@ -0,0 +1,34 @@
+#ifndef __HOST_BOARD_H__
+#define __HOST_BOARD_H__
+
+#include "audio_hal.h"
+#include "driver/i2s_std.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  int mck_io_num;
+  int bck_io_num;
+  int ws_io_num;
+  int data_out_num;
+  int data_in_num;
+} board_i2s_pin_t;
+
+struct audio_board_handle {
+  audio_hal_handle_t audio_hal;
+  audio_hal_handle_t adc_hal;
+};
+
+typedef struct audio_board_handle *audio_board_handle_t;
+
+audio_board_handle_t audio_board_init(void);
+esp_err_t get_i2s_pins(i2s_port_t port, board_i2s_pin_t *i2s_config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_BOARD_H__
@@ -0,0 +1,11 @@
+#ifndef __HOST_CLK_CTRL_OS_H__
+#define __HOST_CLK_CTRL_OS_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+static inline void periph_rtc_apll_acquire(void) {}
+static inline void periph_rtc_apll_release(void) {}
+
+#endif  // __HOST_CLK_CTRL_OS_H__
@@ -0,0 +1,181 @@
+/**
+ * ESP-IDF 5.1 I2S standard mode TX API, implemented by the virtual sink in
+ * i2s_sink.c. Only what snapclient uses is there.
+ */
+
+#ifndef __HOST_I2S_STD_H__
+#define __HOST_I2S_STD_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "hal/gpio_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  I2S_NUM_0 = 0,
+  I2S_NUM_1 = 1,
+  I2S_NUM_AUTO,
+} i2s_port_t;
+
+typedef enum {
+  I2S_ROLE_MASTER,
+  I2S_ROLE_SLAVE,
+} i2s_role_t;
+
+typedef enum {
+  I2S_DATA_BIT_WIDTH_8BIT = 8,
+  I2S_DATA_BIT_WIDTH_16BIT = 16,
+  I2S_DATA_BIT_WIDTH_24BIT = 24,
+  I2S_DATA_BIT_WIDTH_32BIT = 32,
+} i2s_data_bit_width_t;
+
+typedef enum {
+  I2S_SLOT_BIT_WIDTH_AUTO = 0,
+  I2S_SLOT_BIT_WIDTH_8BIT = 8,
+  I2S_SLOT_BIT_WIDTH_16BIT = 16,
+  I2S_SLOT_BIT_WIDTH_24BIT = 24,
+  I2S_SLOT_BIT_WIDTH_32BIT = 32,
+} i2s_slot_bit_width_t;
+
+typedef enum {
+  I2S_SLOT_MODE_MONO = 1,
+  I2S_SLOT_MODE_STEREO = 2,
+} i2s_slot_mode_t;
+
+typedef enum {
+  I2S_STD_SLOT_LEFT = 1,
+  I2S_STD_SLOT_RIGHT = 2,
+  I2S_STD_SLOT_BOTH = 3,
+} i2s_std_slot_mask_t;
+
+typedef enum {
+  I2S_CLK_SRC_DEFAULT,
+  I2S_CLK_SRC_PLL_160M,
+  I2S_CLK_SRC_APLL,
+} i2s_clock_src_t;
+
+typedef enum {
+  I2S_MCLK_MULTIPLE_128 = 128,
+  I2S_MCLK_MULTIPLE_256 = 256,
+  I2S_MCLK_MULTIPLE_384 = 384,
+  I2S_MCLK_MULTIPLE_512 = 512,
+} i2s_mclk_multiple_t;
+
+typedef struct i2s_channel_obj_t *i2s_chan_handle_t;
+
+typedef struct {
+  i2s_port_t id;
+  i2s_role_t role;
+  uint32_t dma_desc_num;
+  uint32_t dma_frame_num;
+  bool auto_clear;
+} i2s_chan_config_t;
+
+typedef struct {
+  uint32_t sample_rate_hz;
+  i2s_clock_src_t clk_src;
+  i2s_mclk_multiple_t mclk_multiple;
+} i2s_std_clk_config_t;
+
+typedef struct {
+  i2s_data_bit_width_t data_bit_width;
+  i2s_slot_bit_width_t slot_bit_width;
+  i2s_slot_mode_t slot_mode;
+  i2s_std_slot_mask_t slot_mask;
+  uint32_t ws_width;
+  bool ws_pol;
+  bool bit_shift;
+  bool msb_right;
+} i2s_std_slot_config_t;
+
+typedef struct {
+  gpio_num_t mclk;
+  gpio_num_t bclk;
+  gpio_num_t ws;
+  gpio_num_t dout;
+  gpio_num_t din;
+  struct {
+    uint32_t mclk_inv : 1;
+    uint32_t bclk_inv : 1;
+    uint32_t ws_inv : 1;
+  } invert_flags;
+} i2s_std_gpio_config_t;
+
+typedef struct {
+  i2s_std_clk_config_t clk_cfg;
+  i2s_std_slot_config_t slot_cfg;
+  i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+
+typedef struct {
+  void *data;  //!< points to the DMA buffer pointer of the descriptor
+  size_t size;
+} i2s_event_data_t;
+
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle,
+                                   i2s_event_data_t *event, void *user_ctx);
+
+typedef struct {
+  i2s_isr_callback_t on_recv;
+  i2s_isr_callback_t on_recv_q_ovf;
+  i2s_isr_callback_t on_sent;
+  i2s_isr_callback_t on_send_q_ovf;
+} i2s_event_callbacks_t;
+
+#define I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(bits_per_sample, mono_or_stereo) \
+  {                                                                          \
+      .data_bit_width = (i2s_data_bit_width_t)(bits_per_sample),             \
+      .slot_bit_width = I2S_SLOT_BIT_WIDTH_AUTO,                             \
+      .slot_mode = (mono_or_stereo),                                         \
+      .slot_mask = I2S_STD_SLOT_BOTH,                                        \
+      .ws_width = (bits_per_sample),                                         \
+      .ws_pol = false,                                                       \
+      .bit_shift = true,                                                     \
+      .msb_right = ((bits_per_sample) <= I2S_DATA_BIT_WIDTH_16BIT),          \
+  }
+
+#define I2S_STD_MSB_SLOT_DEFAULT_CONFIG(bits_per_sample, mono_or_stereo) \
+  {                                                                      \
+      .data_bit_width = (i2s_data_bit_width_t)(bits_per_sample),         \
+      .slot_bit_width = I2S_SLOT_BIT_WIDTH_AUTO,                         \
+      .slot_mode = (mono_or_stereo),                                     \
+      .slot_mask = I2S_STD_SLOT_BOTH,                                    \
+      .ws_width = (bits_per_sample),                                     \
+      .ws_pol = false,                                                   \
+      .bit_shift = false,                                                \
+      .msb_right = ((bits_per_sample) <= I2S_DATA_BIT_WIDTH_16BIT),      \
+  }
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg,
+                          i2s_chan_handle_t *tx_handle,
+                          i2s_chan_handle_t *rx_handle);
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle,
+                                    const i2s_std_config_t *std_cfg);
+esp_err_t i2s_channel_reconfig_std_clock(i2s_chan_handle_t handle,
+                                         const i2s_std_clk_config_t *clk_cfg);
+esp_err_t i2s_channel_reconfig_std_slot(i2s_chan_handle_t handle,
+                                        const i2s_std_slot_config_t *slot_cfg);
+esp_err_t i2s_channel_register_event_callback(
+    i2s_chan_handle_t handle, const i2s_event_callbacks_t *callbacks,
+    void *user_data);
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_preload_data(i2s_chan_handle_t tx_handle,
+                                   const void *src, size_t size,
+                                   size_t *bytes_loaded);
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void *src,
+                            size_t size, size_t *bytes_written,
+                            uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_I2S_STD_H__
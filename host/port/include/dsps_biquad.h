@@ -0,0 +1,19 @@
+#ifndef __HOST_DSPS_BIQUAD_H__
+#define __HOST_DSPS_BIQUAD_H__
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// plain C version of esp-dsp, there is no assembly version on the host
+esp_err_t dsps_biquad_f32_ansi(const float *input, float *output, int len,
+                               float *coef, float *w);
+#define dsps_biquad_f32 dsps_biquad_f32_ansi
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_DSPS_BIQUAD_H__
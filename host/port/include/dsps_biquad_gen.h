@@ -0,0 +1,22 @@
+#ifndef __HOST_DSPS_BIQUAD_GEN_H__
+#define __HOST_DSPS_BIQUAD_GEN_H__
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// f is normalized to the sample rate like in esp-dsp
+esp_err_t dsps_biquad_gen_lpf_f32(float *coeffs, float f, float qFactor);
+esp_err_t dsps_biquad_gen_hpf_f32(float *coeffs, float f, float qFactor);
+esp_err_t dsps_biquad_gen_lowShelf_f32(float *coeffs, float f, float gain,
+                                       float qFactor);
+esp_err_t dsps_biquad_gen_highShelf_f32(float *coeffs, float f, float gain,
+                                        float qFactor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_DSPS_BIQUAD_GEN_H__
@@ -0,0 +1,4 @@
+#ifndef __HOST_ES8388_H__
+#define __HOST_ES8388_H__
+
+#endif  // __HOST_ES8388_H__
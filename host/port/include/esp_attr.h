@@ -0,0 +1,12 @@
+#ifndef __HOST_ESP_ATTR_H__
+#define __HOST_ESP_ATTR_H__
+
+// there is no IRAM or DRAM on the host
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_BSS_ATTR
+#define RTC_NOINIT_ATTR
+
+#define BIT64(nr) (1ULL << (nr))
+
+#endif  // __HOST_ESP_ATTR_H__
@@ -0,0 +1,17 @@
+#ifndef __HOST_ESP_CPU_H__
+#define __HOST_ESP_CPU_H__
+
+#include <stdint.h>
+
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+
+/**
+ * cycles of a virtual CPU running at esp_rom_get_cpu_ticks_per_us() MHz,
+ * wraps like the CCOUNT register
+ */
+static inline uint32_t esp_cpu_get_cycle_count(void) {
+  return (uint32_t)((uint64_t)host_time_us() * esp_rom_get_cpu_ticks_per_us());
+}
+
+#endif  // __HOST_ESP_CPU_H__
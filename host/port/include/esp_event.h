@@ -0,0 +1,35 @@
+#ifndef __HOST_ESP_EVENT_H__
+#define __HOST_ESP_EVENT_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t base,
+                                    int32_t id, void *data);
+
+#define ESP_EVENT_ANY_ID -1
+
+// there is no event loop, nothing is ever posted
+static inline esp_err_t esp_event_handler_register(esp_event_base_t base,
+                                                   int32_t id,
+                                                   esp_event_handler_t handler,
+                                                   void *arg) {
+  return ESP_OK;
+}
+
+static inline esp_err_t esp_event_handler_unregister(
+    esp_event_base_t base, int32_t id, esp_event_handler_t handler) {
+  return ESP_OK;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_ESP_EVENT_H__
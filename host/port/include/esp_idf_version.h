@@ -0,0 +1,13 @@
+/**
+ * Version the port emulates, for code which checks it
+ */
+
+#ifndef __HOST_ESP_IDF_VERSION_H__
+#define __HOST_ESP_IDF_VERSION_H__
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) \
+  (((major) << 16) | ((minor) << 8) | (patch))
+
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 1, 0)
+
+#endif  // __HOST_ESP_IDF_VERSION_H__
@@ -0,0 +1,46 @@
+/**
+ * ESP log API on stdout, same line format as on target
+ */
+
+#ifndef __HOST_ESP_LOG_H__
+#define __HOST_ESP_LOG_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ESP_LOG_NONE = 0,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+// no format attribute, target code prints int32_t with %ld
+void esp_log_write(esp_log_level_t level, const char *tag, const char *fmt,
+                   ...);
+
+#define ESP_LOG_LEVEL(level, tag, fmt, ...) \
+  esp_log_write((level), (tag), fmt, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, fmt, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) \
+  ESP_LOG_LEVEL(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_ESP_LOG_H__
@@ -0,0 +1,15 @@
+/**
+ * Memory region checks, there is only one heap on the host and every
+ * pointer is internal RAM
+ */
+
+#ifndef __HOST_ESP_MEMORY_UTILS_H__
+#define __HOST_ESP_MEMORY_UTILS_H__
+
+#include <stdbool.h>
+
+static inline bool esp_ptr_external_ram(const void *p) { return false; }
+
+static inline bool esp_ptr_in_iram(const void *p) { return false; }
+
+#endif  // __HOST_ESP_MEMORY_UTILS_H__
@@ -0,0 +1,7 @@
+#ifndef __HOST_ESP_NETIF_H__
+#define __HOST_ESP_NETIF_H__
+
+#include "esp_err.h"
+#include "lwip/ip_addr.h"
+
+#endif  // __HOST_ESP_NETIF_H__
@@ -0,0 +1,12 @@
+#ifndef __HOST_ESP_ROM_SYS_H__
+#define __HOST_ESP_ROM_SYS_H__
+
+#include <stdint.h>
+
+#define HOST_CPU_MHZ 240
+
+static inline uint32_t esp_rom_get_cpu_ticks_per_us(void) {
+  return HOST_CPU_MHZ;
+}
+
+#endif  // __HOST_ESP_ROM_SYS_H__
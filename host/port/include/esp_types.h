@@ -0,0 +1,8 @@
+#ifndef __HOST_ESP_TYPES_H__
+#define __HOST_ESP_TYPES_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#endif  // __HOST_ESP_TYPES_H__
@@ -0,0 +1,31 @@
+#ifndef __HOST_ESP_WIFI_H__
+#define __HOST_ESP_WIFI_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern esp_event_base_t const WIFI_EVENT;
+
+typedef enum {
+  WIFI_EVENT_STA_START = 2,
+  WIFI_EVENT_STA_CONNECTED = 4,
+  WIFI_EVENT_STA_DISCONNECTED = 5,
+  WIFI_EVENT_STA_BSS_RSSI_LOW = 9,
+} wifi_event_t;
+
+// wired network, there is no RSSI to watch
+static inline esp_err_t esp_wifi_set_rssi_threshold(int32_t rssi) {
+  return ESP_FAIL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_ESP_WIFI_H__
@@ -0,0 +1,42 @@
+#ifndef __HOST_RINGBUF_H__
+#define __HOST_RINGBUF_H__
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// only byte buffers are supported
+typedef enum {
+  RINGBUF_TYPE_NOSPLIT = 0,
+  RINGBUF_TYPE_ALLOWSPLIT,
+  RINGBUF_TYPE_BYTEBUF,
+} RingbufferType_t;
+
+typedef struct host_ringbuf_s *RingbufHandle_t;
+
+typedef struct StaticRingbuffer {
+  uint8_t opaque[256];
+} StaticRingbuffer_t;
+
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type);
+RingbufHandle_t xRingbufferCreateStatic(size_t size, RingbufferType_t type,
+                                        uint8_t *storage,
+                                        StaticRingbuffer_t *buffer);
+void vRingbufferDelete(RingbufHandle_t ringbuf);
+BaseType_t xRingbufferSend(RingbufHandle_t ringbuf, const void *data,
+                           size_t size, TickType_t ticks);
+void *xRingbufferReceiveUpTo(RingbufHandle_t ringbuf, size_t *size,
+                             TickType_t ticks, size_t maxSize);
+void *xRingbufferReceiveUpToFromISR(RingbufHandle_t ringbuf, size_t *size,
+                                    size_t maxSize);
+void vRingbufferReturnItem(RingbufHandle_t ringbuf, void *item);
+void vRingbufferReturnItemFromISR(RingbufHandle_t ringbuf, void *item,
+                                  BaseType_t *woken);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_RINGBUF_H__
@@ -0,0 +1,12 @@
+/**
+ * Chip revision, there is no efuse on the host
+ */
+
+#ifndef __HOST_EFUSE_HAL_H__
+#define __HOST_EFUSE_HAL_H__
+
+#include <stdint.h>
+
+static inline uint32_t efuse_hal_chip_revision(void) { return 300; }
+
+#endif  // __HOST_EFUSE_HAL_H__
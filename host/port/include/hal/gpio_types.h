@@ -0,0 +1,13 @@
+#ifndef __HOST_GPIO_TYPES_H__
+#define __HOST_GPIO_TYPES_H__
+
+typedef enum {
+  GPIO_NUM_NC = -1,
+  GPIO_NUM_0 = 0,
+  GPIO_NUM_5 = 5,
+  GPIO_NUM_MAX = 40,
+} gpio_num_t;
+
+#define I2S_GPIO_UNUSED GPIO_NUM_NC
+
+#endif  // __HOST_GPIO_TYPES_H__
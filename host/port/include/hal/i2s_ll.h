@@ -0,0 +1,27 @@
+/**
+ * Register level start and stop of the virtual I2S sink, see i2s_sink.c
+ */
+
+#ifndef __HOST_I2S_LL_H__
+#define __HOST_I2S_LL_H__
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_i2s_dev_s i2s_dev_t;
+
+i2s_dev_t *host_i2s_ll_get_hw(int port);
+void i2s_ll_tx_start(i2s_dev_t *hw);
+void i2s_ll_tx_stop(i2s_dev_t *hw);
+void i2s_ll_tx_set_slave_mod(i2s_dev_t *hw, bool slave_en);
+
+#define I2S_LL_GET_HW(num) host_i2s_ll_get_hw(num)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_I2S_LL_H__
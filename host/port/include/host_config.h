@@ -0,0 +1,39 @@
+/**
+ * Run time settings of the host build, filled from the command line
+ */
+
+#ifndef __HOST_CONFIG_H__
+#define __HOST_CONFIG_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_config_s {
+  const char *serverHost;  //!< numeric IPv4 address of snapserver
+  uint16_t serverPort;
+  char *clientName;
+  uint8_t instance;  //!< last byte of MAC, tells clients apart
+
+  // virtual DAC clock, see i2s_sink.c
+  double dacPpm;             //!< constant deviation from nominal rate
+  double dacWanderPpm;       //!< amplitude of sinusoidal wander
+  double dacWanderPeriod_s;  //!< period of wander
+
+  const char *playoutLog;  //!< file for playout timestamps, NULL if off
+  double duration_s;       //!< exit after this long, 0 runs forever
+
+  const char *capture;  //!< file stream capture is written to on exit
+  const char *replay;   //!< capture replayed instead of connecting
+  double replaySpeed;   //!< time of the port runs this much faster
+} host_config_t;
+
+extern host_config_t hostConfig;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_CONFIG_H__
@@ -0,0 +1,47 @@
+/**
+ * Virtual I2S sink of the host build
+ *
+ * The sink plays DMA descriptors at the nominal sample rate, skewed by the
+ * DAC clock error from host_config_t and by APLL adjustments. If a playout
+ * log is configured every played descriptor is recorded there.
+ *
+ * Log format, little endian: 8 byte header of HOST_PLAYOUT_MAGIC, version
+ * and record size, then one host_playout_record_t per descriptor.
+ */
+
+#ifndef __HOST_I2S_SINK_H__
+#define __HOST_I2S_SINK_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_PLAYOUT_MAGIC "SCPO"
+#define HOST_PLAYOUT_VERSION 1
+
+// time from channel enable until the first frame is played, FIFO fill
+#define HOST_I2S_START_LATENCY_US 20
+
+// first descriptor after channel enable or i2s_ll_tx_start()
+#define HOST_PLAYOUT_FLAG_START 0x01
+// descriptor wasn't written since it was played last
+#define HOST_PLAYOUT_FLAG_STALE 0x02
+
+typedef struct host_playout_record_s {
+  int64_t t_ns;        //!< host_time_ns() when first frame is played
+  double rate_hz;      //!< actual frame rate descriptor is played with
+  uint32_t frames;     //!< frames in descriptor
+  uint32_t sr;         //!< nominal sample rate
+  uint8_t frameBytes;  //!< bytes per frame, both slots
+  uint8_t flags;       //!< HOST_PLAYOUT_FLAG_*
+  uint16_t reserved;
+  uint32_t first;  //!< first 4 bytes of descriptor, as stored in memory
+} host_playout_record_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_I2S_SINK_H__
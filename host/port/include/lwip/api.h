@@ -0,0 +1,92 @@
+/**
+ * lwIP netconn API on BSD sockets, see netconn.c
+ *
+ * Like lwIP a receive thread per connection queues what arrives and calls
+ * the connection's callback with NETCONN_EVT_RCVPLUS, so arrival times can
+ * be taken the same way as on target.
+ */
+
+#ifndef __HOST_LWIP_API_H__
+#define __HOST_LWIP_API_H__
+
+#include <stddef.h>
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/tcp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NETCONN_NOFLAG 0x00
+#define NETCONN_NOCOPY 0x00
+#define NETCONN_COPY 0x01
+#define NETCONN_MORE 0x02
+#define NETCONN_DONTBLOCK 0x04
+
+enum netconn_type {
+  NETCONN_INVALID = 0,
+  NETCONN_TCP = 0x10,
+};
+
+enum netconn_evt {
+  NETCONN_EVT_RCVPLUS,
+  NETCONN_EVT_RCVMINUS,
+  NETCONN_EVT_SENDPLUS,
+  NETCONN_EVT_SENDMINUS,
+  NETCONN_EVT_ERROR,
+};
+
+struct netconn;
+struct host_netconn_priv_s;
+
+typedef void (*netconn_callback)(struct netconn *conn, enum netconn_evt evt,
+                                 u16_t len);
+
+struct pbuf {
+  struct pbuf *next;
+  void *payload;
+  u16_t tot_len;
+  u16_t len;
+};
+
+struct netbuf {
+  struct pbuf *p;
+  struct pbuf *ptr;  //!< current pbuf of netbuf_first() / netbuf_next()
+};
+
+struct netconn {
+  enum netconn_type type;
+  union {
+    struct tcp_pcb *tcp;
+  } pcb;
+  netconn_callback callback;
+  struct host_netconn_priv_s *priv;
+};
+
+struct netconn *netconn_new_with_callback(enum netconn_type t,
+                                          netconn_callback callback);
+#define netconn_new(t) netconn_new_with_callback(t, NULL)
+err_t netconn_delete(struct netconn *conn);
+err_t netconn_bind(struct netconn *conn, const ip_addr_t *addr, u16_t port);
+err_t netconn_connect(struct netconn *conn, const ip_addr_t *addr,
+                      u16_t port);
+err_t netconn_close(struct netconn *conn);
+err_t netconn_recv(struct netconn *conn, struct netbuf **new_buf);
+err_t netconn_write_partly(struct netconn *conn, const void *dataptr,
+                           size_t size, u8_t apiflags, size_t *bytes_written);
+#define netconn_write(conn, dataptr, size, apiflags) \
+  netconn_write_partly(conn, dataptr, size, apiflags, NULL)
+
+void netbuf_delete(struct netbuf *buf);
+void netbuf_first(struct netbuf *buf);
+s8_t netbuf_next(struct netbuf *buf);
+err_t netbuf_data(struct netbuf *buf, void **dataptr, u16_t *len);
+#define netbuf_len(buf) ((buf)->p->tot_len)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_LWIP_API_H__
@@ -0,0 +1,6 @@
+#ifndef __HOST_LWIP_DNS_H__
+#define __HOST_LWIP_DNS_H__
+
+#include "lwip/ip_addr.h"
+
+#endif  // __HOST_LWIP_DNS_H__
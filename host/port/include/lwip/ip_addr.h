@@ -0,0 +1,59 @@
+#ifndef __HOST_LWIP_IP_ADDR_H__
+#define __HOST_LWIP_IP_ADDR_H__
+
+#include <string.h>
+
+#include "lwip/err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ip4_addr {
+  u32_t addr;  //!< network byte order
+} ip4_addr_t;
+
+typedef struct ip6_addr {
+  u32_t addr[4];
+  u8_t zone;
+} ip6_addr_t;
+
+typedef struct ip_addr {
+  union {
+    ip6_addr_t ip6;
+    ip4_addr_t ip4;
+  } u_addr;
+  u8_t type;
+} ip_addr_t;
+
+enum lwip_ip_addr_type {
+  IPADDR_TYPE_V4 = 0U,
+  IPADDR_TYPE_V6 = 6U,
+  IPADDR_TYPE_ANY = 46U,
+};
+
+extern const ip_addr_t ip_addr_any;
+
+#define IPADDR_ANY (&ip_addr_any)
+#define ip_addr_copy(dest, src) ((dest) = (src))
+#define ip_addr_cmp(a, b)                                        \
+  (((a)->type == (b)->type) &&                                   \
+   (((a)->type == IPADDR_TYPE_V4)                                \
+        ? ((a)->u_addr.ip4.addr == (b)->u_addr.ip4.addr)         \
+        : (memcmp(&(a)->u_addr.ip6, &(b)->u_addr.ip6,            \
+                  sizeof(ip6_addr_t)) == 0)))
+
+#define IPSTR "%d.%d.%d.%d"
+#define ip4_addr_get_byte(ipaddr, idx) (((const u8_t *)(&(ipaddr)->addr))[idx])
+#define IP2STR(ipaddr)                                        \
+  ip4_addr_get_byte(ipaddr, 0), ip4_addr_get_byte(ipaddr, 1), \
+      ip4_addr_get_byte(ipaddr, 2), ip4_addr_get_byte(ipaddr, 3)
+
+// static buffer, not reentrant like in lwIP
+char *ipaddr_ntoa(const ip_addr_t *addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_LWIP_IP_ADDR_H__
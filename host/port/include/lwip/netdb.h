@@ -0,0 +1,6 @@
+#ifndef __HOST_LWIP_NETDB_H__
+#define __HOST_LWIP_NETDB_H__
+
+#include <netdb.h>
+
+#endif  // __HOST_LWIP_NETDB_H__
@@ -0,0 +1,10 @@
+#ifndef __HOST_LWIP_SYS_H__
+#define __HOST_LWIP_SYS_H__
+
+// sys_arch.h of the ESP-IDF port pulls these in
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "lwip/err.h"
+
+#endif  // __HOST_LWIP_SYS_H__
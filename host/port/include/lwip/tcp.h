@@ -0,0 +1,25 @@
+#ifndef __HOST_LWIP_TCP_H__
+#define __HOST_LWIP_TCP_H__
+
+#include "lwip/err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// lwIP option, not the socket option of netinet/tcp.h
+#undef TCP_MSS
+#define TCP_MSS 1460
+
+// a netconn's socket
+struct tcp_pcb {
+  int fd;
+};
+
+void tcp_nagle_disable(struct tcp_pcb *pcb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_LWIP_TCP_H__
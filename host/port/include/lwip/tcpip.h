@@ -0,0 +1,23 @@
+#ifndef __HOST_LWIP_TCPIP_H__
+#define __HOST_LWIP_TCPIP_H__
+
+#include "lwip/err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// embedded first in the caller's message, lwIP keeps a semaphore here
+struct tcpip_api_call_data {
+  err_t err;
+};
+
+typedef err_t (*tcpip_api_call_fn)(struct tcpip_api_call_data *call);
+
+err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data *call);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_LWIP_TCPIP_H__
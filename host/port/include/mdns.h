@@ -0,0 +1,38 @@
+/**
+ * mDNS types only, the host build always uses the server from the command
+ * line
+ */
+
+#ifndef __HOST_MDNS_H__
+#define __HOST_MDNS_H__
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lwip/ip_addr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MDNS_TYPE_PTR 0x000C
+
+typedef struct mdns_ip_addr_s {
+  ip_addr_t addr;
+  struct mdns_ip_addr_s *next;
+} mdns_ip_addr_t;
+
+typedef struct mdns_result_s {
+  struct mdns_result_s *next;
+  char *hostname;
+  uint16_t port;
+  mdns_ip_addr_t *addr;
+} mdns_result_t;
+
+typedef struct mdns_search_once_s mdns_search_once_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_MDNS_H__
@@ -0,0 +1,28 @@
+/**
+ * Replay of a stream capture in place of the server connection
+ *
+ * See components/lightsnapcast/include/capture.h for the file format.
+ */
+
+#ifndef __HOST_REPLAY_H__
+#define __HOST_REPLAY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// time from the last piece of the capture until the report, on top of the
+// server's buffer, so the last chunks get played
+#define REPLAY_DRAIN_MS 500
+
+int replay_load(const char *path);
+size_t replay_read(uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_REPLAY_H__
@@ -0,0 +1,88 @@
+/**
+ * Kconfig for the host build
+ *
+ * Defaults match main/Kconfig.projbuild where the option makes sense on a
+ * workstation, each one can be overridden with -D from CMake. Server and
+ * client name come from the command line, see host/main.c.
+ */
+
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+#include "host_config.h"
+
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_FREERTOS_HZ 1000
+
+// behave like a board with 4MB of PSRAM, see esp_system.c
+#define CONFIG_SPIRAM 1
+#define CONFIG_SPIRAM_BOOT_INIT 1
+
+#define CONFIG_SNAPSERVER_USE_MDNS 0
+#define CONFIG_SNAPCLIENT_USE_MDNS 0
+#define CONFIG_SNAPSERVER_HOST hostConfig.serverHost
+#define CONFIG_SNAPSERVER_PORT hostConfig.serverPort
+#define CONFIG_SNAPCLIENT_NAME hostConfig.clientName
+#define CONFIG_WEB_PORT 8000
+
+#ifndef CONFIG_USE_SAMPLE_INSERTION
+#define CONFIG_USE_SAMPLE_INSERTION 1
+#endif
+
+#ifndef CONFIG_USE_SOFT_RESYNC
+#define CONFIG_USE_SOFT_RESYNC 0
+#endif
+
+#ifndef CONFIG_SYNC_CONTROLLER_PI
+#define CONFIG_SYNC_CONTROLLER_PI 0
+#endif
+
+#ifndef CONFIG_USE_I2S_START_FROM_ISR
+#define CONFIG_USE_I2S_START_FROM_ISR 0
+#endif
+
+#ifndef CONFIG_USE_DMA_REFILL_ISR
+#define CONFIG_USE_DMA_REFILL_ISR 0
+#endif
+
+#ifndef CONFIG_USE_WARM_START
+#define CONFIG_USE_WARM_START 0
+#endif
+
+#ifndef CONFIG_USE_METRICS
+#define CONFIG_USE_METRICS 1
+#endif
+
+#ifndef CONFIG_USE_TRACE
+#define CONFIG_USE_TRACE 1
+#endif
+
+#ifndef CONFIG_TRACE_CONSOLE
+#define CONFIG_TRACE_CONSOLE 1
+#endif
+
+#ifndef CONFIG_USE_STREAM_CAPTURE
+#define CONFIG_USE_STREAM_CAPTURE 1
+#endif
+
+#if CONFIG_USE_STREAM_CAPTURE
+#define CONFIG_STREAM_CAPTURE_SIZE_KB (32 * 1024)
+#endif
+
+#ifndef CONFIG_USE_DSP_PROCESSOR
+#define CONFIG_USE_DSP_PROCESSOR 1
+#endif
+
+#if CONFIG_USE_DSP_PROCESSOR
+#define CONFIG_SNAPCLIENT_DSP_FLOW_STEREO 1
+#endif
+
+#ifndef CONFIG_USE_HEAP_ACCOUNTING
+#define CONFIG_USE_HEAP_ACCOUNTING 1
+#endif
+
+#if CONFIG_USE_HEAP_ACCOUNTING
+#define CONFIG_HEAP_FRAG_SAMPLE_PERIOD_S 10
+#endif
+
+#endif  // __HOST_SDKCONFIG_H__
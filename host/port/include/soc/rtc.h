@@ -0,0 +1,37 @@
+/**
+ * ESP32 audio PLL, only the frequency is modelled. The virtual I2S sink
+ * runs faster or slower if the APLL is set off the frequency it started
+ * with, like the DAC does on target.
+ */
+
+#ifndef __HOST_SOC_RTC_H__
+#define __HOST_SOC_RTC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "soc/soc_caps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_APLL_XTAL_HZ 40000000
+#define HOST_APLL_MULTIPLIER_OUT_MIN_HZ 350000000
+#define HOST_APLL_MULTIPLIER_OUT_MAX_HZ 500000000
+
+uint32_t rtc_clk_apll_coeff_calc(uint32_t freq, uint32_t *o_div,
+                                 uint32_t *sdm0, uint32_t *sdm1,
+                                 uint32_t *sdm2);
+void rtc_clk_apll_coeff_set(uint32_t o_div, uint32_t sdm0, uint32_t sdm1,
+                            uint32_t sdm2);
+void rtc_clk_apll_enable(bool enable);
+
+// current APLL output in Hz, 0 if it was never set
+double host_apll_freq(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_SOC_RTC_H__
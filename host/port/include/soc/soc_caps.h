@@ -0,0 +1,8 @@
+#ifndef __HOST_SOC_CAPS_H__
+#define __HOST_SOC_CAPS_H__
+
+// the virtual I2S sink models an ESP32 with APLL
+#define SOC_I2S_SUPPORTS_APLL 1
+#define SOC_I2S_NUM 2
+
+#endif  // __HOST_SOC_CAPS_H__
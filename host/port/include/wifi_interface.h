@@ -0,0 +1,15 @@
+#ifndef __HOST_WIFI_INTERFACE_H__
+#define __HOST_WIFI_INTERFACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the host's network is up already
+void wifi_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HOST_WIFI_INTERFACE_H__
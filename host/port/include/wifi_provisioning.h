@@ -0,0 +1,4 @@
+#ifndef __HOST_WIFI_PROVISIONING_H__
+#define __HOST_WIFI_PROVISIONING_H__
+
+#endif  // __HOST_WIFI_PROVISIONING_H__
@@ -0,0 +1,439 @@
+/**
+ * lwIP netconn API on BSD sockets
+ *
+ * A receive thread per connection reads from the socket, reports the number
+ * of bytes with NETCONN_EVT_RCVPLUS and queues them as a netbuf of pbufs of
+ * at most TCP_MSS bytes. The queue is bounded and the socket's receive
+ * buffer is kept small, so a slow reader closes the TCP window like lwIP
+ * does with TCP_WND.
+ *
+ * With --replay nothing is connected, the receive thread reads the capture
+ * from port/replay.c and everything written is dropped.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "host_config.h"
+#include "lwip/api.h"
+#include "lwip/tcpip.h"
+#include "replay.h"
+
+// netbufs queued per connection, like DEFAULT_TCP_RECVMBOX_SIZE
+#define NETCONN_RECVMBOX_SIZE 6
+// bytes read at once, NETCONN_EVT_RCVPLUS is reported per read
+#define NETCONN_RECV_LEN (4 * TCP_MSS)
+// socket receive buffer, close to TCP_WND of the target
+#define NETCONN_SO_RCVBUF (8 * TCP_MSS)
+
+typedef enum {
+  NETCONN_STATE_NEW = 0,
+  NETCONN_STATE_CONNECTED,
+  NETCONN_STATE_RX_CLOSED,  //!< peer closed or error, ERR_CLSD reported
+  NETCONN_STATE_CLOSED,
+} netconn_state_t;
+
+struct host_netconn_priv_s {
+  struct tcp_pcb tcp;
+  QueueHandle_t recvmbox;  //!< struct netbuf *, NULL marks end of stream
+  pthread_t rxThread;
+  bool rxThreadRunning;
+  volatile bool closing;
+  netconn_state_t state;
+  err_t rxErr;  //!< reason for end of stream
+  pthread_mutex_t txLock;
+};
+
+static const char *TAG = "NETCONN";
+
+const ip_addr_t ip_addr_any = {.u_addr.ip4.addr = INADDR_ANY,
+                               .type = IPADDR_TYPE_V4};
+
+/**
+ *
+ */
+char *ipaddr_ntoa(const ip_addr_t *addr) {
+  static char str[INET6_ADDRSTRLEN];
+
+  if (addr->type == IPADDR_TYPE_V6) {
+    inet_ntop(AF_INET6, &addr->u_addr.ip6.addr, str, sizeof(str));
+  } else {
+    inet_ntop(AF_INET, &addr->u_addr.ip4.addr, str, sizeof(str));
+  }
+
+  return str;
+}
+
+/**
+ *
+ */
+void tcp_nagle_disable(struct tcp_pcb *pcb) {
+  int one = 1;
+
+  setsockopt(pcb->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/**
+ * there is no tcpip thread, sockets are thread safe
+ */
+err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data *call) {
+  return fn(call);
+}
+
+/**
+ * one allocation for netbuf, pbufs and data
+ */
+static struct netbuf *netbuf_alloc(const uint8_t *data, size_t len) {
+  size_t pbufCnt = (len + TCP_MSS - 1) / TCP_MSS;
+  struct netbuf *buf;
+  struct pbuf *p;
+  uint8_t *payload;
+
+  buf = malloc(sizeof(struct netbuf) + pbufCnt * sizeof(struct pbuf) + len);
+  if (buf == NULL) {
+    return NULL;
+  }
+
+  p = (struct pbuf *)(buf + 1);
+  payload = (uint8_t *)(p + pbufCnt);
+  memcpy(payload, data, len);
+
+  for (size_t i = 0; i < pbufCnt; i++) {
+    size_t off = i * TCP_MSS;
+
+    p[i].payload = &payload[off];
+    p[i].len = (len - off > TCP_MSS) ? TCP_MSS : (len - off);
+    p[i].tot_len = len - off;
+    p[i].next = (i + 1 < pbufCnt) ? &p[i + 1] : NULL;
+  }
+
+  buf->p = p;
+  buf->ptr = p;
+
+  return buf;
+}
+
+/**
+ * queue netbuf, gives up if connection is deleted meanwhile
+ */
+static bool netconn_rx_post(struct netconn *conn, struct netbuf *buf) {
+  struct host_netconn_priv_s *priv = conn->priv;
+
+  while (priv->closing == false) {
+    if (xQueueSend(priv->recvmbox, &buf, pdMS_TO_TICKS(100)) == pdTRUE) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * plays the part of the tcpip thread
+ */
+static void *netconn_rx_task(void *arg) {
+  struct netconn *conn = arg;
+  struct host_netconn_priv_s *priv = conn->priv;
+  uint8_t *rxBuf = malloc(NETCONN_RECV_LEN);
+
+  while ((rxBuf != NULL) && (priv->closing == false)) {
+    struct netbuf *buf;
+    ssize_t len;
+
+    if (hostConfig.replay != NULL) {
+      len = replay_read(rxBuf, NETCONN_RECV_LEN);
+    } else {
+      len = recv(priv->tcp.fd, rxBuf, NETCONN_RECV_LEN, 0);
+    }
+
+    if (len <= 0) {
+      if ((len < 0) && (errno == EINTR)) {
+        continue;
+      }
+
+      priv->rxErr = (len == 0) ? ERR_CLSD : ERR_RST;
+      if (conn->callback != NULL) {
+        conn->callback(conn, NETCONN_EVT_RCVPLUS, 0);
+      }
+
+      break;
+    }
+
+    if (conn->callback != NULL) {
+      conn->callback(conn, NETCONN_EVT_RCVPLUS, (u16_t)len);
+    }
+
+    buf = netbuf_alloc(rxBuf, len);
+    if ((buf == NULL) || (netconn_rx_post(conn, buf) == false)) {
+      free(buf);
+      priv->rxErr = ERR_MEM;
+
+      break;
+    }
+  }
+
+  free(rxBuf);
+
+  // end of stream marker
+  netconn_rx_post(conn, NULL);
+
+  return NULL;
+}
+
+/**
+ *
+ */
+struct netconn *netconn_new_with_callback(enum netconn_type t,
+                                          netconn_callback callback) {
+  struct netconn *conn;
+  struct host_netconn_priv_s *priv;
+  int rcvBuf = NETCONN_SO_RCVBUF;
+
+  if (t != NETCONN_TCP) {
+    return NULL;
+  }
+
+  conn = calloc(1, sizeof(struct netconn) + sizeof(*priv));
+  if (conn == NULL) {
+    return NULL;
+  }
+  priv = (struct host_netconn_priv_s *)(conn + 1);
+
+  priv->tcp.fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (priv->tcp.fd < 0) {
+    free(conn);
+
+    return NULL;
+  }
+  setsockopt(priv->tcp.fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+
+  priv->recvmbox = xQueueCreate(NETCONN_RECVMBOX_SIZE, sizeof(struct netbuf *));
+  if (priv->recvmbox == NULL) {
+    close(priv->tcp.fd);
+    free(conn);
+
+    return NULL;
+  }
+  pthread_mutex_init(&priv->txLock, NULL);
+
+  conn->type = t;
+  conn->pcb.tcp = &priv->tcp;
+  conn->callback = callback;
+  conn->priv = priv;
+
+  return conn;
+}
+
+/**
+ *
+ */
+err_t netconn_bind(struct netconn *conn, const ip_addr_t *addr, u16_t port) {
+  struct sockaddr_in sa = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port),
+      .sin_addr.s_addr = addr->u_addr.ip4.addr,
+  };
+
+  if (bind(conn->priv->tcp.fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    return ERR_USE;
+  }
+
+  return ERR_OK;
+}
+
+/**
+ *
+ */
+err_t netconn_connect(struct netconn *conn, const ip_addr_t *addr,
+                      u16_t port) {
+  struct host_netconn_priv_s *priv = conn->priv;
+  struct sockaddr_in sa = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port),
+      .sin_addr.s_addr = addr->u_addr.ip4.addr,
+  };
+
+  if (priv->state != NETCONN_STATE_NEW) {
+    return ERR_ISCONN;
+  }
+
+  if ((hostConfig.replay == NULL) &&
+      (connect(priv->tcp.fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)) {
+    ESP_LOGD(TAG, "connect: %s", strerror(errno));
+
+    return (errno == ECONNREFUSED) ? ERR_RST : ERR_CONN;
+  }
+
+  priv->state = NETCONN_STATE_CONNECTED;
+
+  if (pthread_create(&priv->rxThread, NULL, netconn_rx_task, conn) != 0) {
+    return ERR_MEM;
+  }
+  pthread_setname_np(priv->rxThread, "tcpip");
+  priv->rxThreadRunning = true;
+
+  return ERR_OK;
+}
+
+/**
+ *
+ */
+err_t netconn_recv(struct netconn *conn, struct netbuf **new_buf) {
+  struct host_netconn_priv_s *priv = conn->priv;
+  struct netbuf *buf = NULL;
+
+  *new_buf = NULL;
+
+  if (priv->state != NETCONN_STATE_CONNECTED) {
+    return ERR_CONN;
+  }
+
+  xQueueReceive(priv->recvmbox, &buf, portMAX_DELAY);
+  if (buf == NULL) {
+    // report end of stream once, like lwIP does after FIN
+    priv->state = NETCONN_STATE_RX_CLOSED;
+
+    return priv->rxErr;
+  }
+
+  *new_buf = buf;
+
+  return ERR_OK;
+}
+
+/**
+ * blocks until everything is sent, data is always copied by the kernel
+ */
+err_t netconn_write_partly(struct netconn *conn, const void *dataptr,
+                           size_t size, u8_t apiflags, size_t *bytes_written) {
+  struct host_netconn_priv_s *priv = conn->priv;
+  const uint8_t *p = dataptr;
+  size_t sent = 0;
+  err_t err = ERR_OK;
+
+  if (priv->state == NETCONN_STATE_NEW) {
+    return ERR_CONN;
+  }
+
+  if (hostConfig.replay != NULL) {
+    sent = size;
+  }
+
+  pthread_mutex_lock(&priv->txLock);
+  while (sent < size) {
+    ssize_t n = send(priv->tcp.fd, &p[sent], size - sent, MSG_NOSIGNAL);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      err = (errno == ECONNRESET) ? ERR_RST : ERR_CONN;
+
+      break;
+    }
+
+    sent += n;
+  }
+  pthread_mutex_unlock(&priv->txLock);
+
+  if (bytes_written != NULL) {
+    *bytes_written = sent;
+  }
+
+  return err;
+}
+
+/**
+ *
+ */
+err_t netconn_close(struct netconn *conn) {
+  struct host_netconn_priv_s *priv = conn->priv;
+
+  if (priv->state != NETCONN_STATE_NEW) {
+    shutdown(priv->tcp.fd, SHUT_RDWR);
+  }
+  priv->state = NETCONN_STATE_CLOSED;
+
+  return ERR_OK;
+}
+
+/**
+ *
+ */
+err_t netconn_delete(struct netconn *conn) {
+  struct host_netconn_priv_s *priv;
+  struct netbuf *buf;
+
+  if (conn == NULL) {
+    return ERR_OK;
+  }
+  priv = conn->priv;
+
+  priv->closing = true;
+  shutdown(priv->tcp.fd, SHUT_RDWR);
+  if (priv->rxThreadRunning == true) {
+    pthread_join(priv->rxThread, NULL);
+  }
+
+  while (xQueueReceive(priv->recvmbox, &buf, 0) == pdTRUE) {
+    netbuf_delete(buf);
+  }
+  vQueueDelete(priv->recvmbox);
+
+  close(priv->tcp.fd);
+  pthread_mutex_destroy(&priv->txLock);
+  free(conn);
+
+  return ERR_OK;
+}
+
+/**
+ *
+ */
+void netbuf_delete(struct netbuf *buf) { free(buf); }
+
+/**
+ *
+ */
+void netbuf_first(struct netbuf *buf) { buf->ptr = buf->p; }
+
+/**
+ * -1 if there is no next pbuf, 1 if the next one is the last, 0 otherwise
+ */
+s8_t netbuf_next(struct netbuf *buf) {
+  if (buf->ptr->next == NULL) {
+    return -1;
+  }
+
+  buf->ptr = buf->ptr->next;
+  if (buf->ptr->next == NULL) {
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *
+ */
+err_t netbuf_data(struct netbuf *buf, void **dataptr, u16_t *len) {
+  if ((buf == NULL) || (buf->ptr == NULL)) {
+    return ERR_BUF;
+  }
+
+  *dataptr = buf->ptr->payload;
+  *len = buf->ptr->len;
+
+  return ERR_OK;
+}
@@ -0,0 +1,212 @@
+/**
+ * NVS on a list of blobs in memory
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define NVS_NAMESPACES_MAX 16
+#define NVS_NAME_LEN 16
+
+typedef struct nvs_blob_s {
+  uint32_t ns;  //!< namespace index
+  char key[NVS_NAME_LEN];
+  void *data;
+  size_t len;
+  struct nvs_blob_s *next;
+} nvs_blob_t;
+
+static pthread_mutex_t nvsLock = PTHREAD_MUTEX_INITIALIZER;
+static char nvsNamespace[NVS_NAMESPACES_MAX][NVS_NAME_LEN];
+static uint32_t nvsNamespaceCnt = 0;
+static nvs_blob_t *nvsBlobs = NULL;
+
+/**
+ *
+ */
+esp_err_t nvs_flash_init(void) { return ESP_OK; }
+
+/**
+ *
+ */
+esp_err_t nvs_flash_erase(void) {
+  pthread_mutex_lock(&nvsLock);
+  while (nvsBlobs != NULL) {
+    nvs_blob_t *b = nvsBlobs;
+
+    nvsBlobs = b->next;
+    free(b->data);
+    free(b);
+  }
+  pthread_mutex_unlock(&nvsLock);
+
+  return ESP_OK;
+}
+
+/**
+ * handle is namespace index + 1, read only handles have bit 31 set
+ */
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode,
+                   nvs_handle_t *handle) {
+  uint32_t i;
+  esp_err_t err = ESP_OK;
+
+  pthread_mutex_lock(&nvsLock);
+
+  for (i = 0; i < nvsNamespaceCnt; i++) {
+    if (strncmp(nvsNamespace[i], name, NVS_NAME_LEN - 1) == 0) {
+      break;
+    }
+  }
+
+  if (i == nvsNamespaceCnt) {
+    if (mode == NVS_READONLY) {
+      err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (i == NVS_NAMESPACES_MAX) {
+      err = ESP_ERR_NO_MEM;
+    } else {
+      snprintf(nvsNamespace[i], NVS_NAME_LEN, "%s", name);
+      nvsNamespaceCnt++;
+    }
+  }
+
+  if (err == ESP_OK) {
+    *handle = (i + 1) | ((mode == NVS_READONLY) ? (1UL << 31) : 0);
+  }
+
+  pthread_mutex_unlock(&nvsLock);
+
+  return err;
+}
+
+/**
+ *
+ */
+void nvs_close(nvs_handle_t handle) {}
+
+/**
+ *
+ */
+esp_err_t nvs_commit(nvs_handle_t handle) { return ESP_OK; }
+
+/**
+ * called with lock taken
+ */
+static nvs_blob_t *nvs_blob_find(nvs_handle_t handle, const char *key) {
+  uint32_t ns = (handle & ~(1UL << 31)) - 1;
+
+  for (nvs_blob_t *b = nvsBlobs; b != NULL; b = b->next) {
+    if ((b->ns == ns) && (strncmp(b->key, key, NVS_NAME_LEN - 1) == 0)) {
+      return b;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ *
+ */
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value,
+                       size_t *length) {
+  esp_err_t err = ESP_OK;
+  nvs_blob_t *b;
+
+  pthread_mutex_lock(&nvsLock);
+
+  b = nvs_blob_find(handle, key);
+  if (b == NULL) {
+    err = ESP_ERR_NVS_NOT_FOUND;
+  } else if (value == NULL) {
+    *length = b->len;
+  } else if (*length < b->len) {
+    *length = b->len;
+    err = ESP_ERR_NVS_INVALID_LENGTH;
+  } else {
+    memcpy(value, b->data, b->len);
+    *length = b->len;
+  }
+
+  pthread_mutex_unlock(&nvsLock);
+
+  return err;
+}
+
+/**
+ *
+ */
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value,
+                       size_t length) {
+  esp_err_t err = ESP_OK;
+  nvs_blob_t *b;
+  void *data;
+
+  if (handle & (1UL << 31)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  data = malloc(length);
+  if (data == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  memcpy(data, value, length);
+
+  pthread_mutex_lock(&nvsLock);
+
+  b = nvs_blob_find(handle, key);
+  if (b == NULL) {
+    b = calloc(1, sizeof(nvs_blob_t));
+    if (b == NULL) {
+      err = ESP_ERR_NO_MEM;
+    } else {
+      b->ns = handle - 1;
+      snprintf(b->key, NVS_NAME_LEN, "%s", key);
+      b->next = nvsBlobs;
+      nvsBlobs = b;
+    }
+  }
+
+  if (err == ESP_OK) {
+    free(b->data);
+    b->data = data;
+    b->len = length;
+  } else {
+    free(data);
+  }
+
+  pthread_mutex_unlock(&nvsLock);
+
+  return err;
+}
+
+/**
+ *
+ */
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+  esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+
+  pthread_mutex_lock(&nvsLock);
+
+  for (nvs_blob_t **p = &nvsBlobs; *p != NULL; p = &(*p)->next) {
+    nvs_blob_t *b = *p;
+
+    if ((b->ns == (handle & ~(1UL << 31)) - 1) &&
+        (strncmp(b->key, key, NVS_NAME_LEN - 1) == 0)) {
+      *p = b->next;
+      free(b->data);
+      free(b);
+      err = ESP_OK;
+
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&nvsLock);
+
+  return err;
+}
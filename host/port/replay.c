@@ -0,0 +1,455 @@
+/**
+ * Replay of a stream capture
+ *
+ * With --replay the receive thread of port/netconn.c reads from here
+ * instead of a socket. Captured pieces are delivered with their original
+ * spacing in host_time_ns(), so --replay-speed replays faster by speeding up
+ * all time of the port. Latencies of time replies are shifted by the
+ * difference of replay and capture time base, the client syncs as it did
+ * while capturing.
+ *
+ * When the capture is through and the server's buffer has played, the
+ * throughput, per stage timings of lightsnapcast/metrics.c, the player's
+ * resync and format switch statistics and the number of allocations during
+ * the replay are printed and the process exits.
+ * Heap accounting of audio_mem is printed per tag, since start of the
+ * client.
+ * Allocations are counted with -Wl,--wrap, only calls of the client and
+ * the port are seen, not those inside libraries.
+ */
+
+#include "replay.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio_mem.h"
+#include "capture.h"
+#include "freertos/FreeRTOS.h"
+#include "host_config.h"
+#include "metrics.h"
+#include "player.h"
+#include "snapcast.h"
+
+typedef struct replay_piece_s {
+  int64_t t_us;  //!< arrival time in capture's time base
+  size_t off;    //!< position in stream
+  size_t len;
+} replay_piece_t;
+
+static uint8_t *stream = NULL;
+static size_t streamLen = 0;
+static replay_piece_t *piece = NULL;
+static size_t pieceCnt = 0;
+
+// positions of time reply latencies in stream, patched on start
+static size_t *latencyOff = NULL;
+static size_t latencyCnt = 0;
+
+static uint32_t chunkCnt = 0;
+static char codec[16] = "unknown";
+static int32_t bufferMs = 1000;
+
+static bool started = false;
+static size_t next = 0;     //!< next piece to deliver
+static size_t nextPos = 0;  //!< bytes of it delivered already
+static int64_t start_us = 0;
+static int64_t delta_us = 0;  //!< replay minus capture time base
+
+#if CONFIG_USE_METRICS
+static metrics_snapshot_t metricsStart;
+#endif
+
+static uint64_t allocCnt = 0;
+static uint64_t allocBytes = 0;
+static uint64_t freeCnt = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+/**
+ *
+ */
+void *__wrap_malloc(size_t size) {
+  __atomic_fetch_add(&allocCnt, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&allocBytes, size, __ATOMIC_RELAXED);
+
+  return __real_malloc(size);
+}
+
+/**
+ *
+ */
+void *__wrap_calloc(size_t n, size_t size) {
+  __atomic_fetch_add(&allocCnt, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&allocBytes, n * size, __ATOMIC_RELAXED);
+
+  return __real_calloc(n, size);
+}
+
+/**
+ *
+ */
+void *__wrap_realloc(void *ptr, size_t size) {
+  __atomic_fetch_add(&allocCnt, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&allocBytes, size, __ATOMIC_RELAXED);
+
+  return __real_realloc(ptr, size);
+}
+
+/**
+ *
+ */
+void __wrap_free(void *ptr) {
+  if (ptr != NULL) {
+    __atomic_fetch_add(&freeCnt, 1, __ATOMIC_RELAXED);
+  }
+
+  __real_free(ptr);
+}
+
+/**
+ *
+ */
+static uint32_t get_u32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ *
+ */
+static void put_u32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+/**
+ * Find time replies, count wire chunks and pick codec and buffer size.
+ * A message cut off at the end of the capture is ignored.
+ */
+static int replay_scan(void) {
+  size_t pos = 0;
+
+  while (pos + BASE_MESSAGE_SIZE <= streamLen) {
+    const uint8_t *msg = &stream[pos];
+    uint16_t type = msg[0] | (msg[1] << 8);
+    uint32_t size = get_u32(&msg[22]);
+    const uint8_t *payload = &msg[BASE_MESSAGE_SIZE];
+
+    if ((type > SNAPCAST_MESSAGE_LAST) || (size > streamLen)) {
+      fprintf(stderr, "replay: bad message at %zu\n", pos);
+
+      return -1;
+    }
+
+    if (pos + BASE_MESSAGE_SIZE + size > streamLen) {
+      break;
+    }
+
+    switch (type) {
+      case SNAPCAST_MESSAGE_TIME:
+        if (size >= TIME_MESSAGE_SIZE) {
+          latencyOff[latencyCnt++] = pos + BASE_MESSAGE_SIZE;
+        }
+        break;
+
+      case SNAPCAST_MESSAGE_WIRE_CHUNK:
+        chunkCnt++;
+        break;
+
+      case SNAPCAST_MESSAGE_CODEC_HEADER:
+        if ((size >= 4) && (get_u32(payload) < sizeof(codec)) &&
+            (get_u32(payload) <= size - 4)) {
+          memcpy(codec, &payload[4], get_u32(payload));
+          codec[get_u32(payload)] = 0;
+        }
+        break;
+
+      case SNAPCAST_MESSAGE_SERVER_SETTINGS: {
+        char json[512];
+        char *p;
+        size_t n = (size > 4) ? size - 4 : 0;
+
+        if (n >= sizeof(json)) {
+          n = sizeof(json) - 1;
+        }
+        memcpy(json, &payload[4], n);
+        json[n] = 0;
+
+        p = strstr(json, "\"bufferMs\":");
+        if (p != NULL) {
+          bufferMs = atoi(p + strlen("\"bufferMs\":"));
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+
+    pos += BASE_MESSAGE_SIZE + size;
+  }
+
+  return 0;
+}
+
+/**
+ * Read capture to memory and find what replay and report need
+ */
+int replay_load(const char *path) {
+  FILE *f = fopen(path, "rb");
+  uint8_t hdr[8];
+  capture_record_t rec;
+  long fileLen;
+
+  if (f == NULL) {
+    fprintf(stderr, "replay: can't open %s: %s\n", path, strerror(errno));
+
+    return -1;
+  }
+
+  fseek(f, 0, SEEK_END);
+  fileLen = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  if ((fread(hdr, sizeof(hdr), 1, f) != 1) ||
+      (memcmp(hdr, CAPTURE_DUMP_MAGIC, 4) != 0) ||
+      (hdr[4] != CAPTURE_VERSION) || (hdr[5] != sizeof(capture_record_t))) {
+    fprintf(stderr, "replay: %s is no capture of version %d\n", path,
+            CAPTURE_VERSION);
+    fclose(f);
+
+    return -1;
+  }
+
+  // upper bounds, records are at least one byte long
+  stream = malloc(fileLen);
+  piece = malloc((fileLen / (sizeof(rec) + 1) + 1) * sizeof(replay_piece_t));
+  latencyOff = malloc((fileLen / BASE_MESSAGE_SIZE + 1) * sizeof(size_t));
+  if ((stream == NULL) || (piece == NULL) || (latencyOff == NULL)) {
+    fclose(f);
+
+    return -1;
+  }
+
+  while (fread(&rec, sizeof(rec), 1, f) == 1) {
+    if ((rec.len == 0) || (rec.len > fileLen) ||
+        (fread(&stream[streamLen], rec.len, 1, f) != 1)) {
+      fprintf(stderr, "replay: truncated record %zu\n", pieceCnt);
+
+      break;
+    }
+
+    piece[pieceCnt].t_us = rec.t_us;
+    piece[pieceCnt].off = streamLen;
+    piece[pieceCnt].len = rec.len;
+    pieceCnt++;
+    streamLen += rec.len;
+  }
+  fclose(f);
+
+  if ((pieceCnt == 0) || (replay_scan() < 0)) {
+    return -1;
+  }
+
+  printf("replay: %s, %zu bytes in %zu pieces over %.1fs, %u %s chunks\n",
+         path, streamLen, pieceCnt,
+         (piece[pieceCnt - 1].t_us - piece[0].t_us) * 1e-6, chunkCnt,
+         codec);
+
+  return 0;
+}
+
+/**
+ * move time replies to the time base of the replay
+ */
+static void replay_start(void) {
+  started = true;
+  start_us = host_time_us();
+  delta_us = start_us - piece[0].t_us;
+
+  for (size_t i = 0; i < latencyCnt; i++) {
+    uint8_t *p = &stream[latencyOff[i]];
+    int64_t lat = (int64_t)(int32_t)get_u32(p) * 1000000LL +
+                  (int32_t)get_u32(&p[4]);
+
+    lat -= delta_us;
+    put_u32(p, (uint32_t)(int32_t)(lat / 1000000LL));
+    put_u32(&p[4], (uint32_t)(int32_t)(lat % 1000000LL));
+  }
+
+#if CONFIG_USE_METRICS
+  metrics_get(&metricsStart);
+#endif
+
+  __atomic_store_n(&allocCnt, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&allocBytes, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&freeCnt, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ *
+ */
+static void replay_sleep_until(int64_t t_us) {
+  struct timespec ts;
+
+  // host_time_us() is host_time_ns() since process start
+  host_time_to_timespec(host_time_ns() + (t_us - host_time_us()) * 1000,
+                        &ts);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+         EINTR) {
+  }
+}
+
+#if CONFIG_USE_METRICS
+/**
+ * upper bound of bucket holding fraction q of the samples in µs, -1 for
+ * +Inf
+ */
+static int32_t replay_quantile(const metrics_histogram_t *h, double q) {
+  static const uint32_t bounds[METRICS_HIST_BUCKETS] =
+      METRICS_HIST_BOUNDS_US;
+  uint32_t sum = 0;
+
+  for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+    sum += h->bucket[i];
+    if (sum >= q * h->count) {
+      return bounds[i];
+    }
+  }
+
+  return -1;
+}
+#endif
+
+/**
+ *
+ */
+static void replay_report(void) {
+  double scale = hostConfig.replaySpeed;
+  double wall_s = (host_time_us() - start_us) * 1e-6 / scale;
+  uint64_t allocs = __atomic_load_n(&allocCnt, __ATOMIC_RELAXED);
+  player_resync_stats_t rs;
+
+  printf("replay: %u chunks in %.2fs at speed %.1f, %.1f chunks/s\n",
+         chunkCnt, wall_s, scale, chunkCnt / wall_s);
+
+#if CONFIG_USE_METRICS
+  metrics_snapshot_t m;
+
+  metrics_get(&m);
+
+  printf("replay: %-34s %8s %9s %8s %8s\n", "stage", "count", "mean_us",
+         "p50_us", "p99_us");
+  for (int i = 0; i < METRICS_HIST_MAX; i++) {
+    const metrics_desc_t *desc = metrics_hist_desc(i);
+    metrics_histogram_t h = m.hist[i];
+    char name[48];
+
+    h.count -= metricsStart.hist[i].count;
+    h.sum_us -= metricsStart.hist[i].sum_us;
+    for (int b = 0; b <= METRICS_HIST_BUCKETS; b++) {
+      h.bucket[b] -= metricsStart.hist[i].bucket[b];
+    }
+
+    if (h.count == 0) {
+      continue;
+    }
+
+    snprintf(name, sizeof(name), "%s%s%s%s", desc->name,
+             desc->labels ? "{" : "", desc->labels ? desc->labels : "",
+             desc->labels ? "}" : "");
+
+    // bucket bounds are in replay time
+    printf("replay: %-34s %8u %9.1f %8.0f %8.0f\n", name, h.count,
+           (double)h.sum_us / h.count / scale,
+           replay_quantile(&h, 0.5) / scale,
+           replay_quantile(&h, 0.99) / scale);
+
+    if (i == METRICS_HIST_RX_PROCESS) {
+      printf("replay: receive path busy %.3fs, capacity %.0f chunks/s\n",
+             h.sum_us * 1e-6 / scale,
+             chunkCnt / (h.sum_us * 1e-6 / scale));
+    }
+  }
+#endif
+
+  // times are in replay time, like the client sees them
+  if (player_get_resync_stats(&rs) == 0) {
+    printf("replay: resync hard %u, dropout %lldus, soft %u, reconfig %u, "
+           "gap %lldus (max %lldus), underruns %u\n",
+           rs.hardCnt, (long long)rs.dropout_us, rs.softCnt, rs.reconfigCnt,
+           (long long)rs.reconfigGap_us, (long long)rs.reconfigGapMax_us,
+           rs.underrunCnt);
+  }
+
+  printf("replay: %llu allocations, %.1f per chunk, %llu bytes, %llu "
+         "frees\n",
+         (unsigned long long)allocs, (double)allocs / chunkCnt,
+         (unsigned long long)__atomic_load_n(&allocBytes, __ATOMIC_RELAXED),
+         (unsigned long long)__atomic_load_n(&freeCnt, __ATOMIC_RELAXED));
+
+#if CONFIG_USE_HEAP_ACCOUNTING
+  printf("replay: %-34s %8s %9s %8s %8s\n", "heap", "current", "peak",
+         "allocs", "fails");
+  for (int i = 0; i < AUDIO_MEM_TAG_MAX; i++) {
+    audio_mem_usage_t sum = {0}, usage;
+
+    // the host has one heap only, but keep it correct for all
+    for (int j = 0; j < AUDIO_MEM_HEAP_MAX; j++) {
+      audio_mem_stats_get(i, j, &usage);
+      sum.current += usage.current;
+      sum.peak += usage.peak;
+      sum.allocs += usage.allocs;
+      sum.fails += usage.fails;
+    }
+
+    printf("replay: %-34s %8zu %9zu %8u %8u\n", audio_mem_tag_str(i),
+           sum.current, sum.peak, sum.allocs, sum.fails);
+  }
+#endif
+}
+
+/**
+ * Block until the next piece is due and copy up to len bytes of it. After
+ * the last one waits for playout, reports and exits.
+ */
+size_t replay_read(uint8_t *buf, size_t len) {
+  const replay_piece_t *p;
+
+  if (started == false) {
+    replay_start();
+  }
+
+  if (next >= pieceCnt) {
+    replay_sleep_until(host_time_us() +
+                       (bufferMs + REPLAY_DRAIN_MS) * 1000LL);
+    replay_report();
+
+    // flushes the playout log
+    exit(EXIT_SUCCESS);
+  }
+
+  p = &piece[next];
+  replay_sleep_until(p->t_us + delta_us);
+
+  if (len > p->len - nextPos) {
+    len = p->len - nextPos;
+  }
+  memcpy(buf, &stream[p->off + nextPos], len);
+
+  nextPos += len;
+  if (nextPos >= p->len) {
+    next++;
+    nextPos = 0;
+  }
+
+  return len;
+}
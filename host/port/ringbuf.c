@@ -0,0 +1,254 @@
+/**
+ * Byte ring buffer with the ESP-IDF ringbuf API
+ *
+ * Received items point into the buffer storage, the space is released when
+ * the item is returned. Only one item may be outstanding at a time.
+ */
+
+#include "freertos/ringbuf.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct host_ringbuf_s {
+  pthread_mutex_t lock;
+  pthread_cond_t space;
+  pthread_cond_t data;
+  uint8_t *storage;
+  bool ownStorage;
+  size_t size;
+  size_t head;         //!< read position
+  size_t count;        //!< bytes stored, outstanding item included
+  size_t outstanding;  //!< bytes of item not returned yet
+};
+
+/**
+ *
+ */
+static void ringbuf_deadline(TickType_t ticks, struct timespec *deadline) {
+  uint64_t ns = (uint64_t)ticks * 1000000000ULL / configTICK_RATE_HZ;
+
+  host_time_to_timespec(host_time_ns() + (int64_t)ns, deadline);
+}
+
+/**
+ *
+ */
+RingbufHandle_t xRingbufferCreateStatic(size_t size, RingbufferType_t type,
+                                        uint8_t *storage,
+                                        StaticRingbuffer_t *buffer) {
+  struct host_ringbuf_s *rb;
+  pthread_condattr_t attr;
+
+  (void)buffer;
+
+  if ((type != RINGBUF_TYPE_BYTEBUF) || (size == 0)) {
+    return NULL;
+  }
+
+  rb = calloc(1, sizeof(struct host_ringbuf_s));
+  if (rb == NULL) {
+    return NULL;
+  }
+
+  rb->storage = storage;
+  rb->size = size;
+
+  pthread_mutex_init(&rb->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&rb->space, &attr);
+  pthread_cond_init(&rb->data, &attr);
+  pthread_condattr_destroy(&attr);
+
+  return rb;
+}
+
+/**
+ *
+ */
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type) {
+  uint8_t *storage = malloc(size);
+  RingbufHandle_t rb;
+
+  if (storage == NULL) {
+    return NULL;
+  }
+
+  rb = xRingbufferCreateStatic(size, type, storage, NULL);
+  if (rb == NULL) {
+    free(storage);
+
+    return NULL;
+  }
+  rb->ownStorage = true;
+
+  return rb;
+}
+
+/**
+ *
+ */
+void vRingbufferDelete(RingbufHandle_t rb) {
+  if (rb == NULL) {
+    return;
+  }
+
+  pthread_mutex_destroy(&rb->lock);
+  pthread_cond_destroy(&rb->space);
+  pthread_cond_destroy(&rb->data);
+  if (rb->ownStorage == true) {
+    free(rb->storage);
+  }
+  free(rb);
+}
+
+/**
+ * data is only written completely, like on target
+ */
+BaseType_t xRingbufferSend(RingbufHandle_t rb, const void *data, size_t size,
+                           TickType_t ticks) {
+  struct timespec deadline;
+  size_t tail, first;
+
+  if (size > rb->size) {
+    return pdFALSE;
+  }
+
+  ringbuf_deadline(ticks, &deadline);
+
+  pthread_mutex_lock(&rb->lock);
+  while (rb->size - rb->count < size) {
+    int err = 0;
+
+    if (ticks == 0) {
+      err = ETIMEDOUT;
+    } else if (ticks == portMAX_DELAY) {
+      pthread_cond_wait(&rb->space, &rb->lock);
+    } else {
+      err = pthread_cond_timedwait(&rb->space, &rb->lock, &deadline);
+    }
+
+    if ((err == ETIMEDOUT) && (rb->size - rb->count < size)) {
+      pthread_mutex_unlock(&rb->lock);
+
+      return pdFALSE;
+    }
+  }
+
+  tail = (rb->head + rb->count) % rb->size;
+  first = rb->size - tail;
+  if (first > size) {
+    first = size;
+  }
+  memcpy(&rb->storage[tail], data, first);
+  memcpy(rb->storage, (const uint8_t *)data + first, size - first);
+  rb->count += size;
+
+  pthread_cond_signal(&rb->data);
+  pthread_mutex_unlock(&rb->lock);
+
+  return pdTRUE;
+}
+
+/**
+ * called with lock taken
+ */
+static void *ringbuf_take(RingbufHandle_t rb, size_t *size, size_t maxSize) {
+  size_t len = rb->count;
+  void *item;
+
+  // contiguous part only, rest comes with next item
+  if (len > rb->size - rb->head) {
+    len = rb->size - rb->head;
+  }
+  if (len > maxSize) {
+    len = maxSize;
+  }
+
+  item = &rb->storage[rb->head];
+  rb->outstanding = len;
+  *size = len;
+
+  return item;
+}
+
+/**
+ *
+ */
+void *xRingbufferReceiveUpTo(RingbufHandle_t rb, size_t *size,
+                             TickType_t ticks, size_t maxSize) {
+  struct timespec deadline;
+  void *item;
+
+  ringbuf_deadline(ticks, &deadline);
+
+  pthread_mutex_lock(&rb->lock);
+  while ((rb->count == 0) || (rb->outstanding > 0)) {
+    int err = 0;
+
+    if (ticks == 0) {
+      err = ETIMEDOUT;
+    } else if (ticks == portMAX_DELAY) {
+      pthread_cond_wait(&rb->data, &rb->lock);
+    } else {
+      err = pthread_cond_timedwait(&rb->data, &rb->lock, &deadline);
+    }
+
+    if ((err == ETIMEDOUT) && ((rb->count == 0) || (rb->outstanding > 0))) {
+      pthread_mutex_unlock(&rb->lock);
+
+      return NULL;
+    }
+  }
+
+  item = ringbuf_take(rb, size, maxSize);
+  pthread_mutex_unlock(&rb->lock);
+
+  return item;
+}
+
+/**
+ *
+ */
+void *xRingbufferReceiveUpToFromISR(RingbufHandle_t rb, size_t *size,
+                                    size_t maxSize) {
+  void *item = NULL;
+
+  pthread_mutex_lock(&rb->lock);
+  if ((rb->count > 0) && (rb->outstanding == 0)) {
+    item = ringbuf_take(rb, size, maxSize);
+  }
+  pthread_mutex_unlock(&rb->lock);
+
+  return item;
+}
+
+/**
+ *
+ */
+void vRingbufferReturnItem(RingbufHandle_t rb, void *item) {
+  (void)item;
+
+  pthread_mutex_lock(&rb->lock);
+  rb->head = (rb->head + rb->outstanding) % rb->size;
+  rb->count -= rb->outstanding;
+  rb->outstanding = 0;
+  pthread_cond_broadcast(&rb->space);
+  pthread_cond_signal(&rb->data);
+  pthread_mutex_unlock(&rb->lock);
+}
+
+/**
+ *
+ */
+void vRingbufferReturnItemFromISR(RingbufHandle_t rb, void *item,
+                                  BaseType_t *woken) {
+  if (woken != NULL) {
+    *woken = pdFALSE;
+  }
+
+  vRingbufferReturnItem(rb, item);
+}
@@ -0,0 +1,96 @@
+/**
+ * APLL coefficients as calculated by ESP-IDF for ESP32,
+ * apll_freq = xtal * (4 + sdm2 + sdm1 / 256 + sdm0 / 65536) / ((o_div + 2) * 2)
+ */
+
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "soc/rtc.h"
+
+static portMUX_TYPE apllMux = portMUX_INITIALIZER_UNLOCKED;
+static double apllFreq = 0;
+
+/**
+ *
+ */
+static double apll_freq_get(uint32_t o_div, uint32_t sdm0, uint32_t sdm1,
+                            uint32_t sdm2) {
+  return (double)HOST_APLL_XTAL_HZ *
+         (4.0 + sdm2 + sdm1 / 256.0 + sdm0 / 65536.0) / ((o_div + 2) * 2.0);
+}
+
+/**
+ * returns the frequency which will be reached, 0 if freq is out of range
+ */
+uint32_t rtc_clk_apll_coeff_calc(uint32_t freq, uint32_t *o_div,
+                                 uint32_t *sdm0, uint32_t *sdm1,
+                                 uint32_t *sdm2) {
+  int div;
+  uint64_t numerator;
+
+  if (freq == 0) {
+    return 0;
+  }
+
+  div = (int)(HOST_APLL_MULTIPLIER_OUT_MIN_HZ / (2.0 * freq) + 1) - 2;
+  if (div > 31) {
+    return 0;
+  }
+  if (div < 0) {
+    div = (int)(HOST_APLL_MULTIPLIER_OUT_MAX_HZ / (2.0 * freq)) - 2;
+    if (div < 0) {
+      return 0;
+    }
+  }
+
+  // 4 + sdm2 + sdm1 / 256 + sdm0 / 65536 in 16.16 fixed point
+  numerator = ((uint64_t)freq * 2 * (div + 2) << 16) / HOST_APLL_XTAL_HZ;
+  if ((numerator < (4 << 16)) || (numerator >= ((uint64_t)(4 + 64) << 16))) {
+    return 0;
+  }
+  numerator -= 4 << 16;
+
+  *o_div = div;
+  *sdm2 = numerator >> 16;
+  *sdm1 = (numerator >> 8) & 0xFF;
+  *sdm0 = numerator & 0xFF;
+
+  return (uint32_t)lround(apll_freq_get(*o_div, *sdm0, *sdm1, *sdm2));
+}
+
+/**
+ *
+ */
+void rtc_clk_apll_coeff_set(uint32_t o_div, uint32_t sdm0, uint32_t sdm1,
+                            uint32_t sdm2) {
+  double freq = apll_freq_get(o_div, sdm0, sdm1, sdm2);
+
+  portENTER_CRITICAL(&apllMux);
+  apllFreq = freq;
+  portEXIT_CRITICAL(&apllMux);
+}
+
+/**
+ *
+ */
+void rtc_clk_apll_enable(bool enable) {
+  if (enable == false) {
+    portENTER_CRITICAL(&apllMux);
+    apllFreq = 0;
+    portEXIT_CRITICAL(&apllMux);
+  }
+}
+
+/**
+ *
+ */
+double host_apll_freq(void) {
+  double freq;
+
+  portENTER_CRITICAL(&apllMux);
+  freq = apllFreq;
+  portEXIT_CRITICAL(&apllMux);
+
+  return freq;
+}
@@ -0,0 +1,55 @@
+# Replays a capture in real time and checks the player's statistics of the
+# report
+#
+#   cmake -DHOST=build-host/snapclient-host -DCAPTURE=capture.cap \
+#         -DRECONFIG=1 -DMAX_GAP_US=20000 -P host/replay_test.cmake
+#
+# RECONFIG is the number of sample format switches expected, their gap must
+# not exceed MAX_GAP_US. No audio may be dropped, a single hard resync is
+# expected when the queue runs empty after the capture.
+
+if(NOT DEFINED MAX_GAP_US)
+  set(MAX_GAP_US 0)
+endif()
+
+execute_process(
+    COMMAND ${HOST} --replay ${CAPTURE}
+    OUTPUT_VARIABLE out
+    ERROR_VARIABLE err
+    RESULT_VARIABLE rc)
+
+if(NOT rc EQUAL 0)
+  message(FATAL_ERROR "${out}${err}replay of ${CAPTURE} failed: ${rc}")
+endif()
+
+string(REGEX MATCH "(^|\n)E \\([0-9]+\\)[^\n]*" error "${out}${err}")
+if(error)
+  message(FATAL_ERROR "${out}${err}error logged:${error}")
+endif()
+
+string(CONCAT re
+    "replay: resync hard ([0-9]+), dropout ([0-9]+)us, soft [0-9]+, "
+    "reconfig ([0-9]+), gap -?[0-9]+us \\(max (-?[0-9]+)us\\)")
+string(REGEX MATCH "${re}" line "${out}")
+if(NOT line)
+  message(FATAL_ERROR "${out}${err}no resync statistics in report")
+endif()
+
+set(hard ${CMAKE_MATCH_1})
+set(dropout ${CMAKE_MATCH_2})
+set(reconfig ${CMAKE_MATCH_3})
+set(gap ${CMAKE_MATCH_4})
+
+message(STATUS "${line}")
+
+if(NOT reconfig EQUAL RECONFIG)
+  message(FATAL_ERROR "${reconfig} format switches, expected ${RECONFIG}")
+endif()
+
+if((gap LESS 0) OR (gap GREATER MAX_GAP_US))
+  message(FATAL_ERROR "format switch gap ${gap}us, max. ${MAX_GAP_US}us")
+endif()
+
+if((hard GREATER 1) OR (NOT dropout EQUAL 0))
+  message(FATAL_ERROR "${hard} hard resyncs dropped ${dropout}us of audio")
+endif()
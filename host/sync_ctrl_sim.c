@@ -0,0 +1,390 @@
+/**
+ * Closed loop simulation of the sync controller
+ *
+ * Feeds components/lightsnapcast/sync_ctrl.c with the playback error of a
+ * modelled client, once per chunk like the player does, and applies its
+ * decisions to the model. Minutes of playback take milliseconds, so
+ * algorithms, median lengths and offsets can be compared over many DAC
+ * errors before they are tried with tools/sync_bench.py:
+ *
+ *   build-host/sync-ctrl-sim --dac-ppm 80 --jitter-us 100 --seconds 600
+ *
+ * The model: the DAC runs dac-ppm (plus wander) fast, the measured age is
+ * the true error plus a slowly varying error of the server time estimate
+ * and gaussian jitter of the DMA timing. Inserted frames delay playback,
+ * dropped ones advance it, an APLL step changes the DAC speed by
+ * SYNC_CTRL_APLL_PPM until the next one.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sync_ctrl.h"
+
+#define SIM_SR 48000
+
+// same as player.h and player.c
+#define SIM_HARD_RESYNC_US 2000
+#define SIM_SOFT_RESYNC_MAX_US 50000
+#define SIM_START_MARGIN_US 5000
+#define SIM_INSERT_SHORT_OFFSET 128
+#define SIM_INSERT_MINI_OFFSET 64
+#define SIM_APLL_SHORT_OFFSET 2
+#define SIM_APLL_MINI_OFFSET 1
+
+typedef struct sim_params_s {
+  double dacPpm;
+  double wanderPpm;
+  double wanderPeriod_s;
+  double jitter_us;
+  double clockNoise_us;
+  double start_us;
+  double seconds;
+  double settle_s;
+  int chunk_ms;
+  bool feedForward;
+  unsigned int seed;
+} sim_params_t;
+
+typedef struct sim_result_s {
+  double p50_us;
+  double p99_us;
+  double max_us;
+  uint32_t steps;
+  uint32_t soft;
+  uint32_t hard;
+} sim_result_t;
+
+static uint64_t rngState;
+
+/**
+ * xorshift64*, same sequence on every host
+ */
+static double rng_uniform(void) {
+  rngState ^= rngState >> 12;
+  rngState ^= rngState << 25;
+  rngState ^= rngState >> 27;
+
+  return (double)((rngState * 2685821657736338717ULL) >> 11) /
+         (double)(1ULL << 53);
+}
+
+static double rng_gauss(void) {
+  double u = rng_uniform();
+  double v = rng_uniform();
+
+  if (u < 1e-12) {
+    u = 1e-12;
+  }
+
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/**
+ * restart playback with a small start error like initial sync has
+ */
+static double sim_start(sync_ctrl_t *ctrl, const sim_params_t *p) {
+  sync_ctrl_input_t in = {
+      .buf_us = 100000,
+      .chunkDuration_us = p->chunk_ms * 1000,
+      .sr = SIM_SR,
+  };
+  sync_ctrl_start_t start;
+
+  sync_ctrl_start(ctrl, &in, 0, &start);
+
+  return (2 * rng_uniform() - 1) * p->start_us;
+}
+
+/**
+ *
+ */
+static int sim_run(sync_ctrl_mode_t mode, sync_ctrl_algo_t algo,
+                   const sim_params_t *p, sim_result_t *r) {
+  sync_ctrl_config_t cfg = {
+      .mode = mode,
+      .algo = algo,
+      .softResync = true,
+      .hardResyncFine_us = SIM_HARD_RESYNC_US,
+      .hardResyncCoarse_us = SIM_HARD_RESYNC_US,
+      .softResyncMax_us = SIM_SOFT_RESYNC_MAX_US,
+      .startMargin_us = SIM_START_MARGIN_US,
+      .insertFrames = (mode == SYNC_CTRL_MODE_INSERT) ? 1 : 0,
+  };
+  static sync_ctrl_t ctrl;
+  int64_t dt_us = p->chunk_ms * 1000;
+  uint32_t n = (uint32_t)(p->seconds * 1000 / p->chunk_ms);
+  uint32_t settle = (uint32_t)(p->settle_s * 1000 / p->chunk_ms);
+  double frame_us = 1000000.0 / SIM_SR;
+  double alpha = (double)dt_us / 10000000.0;  // 10s estimate drift
+  double err, est = 0;
+  double *abs_err;
+  uint32_t cnt = 0;
+  int8_t apllDir = 0;
+
+#if defined(SHORT_OFFSET) && defined(MINI_OFFSET)
+  cfg.shortOffset_us = SHORT_OFFSET;
+  cfg.miniOffset_us = MINI_OFFSET;
+#else
+  if (mode == SYNC_CTRL_MODE_INSERT) {
+    cfg.shortOffset_us = SIM_INSERT_SHORT_OFFSET;
+    cfg.miniOffset_us = SIM_INSERT_MINI_OFFSET;
+  } else {
+    cfg.shortOffset_us = SIM_APLL_SHORT_OFFSET;
+    cfg.miniOffset_us = SIM_APLL_MINI_OFFSET;
+  }
+#endif
+
+  abs_err = malloc(n * sizeof(double));
+  if (abs_err == NULL) {
+    return -1;
+  }
+
+  memset(r, 0, sizeof(sim_result_t));
+  rngState = 0x9e3779b97f4a7c15ULL ^ p->seed;
+
+  sync_ctrl_init(&ctrl, &cfg);
+  err = sim_start(&ctrl, p);
+
+  for (uint32_t i = 0; i < n; i++) {
+    double t_s = (double)i * dt_us / 1000000.0;
+    double ppm = p->dacPpm;
+    sync_ctrl_output_t out;
+
+    if (p->wanderPeriod_s > 0) {
+      ppm += p->wanderPpm * sin(2 * M_PI * t_s / p->wanderPeriod_s);
+    }
+
+    // fast DAC gets early, APLL speeds up if we are late
+    err -= (ppm + apllDir * SYNC_CTRL_APLL_PPM) * dt_us / 1000000.0;
+    est += alpha * (p->clockNoise_us * sqrt(2 / alpha) * rng_gauss() - est);
+
+    sync_ctrl_input_t in = {
+        .serverNow_us = (int64_t)(err + est + p->jitter_us * rng_gauss()),
+        .chunkDuration_us = dt_us,
+        .sr = SIM_SR,
+        .queueDepth = 10,
+        .fineLock = true,
+        .dacPpmValid = p->feedForward,
+        .dacPpm = (float)p->dacPpm,
+    };
+
+    sync_ctrl_update(&ctrl, &in, &out);
+
+    switch (out.action) {
+      case SYNC_CTRL_SOFT_RESYNC:
+        err -= out.softResyncFrames * frame_us;
+        r->soft++;
+        break;
+
+      case SYNC_CTRL_HARD_RESYNC:
+        err = sim_start(&ctrl, p);
+        apllDir = 0;
+        r->hard++;
+        break;
+
+      default:
+        // inserted frames delay playback
+        err -= out.insert * (double)cfg.insertFrames * frame_us;
+        if (out.control == true) {
+          if ((mode == SYNC_CTRL_MODE_APLL) && (out.dir != apllDir)) {
+            r->steps++;
+          }
+          apllDir = (mode == SYNC_CTRL_MODE_APLL) ? out.dir : 0;
+        }
+        if (out.insert != 0) {
+          r->steps++;
+        }
+        break;
+    }
+
+    if (i >= settle) {
+      abs_err[cnt++] = fabs(err);
+    }
+  }
+
+  if (cnt > 0) {
+    qsort(abs_err, cnt, sizeof(double), cmp_double);
+    r->p50_us = abs_err[cnt / 2];
+    r->p99_us = abs_err[(uint32_t)(cnt * 0.99)];
+    r->max_us = abs_err[cnt - 1];
+  }
+
+  free(abs_err);
+
+  return 0;
+}
+
+// indexed by sync_ctrl_algo_t and sync_ctrl_mode_t
+static const char *algoNames[] = {"median", "pi", NULL};
+static const char *modeNames[] = {"insert", "apll", NULL};
+
+/**
+ * index of name in names, -1 for "all", -2 if unknown
+ */
+static int name_index(const char *name, const char **names) {
+  if (strcmp(name, "all") == 0) {
+    return -1;
+  }
+
+  for (int i = 0; names[i] != NULL; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      return i;
+    }
+  }
+
+  return -2;
+}
+
+/**
+ *
+ */
+static void usage(const char *prog, const sim_params_t *p) {
+  printf(
+      "usage: %s [options]\n"
+      "  -a, --algo median|pi|all     controller (all)\n"
+      "  -m, --mode insert|apll|all   actuator (all)\n"
+      "  -d, --dac-ppm PPM            DAC clock error (%.0f)\n"
+      "  -w, --dac-wander-ppm PPM     amplitude of DAC clock wander\n"
+      "  -W, --dac-wander-period SEC  period of DAC clock wander (%.0f)\n"
+      "  -j, --jitter-us US           age measurement jitter (%.0f)\n"
+      "  -n, --clock-noise-us US      server time estimate error (%.0f)\n"
+      "  -c, --chunk-ms MS            chunk duration (%d)\n"
+      "  -t, --seconds SEC            simulated playback (%.0f)\n"
+      "  -S, --settle SEC             not counted in error (%.0f)\n"
+      "  -f, --feed-forward           controller knows the DAC error\n"
+      "  -s, --seed N                 random seed (%u)\n",
+      prog, p->dacPpm, p->wanderPeriod_s, p->jitter_us, p->clockNoise_us,
+      p->chunk_ms, p->seconds, p->settle_s, p->seed);
+}
+
+/**
+ *
+ */
+int main(int argc, char **argv) {
+  static const struct option longOpts[] = {
+      {"algo", required_argument, NULL, 'a'},
+      {"mode", required_argument, NULL, 'm'},
+      {"dac-ppm", required_argument, NULL, 'd'},
+      {"dac-wander-ppm", required_argument, NULL, 'w'},
+      {"dac-wander-period", required_argument, NULL, 'W'},
+      {"jitter-us", required_argument, NULL, 'j'},
+      {"clock-noise-us", required_argument, NULL, 'n'},
+      {"chunk-ms", required_argument, NULL, 'c'},
+      {"seconds", required_argument, NULL, 't'},
+      {"settle", required_argument, NULL, 'S'},
+      {"feed-forward", no_argument, NULL, 'f'},
+      {"seed", required_argument, NULL, 's'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  sim_params_t p = {
+      .dacPpm = 50,
+      .wanderPeriod_s = 60,
+      .jitter_us = 50,
+      .clockNoise_us = 20,
+      .start_us = 50,
+      .seconds = 300,
+      .settle_s = 30,
+      .chunk_ms = 20,
+      .seed = 1,
+  };
+  int algo = -1, mode = -1;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "a:m:d:w:W:j:n:c:t:S:fs:h", longOpts,
+                            NULL)) != -1) {
+    switch (opt) {
+      case 'a':
+        algo = name_index(optarg, algoNames);
+        if (algo < -1) {
+          usage(argv[0], &p);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'm':
+        mode = name_index(optarg, modeNames);
+        if (mode < -1) {
+          usage(argv[0], &p);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'd':
+        p.dacPpm = atof(optarg);
+        break;
+      case 'w':
+        p.wanderPpm = atof(optarg);
+        break;
+      case 'W':
+        p.wanderPeriod_s = atof(optarg);
+        break;
+      case 'j':
+        p.jitter_us = atof(optarg);
+        break;
+      case 'n':
+        p.clockNoise_us = atof(optarg);
+        break;
+      case 'c':
+        p.chunk_ms = atoi(optarg);
+        break;
+      case 't':
+        p.seconds = atof(optarg);
+        break;
+      case 'S':
+        p.settle_s = atof(optarg);
+        break;
+      case 'f':
+        p.feedForward = true;
+        break;
+      case 's':
+        p.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 'h':
+        usage(argv[0], &p);
+        return EXIT_SUCCESS;
+      default:
+        usage(argv[0], &p);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if ((p.chunk_ms <= 0) || (p.seconds <= p.settle_s)) {
+    usage(argv[0], &p);
+    return EXIT_FAILURE;
+  }
+
+  printf("median %d/%d, dac %.0fppm, jitter %.0fus, %.0fs\n",
+         SHORT_BUFFER_LEN, MINI_BUFFER_LEN, p.dacPpm, p.jitter_us,
+         p.seconds);
+  printf("algo   mode      |err| p50    p99    max  steps  soft  hard\n");
+
+  for (int m = SYNC_CTRL_MODE_INSERT; m <= SYNC_CTRL_MODE_APLL; m++) {
+    for (int a = SYNC_CTRL_ALGO_MEDIAN; a <= SYNC_CTRL_ALGO_PI; a++) {
+      sim_result_t r;
+
+      if (((mode >= 0) && (mode != m)) || ((algo >= 0) && (algo != a))) {
+        continue;
+      }
+
+      if (sim_run(m, a, &p, &r) < 0) {
+        return EXIT_FAILURE;
+      }
+
+      printf("%-6s %-6s %10.0fus %4.0fus %4.0fus %6u %5u %5u\n",
+             algoNames[a], modeNames[m], r.p50_us, r.p99_us, r.max_us,
+             r.steps, r.soft, r.hard);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -5,6 +5,7 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 
+#include <cJSON.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -38,6 +39,8 @@
 #include "lwip/netdb.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
 #include "mdns.h"
 #include "net_functions.h"
 
@@ -57,10 +60,18 @@
 
 // flac decoder is implemented as a subcomponet from master git repo
 #include "FLAC/stream_decoder.h"
+#include "audio_mem.h"
+#include "capture.h"
+#include "metrics.h"
 #include "ota_server.h"
+#include "pcm_convert.h"
 #include "player.h"
 #include "snapcast.h"
+#include "snapcast_parser.h"
+#include "time_sync.h"
+#include "trace.h"
 #include "ui_http_server.h"
+#include "warm_start.h"
 
 static bool isCachedChunk = false;
 static uint32_t cachedBlocks = 0;
@@ -89,12 +100,18 @@ const char *VERSION_STRING = "0.0.3";
 #define OTA_TASK_CORE_ID tskNO_AFFINITY
 // 1  // tskNO_AFFINITY
 
+#if CONFIG_NVS_STRESS_TEST
+#define NVS_STRESS_TASK_PRIORITY 5
+#define NVS_STRESS_TASK_CORE_ID tskNO_AFFINITY
+#define NVS_STRESS_INTERVAL_MS 500
+#define NVS_STRESS_BLOB_SIZE 1024
+// log results every this many writes
+#define NVS_STRESS_REPORT_CNT 20
+#endif
+
 TaskHandle_t t_ota_task = NULL;
 TaskHandle_t t_http_get_task = NULL;
 
-#define FAST_SYNC_LATENCY_BUF 10000      // in µs
-#define NORMAL_SYNC_LATENCY_BUF 1000000  // in µs
-
 struct timeval tdif, tavg;
 
 /* snapast parameters; configurable in menuconfig */
@@ -106,6 +123,8 @@ struct timeval tdif, tavg;
 #define SNAPCAST_CLIENT_NAME CONFIG_SNAPCLIENT_NAME
 #define SNAPCAST_USE_SOFT_VOL CONFIG_SNAPCLIENT_USE_SOFT_VOL
 
+#define SNAPCAST_MDNS_TIMEOUT_MS 3000
+
 /* Logging tag */
 static const char *TAG = "SC";
 
@@ -134,6 +153,12 @@ typedef struct audioDACdata_s {
 
 audioDACdata_t audioDAC_data;
 static QueueHandle_t audioDACQHdl = NULL;
+
+#if CONFIG_USE_WARM_START
+static warm_start_t warmStart;
+static bool warmStartValid = false;
+static int64_t warmStartChecked_us = 0;
+#endif
 SemaphoreHandle_t audioDACSemaphore = NULL;
 
 typedef struct decoderData_s {
@@ -149,6 +174,9 @@ void time_sync_msg_cb(void *args);
 
 static char base_message_serialized[BASE_MESSAGE_SIZE];
 
+// preallocated time sync message, time message part is always 0
+static uint8_t timeSyncMessage[BASE_MESSAGE_SIZE + TIME_MESSAGE_SIZE];
+
 static const esp_timer_create_args_t tSyncArgs = {
     .callback = &time_sync_msg_cb,
     .dispatch_method = ESP_TIMER_TASK,
@@ -177,6 +205,22 @@ static decoderData_t pcmChunk = {
     .bytes = 0,
 };
 
+// state of the stream, shared by http_get_task() and the parser callbacks
+static snapcastSetting_t scSet;
+static codec_type_t codec = NONE;
+static bool received_header = false;
+static pcm_chunk_message_t *pcmData = NULL;
+static wire_chunk_message_t wire_chnk = {{0, 0}, 0, NULL};
+static bool skipChunk = false;  //!< current wire chunk is too late to decode
+static uint32_t skippedChunks = 0;  //!< chunks skipped since last decoded one
+static uint32_t payloadOffset = 0;
+static uint32_t tmpData = 0;
+static int32_t payloadDataShift = 0;
+static int64_t rxTime_us = 0;  //!< arrival of current base message
+static int64_t lastTimeSync = 0;
+static ip_addr_t remote_ip;
+static uint16_t remotePort = 0;
+
 /**
  *
  */
@@ -200,18 +244,6 @@ void time_sync_msg_cb(void *args) {
   //    return;
   //  }
 
-  uint8_t *p_pkt = (uint8_t *)malloc(BASE_MESSAGE_SIZE + TIME_MESSAGE_SIZE);
-  if (p_pkt == NULL) {
-    ESP_LOGW(
-        TAG,
-        "%s: Failed to get memory for time sync message. Skipping this round.",
-        __func__);
-
-    return;
-  }
-
-  memset(p_pkt, 0, BASE_MESSAGE_SIZE + TIME_MESSAGE_SIZE);
-
   base_message_tx.type = SNAPCAST_MESSAGE_TIME;
   base_message_tx.id = id_counter++;
   base_message_tx.refersTo = 0;
@@ -221,7 +253,7 @@ void time_sync_msg_cb(void *args) {
   base_message_tx.sent.sec = now / 1000000;
   base_message_tx.sent.usec = now - base_message_tx.sent.sec * 1000000;
   base_message_tx.size = TIME_MESSAGE_SIZE;
-  rc1 = base_message_serialize(&base_message_tx, (char *)&p_pkt[0],
+  rc1 = base_message_serialize(&base_message_tx, (char *)timeSyncMessage,
                                BASE_MESSAGE_SIZE);
   if (rc1) {
     ESP_LOGE(TAG, "Failed to serialize base message for time");
@@ -239,15 +271,17 @@ void time_sync_msg_cb(void *args) {
   //    return;
   //  }
 
-  rc1 = netconn_write(lwipNetconn, p_pkt, BASE_MESSAGE_SIZE + TIME_MESSAGE_SIZE,
-                      NETCONN_NOCOPY);
+  // buffer is reused next round so lwIP has to copy these 34 bytes, we must
+  // not pass it with NETCONN_NOCOPY as it may be needed for retransmission
+  rc1 = netconn_write(lwipNetconn, timeSyncMessage,
+                      BASE_MESSAGE_SIZE + TIME_MESSAGE_SIZE, NETCONN_COPY);
   if (rc1 != ERR_OK) {
     ESP_LOGW(TAG, "error writing timesync msg");
 
     return;
   }
 
-  free(p_pkt);
+  time_sync_tx_done(BASE_MESSAGE_SIZE + TIME_MESSAGE_SIZE);
 
   //  ESP_LOGI(TAG, "%s: sent time sync message", __func__);
 
@@ -257,6 +291,16 @@ void time_sync_msg_cb(void *args) {
   //  }
 }
 
+/**
+ * called from tcpip thread, remember when data arrived on our connection
+ */
+static void netconn_rx_callback(struct netconn *conn, enum netconn_evt evt,
+                                u16_t len) {
+  if ((evt == NETCONN_EVT_RCVPLUS) && (len > 0)) {
+    time_sync_rx_timestamp_insert(len);
+  }
+}
+
 /**
  *
  */
@@ -294,7 +338,7 @@ static FLAC__StreamDecoderReadStatus read_callback(
 
       // ESP_LOGW(TAG, "read all flac inData %d", *bytes);
 
-      free(decoderChunk.inData);
+      audio_free_tag(AUDIO_MEM_TAG_DECODER, decoderChunk.inData);
       decoderChunk.inData = NULL;
       decoderChunk.bytes = 0;
     } else {
@@ -303,8 +347,8 @@ static FLAC__StreamDecoderReadStatus read_callback(
       memmove(decoderChunk.inData, decoderChunk.inData + *bytes,
               decoderChunk.bytes - *bytes);
       decoderChunk.bytes -= *bytes;
-      decoderChunk.inData =
-          (uint8_t *)realloc(decoderChunk.inData, decoderChunk.bytes);
+      decoderChunk.inData = (uint8_t *)audio_realloc_tag(
+          AUDIO_MEM_TAG_DECODER, decoderChunk.inData, decoderChunk.bytes);
 
       // ESP_LOGW(TAG, "didn't read all flac inData %d", *bytes);
       //	    flacData->inData += *bytes;
@@ -331,7 +375,6 @@ static FLAC__StreamDecoderReadStatus read_callback(
 static FLAC__StreamDecoderWriteStatus write_callback(
     const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame,
     const FLAC__int32 *const buffer[], void *client_data) {
-  size_t i;
   snapcastSetting_t *scSet = (snapcastSetting_t *)client_data;
 
   size_t bytes = frame->header.blocksize * frame->header.channels *
@@ -369,20 +412,15 @@ static FLAC__StreamDecoderWriteStatus write_callback(
     return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
   }
 
-  pcmChunk.outData =
-      (uint8_t *)realloc(pcmChunk.outData, pcmChunk.bytes + bytes);
+  pcmChunk.outData = (uint8_t *)audio_realloc_tag(
+      AUDIO_MEM_TAG_DECODER, pcmChunk.outData, pcmChunk.bytes + bytes);
   if (!pcmChunk.outData) {
     ESP_LOGE(TAG, "%s, failed to allocate PCM chunk payload", __func__);
     return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
   }
 
-  for (i = 0; i < frame->header.blocksize; i++) {
-    // write little endian
-    pcmChunk.outData[pcmChunk.bytes + 4 * i] = (uint8_t)(buffer[0][i]);
-    pcmChunk.outData[pcmChunk.bytes + 4 * i + 1] = (uint8_t)(buffer[0][i] >> 8);
-    pcmChunk.outData[pcmChunk.bytes + 4 * i + 2] = (uint8_t)(buffer[1][i]);
-    pcmChunk.outData[pcmChunk.bytes + 4 * i + 3] = (uint8_t)(buffer[1][i] >> 8);
-  }
+  pcm_convert_flac(&pcmChunk.outData[pcmChunk.bytes], buffer,
+                   frame->header.blocksize);
 
   pcmChunk.bytes += bytes;
 
@@ -446,19 +484,717 @@ void audio_set_mute(bool mute) {
     audioDAC_data.mute = mute;
     xQueueOverwrite(audioDACQHdl, &audioDAC_data);
   }
-  xSemaphoreGive(audioDACSemaphore);
+  xSemaphoreGive(audioDACSemaphore);
+}
+
+/**
+ *
+ */
+void audio_set_volume(int volume) {
+  xSemaphoreTake(audioDACSemaphore, portMAX_DELAY);
+  if (volume != audioDAC_data.volume) {
+    audioDAC_data.volume = volume;
+    xQueueOverwrite(audioDACQHdl, &audioDAC_data);
+  }
+  xSemaphoreGive(audioDACSemaphore);
+}
+
+/**
+ * Check if a wire chunk can still be played before we spend time decoding it.
+ * As long as we don't know server time chunks are thrown away by player
+ * anyway.
+ */
+static bool wire_chunk_is_late(const tv_t *timestamp,
+                               const snapcastSetting_t *setting) {
+  int64_t serverNow, diff2Server, chunkStart, age;
+  int64_t chunkDuration_us = 0;
+
+  if (server_now(&serverNow, &diff2Server) < 0) {
+    return true;
+  }
+
+  chunkStart = (int64_t)timestamp->sec * 1000000LL + (int64_t)timestamp->usec;
+
+  if (setting->sr > 0) {
+    chunkDuration_us =
+        1000000LL * (int64_t)setting->chkInFrames / (int64_t)setting->sr;
+  }
+
+  // same as in player_task(), but without DMA buffer
+  age = serverNow - chunkStart - (int64_t)setting->buf_ms * 1000LL +
+        (int64_t)setting->cDacLat_ms * 1000LL;
+
+  // chunk would be over before we could start playing it
+  return age > chunkDuration_us;
+}
+
+#if CONFIG_USE_WARM_START
+/**
+ * remember stream state for next boot once we are playing, flash is only
+ * written if something changed
+ */
+static void warm_start_update(const ip_addr_t *serverIp, uint16_t serverPort,
+                              const snapcastSetting_t *setting) {
+  int64_t now = esp_timer_get_time();
+  float skew = 0;
+
+  if ((warmStartChecked_us != 0) &&
+      ((now - warmStartChecked_us) < WARM_START_STORE_INTERVAL_US)) {
+    return;
+  }
+
+  if ((setting->chkInFrames == 0) || (setting->sr <= 0) ||
+      (player_get_clock_lock() != CLOCK_FINE)) {
+    return;
+  }
+
+  warmStartChecked_us = now;
+
+  player_get_clock_skew(&skew);
+  warm_start_set(&warmStart, serverIp, serverPort, setting, skew);
+  if (warm_start_store(&warmStart) == 0) {
+    warmStartValid = true;
+  }
+}
+#endif
+
+/**
+ * use the time the pbuf holding the base message header arrived
+ */
+static void stream_base_cb(void *ctx, base_message_t *base, uint64_t pos) {
+  if (time_sync_rx_timestamp_get(pos, &rxTime_us) < 0) {
+    rxTime_us = esp_timer_get_time();
+  }
+
+  base->received.sec = rxTime_us / 1000000;
+  base->received.usec = rxTime_us - base->received.sec * 1000000;
+}
+
+/**
+ *
+ */
+static bool stream_chunk_begin_cb(void *ctx, wire_chunk_message_t *chunk) {
+  wire_chnk = *chunk;
+
+  // don't bother receiving and decoding chunks which can't be played
+  // anymore, e.g. after a stall
+  skipChunk = false;
+  if (received_header == true) {
+    skipChunk = wire_chunk_is_late(&wire_chnk.timestamp, &scSet);
+  }
+
+  // TODO: we could use wire chunk directly maybe?
+  decoderChunk.bytes = wire_chnk.size;
+  while ((skipChunk == false) && !decoderChunk.inData) {
+    decoderChunk.inData = (uint8_t *)audio_malloc_tag(AUDIO_MEM_TAG_DECODER,
+                                                      decoderChunk.bytes);
+    if (!decoderChunk.inData) {
+      ESP_LOGW(TAG,
+               "malloc decoderChunk.inData failed, wait 1ms and try again");
+
+      vTaskDelay(pdMS_TO_TICKS(1));
+    }
+  }
+
+  payloadOffset = 0;
+
+#if 0
+  ESP_LOGI(TAG, "chunk with size: %u, at time %ld.%ld", wire_chnk.size,
+           wire_chnk.timestamp.sec, wire_chnk.timestamp.usec);
+#endif
+
+  return skipChunk == false;
+}
+
+/**
+ *
+ */
+static int stream_chunk_data_cb(void *ctx, const uint8_t *data, size_t len) {
+  if (received_header == false) {
+    return 0;
+  }
+
+  switch (codec) {
+    case OPUS:
+    case FLAC: {
+      memcpy(&decoderChunk.inData[payloadOffset], data, len);
+      payloadOffset += len;
+      decoderChunk.outData = NULL;
+      decoderChunk.type = SNAPCAST_MESSAGE_WIRE_CHUNK;
+
+      break;
+    }
+
+    case PCM: {
+      size_t offset = 0;
+
+      if (pcmData == NULL) {
+        if (allocate_pcm_chunk_memory(&pcmData, wire_chnk.size) < 0) {
+          pcmData = NULL;
+        }
+
+        tmpData = 0;
+        payloadDataShift = 3;
+        payloadOffset = 0;
+      }
+
+      while (len--) {
+        tmpData |= ((uint32_t)data[offset++] << (8 * payloadDataShift));
+
+        payloadDataShift--;
+        if (payloadDataShift < 0) {
+          payloadDataShift = 3;
+
+          if ((pcmData) && (pcmData->fragment->payload)) {
+            volatile uint32_t *sample;
+            uint8_t dummy1;
+            uint32_t dummy2 = 0;
+
+            // TODO: find a more clever way to do this, best would be to
+            // actually store it the right way in the first place
+            dummy1 = tmpData >> 24;
+            dummy2 |= (uint32_t)dummy1 << 16;
+            dummy1 = tmpData >> 16;
+            dummy2 |= (uint32_t)dummy1 << 24;
+            dummy1 = tmpData >> 8;
+            dummy2 |= (uint32_t)dummy1 << 0;
+            dummy1 = tmpData >> 0;
+            dummy2 |= (uint32_t)dummy1 << 8;
+            tmpData = dummy2;
+
+            sample = (volatile uint32_t *)(&(
+                pcmData->fragment->payload[payloadOffset]));
+            *sample = (volatile uint32_t)tmpData;
+
+            payloadOffset += 4;
+          }
+
+          tmpData = 0;
+        }
+      }
+
+      break;
+    }
+
+    default: {
+      ESP_LOGE(TAG, "Decoder (1) not supported");
+
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * decode a complete wire chunk and pass it on to the player
+ */
+static int stream_chunk_end_cb(void *ctx, wire_chunk_message_t *chunk,
+                               bool skipped) {
+  if ((received_header == true) && (skipped == true)) {
+    skippedChunks++;
+    decoderChunk.bytes = 0;
+
+    // FLAC frames don't depend on each other, just drop what the decoder
+    // may have buffered
+    if ((codec == FLAC) && (flacDecoder != NULL)) {
+      FLAC__stream_decoder_flush(flacDecoder);
+    }
+
+    return 0;
+  }
+
+  if (received_header == false) {
+    return 0;
+  }
+
+  if (skippedChunks > 0) {
+    TRACE_EVENT(TRACE_EVT_LATE_CHUNKS_SKIPPED, skippedChunks);
+
+    // decoder state doesn't match this packet
+    if ((codec == OPUS) && (opusDecoder != NULL)) {
+      opus_decoder_ctl(opusDecoder, OPUS_RESET_STATE);
+    }
+
+    skippedChunks = 0;
+  }
+
+  switch (codec) {
+    case OPUS: {
+      int frame_size = -1;
+      int samples_per_frame;
+      opus_int16 *audio = NULL;
+
+      samples_per_frame =
+          opus_packet_get_samples_per_frame(decoderChunk.inData, scSet.sr);
+      if (samples_per_frame < 0) {
+        ESP_LOGE(TAG, "couldn't get samples per frame count of packet");
+      }
+
+      scSet.chkInFrames = samples_per_frame;
+
+      // ESP_LOGW(TAG, "%d, %llu, %llu", samples_per_frame,
+      //          1000000ULL * samples_per_frame / scSet.sr,
+      //          1000000ULL * wire_chnk.timestamp.sec +
+      //              wire_chnk.timestamp.usec);
+
+      // ESP_LOGW(TAG, "got OPUS decoded chunk size: %ld "
+      //          "frames from encoded chunk with size %d, allocated audio "
+      //          "buffer %d", scSet.chkInFrames, wire_chnk.size,
+      //          samples_per_frame);
+
+      METRICS_SPAN_BEGIN(decodeSpan);
+
+      size_t bytes;
+      do {
+        bytes = samples_per_frame * (scSet.ch * scSet.bits >> 3);
+
+        while ((audio = (opus_int16 *)audio_realloc_tag(
+                    AUDIO_MEM_TAG_DECODER, audio, bytes)) == NULL) {
+          ESP_LOGE(TAG, "couldn't realloc memory for OPUS audio %d", bytes);
+
+          vTaskDelay(pdMS_TO_TICKS(1));
+        }
+
+        frame_size = opus_decode(opusDecoder, decoderChunk.inData,
+                                 decoderChunk.bytes, (opus_int16 *)audio,
+                                 samples_per_frame, 0);
+
+        samples_per_frame <<= 1;
+      } while (frame_size < 0);
+
+      METRICS_SPAN_END(decodeSpan, METRICS_HIST_DECODE_OPUS);
+
+      audio_free_tag(AUDIO_MEM_TAG_DECODER, decoderChunk.inData);
+      decoderChunk.inData = NULL;
+
+      pcm_chunk_message_t *new_pcmChunk = NULL;
+
+      // ESP_LOGW(TAG, "OPUS decode: %d", frame_size);
+
+      if (allocate_pcm_chunk_memory(&new_pcmChunk, bytes) < 0) {
+        pcmData = NULL;
+      } else {
+        new_pcmChunk->timestamp = wire_chnk.timestamp;
+
+        if (new_pcmChunk->fragment->payload) {
+          pcm_convert_opus(new_pcmChunk->fragment->payload, audio, bytes);
+        }
+
+        audio_free_tag(AUDIO_MEM_TAG_DECODER, audio);
+        audio = NULL;
+
+#if CONFIG_USE_DSP_PROCESSOR
+        if (new_pcmChunk->fragment->payload) {
+          METRICS_SPAN_BEGIN(dspSpan);
+
+          dsp_processor_worker(new_pcmChunk->fragment->payload,
+                               new_pcmChunk->fragment->size, scSet.sr);
+
+          METRICS_SPAN_END(dspSpan, METRICS_HIST_DSP);
+        }
+#endif
+
+        insert_pcm_chunk(new_pcmChunk);
+      }
+
+      if (player_send_snapcast_setting(&scSet) != pdPASS) {
+        ESP_LOGE(TAG,
+                 "Failed to notify sync task about codec. Did you init "
+                 "player?");
+
+        return -1;
+      }
+
+      break;
+    }
+
+    case FLAC: {
+      isCachedChunk = true;
+      cachedBlocks = 0;
+
+      METRICS_SPAN_BEGIN(decodeSpan);
+
+      while (decoderChunk.bytes > 0) {
+        if (FLAC__stream_decoder_process_single(flacDecoder) == 0) {
+          ESP_LOGE(TAG, "%s: FLAC__stream_decoder_process_single failed",
+                   __func__);
+
+          // TODO: should insert some abort condition?
+          vTaskDelay(pdMS_TO_TICKS(10));
+        }
+      }
+
+      METRICS_SPAN_END(decodeSpan, METRICS_HIST_DECODE_FLAC);
+
+      // alternating chunk sizes need time stamp repair
+      if ((cachedBlocks > 0) && (scSet.sr != 0)) {
+        uint64_t diffUs = 1000000ULL * cachedBlocks / scSet.sr;
+
+        uint64_t timestamp = 1000000ULL * wire_chnk.timestamp.sec +
+                             wire_chnk.timestamp.usec;
+
+        timestamp = timestamp - diffUs;
+
+        wire_chnk.timestamp.sec = timestamp / 1000000ULL;
+        wire_chnk.timestamp.usec = timestamp % 1000000ULL;
+      }
+
+      pcm_chunk_message_t *new_pcmChunk;
+      int32_t ret = allocate_pcm_chunk_memory(&new_pcmChunk, pcmChunk.bytes);
+
+      scSet.chkInFrames = FLAC__stream_decoder_get_blocksize(flacDecoder);
+
+      // ESP_LOGE (TAG, "block size: %ld",
+      // scSet.chkInFrames * scSet.bits / 8 * scSet.ch);
+      // ESP_LOGI(TAG, "new_pcmChunk with size %ld",
+      // new_pcmChunk->totalSize);
+
+      if (ret == 0) {
+        pcm_convert_to_chunk(new_pcmChunk, pcmChunk.outData, pcmChunk.bytes,
+                             scSet.ch * (scSet.bits / 8));
+
+        new_pcmChunk->timestamp = wire_chnk.timestamp;
+
+#if CONFIG_USE_DSP_PROCESSOR
+        if (new_pcmChunk->fragment->payload) {
+          METRICS_SPAN_BEGIN(dspSpan);
+
+          dsp_processor_worker(new_pcmChunk->fragment->payload,
+                               new_pcmChunk->fragment->size, scSet.sr);
+
+          METRICS_SPAN_END(dspSpan, METRICS_HIST_DSP);
+        }
+
+#endif
+
+        insert_pcm_chunk(new_pcmChunk);
+      }
+
+      audio_free_tag(AUDIO_MEM_TAG_DECODER, pcmChunk.outData);
+      pcmChunk.outData = NULL;
+      pcmChunk.bytes = 0;
+
+      if (player_send_snapcast_setting(&scSet) != pdPASS) {
+        ESP_LOGE(TAG,
+                 "Failed to notify sync task about codec. Did you init "
+                 "player?");
+
+        return -1;
+      }
+
+      break;
+    }
+
+    case PCM: {
+      size_t decodedSize = wire_chnk.size;
+
+      if (pcmData) {
+        pcmData->timestamp = wire_chnk.timestamp;
+      }
+
+      scSet.chkInFrames =
+          decodedSize / ((size_t)scSet.ch * (size_t)(scSet.bits / 8));
+
+      // ESP_LOGW(TAG, "got PCM decoded chunk size: %ld frames",
+      //          scSet.chkInFrames);
+
+      if (player_send_snapcast_setting(&scSet) != pdPASS) {
+        ESP_LOGE(TAG,
+                 "Failed to notify sync task about codec. Did you init "
+                 "player?");
+
+        return -1;
+      }
+
+#if CONFIG_USE_DSP_PROCESSOR
+      if ((pcmData) && (pcmData->fragment->payload)) {
+        METRICS_SPAN_BEGIN(dspSpan);
+
+        dsp_processor_worker(pcmData->fragment->payload,
+                             pcmData->fragment->size, scSet.sr);
+
+        METRICS_SPAN_END(dspSpan, METRICS_HIST_DSP);
+      }
+#endif
+
+      if (pcmData) {
+        insert_pcm_chunk(pcmData);
+      }
+
+      pcmData = NULL;
+
+      audio_free_tag(AUDIO_MEM_TAG_DECODER, decoderChunk.inData);
+      decoderChunk.inData = NULL;
+
+      break;
+    }
+
+    default: {
+      ESP_LOGE(TAG, "Decoder (2) not supported");
+
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * set up the decoder for the stream
+ */
+static int stream_codec_header_cb(void *ctx, const char *codecString,
+                                  const char *codecPayload, uint32_t size) {
+  // ESP_LOGI (TAG, "got codec string: %s", codecString);
+
+  if (strcmp(codecString, "opus") == 0) {
+    codec = OPUS;
+  } else if (strcmp(codecString, "flac") == 0) {
+    codec = FLAC;
+  } else if (strcmp(codecString, "pcm") == 0) {
+    codec = PCM;
+  } else {
+    codec = NONE;
+
+    ESP_LOGI(TAG, "Codec : %s not supported", codecString);
+    ESP_LOGI(TAG,
+             "Change encoder codec to opus, flac or pcm in "
+             "/etc/snapserver.conf on server");
+
+    return -1;
+  }
+
+  // first ensure everything is set up correctly and resources are available
+  if (flacDecoder != NULL) {
+    FLAC__stream_decoder_finish(flacDecoder);
+    FLAC__stream_decoder_delete(flacDecoder);
+    flacDecoder = NULL;
+  }
+
+  if (opusDecoder != NULL) {
+    opus_decoder_destroy(opusDecoder);
+    opusDecoder = NULL;
+  }
+
+  if (codec == OPUS) {
+    uint16_t channels;
+    uint32_t rate;
+    uint16_t bits;
+
+    memcpy(&rate, codecPayload + 4, sizeof(rate));
+    memcpy(&bits, codecPayload + 8, sizeof(bits));
+    memcpy(&channels, codecPayload + 10, sizeof(channels));
+
+    scSet.codec = codec;
+    scSet.bits = bits;
+    scSet.ch = channels;
+    scSet.sr = rate;
+
+    ESP_LOGI(TAG, "Opus sample format: %ld:%d:%d\n", rate, bits, channels);
+
+    int error = 0;
+
+    opusDecoder = opus_decoder_create(scSet.sr, scSet.ch, &error);
+    if (error != 0) {
+      ESP_LOGI(TAG, "Failed to init opus coder");
+      return -1;
+    }
+
+    ESP_LOGI(TAG, "Initialized opus Decoder: %d", error);
+  } else if (codec == FLAC) {
+    decoderChunk.bytes = size;
+    decoderChunk.inData =
+        (uint8_t *)audio_malloc_tag(AUDIO_MEM_TAG_DECODER, decoderChunk.bytes);
+    memcpy(decoderChunk.inData, codecPayload, size);
+    decoderChunk.outData = NULL;
+    decoderChunk.type = SNAPCAST_MESSAGE_CODEC_HEADER;
+
+    flacDecoder = FLAC__stream_decoder_new();
+    if (flacDecoder == NULL) {
+      ESP_LOGE(TAG, "Failed to init flac decoder");
+      return -1;
+    }
+
+    FLAC__StreamDecoderInitStatus init_status =
+        FLAC__stream_decoder_init_stream(
+            flacDecoder, read_callback, NULL, NULL, NULL, NULL,
+            write_callback, metadata_callback, error_callback, &scSet);
+    if (init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+      ESP_LOGE(TAG, "ERROR: initializing decoder: %s\n",
+               FLAC__StreamDecoderInitStatusString[init_status]);
+
+      return -1;
+    }
+
+    FLAC__stream_decoder_process_until_end_of_metadata(flacDecoder);
+
+    // ESP_LOGI(TAG, "%s: processed codec header", __func__);
+  } else if (codec == PCM) {
+    uint16_t channels;
+    uint32_t rate;
+    uint16_t bits;
+
+    memcpy(&channels, codecPayload + 22, sizeof(channels));
+    memcpy(&rate, codecPayload + 24, sizeof(rate));
+    memcpy(&bits, codecPayload + 34, sizeof(bits));
+
+    scSet.codec = codec;
+    scSet.bits = bits;
+    scSet.ch = channels;
+    scSet.sr = rate;
+
+    ESP_LOGI(TAG, "pcm sampleformat: %ld:%d:%d", scSet.sr, scSet.bits,
+             scSet.ch);
+  }
+
+  if (player_send_snapcast_setting(&scSet) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to notify sync task. Did you init player?");
+
+    return -1;
+  }
+
+  // ESP_LOGI(TAG, "done codec header msg");
+
+  received_header = true;
+  time_sync_start();
+
+  return 0;
+}
+
+/**
+ *
+ */
+static int stream_server_settings_cb(void *ctx, const char *json) {
+  server_settings_message_t server_settings_message;
+  int result;
+
+  // ESP_LOGI(TAG, "got string: %s", json);
+
+  result = server_settings_message_deserialize(&server_settings_message, json);
+  if (result) {
+    ESP_LOGE(TAG, "Failed to read server settings: %d", result);
+  } else {
+    // log mute state, buffer, latency
+    ESP_LOGI(TAG, "Buffer length:  %ld", server_settings_message.buffer_ms);
+    ESP_LOGI(TAG, "Latency:        %ld", server_settings_message.latency);
+    ESP_LOGI(TAG, "Mute:           %d", server_settings_message.muted);
+    ESP_LOGI(TAG, "Setting volume: %ld", server_settings_message.volume);
+  }
+
+  // Volume setting using ADF HAL abstraction
+  if (scSet.muted != server_settings_message.muted) {
+#if SNAPCAST_USE_SOFT_VOL
+    if (server_settings_message.muted) {
+      dsp_processor_set_volome(0.0);
+    } else {
+      dsp_processor_set_volome((double)server_settings_message.volume / 100);
+    }
+#endif
+    audio_set_mute(server_settings_message.muted);
+  }
+
+  if (scSet.volume != server_settings_message.volume) {
+#if SNAPCAST_USE_SOFT_VOL
+    if (!server_settings_message.muted) {
+      dsp_processor_set_volome((double)server_settings_message.volume / 100);
+    }
+#else
+    audio_set_volume(server_settings_message.volume);
+#endif
+  }
+
+  scSet.cDacLat_ms = server_settings_message.latency;
+  scSet.buf_ms = server_settings_message.buffer_ms;
+  scSet.muted = server_settings_message.muted;
+  scSet.volume = server_settings_message.volume;
+
+  if (player_send_snapcast_setting(&scSet) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to notify sync task. Did you init player?");
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ *
+ */
+static int stream_time_cb(void *ctx, const base_message_t *base,
+                          const time_message_t *time) {
+  int64_t trx, tdif, ttx, rtt;
+  int64_t tmpDiffToServer;
+  int64_t diff;
+
+  trx = (int64_t)base->received.sec * 1000000LL +
+        (int64_t)base->received.usec;
+  ttx = (int64_t)base->sent.sec * 1000000LL + (int64_t)base->sent.usec;
+  tdif = trx - ttx;
+  trx = (int64_t)time->latency.sec * 1000000LL + (int64_t)time->latency.usec;
+  tmpDiffToServer = (trx - tdif) / 2;
+  // server and client offsets cancel out here
+  rtt = trx + tdif;
+
+  // clear diffBuffer if last update is older than a minute
+  diff = rxTime_us - lastTimeSync;
+  if (diff > 60000000LL) {
+    ESP_LOGW(TAG,
+             "Last time sync older than a minute. Clearing time buffer");
+
+    reset_latency_buffer_keep_offset();
+
+    time_sync_request_burst(TIME_SYNC_BURST_TIMEOUT);
+  }
+
+  // choose next sync period based on how well this reply fits our current
+  // estimate, replies delayed on the way aren't used
+  if (time_sync_rx(rtt, tmpDiffToServer,
+                   BASE_MESSAGE_SIZE + TIME_MESSAGE_SIZE) != 1) {
+    player_latency_insert(tmpDiffToServer, rtt);
+  }
+
+#if CONFIG_USE_WARM_START
+  warm_start_update(&remote_ip, remotePort, &scSet);
+#endif
+
+  // ESP_LOGI(TAG, "Current latency:%lld:", tmpDiffToServer);
+
+  // store current time
+  lastTimeSync = rxTime_us;
+
+  return 0;
 }
 
+static const snapcast_parser_cb_t streamCb = {
+    .base = stream_base_cb,
+    .chunkBegin = stream_chunk_begin_cb,
+    .chunkData = stream_chunk_data_cb,
+    .chunkEnd = stream_chunk_end_cb,
+    .codecHeader = stream_codec_header_cb,
+    .serverSettings = stream_server_settings_cb,
+    .time = stream_time_cb,
+};
+
+typedef struct nagle_call_s {
+  struct tcpip_api_call_data call;
+  struct netconn *conn;
+} nagle_call_t;
+
 /**
- *
+ * runs in tcpip thread, raw API calls on the netconn's pcb race with it
+ * otherwise. LOCK_TCPIP_CORE() would do nothing without
+ * CONFIG_LWIP_TCPIP_CORE_LOCKING.
  */
-void audio_set_volume(int volume) {
-  xSemaphoreTake(audioDACSemaphore, portMAX_DELAY);
-  if (volume != audioDAC_data.volume) {
-    audioDAC_data.volume = volume;
-    xQueueOverwrite(audioDACQHdl, &audioDAC_data);
+static err_t nagle_disable_cb(struct tcpip_api_call_data *call) {
+  nagle_call_t *nagle = (nagle_call_t *)call;
+
+  if (nagle->conn->pcb.tcp == NULL) {
+    return ERR_CONN;
   }
-  xSemaphoreGive(audioDACSemaphore);
+
+  tcp_nagle_disable(nagle->conn->pcb.tcp);
+
+  return ERR_OK;
 }
 
 /**
@@ -468,47 +1204,51 @@ static void http_get_task(void *pvParameters) {
   char *start;
   base_message_t base_message_rx;
   hello_message_t hello_message;
-  wire_chunk_message_t wire_chnk = {{0, 0}, 0, NULL};
   char *hello_message_serialized = NULL;
   int result;
-  int64_t now, trx, tdif, ttx;
-  time_message_t time_message_rx = {{0, 0}};
-  int64_t tmpDiffToServer;
-  int64_t lastTimeSync = 0;
+  int64_t now;
   esp_timer_handle_t timeSyncMessageTimer = NULL;
+#if SNAPCAST_SERVER_USE_MDNS
   esp_err_t err = 0;
-  server_settings_message_t server_settings_message;
-  bool received_header = false;
   mdns_result_t *r;
-  codec_type_t codec = NONE;
-  snapcastSetting_t scSet;
-  pcm_chunk_message_t *pcmData = NULL;
-  ip_addr_t remote_ip;
-  uint16_t remotePort = 0;
+#endif
+  ip_addr_t lastRemoteIp;
+  uint16_t lastRemotePort = 0;
   int rc1 = ERR_OK, rc2 = ERR_OK;
   struct netbuf *firstNetBuf = NULL;
   uint16_t len;
-  uint64_t timeout = FAST_SYNC_LATENCY_BUF;
-  char *codecString = NULL;
-  char *codecPayload = NULL;
-  char *serverSettingsString = NULL;
+  snapcast_parser_t parser;
+#if CONFIG_USE_WARM_START
+#if SNAPCAST_SERVER_USE_MDNS
+  bool warmStartServer = warmStartValid;
+  mdns_search_once_t *mdnsSearch = NULL;
+#endif
+
+  // server clock didn't change if it is the one we used before reboot, keep
+  // its skew then
+  if (warmStartValid == true) {
+    ip_addr_copy(lastRemoteIp, warmStart.serverIp);
+    lastRemotePort = warmStart.serverPort;
+  }
+#endif
 
   // create a timer to send time sync messages every x µs
   esp_timer_create(&tSyncArgs, &timeSyncMessageTimer);
+  time_sync_init(timeSyncMessageTimer);
 
 #if CONFIG_SNAPCLIENT_USE_MDNS
   ESP_LOGI(TAG, "Enable mdns");
   mdns_init();
 #endif
 
+  snapcast_parser_init(&parser, &streamCb, NULL);
+
   while (1) {
     // do some house keeping
     {
       received_header = false;
 
-      timeout = FAST_SYNC_LATENCY_BUF;
-
-      esp_timer_stop(timeSyncMessageTimer);
+      time_sync_stop();
 
       if (opusDecoder != NULL) {
         opus_decoder_destroy(opusDecoder);
@@ -522,64 +1262,82 @@ static void http_get_task(void *pvParameters) {
       }
 
       if (decoderChunk.inData) {
-        free(decoderChunk.inData);
+        audio_free_tag(AUDIO_MEM_TAG_DECODER, decoderChunk.inData);
         decoderChunk.inData = NULL;
       }
 
       if (decoderChunk.outData) {
-        free(decoderChunk.outData);
+        audio_free_tag(AUDIO_MEM_TAG_DECODER, decoderChunk.outData);
         decoderChunk.outData = NULL;
       }
 
-      if (codecString) {
-        free(codecString);
-        codecString = NULL;
-      }
-
-      if (codecPayload) {
-        free(codecPayload);
-        codecPayload = NULL;
-      }
-
-      if (codecPayload) {
-        free(serverSettingsString);
-        serverSettingsString = NULL;
-      }
+      snapcast_parser_free(&parser);
     }
 
 #if SNAPCAST_SERVER_USE_MDNS
-    // Find snapcast server
-    // Connect to first snapcast server found
-    r = NULL;
-    err = 0;
-    while (!r || err) {
-      ESP_LOGI(TAG, "Lookup snapcast service on network");
-      esp_err_t err = mdns_query_ptr("_snapcast", "_tcp", 3000, 20, &r);
-      if (err) {
-        ESP_LOGE(TAG, "Query Failed");
-        vTaskDelay(pdMS_TO_TICKS(1000));
-      }
+#if CONFIG_USE_WARM_START
+    if (warmStartServer == true) {
+      // contact the server we used before reboot right away, lookup runs in
+      // the background in case it isn't there anymore
+      warmStartServer = false;
+
+      mdnsSearch =
+          mdns_query_async_new(NULL, "_snapcast", "_tcp", MDNS_TYPE_PTR,
+                               SNAPCAST_MDNS_TIMEOUT_MS, 20, NULL);
+
+      ip_addr_copy(remote_ip, warmStart.serverIp);
+      remotePort = warmStart.serverPort;
+
+      ESP_LOGI(TAG, "try connecting to cached server %s:%d",
+               ipaddr_ntoa(&remote_ip), remotePort);
+    } else
+#endif
+    {
+      // Find snapcast server
+      // Connect to first snapcast server found
+      r = NULL;
+      err = 0;
+      while (!r || err) {
+        ESP_LOGI(TAG, "Lookup snapcast service on network");
+        esp_err_t err = ESP_OK;
+#if CONFIG_USE_WARM_START
+        if (mdnsSearch != NULL) {
+          mdns_query_async_get_results(mdnsSearch, SNAPCAST_MDNS_TIMEOUT_MS,
+                                       &r, NULL);
+          mdns_query_async_delete(mdnsSearch);
+          mdnsSearch = NULL;
+        } else
+#endif
+        {
+          err = mdns_query_ptr("_snapcast", "_tcp", SNAPCAST_MDNS_TIMEOUT_MS,
+                               20, &r);
+        }
+        if (err) {
+          ESP_LOGE(TAG, "Query Failed");
+          vTaskDelay(pdMS_TO_TICKS(1000));
+        }
 
-      if (!r) {
-        ESP_LOGW(TAG, "No results found!");
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        if (!r) {
+          ESP_LOGW(TAG, "No results found!");
+          vTaskDelay(pdMS_TO_TICKS(1000));
+        }
       }
-    }
 
-    mdns_ip_addr_t *a = r->addr;
-    if (a) {
-      ip_addr_copy(remote_ip, (a->addr));
-      remote_ip.type = a->addr.type;
-      remotePort = r->port;
-      ESP_LOGI(TAG, "Found %s:%d", ipaddr_ntoa(&remote_ip), remotePort);
+      mdns_ip_addr_t *a = r->addr;
+      if (a) {
+        ip_addr_copy(remote_ip, (a->addr));
+        remote_ip.type = a->addr.type;
+        remotePort = r->port;
+        ESP_LOGI(TAG, "Found %s:%d", ipaddr_ntoa(&remote_ip), remotePort);
 
-      mdns_query_results_free(r);
-    } else {
-      mdns_query_results_free(r);
+        mdns_query_results_free(r);
+      } else {
+        mdns_query_results_free(r);
 
-      ESP_LOGW(TAG, "No IP found in MDNS query");
+        ESP_LOGW(TAG, "No IP found in MDNS query");
 
-      continue;
+        continue;
+      }
     }
 #else
     // configure a failsafe snapserver according to CONFIG values
@@ -602,7 +1360,10 @@ static void http_get_task(void *pvParameters) {
       lwipNetconn = NULL;
     }
 
-    lwipNetconn = netconn_new(NETCONN_TCP);
+    time_sync_rx_timestamp_reset();
+    capture_start();
+
+    lwipNetconn = netconn_new_with_callback(NETCONN_TCP, netconn_rx_callback);
     if (lwipNetconn == NULL) {
       ESP_LOGE(TAG, "can't create netconn");
 
@@ -630,12 +1391,43 @@ static void http_get_task(void *pvParameters) {
 
     ESP_LOGI(TAG, "netconn connected");
 
-    if (reset_latency_buffer() < 0) {
+#if CONFIG_USE_WARM_START
+#if SNAPCAST_SERVER_USE_MDNS
+    if (mdnsSearch != NULL) {
+      mdns_query_async_delete(mdnsSearch);
+      mdnsSearch = NULL;
+    }
+#endif
+
+    warmStartChecked_us = 0;
+#endif
+
+    // don't let nagle delay our small time sync messages
+    nagle_call_t nagle = {.conn = lwipNetconn};
+    if (tcpip_api_call(nagle_disable_cb, &nagle.call) != ERR_OK) {
+      ESP_LOGW(TAG, "couldn't disable nagle");
+    }
+
+    // server clock didn't change if we reconnect to the same server, so
+    // keep using what we know until we got new time sync samples
+    if ((lastRemotePort == remotePort) &&
+        ip_addr_cmp(&lastRemoteIp, &remote_ip)) {
+      rc1 = reset_latency_buffer_keep_offset();
+    } else {
+      rc1 = reset_latency_buffer();
+    }
+
+    if (rc1 < 0) {
       ESP_LOGE(TAG,
                "reset_diff_buffer: couldn't reset median filter long. STOP");
       return;
     }
 
+    ip_addr_copy(lastRemoteIp, remote_ip);
+    lastRemotePort = remotePort;
+
+    time_sync_request_burst(TIME_SYNC_BURST_CONNECT);
+
     char mac_address[18];
     uint8_t base_mac[6];
     // Get MAC address for WiFi station
@@ -672,12 +1464,16 @@ static void http_get_task(void *pvParameters) {
     hello_message.protocol_version = 2;
 
     if (hello_message_serialized == NULL) {
-      hello_message_serialized = hello_message_serialize(
-          &hello_message, (size_t *)&(base_message_rx.size));
+      // size_t isn't 32 bit everywhere, e.g. in the host build
+      size_t helloSize;
+
+      hello_message_serialized =
+          hello_message_serialize(&hello_message, &helloSize);
       if (!hello_message_serialized) {
         ESP_LOGE(TAG, "Failed to serialize hello message");
         return;
       }
+      base_message_rx.size = helloSize;
     }
 
     result = base_message_serialize(&base_message_rx, base_message_serialized,
@@ -704,7 +1500,7 @@ static void http_get_task(void *pvParameters) {
 
     ESP_LOGI(TAG, "netconn sent hello message");
 
-    free(hello_message_serialized);
+    audio_free_tag(AUDIO_MEM_TAG_NET, hello_message_serialized);
     hello_message_serialized = NULL;
 
     // init default setting
@@ -717,25 +1513,24 @@ static void http_get_task(void *pvParameters) {
     scSet.volume = 0;
     scSet.muted = true;
 
-    uint64_t startTime, endTime;
-    //    size_t currentPos = 0;
-    size_t typedMsgCurrentPos = 0;
-    uint32_t typedMsgLen = 0;
-    uint32_t offset = 0;
-    uint32_t payloadOffset = 0;
-    uint32_t tmpData = 0;
-    int32_t payloadDataShift = 0;
-
-#define BASE_MESSAGE_STATE 0
-#define TYPED_MESSAGE_STATE 1
+#if CONFIG_USE_WARM_START
+    if (warmStartValid == true) {
+      // player was set up with this already, so it won't be reconfigured if
+      // the stream didn't change
+      warm_start_get_setting(&warmStart, &scSet);
+    }
+#endif
 
-    // 0 ... base message, 1 ... typed message
-    uint32_t state = BASE_MESSAGE_STATE;
-    uint32_t internalState = 0;
+    // stream positions start over with the connection
+    snapcast_parser_init(&parser, &streamCb, NULL);
 
     firstNetBuf = NULL;
 
     while (1) {
+      // don't read more than the chunk queue can take, let TCP window do
+      // the throttling
+      pcm_chunk_queue_wait_space(pdMS_TO_TICKS(PCM_QUEUE_THROTTLE_MAX_MS));
+
       rc2 = netconn_recv(lwipNetconn, &firstNetBuf);
       if (rc2 != ERR_OK) {
         if (rc2 == ERR_CONN) {
@@ -753,6 +1548,11 @@ static void http_get_task(void *pvParameters) {
         continue;
       }
 
+      METRICS_COUNT(METRICS_NET_RX_PACKETS, 1);
+      METRICS_COUNT(METRICS_NET_RX_BYTES, netbuf_len(firstNetBuf));
+
+      METRICS_SPAN_BEGIN(rxSpan);
+
       // now parse the data
       netbuf_first(firstNetBuf);
       do {
@@ -760,6 +1560,8 @@ static void http_get_task(void *pvParameters) {
 
         rc1 = netbuf_data(firstNetBuf, (void **)&start, &len);
         if (rc1 == ERR_OK) {
+          capture_write(parser.pos, start, len);
+
           // ESP_LOGI (TAG, "netconn rx,"
           // "data len: %d, %d", len, netbuf_len(firstNetBuf) -
           // currentPos);
@@ -769,1679 +1571,101 @@ static void http_get_task(void *pvParameters) {
           continue;
         }
 
-        while (len > 0) {
-          rc1 = ERR_OK;  // probably not necessary
-
-          switch (state) {
-            // decode base message
-            case BASE_MESSAGE_STATE: {
-              switch (internalState) {
-                case 0:
-                  base_message_rx.type = *start & 0xFF;
-                  internalState++;
-                  break;
-
-                case 1:
-                  base_message_rx.type |= (*start & 0xFF) << 8;
-                  internalState++;
-                  break;
-
-                case 2:
-                  base_message_rx.id = *start & 0xFF;
-                  internalState++;
-                  break;
-
-                case 3:
-                  base_message_rx.id |= (*start & 0xFF) << 8;
-                  internalState++;
-                  break;
-
-                case 4:
-                  base_message_rx.refersTo = *start & 0xFF;
-                  internalState++;
-                  break;
-
-                case 5:
-                  base_message_rx.refersTo |= (*start & 0xFF) << 8;
-                  internalState++;
-                  break;
-
-                case 6:
-                  base_message_rx.sent.sec = *start & 0xFF;
-                  internalState++;
-                  break;
-
-                case 7:
-                  base_message_rx.sent.sec |= (*start & 0xFF) << 8;
-                  internalState++;
-                  break;
-
-                case 8:
-                  base_message_rx.sent.sec |= (*start & 0xFF) << 16;
-                  internalState++;
-                  break;
-
-                case 9:
-                  base_message_rx.sent.sec |= (*start & 0xFF) << 24;
-                  internalState++;
-                  break;
-
-                case 10:
-                  base_message_rx.sent.usec = *start & 0xFF;
-                  internalState++;
-                  break;
-
-                case 11:
-                  base_message_rx.sent.usec |= (*start & 0xFF) << 8;
-                  internalState++;
-                  break;
-
-                case 12:
-                  base_message_rx.sent.usec |= (*start & 0xFF) << 16;
-                  internalState++;
-                  break;
-
-                case 13:
-                  base_message_rx.sent.usec |= (*start & 0xFF) << 24;
-                  internalState++;
-                  break;
-
-                case 14:
-                  base_message_rx.received.sec = *start & 0xFF;
-                  internalState++;
-                  break;
-
-                case 15:
-                  base_message_rx.received.sec |= (*start & 0xFF) << 8;
-                  internalState++;
-                  break;
-
-                case 16:
-                  base_message_rx.received.sec |= (*start & 0xFF) << 16;
-                  internalState++;
-                  break;
-
-                case 17:
-                  base_message_rx.received.sec |= (*start & 0xFF) << 24;
-                  internalState++;
-                  break;
-
-                case 18:
-                  base_message_rx.received.usec = *start & 0xFF;
-                  internalState++;
-                  break;
-
-                case 19:
-                  base_message_rx.received.usec |= (*start & 0xFF) << 8;
-                  internalState++;
-                  break;
-
-                case 20:
-                  base_message_rx.received.usec |= (*start & 0xFF) << 16;
-                  internalState++;
-                  break;
-
-                case 21:
-                  base_message_rx.received.usec |= (*start & 0xFF) << 24;
-                  internalState++;
-                  break;
-
-                case 22:
-                  base_message_rx.size = *start & 0xFF;
-                  internalState++;
-                  break;
-
-                case 23:
-                  base_message_rx.size |= (*start & 0xFF) << 8;
-                  internalState++;
-                  break;
-
-                case 24:
-                  base_message_rx.size |= (*start & 0xFF) << 16;
-                  internalState++;
-                  break;
-
-                case 25:
-                  base_message_rx.size |= (*start & 0xFF) << 24;
-                  internalState = 0;
-
-                  now = esp_timer_get_time();
-
-                  base_message_rx.received.sec = now / 1000000;
-                  base_message_rx.received.usec =
-                      now - base_message_rx.received.sec * 1000000;
-
-                  typedMsgCurrentPos = 0;
-
-                  //                   ESP_LOGI(TAG,"BM type %d ts %d.%d",
-                  //                   base_message_rx.type,
-                  //                   base_message_rx.received.sec,
-                  //                   base_message_rx.received.usec);
-                  // ESP_LOGI(TAG,"%d, %d.%d", base_message_rx.type,
-                  //                   base_message_rx.received.sec,
-                  //                   base_message_rx.received.usec);
-                  // ESP_LOGI(TAG,"%d, %llu", base_message_rx.type,
-                  //		   1000000ULL * base_message_rx.received.sec +
-                  // base_message_rx.received.usec);
-
-                  state = TYPED_MESSAGE_STATE;
-                  break;
-              }
-
-              // currentPos++;++;
-              len--;
-              start++;
-
-              break;
-            }
-
-            // decode typed message
-            case TYPED_MESSAGE_STATE: {
-              switch (base_message_rx.type) {
-                case SNAPCAST_MESSAGE_WIRE_CHUNK: {
-                  switch (internalState) {
-                    case 0: {
-                      wire_chnk.timestamp.sec = *start & 0xFF;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 1: {
-                      wire_chnk.timestamp.sec |= (*start & 0xFF) << 8;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 2: {
-                      wire_chnk.timestamp.sec |= (*start & 0xFF) << 16;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 3: {
-                      wire_chnk.timestamp.sec |= (*start & 0xFF) << 24;
-
-                      // ESP_LOGI(TAG,
-                      // "wire chunk time sec: %d",
-                      // wire_chnk.timestamp.sec);
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 4: {
-                      wire_chnk.timestamp.usec = (*start & 0xFF);
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 5: {
-                      wire_chnk.timestamp.usec |= (*start & 0xFF) << 8;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 6: {
-                      wire_chnk.timestamp.usec |= (*start & 0xFF) << 16;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 7: {
-                      wire_chnk.timestamp.usec |= (*start & 0xFF) << 24;
-
-                      // ESP_LOGI(TAG,
-                      // "wire chunk time usec: %d",
-                      // wire_chnk.timestamp.usec);
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 8: {
-                      wire_chnk.size = (*start & 0xFF);
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 9: {
-                      wire_chnk.size |= (*start & 0xFF) << 8;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 10: {
-                      wire_chnk.size |= (*start & 0xFF) << 16;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 11: {
-                      wire_chnk.size |= (*start & 0xFF) << 24;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      // TODO: we could use wire chunk directly maybe?
-                      decoderChunk.bytes = wire_chnk.size;
-                      while (!decoderChunk.inData) {
-                        decoderChunk.inData =
-                            (uint8_t *)malloc(decoderChunk.bytes);
-                        if (!decoderChunk.inData) {
-                          ESP_LOGW(TAG,
-                                   "malloc decoderChunk.inData failed, wait "
-                                   "1ms and try again");
-
-                          vTaskDelay(pdMS_TO_TICKS(1));
-                        }
-                      }
-
-                      payloadOffset = 0;
-
-#if 0
-                       ESP_LOGI(TAG, "chunk with size: %u, at time %ld.%ld",
-                    		   	   	   	   	 wire_chnk.size,
-                                             wire_chnk.timestamp.sec,
-                                             wire_chnk.timestamp.usec);
-#endif
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 12: {
-                      size_t tmp_size;
-
-                      if ((base_message_rx.size - typedMsgCurrentPos) <= len) {
-                        tmp_size = base_message_rx.size - typedMsgCurrentPos;
-                      } else {
-                        tmp_size = len;
-                      }
-
-                      if (received_header == true) {
-                        switch (codec) {
-                          case OPUS:
-                          case FLAC: {
-                            memcpy(&decoderChunk.inData[payloadOffset], start,
-                                   tmp_size);
-                            payloadOffset += tmp_size;
-                            decoderChunk.outData = NULL;
-                            decoderChunk.type = SNAPCAST_MESSAGE_WIRE_CHUNK;
-
-                            break;
-                          }
-
-                          case PCM: {
-                            size_t _tmp = tmp_size;
-
-                            offset = 0;
-
-                            if (pcmData == NULL) {
-                              if (allocate_pcm_chunk_memory(
-                                      &pcmData, wire_chnk.size) < 0) {
-                                pcmData = NULL;
-                              }
-
-                              tmpData = 0;
-                              payloadDataShift = 3;
-                              payloadOffset = 0;
-                            }
-
-                            while (_tmp--) {
-                              tmpData |= ((uint32_t)start[offset++]
-                                          << (8 * payloadDataShift));
-
-                              payloadDataShift--;
-                              if (payloadDataShift < 0) {
-                                payloadDataShift = 3;
-
-                                if ((pcmData) && (pcmData->fragment->payload)) {
-                                  volatile uint32_t *sample;
-                                  uint8_t dummy1;
-                                  uint32_t dummy2 = 0;
-
-                                  // TODO: find a more
-                                  // clever way to do this,
-                                  // best would be to
-                                  // actually store it the
-                                  // right way in the first
-                                  // place
-                                  dummy1 = tmpData >> 24;
-                                  dummy2 |= (uint32_t)dummy1 << 16;
-                                  dummy1 = tmpData >> 16;
-                                  dummy2 |= (uint32_t)dummy1 << 24;
-                                  dummy1 = tmpData >> 8;
-                                  dummy2 |= (uint32_t)dummy1 << 0;
-                                  dummy1 = tmpData >> 0;
-                                  dummy2 |= (uint32_t)dummy1 << 8;
-                                  tmpData = dummy2;
-
-                                  sample = (volatile uint32_t *)(&(
-                                      pcmData->fragment
-                                          ->payload[payloadOffset]));
-                                  *sample = (volatile uint32_t)tmpData;
-
-                                  payloadOffset += 4;
-                                }
-
-                                tmpData = 0;
-                              }
-                            }
-
-                            break;
-                          }
-
-                          default: {
-                            ESP_LOGE(TAG, "Decoder (1) not supported");
-
-                            return;
-
-                            break;
-                          }
-                        }
-                      }
-
-                      typedMsgCurrentPos += tmp_size;
-                      start += tmp_size;
-                      // currentPos += tmp_size;
-                      len -= tmp_size;
-
-                      if (typedMsgCurrentPos >= base_message_rx.size) {
-                        if (received_header == true) {
-                          switch (codec) {
-                            case OPUS: {
-                              int frame_size = -1;
-                              int samples_per_frame;
-                              opus_int16 *audio = NULL;
-
-                              samples_per_frame =
-                                  opus_packet_get_samples_per_frame(
-                                      decoderChunk.inData, scSet.sr);
-                              if (samples_per_frame < 0) {
-                                ESP_LOGE(TAG,
-                                         "couldn't get samples per frame count "
-                                         "of packet");
-                              }
-
-                              scSet.chkInFrames = samples_per_frame;
-
-                              // ESP_LOGW(TAG, "%d, %llu, %llu",
-                              // samples_per_frame, 1000000ULL *
-                              // samples_per_frame / scSet.sr,
-                              // 1000000ULL *
-                              // wire_chnk.timestamp.sec +
-                              // wire_chnk.timestamp.usec);
-
-                              // ESP_LOGW(TAG, "got OPUS decoded chunk size: %ld
-                              // " "frames from encoded chunk with size %d,
-                              // allocated audio buffer %d", scSet.chkInFrames,
-                              // wire_chnk.size, samples_per_frame);
-
-                              size_t bytes;
-                              do {
-                                bytes = samples_per_frame *
-                                        (scSet.ch * scSet.bits >> 3);
-
-                                while ((audio = (opus_int16 *)realloc(
-                                            audio, bytes)) == NULL) {
-                                  ESP_LOGE(TAG,
-                                           "couldn't realloc memory for OPUS "
-                                           "audio %d",
-                                           bytes);
-
-                                  vTaskDelay(pdMS_TO_TICKS(1));
-                                }
-
-                                frame_size = opus_decode(
-                                    opusDecoder, decoderChunk.inData,
-                                    decoderChunk.bytes, (opus_int16 *)audio,
-                                    samples_per_frame, 0);
-
-                                samples_per_frame <<= 1;
-                              } while (frame_size < 0);
-
-                              free(decoderChunk.inData);
-                              decoderChunk.inData = NULL;
-
-                              pcm_chunk_message_t *new_pcmChunk = NULL;
-
-                              // ESP_LOGW(TAG, "OPUS decode: %d", frame_size);
-
-                              if (allocate_pcm_chunk_memory(&new_pcmChunk,
-                                                            bytes) < 0) {
-                                pcmData = NULL;
-                              } else {
-                                new_pcmChunk->timestamp = wire_chnk.timestamp;
-
-                                if (new_pcmChunk->fragment->payload) {
-                                  volatile uint32_t *sample;
-                                  uint32_t tmpData;
-                                  uint32_t cnt = 0;
-
-                                  for (int i = 0; i < bytes; i += 4) {
-                                    sample = (volatile uint32_t *)(&(
-                                        new_pcmChunk->fragment->payload[i]));
-                                    tmpData = (((uint32_t)audio[cnt] << 16) &
-                                               0xFFFF0000) |
-                                              (((uint32_t)audio[cnt + 1] << 0) &
-                                               0x0000FFFF);
-                                    *sample = (volatile uint32_t)tmpData;
-
-                                    cnt += 2;
-                                  }
-                                }
-
-                                free(audio);
-                                audio = NULL;
-
-#if CONFIG_USE_DSP_PROCESSOR
-                                if (new_pcmChunk->fragment->payload) {
-                                  dsp_processor_worker(
-                                      new_pcmChunk->fragment->payload,
-                                      new_pcmChunk->fragment->size, scSet.sr);
-                                }
-#endif
-
-                                insert_pcm_chunk(new_pcmChunk);
-                              }
-
-                              if (player_send_snapcast_setting(&scSet) !=
-                                  pdPASS) {
-                                ESP_LOGE(TAG,
-                                         "Failed to notify "
-                                         "sync task about "
-                                         "codec. Did you "
-                                         "init player?");
-
-                                return;
-                              }
-
-                              break;
-                            }
-
-                            case FLAC: {
-                              isCachedChunk = true;
-                              cachedBlocks = 0;
-
-                              while (decoderChunk.bytes > 0) {
-                                if (FLAC__stream_decoder_process_single(
-                                        flacDecoder) == 0) {
-                                  ESP_LOGE(
-                                      TAG,
-                                      "%s: FLAC__stream_decoder_process_single "
-                                      "failed",
-                                      __func__);
-
-                                  // TODO: should insert some abort condition?
-                                  vTaskDelay(pdMS_TO_TICKS(10));
-                                }
-                              }
-
-                              // alternating chunk sizes need time stamp repair
-                              if ((cachedBlocks > 0) && (scSet.sr != 0)) {
-                                uint64_t diffUs =
-                                    1000000ULL * cachedBlocks / scSet.sr;
-
-                                uint64_t timestamp =
-                                    1000000ULL * wire_chnk.timestamp.sec +
-                                    wire_chnk.timestamp.usec;
-
-                                timestamp = timestamp - diffUs;
-
-                                wire_chnk.timestamp.sec =
-                                    timestamp / 1000000ULL;
-                                wire_chnk.timestamp.usec =
-                                    timestamp % 1000000ULL;
-                              }
-
-                              pcm_chunk_message_t *new_pcmChunk;
-                              int32_t ret = allocate_pcm_chunk_memory(
-                                  &new_pcmChunk, pcmChunk.bytes);
-
-                              scSet.chkInFrames =
-                                  FLAC__stream_decoder_get_blocksize(
-                                      flacDecoder);
-
-                              // ESP_LOGE (TAG, "block size: %ld",
-                              // scSet.chkInFrames * scSet.bits / 8 * scSet.ch);
-                              // ESP_LOGI(TAG, "new_pcmChunk with size %ld",
-                              // new_pcmChunk->totalSize);
-
-                              if (ret == 0) {
-                                pcm_chunk_fragment_t *fragment =
-                                    new_pcmChunk->fragment;
-                                uint32_t fragmentCnt = 0;
-
-                                if (fragment->payload != NULL) {
-                                  uint32_t frames =
-                                      pcmChunk.bytes /
-                                      (scSet.ch * (scSet.bits / 8));
-
-                                  for (int i = 0; i < frames; i++) {
-                                    // TODO: for now fragmented payload is not
-                                    // supported and the whole chunk is expected
-                                    // to be in the first fragment
-                                    uint32_t tmpData;
-                                    memcpy(&tmpData,
-                                           &pcmChunk.outData[fragmentCnt],
-                                           (scSet.ch * (scSet.bits / 8)));
-
-                                    if (fragment != NULL) {
-                                      volatile uint32_t *test =
-                                          (volatile uint32_t *)(&(
-                                              fragment->payload[fragmentCnt]));
-                                      *test = (volatile uint32_t)tmpData;
-                                    }
-
-                                    fragmentCnt +=
-                                        (scSet.ch * (scSet.bits / 8));
-                                    if (fragmentCnt >= fragment->size) {
-                                      fragmentCnt = 0;
-
-                                      fragment = fragment->nextFragment;
-                                    }
-                                  }
-                                }
-
-                                new_pcmChunk->timestamp = wire_chnk.timestamp;
+        if (snapcast_parser_feed(&parser, (const uint8_t *)start, len) < 0) {
+          return;
+        }
+      } while (netbuf_next(firstNetBuf) >= 0);
 
-#if CONFIG_USE_DSP_PROCESSOR
-                                if (new_pcmChunk->fragment->payload) {
-                                  dsp_processor_worker(
-                                      new_pcmChunk->fragment->payload,
-                                      new_pcmChunk->fragment->size, scSet.sr);
-                                }
+      METRICS_SPAN_END(rxSpan, METRICS_HIST_RX_PROCESS);
 
-#endif
+      netbuf_delete(firstNetBuf);
 
-                                insert_pcm_chunk(new_pcmChunk);
-                              }
+      if (rc1 != ERR_OK) {
+        ESP_LOGE(TAG, "Data error, closing netconn");
 
-                              free(pcmChunk.outData);
-                              pcmChunk.outData = NULL;
-                              pcmChunk.bytes = 0;
+        netconn_close(lwipNetconn);
 
-                              if (player_send_snapcast_setting(&scSet) !=
-                                  pdPASS) {
-                                ESP_LOGE(TAG,
-                                         "Failed to "
-                                         "notify "
-                                         "sync task "
-                                         "about "
-                                         "codec. Did you "
-                                         "init player?");
+        break;
+      }
+    }
+  }
+}
 
-                                return;
-                              }
+#if CONFIG_NVS_STRESS_TEST
+/**
+ * Write a changing blob to NVS periodically, each write disables flash cache
+ * for a while. Underruns reported by the player have to stay constant, the
+ * test aborts on the first one or on a failed write.
+ */
+static void nvs_stress_task(void *pvParameters) {
+  uint8_t *blob = (uint8_t *)malloc(NVS_STRESS_BLOB_SIZE);
+  uint32_t cnt = 0;
+  int64_t max_us = 0, dt = 0;
+  player_resync_stats_t stats;
+  uint32_t underrunCnt, hardCnt;
+  nvs_handle_t handle;
 
-                              break;
-                            }
+  if (blob == NULL) {
+    ESP_LOGE(TAG, "%s: couldn't get memory", __func__);
 
-                            case PCM: {
-                              size_t decodedSize = wire_chnk.size;
+    vTaskDelete(NULL);
 
-                              // ESP_LOGW(TAG, "got PCM chunk,"
-                              //               "typedMsgCurrentPos %d",
-                              //               typedMsgCurrentPos);
+    return;
+  }
 
-                              if (pcmData) {
-                                pcmData->timestamp = wire_chnk.timestamp;
-                              }
+  player_get_resync_stats(&stats);
+  underrunCnt = stats.underrunCnt;
+  hardCnt = stats.hardCnt;
 
-                              scSet.chkInFrames =
-                                  decodedSize /
-                                  ((size_t)scSet.ch * (size_t)(scSet.bits / 8));
+  while (1) {
+    vTaskDelay(pdMS_TO_TICKS(NVS_STRESS_INTERVAL_MS));
+
+    // DMA played out what the last write may have held up by now. Output
+    // stops and starts with a hard resync, e.g. if the stream stops, the
+    // underruns that come with it aren't ours.
+    player_get_resync_stats(&stats);
+    if (stats.hardCnt != hardCnt) {
+      hardCnt = stats.hardCnt;
+    } else if (stats.underrunCnt != underrunCnt) {
+      ESP_LOGE(TAG, "NVS stress: %ld underruns after write %ld of %lldus",
+               stats.underrunCnt - underrunCnt, cnt, dt);
+
+      esp_system_abort("NVS stress: flash write caused I2S underruns");
+    }
+    underrunCnt = stats.underrunCnt;
 
-                              // ESP_LOGW(TAG,
-                              //          "got PCM decoded chunk size: %ld
-                              //          frames", scSet.chkInFrames);
+    memset(blob, cnt, NVS_STRESS_BLOB_SIZE);
 
-                              if (player_send_snapcast_setting(&scSet) !=
-                                  pdPASS) {
-                                ESP_LOGE(TAG,
-                                         "Failed to notify "
-                                         "sync task about "
-                                         "codec. Did you "
-                                         "init player?");
+    int64_t start_us = esp_timer_get_time();
+    ESP_ERROR_CHECK(nvs_open("nvsstress", NVS_READWRITE, &handle));
+    ESP_ERROR_CHECK(nvs_set_blob(handle, "blob", blob, NVS_STRESS_BLOB_SIZE));
+    ESP_ERROR_CHECK(nvs_commit(handle));
+    nvs_close(handle);
+    dt = esp_timer_get_time() - start_us;
 
-                                return;
-                              }
+    cnt++;
+    if (dt > max_us) {
+      max_us = dt;
+    }
 
-#if CONFIG_USE_DSP_PROCESSOR
-                              if ((pcmData) && (pcmData->fragment->payload)) {
-                                dsp_processor_worker(pcmData->fragment->payload,
-                                                     pcmData->fragment->size,
-                                                     scSet.sr);
-                              }
+    if ((cnt % NVS_STRESS_REPORT_CNT) == 0) {
+      ESP_LOGI(TAG, "NVS stress: %ld writes, max %lldus, no underruns", cnt,
+               max_us);
+    }
+  }
+}
 #endif
 
-                              if (pcmData) {
-                                insert_pcm_chunk(pcmData);
-                              }
-
-                              pcmData = NULL;
-
-                              free(decoderChunk.inData);
-                              decoderChunk.inData = NULL;
-
-                              break;
-                            }
-
-                            default: {
-                              ESP_LOGE(TAG,
-                                       "Decoder (2) not "
-                                       "supported");
-
-                              return;
-
-                              break;
-                            }
-                          }
-                        }
-
-                        state = BASE_MESSAGE_STATE;
-                        internalState = 0;
-
-                        typedMsgCurrentPos = 0;
-                      }
-
-                      break;
-                    }
-
-                    default: {
-                      ESP_LOGE(TAG,
-                               "wire chunk decoder "
-                               "shouldn't get here");
-
-                      break;
-                    }
-                  }
-
-                  break;
-                }
-
-                case SNAPCAST_MESSAGE_CODEC_HEADER: {
-                  switch (internalState) {
-                    case 0: {
-                      typedMsgLen = *start & 0xFF;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 1: {
-                      typedMsgLen |= (*start & 0xFF) << 8;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 2: {
-                      typedMsgLen |= (*start & 0xFF) << 16;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 3: {
-                      typedMsgLen |= (*start & 0xFF) << 24;
-
-                      codecString =
-                          malloc(typedMsgLen + 1);  // allocate memory for
-                                                    // codec string
-                      if (codecString == NULL) {
-                        ESP_LOGE(TAG,
-                                 "couldn't get memory "
-                                 "for codec string");
-
-                        return;
-                      }
-
-                      offset = 0;
-                      // ESP_LOGI(TAG,
-                      // "codec header string is %d long",
-                      // typedMsgLen);
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 4: {
-                      if (len >= typedMsgLen) {
-                        memcpy(&codecString[offset], start, typedMsgLen);
-
-                        offset += typedMsgLen;
-
-                        typedMsgCurrentPos += typedMsgLen;
-                        start += typedMsgLen;
-                        // currentPos += typedMsgLen;
-                        len -= typedMsgLen;
-                      } else {
-                        memcpy(&codecString[offset], start, typedMsgLen);
-
-                        offset += len;
-
-                        typedMsgCurrentPos += len;
-                        start += len;
-                        // currentPos += len;
-                        len -= len;
-                      }
-
-                      if (offset == typedMsgLen) {
-                        // NULL terminate string
-                        codecString[typedMsgLen] = 0;
-
-                        // ESP_LOGI (TAG, "got codec string: %s", tmp);
-
-                        if (strcmp(codecString, "opus") == 0) {
-                          codec = OPUS;
-                        } else if (strcmp(codecString, "flac") == 0) {
-                          codec = FLAC;
-                        } else if (strcmp(codecString, "pcm") == 0) {
-                          codec = PCM;
-                        } else {
-                          codec = NONE;
-
-                          ESP_LOGI(TAG, "Codec : %s not supported",
-                                   codecString);
-                          ESP_LOGI(TAG,
-                                   "Change encoder codec to "
-                                   "opus, flac or pcm in "
-                                   "/etc/snapserver.conf on "
-                                   "server");
-
-                          return;
-                        }
-
-                        free(codecString);
-                        codecString = NULL;
-
-                        internalState++;
-                      }
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 5: {
-                      typedMsgLen = *start & 0xFF;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 6: {
-                      typedMsgLen |= (*start & 0xFF) << 8;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 7: {
-                      typedMsgLen |= (*start & 0xFF) << 16;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 8: {
-                      typedMsgLen |= (*start & 0xFF) << 24;
-
-                      codecPayload = malloc(typedMsgLen);  // allocate memory
-                                                           // for codec payload
-                      if (codecPayload == NULL) {
-                        ESP_LOGE(TAG,
-                                 "couldn't get memory "
-                                 "for codec payload");
-
-                        return;
-                      }
-
-                      offset = 0;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 9: {
-                      if (len >= typedMsgLen) {
-                        memcpy(&codecPayload[offset], start, typedMsgLen);
-
-                        offset += typedMsgLen;
-
-                        typedMsgCurrentPos += typedMsgLen;
-                        start += typedMsgLen;
-                        // currentPos += typedMsgLen;
-                        len -= typedMsgLen;
-                      } else {
-                        memcpy(&codecPayload[offset], start, len);
-
-                        offset += len;
-
-                        typedMsgCurrentPos += len;
-                        start += len;
-                        // currentPos += len;
-                        len -= len;
-                      }
-
-                      if (offset == typedMsgLen) {
-                        // first ensure everything is set up
-                        // correctly and resources are
-                        // available
-
-                        if (flacDecoder != NULL) {
-                          FLAC__stream_decoder_finish(flacDecoder);
-                          FLAC__stream_decoder_delete(flacDecoder);
-                          flacDecoder = NULL;
-                        }
-
-                        if (opusDecoder != NULL) {
-                          opus_decoder_destroy(opusDecoder);
-                          opusDecoder = NULL;
-                        }
-
-                        if (codec == OPUS) {
-                          uint16_t channels;
-                          uint32_t rate;
-                          uint16_t bits;
-
-                          memcpy(&rate, codecPayload + 4, sizeof(rate));
-                          memcpy(&bits, codecPayload + 8, sizeof(bits));
-                          memcpy(&channels, codecPayload + 10,
-                                 sizeof(channels));
-
-                          scSet.codec = codec;
-                          scSet.bits = bits;
-                          scSet.ch = channels;
-                          scSet.sr = rate;
-
-                          ESP_LOGI(TAG, "Opus sample format: %ld:%d:%d\n", rate,
-                                   bits, channels);
-
-                          int error = 0;
-
-                          opusDecoder =
-                              opus_decoder_create(scSet.sr, scSet.ch, &error);
-                          if (error != 0) {
-                            ESP_LOGI(TAG, "Failed to init opus coder");
-                            return;
-                          }
-
-                          ESP_LOGI(TAG, "Initialized opus Decoder: %d", error);
-                        } else if (codec == FLAC) {
-                          decoderChunk.bytes = typedMsgLen;
-                          decoderChunk.inData =
-                              (uint8_t *)malloc(decoderChunk.bytes);
-                          memcpy(decoderChunk.inData, codecPayload,
-                                 typedMsgLen);
-                          decoderChunk.outData = NULL;
-                          decoderChunk.type = SNAPCAST_MESSAGE_CODEC_HEADER;
-
-                          flacDecoder = FLAC__stream_decoder_new();
-                          if (flacDecoder == NULL) {
-                            ESP_LOGE(TAG, "Failed to init flac decoder");
-                            return;
-                          }
-
-                          FLAC__StreamDecoderInitStatus init_status =
-                              FLAC__stream_decoder_init_stream(
-                                  flacDecoder, read_callback, NULL, NULL, NULL,
-                                  NULL, write_callback, metadata_callback,
-                                  error_callback, &scSet);
-                          if (init_status !=
-                              FLAC__STREAM_DECODER_INIT_STATUS_OK) {
-                            ESP_LOGE(TAG, "ERROR: initializing decoder: %s\n",
-                                     FLAC__StreamDecoderInitStatusString
-                                         [init_status]);
-
-                            return;
-                          }
-
-                          FLAC__stream_decoder_process_until_end_of_metadata(
-                              flacDecoder);
-
-                          // ESP_LOGI(TAG, "%s: processed codec header",
-                          // __func__);
-                        } else if (codec == PCM) {
-                          uint16_t channels;
-                          uint32_t rate;
-                          uint16_t bits;
-
-                          memcpy(&channels, codecPayload + 22,
-                                 sizeof(channels));
-                          memcpy(&rate, codecPayload + 24, sizeof(rate));
-                          memcpy(&bits, codecPayload + 34, sizeof(bits));
-
-                          scSet.codec = codec;
-                          scSet.bits = bits;
-                          scSet.ch = channels;
-                          scSet.sr = rate;
-
-                          ESP_LOGI(TAG, "pcm sampleformat: %ld:%d:%d", scSet.sr,
-                                   scSet.bits, scSet.ch);
-                        } else {
-                          ESP_LOGE(TAG,
-                                   "codec header decoder "
-                                   "shouldn't get here after "
-                                   "codec string was detected");
-
-                          return;
-                        }
-
-                        free(codecPayload);
-                        codecPayload = NULL;
-
-                        if (player_send_snapcast_setting(&scSet) != pdPASS) {
-                          ESP_LOGE(TAG,
-                                   "Failed to notify sync task. "
-                                   "Did you init player?");
-
-                          return;
-                        }
-
-                        // ESP_LOGI(TAG, "done codec header msg");
-
-                        state = BASE_MESSAGE_STATE;
-                        internalState = 0;
-
-                        received_header = true;
-                        esp_timer_stop(timeSyncMessageTimer);
-                        if (!esp_timer_is_active(timeSyncMessageTimer)) {
-                          esp_timer_start_periodic(timeSyncMessageTimer,
-                                                   timeout);
-                        }
-                      }
-
-                      break;
-                    }
-
-                    default: {
-                      ESP_LOGE(TAG,
-                               "codec header decoder "
-                               "shouldn't get here");
-
-                      break;
-                    }
-                  }
-
-                  break;
-                }
-
-                case SNAPCAST_MESSAGE_SERVER_SETTINGS: {
-                  switch (internalState) {
-                    case 0: {
-                      typedMsgLen = *start & 0xFF;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 1: {
-                      typedMsgLen |= (*start & 0xFF) << 8;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 2: {
-                      typedMsgLen |= (*start & 0xFF) << 16;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 3: {
-                      typedMsgLen |= (*start & 0xFF) << 24;
-
-                      // ESP_LOGI(TAG,"server settings string is %lu"
-                      //              " long", typedMsgLen);
-
-                      // now get some memory for server settings
-                      // string
-                      serverSettingsString = malloc(typedMsgLen + 1);
-                      if (serverSettingsString == NULL) {
-                        ESP_LOGE(TAG,
-                                 "couldn't get memory for "
-                                 "server settings string");
-                      }
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      offset = 0;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 4: {
-                      size_t tmpSize =
-                          base_message_rx.size - typedMsgCurrentPos;
-
-                      if (len > 0) {
-                        if (tmpSize < len) {
-                          if (serverSettingsString) {
-                            memcpy(&serverSettingsString[offset], start,
-                                   tmpSize);
-                          }
-                          offset += tmpSize;
-
-                          start += tmpSize;
-                          // currentPos += tmpSize;  // will be
-                          //  incremented by 1
-                          //  later so -1 here
-                          typedMsgCurrentPos += tmpSize;
-                          len -= tmpSize;
-                        } else {
-                          if (serverSettingsString) {
-                            memcpy(&serverSettingsString[offset], start, len);
-                          }
-                          offset += len;
-
-                          start += len;
-                          // currentPos += len;  // will be incremented
-                          //  by 1 later so -1
-                          //  here
-                          typedMsgCurrentPos += len;
-                          len = 0;
-                        }
-                      }
-
-                      if (typedMsgCurrentPos >= base_message_rx.size) {
-                        if (serverSettingsString) {
-                          // ESP_LOGI(TAG, "done server settings %lu/%lu",
-                          //								offset,
-                          //								typedMsgLen);
-
-                          // NULL terminate string
-                          serverSettingsString[typedMsgLen] = 0;
-
-                          // ESP_LOGI(TAG, "got string: %s",
-                          // serverSettingsString);
-
-                          result = server_settings_message_deserialize(
-                              &server_settings_message, serverSettingsString);
-                          if (result) {
-                            ESP_LOGE(TAG,
-                                     "Failed to read server "
-                                     "settings: %d",
-                                     result);
-                          } else {
-                            // log mute state, buffer, latency
-                            ESP_LOGI(TAG, "Buffer length:  %ld",
-                                     server_settings_message.buffer_ms);
-                            ESP_LOGI(TAG, "Latency:        %ld",
-                                     server_settings_message.latency);
-                            ESP_LOGI(TAG, "Mute:           %d",
-                                     server_settings_message.muted);
-                            ESP_LOGI(TAG, "Setting volume: %ld",
-                                     server_settings_message.volume);
-                          }
-
-                          // Volume setting using ADF HAL
-                          // abstraction
-                          if (scSet.muted != server_settings_message.muted) {
-#if SNAPCAST_USE_SOFT_VOL
-                            if (server_settings_message.muted) {
-                              dsp_processor_set_volome(0.0);
-                            } else {
-                              dsp_processor_set_volome(
-                                  (double)server_settings_message.volume / 100);
-                            }
-#endif
-                            audio_set_mute(server_settings_message.muted);
-                          }
+#if CONFIG_USE_HEAP_ACCOUNTING
+/**
+ * cJSON hooks, so JSON shows up in heap accounting
+ */
+static void *json_malloc(size_t size) {
+  return audio_malloc_tag(AUDIO_MEM_TAG_JSON, size);
+}
 
-                          if (scSet.volume != server_settings_message.volume) {
-#if SNAPCAST_USE_SOFT_VOL
-                            if (!server_settings_message.muted) {
-                              dsp_processor_set_volome(
-                                  (double)server_settings_message.volume / 100);
-                            }
-#else
-                            audio_set_volume(server_settings_message.volume);
+static void json_free(void *ptr) { audio_free_tag(AUDIO_MEM_TAG_JSON, ptr); }
 #endif
-                          }
-
-                          scSet.cDacLat_ms = server_settings_message.latency;
-                          scSet.buf_ms = server_settings_message.buffer_ms;
-                          scSet.muted = server_settings_message.muted;
-                          scSet.volume = server_settings_message.volume;
-
-                          if (player_send_snapcast_setting(&scSet) != pdPASS) {
-                            ESP_LOGE(TAG,
-                                     "Failed to notify sync task. "
-                                     "Did you init player?");
-
-                            return;
-                          }
-
-                          free(serverSettingsString);
-                          serverSettingsString = NULL;
-                        }
-
-                        state = BASE_MESSAGE_STATE;
-                        internalState = 0;
-
-                        typedMsgCurrentPos = 0;
-                      }
-
-                      break;
-                    }
-
-                    default: {
-                      ESP_LOGE(TAG,
-                               "server settings decoder "
-                               "shouldn't get here");
-
-                      break;
-                    }
-                  }
-
-                  break;
-                }
-
-                case SNAPCAST_MESSAGE_STREAM_TAGS: {
-                  size_t tmpSize = base_message_rx.size - typedMsgCurrentPos;
-
-                  if (tmpSize < len) {
-                    start += tmpSize;
-                    // currentPos += tmpSize;
-                    typedMsgCurrentPos += tmpSize;
-                    len -= tmpSize;
-                  } else {
-                    start += len;
-                    // currentPos += len;
-
-                    typedMsgCurrentPos += len;
-                    len = 0;
-                  }
-
-                  if (typedMsgCurrentPos >= base_message_rx.size) {
-                    // ESP_LOGI(TAG,
-                    // "done stream tags with length %d %d %d",
-                    // base_message_rx.size, currentPos,
-                    // tmpSize);
-
-                    typedMsgCurrentPos = 0;
-                    // currentPos = 0;
-
-                    state = BASE_MESSAGE_STATE;
-                    internalState = 0;
-                  }
-
-                  break;
-                }
-
-                case SNAPCAST_MESSAGE_TIME: {
-                  switch (internalState) {
-                    case 0: {
-                      time_message_rx.latency.sec = *start;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 1: {
-                      time_message_rx.latency.sec |= (int32_t)*start << 8;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 2: {
-                      time_message_rx.latency.sec |= (int32_t)*start << 16;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 3: {
-                      time_message_rx.latency.sec |= (int32_t)*start << 24;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 4: {
-                      time_message_rx.latency.usec = *start;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 5: {
-                      time_message_rx.latency.usec |= (int32_t)*start << 8;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 6: {
-                      time_message_rx.latency.usec |= (int32_t)*start << 16;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-
-                      internalState++;
-
-                      if (len == 0) {
-                        break;
-                      }
-                    }
-
-                    case 7: {
-                      time_message_rx.latency.usec |= (int32_t)*start << 24;
-
-                      typedMsgCurrentPos++;
-                      start++;
-                      // currentPos++;
-                      len--;
-                      if (typedMsgCurrentPos >= base_message_rx.size) {
-                        // ESP_LOGI(TAG, "done time message");
-
-                        typedMsgCurrentPos = 0;
-
-                        state = BASE_MESSAGE_STATE;
-                        internalState = 0;
-
-                        trx =
-                            (int64_t)base_message_rx.received.sec * 1000000LL +
-                            (int64_t)base_message_rx.received.usec;
-                        ttx = (int64_t)base_message_rx.sent.sec * 1000000LL +
-                              (int64_t)base_message_rx.sent.usec;
-                        tdif = trx - ttx;
-                        trx = (int64_t)time_message_rx.latency.sec * 1000000LL +
-                              (int64_t)time_message_rx.latency.usec;
-                        tmpDiffToServer = (trx - tdif) / 2;
-
-                        int64_t diff;
-
-                        // clear diffBuffer if last update is
-                        // older than a minute
-                        diff = now - lastTimeSync;
-                        if (diff > 60000000LL) {
-                          ESP_LOGW(TAG,
-                                   "Last time sync older "
-                                   "than a minute. "
-                                   "Clearing time buffer");
-
-                          reset_latency_buffer();
-
-                          timeout = FAST_SYNC_LATENCY_BUF;
-
-                          esp_timer_stop(timeSyncMessageTimer);
-                          if (received_header == true) {
-                            if (!esp_timer_is_active(timeSyncMessageTimer)) {
-                              esp_timer_start_periodic(timeSyncMessageTimer,
-                                                       timeout);
-                            }
-                          }
-                        }
-
-                        player_latency_insert(tmpDiffToServer);
-
-                        // ESP_LOGI(TAG, "Current latency:%lld:",
-                        // tmpDiffToServer);
-
-                        // store current time
-                        lastTimeSync = now;
-
-                        if (received_header == true) {
-                          if (!esp_timer_is_active(timeSyncMessageTimer)) {
-                            esp_timer_start_periodic(timeSyncMessageTimer,
-                                                     timeout);
-                          }
-
-                          bool is_full = false;
-                          latency_buffer_full(&is_full, portMAX_DELAY);
-                          if ((is_full == true) &&
-                              (timeout < NORMAL_SYNC_LATENCY_BUF)) {
-                            timeout = NORMAL_SYNC_LATENCY_BUF;
-
-                            ESP_LOGI(TAG, "latency buffer full");
-
-                            if (esp_timer_is_active(timeSyncMessageTimer)) {
-                              esp_timer_stop(timeSyncMessageTimer);
-                            }
-
-                            esp_timer_start_periodic(timeSyncMessageTimer,
-                                                     timeout);
-                          } else if ((is_full == false) &&
-                                     (timeout > FAST_SYNC_LATENCY_BUF)) {
-                            timeout = FAST_SYNC_LATENCY_BUF;
-
-                            ESP_LOGI(TAG, "latency buffer not full");
-
-                            if (esp_timer_is_active(timeSyncMessageTimer)) {
-                              esp_timer_stop(timeSyncMessageTimer);
-                            }
-
-                            esp_timer_start_periodic(timeSyncMessageTimer,
-                                                     timeout);
-                          }
-                        }
-                      } else {
-                        ESP_LOGE(TAG,
-                                 "error time message, this "
-                                 "shouldn't happen! %d %ld",
-                                 typedMsgCurrentPos, base_message_rx.size);
-
-                        typedMsgCurrentPos = 0;
-
-                        state = BASE_MESSAGE_STATE;
-                        internalState = 0;
-                      }
-
-                      break;
-                    }
-
-                    default: {
-                      ESP_LOGE(TAG,
-                               "time message decoder shouldn't "
-                               "get here %d %ld %ld",
-                               typedMsgCurrentPos, base_message_rx.size,
-                               internalState);
-
-                      break;
-                    }
-                  }
-
-                  break;
-                }
-
-                default: {
-                  typedMsgCurrentPos++;
-                  start++;
-                  // currentPos++;
-                  len--;
-
-                  if (typedMsgCurrentPos >= base_message_rx.size) {
-                    ESP_LOGI(TAG, "done unknown typed message %d",
-                             base_message_rx.type);
-
-                    state = BASE_MESSAGE_STATE;
-                    internalState = 0;
-
-                    typedMsgCurrentPos = 0;
-                  }
-
-                  break;
-                }
-              }
-
-              break;
-            }
-
-            default: {
-              break;
-            }
-          }
-
-          if (rc1 != ERR_OK) {
-            break;
-          }
-        }
-      } while (netbuf_next(firstNetBuf) >= 0);
-
-      netbuf_delete(firstNetBuf);
-
-      if (rc1 != ERR_OK) {
-        ESP_LOGE(TAG, "Data error, closing netconn");
-
-        netconn_close(lwipNetconn);
-
-        break;
-      }
-    }
-  }
-}
 
 /**
  *
@@ -2468,6 +1692,17 @@ void app_main(void) {
   esp_log_level_set("wifi", ESP_LOG_WARN);
   esp_log_level_set("wifi_init", ESP_LOG_WARN);
 
+  trace_init();
+  capture_init();
+
+#if CONFIG_USE_HEAP_ACCOUNTING
+  // before anything is allocated by cJSON, it must be freed by the same hooks
+  cJSON_Hooks jsonHooks = {.malloc_fn = json_malloc, .free_fn = json_free};
+  cJSON_InitHooks(&jsonHooks);
+
+  audio_mem_frag_start(CONFIG_HEAP_FRAG_SAMPLE_PERIOD_S * 1000);
+#endif
+
 #if CONFIG_SNAPCLIENT_USE_INTERNAL_ETHERNET || \
     CONFIG_SNAPCLIENT_USE_SPI_ETHERNET
   // clang-format off
@@ -2603,6 +1838,20 @@ void app_main(void) {
   init_snapcast(audioQHdl);
   init_player(i2s_pin_config0, I2S_NUM_0);
 
+#if CONFIG_USE_WARM_START
+  // set up I2S for the stream we played before reboot while network is
+  // coming up
+  if (warm_start_load(&warmStart) == 0) {
+    snapcastSetting_t warmSet;
+
+    memset(&warmSet, 0, sizeof(snapcastSetting_t));
+    warm_start_get_setting(&warmStart, &warmSet);
+    if (player_warm_start(&warmSet, warmStart.clockSkew_ppm) == 0) {
+      warmStartValid = true;
+    }
+  }
+#endif
+
 #if CONFIG_SNAPCLIENT_USE_INTERNAL_ETHERNET || \
     CONFIG_SNAPCLIENT_USE_SPI_ETHERNET
   eth_init();
@@ -2638,6 +1887,12 @@ void app_main(void) {
                           HTTP_TASK_PRIORITY, &t_http_get_task,
                           HTTP_TASK_CORE_ID);
 
+#if CONFIG_NVS_STRESS_TEST
+  xTaskCreatePinnedToCore(&nvs_stress_task, "nvsStress", 3 * 1024, NULL,
+                          NVS_STRESS_TASK_PRIORITY, NULL,
+                          NVS_STRESS_TASK_CORE_ID);
+#endif
+
   //  while (1) {
   //    // audio_event_iface_msg_t msg;
   //    vTaskDelay(portMAX_DELAY);  //(pdMS_TO_TICKS(5000));
@@ -0,0 +1,334 @@
+#!/usr/bin/env python3
+"""Synthesize a snapclient stream capture of a PCM, FLAC or opus stream.
+
+Writes what a client would have received from a snapserver streaming 48kHz
+16bit stereo: server settings, codec header, wire chunks and time replies,
+cut into TCP_MSS sized pieces with arrival times. The result replays like a
+capture downloaded from /capture:
+
+    tools/capture_synth.py --codec flac --chunk-ms 20 flac_20ms.cap
+    build-host/snapclient-host --replay flac_20ms.cap
+
+The host build writes its corpus this way to build-host/corpus.
+--switch-ms changes codec and/or sample rate mid-stream with a new codec
+header, as snapserver does when the client's group switches streams.
+
+Frame k holds k & 0xffff on the left and k >> 16 on the right channel, so
+the playout log of the host build tells which frame was played when. FLAC
+keeps that, one frame per chunk. Opus chunks are CELT packets of random
+bytes, they decode to noise of the packet's duration.
+"""
+
+import argparse
+import json
+import random
+import struct
+
+MAGIC = b"SCCP"
+VERSION = 1
+RECORD = struct.Struct("<qI")
+BASE = struct.Struct("<HHHiiiiI")
+TCP_MSS = 1460
+
+MSG_CODEC_HEADER = 1
+MSG_WIRE_CHUNK = 2
+MSG_SERVER_SETTINGS = 3
+MSG_TIME = 4
+
+# time replies the client asks for right after connecting
+TIME_BURST = 20
+
+SR = 48000
+# FLAC frame header codes of sample rates, others are taken from STREAMINFO
+FLAC_RATE_CODE = {32000: 8, 44100: 9, 48000: 10, 96000: 11}
+CHANNELS = 2
+BITS = 16
+
+OPUS_ID = 0x4F505553
+# CELT only fullband TOC config by frame duration in ms
+OPUS_CONFIG = {10: 30, 20: 31}
+OPUS_RATES = (8000, 12000, 16000, 24000, 48000)
+
+
+def tv(us):
+    return us // 1000000, us % 1000000
+
+
+def message(msg_type, payload, sent_us, refers=0):
+    return BASE.pack(msg_type, 0, refers, *tv(sent_us), 0, 0,
+                     len(payload)) + payload
+
+
+def wav_header(rate):
+    fmt = struct.pack("<HHIIHH", 1, CHANNELS, rate,
+                      rate * CHANNELS * BITS // 8, CHANNELS * BITS // 8, BITS)
+    return (b"RIFF" + struct.pack("<I", 36) + b"WAVEfmt " +
+            struct.pack("<I", len(fmt)) + fmt + b"data" +
+            struct.pack("<I", 0))
+
+
+def signed16(v):
+    return v - 0x10000 if v & 0x8000 else v
+
+
+def pattern(first, frames):
+    """left and right channel of the test pattern"""
+    ks = range(first, first + frames)
+    return ([signed16(k & 0xffff) for k in ks],
+            [signed16((k >> 16) & 0xffff) for k in ks])
+
+
+def crc(data, bits, poly):
+    top = 1 << (bits - 1)
+    mask = (1 << bits) - 1
+    c = 0
+    for b in data:
+        c ^= b << (bits - 8)
+        for _ in range(8):
+            c = ((c << 1) ^ poly) & mask if c & top else (c << 1) & mask
+    return c
+
+
+class BitWriter:
+    """MSB first, as FLAC wants it"""
+
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.n = 0
+
+    def write(self, value, bits):
+        self.acc = (self.acc << bits) | (value & ((1 << bits) - 1))
+        self.n += bits
+        while self.n >= 8:
+            self.n -= 8
+            self.out.append((self.acc >> self.n) & 0xff)
+        self.acc &= (1 << self.n) - 1
+
+    def align(self):
+        if self.n:
+            self.write(0, 8 - self.n)
+
+
+def flac_header(frames, rate):
+    """fLaC marker and STREAMINFO, sizes and MD5 unknown"""
+    bw = BitWriter()
+    bw.write(frames, 16)
+    bw.write(frames, 16)
+    bw.write(0, 24)
+    bw.write(0, 24)
+    bw.write(rate, 20)
+    bw.write(CHANNELS - 1, 3)
+    bw.write(BITS - 1, 5)
+    bw.write(0, 36)
+    info = bytes(bw.out) + bytes(16)
+    return b"fLaC" + struct.pack(">I", 0x80000000 | len(info)) + info
+
+
+def flac_utf8(v):
+    """frame number, coded like UTF-8"""
+    if v < 0x80:
+        return bytes([v])
+    n = 2
+    while v >= 1 << (5 * n + 1):
+        n += 1
+    tail = []
+    for _ in range(n - 1):
+        tail.insert(0, 0x80 | (v & 0x3f))
+        v >>= 6
+    return bytes([((0xff << (8 - n)) & 0xff) | v] + tail)
+
+
+def flac_subframe(bw, x):
+    """CONSTANT, FIXED order 2 or VERBATIM, whichever is smallest"""
+    if all(s == x[0] for s in x):
+        bw.write(0b00000000, 8)
+        bw.write(x[0], BITS)
+        return
+
+    res = [x[i] - 2 * x[i - 1] + x[i - 2] for i in range(2, len(x))]
+    folded = [r << 1 if r >= 0 else (-r << 1) - 1 for r in res]
+    cost = {k: sum((u >> k) + 1 + k for u in folded) for k in range(15)}
+    k = min(cost, key=cost.get)
+
+    if cost[k] + 2 * BITS + 10 >= BITS * len(x):
+        bw.write(0b00000010, 8)
+        for s in x:
+            bw.write(s, BITS)
+        return
+
+    bw.write(0b00010100, 8)
+    bw.write(x[0], BITS)
+    bw.write(x[1], BITS)
+    # rice coding, partition order 0
+    bw.write(0, 2)
+    bw.write(0, 4)
+    bw.write(k, 4)
+    for u in folded:
+        bw.write(1, (u >> k) + 1)
+        bw.write(u, k)
+
+
+def flac_frame(number, first, frames, rate):
+    bw = BitWriter()
+    # sync, fixed block size, block size after the frame number, sample
+    # rate, independent stereo, 16 bit
+    bw.write(0xfff8, 16)
+    bw.write(0x7, 4)
+    bw.write(FLAC_RATE_CODE.get(rate, 0), 4)
+    bw.write(0x18, 8)
+    for b in flac_utf8(number):
+        bw.write(b, 8)
+    bw.write(frames - 1, 16)
+    bw.write(crc(bw.out, 8, 0x07), 8)
+    for x in pattern(first, frames):
+        flac_subframe(bw, x)
+    bw.align()
+    bw.write(crc(bw.out, 16, 0x8005), 16)
+    return bytes(bw.out)
+
+
+def opus_packet(rng, chunk_ms, size):
+    """CELT packet of chunk_ms, 20ms frames of size bytes if longer"""
+    if chunk_ms in OPUS_CONFIG:
+        toc = OPUS_CONFIG[chunk_ms] << 3 | 0x04
+        return bytes([toc]) + rng.randbytes(size * chunk_ms // 20)
+    # code 3, constant bitrate
+    count = chunk_ms // 20
+    toc = OPUS_CONFIG[20] << 3 | 0x04 | 0x03
+    return bytes([toc, count]) + rng.randbytes(size * count)
+
+
+def codec_header(codec, rate, frames):
+    if codec == "flac":
+        return flac_header(frames, rate)
+    if codec == "opus":
+        return struct.pack("<IIHH", OPUS_ID, rate, BITS, CHANNELS)
+    return wav_header(rate)
+
+
+def codec_message(codec, rate, frames, sent_us):
+    name = codec.encode()
+    header = codec_header(codec, rate, frames)
+    return message(MSG_CODEC_HEADER,
+                   struct.pack("<I", len(name)) + name +
+                   struct.pack("<I", len(header)) + header, sent_us)
+
+
+def synth(args):
+    """(arrival time in µs, bytes) of every message, in arrival order"""
+    codec = args.codec
+    rate = SR
+    frames = rate * args.chunk_ms // 1000
+    delay = args.delay_us
+    # server time is client time plus offset
+    offset = args.offset_us
+    t = args.start_us
+
+    settings = json.dumps({"bufferMs": args.buffer_ms, "latency": 0,
+                           "muted": False, "volume": 100}).encode()
+    rng = random.Random(args.chunk_ms)
+    msgs = [
+        (t, message(MSG_SERVER_SETTINGS,
+                    struct.pack("<I", len(settings)) + settings,
+                    t + offset - delay)),
+        (t, codec_message(codec, rate, frames, t + offset - delay)),
+    ]
+
+    # chunks are sent when complete, a buffer ahead of their play time.
+    # Frames are counted on over a switch, FLAC frames from 0.
+    first = 0
+    number = 0
+    n_chunks = args.seconds * 1000 // args.chunk_ms
+    for n in range(n_chunks):
+        ts = n * args.chunk_ms * 1000
+        arrival = t + ts + args.chunk_ms * 1000 + delay
+        if (args.switch_ms is not None) and \
+                (n * args.chunk_ms == args.switch_ms):
+            codec = args.switch_codec or codec
+            rate = args.switch_rate or rate
+            frames = rate * args.chunk_ms // 1000
+            number = 0
+            # sort keeps it in front of the chunk
+            msgs.append((arrival, codec_message(codec, rate, frames,
+                                                arrival + offset - delay)))
+        if codec == "flac":
+            data = flac_frame(number, first, frames, rate)
+        elif codec == "opus":
+            data = opus_packet(rng, args.chunk_ms, args.opus_bytes)
+        else:
+            left, right = pattern(first, frames)
+            data = b"".join(struct.pack("<hh", lr[0], lr[1])
+                            for lr in zip(left, right))
+        first += frames
+        number += 1
+        payload = struct.pack("<ii", *tv(ts + t + offset)) + \
+            struct.pack("<I", len(data)) + data
+        msgs.append((arrival, message(MSG_WIRE_CHUNK, payload,
+                                      arrival + offset - delay)))
+
+    # replies to the client's burst after connecting, then one a second.
+    # Request was sent 2 * delay before, latency is client to server.
+    replies = [t + 10000 * (i + 1) for i in range(TIME_BURST)]
+    replies += [t + 1000000 * (s + 1) for s in range(args.seconds - 1)]
+    for arrival in replies:
+        latency = offset + delay
+        msgs.append((arrival, message(MSG_TIME,
+                                      struct.pack("<ii", *tv(latency)),
+                                      arrival + offset - delay)))
+
+    msgs.sort(key=lambda m: m[0])
+
+    return msgs
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("out", help="capture file to write")
+    parser.add_argument("--codec", choices=("pcm", "flac", "opus"),
+                        default="pcm", help="stream codec (%(default)s)")
+    parser.add_argument("--chunk-ms", type=int, default=20,
+                        help="wire chunk duration (%(default)s)")
+    parser.add_argument("--seconds", type=int, default=4,
+                        help="stream length (%(default)s)")
+    parser.add_argument("--buffer-ms", type=int, default=1000,
+                        help="server buffer (%(default)s)")
+    parser.add_argument("--delay-us", type=int, default=2000,
+                        help="one way network delay (%(default)s)")
+    parser.add_argument("--offset-us", type=int, default=123456789,
+                        help="server minus client time (%(default)s)")
+    parser.add_argument("--start-us", type=int, default=500000,
+                        help="arrival of first message (%(default)s)")
+    parser.add_argument("--opus-bytes", type=int, default=480,
+                        help="opus bytes per 20ms (%(default)s)")
+    parser.add_argument("--switch-ms", type=int,
+                        help="stream time of codec or sample rate switch, "
+                        "a multiple of --chunk-ms")
+    parser.add_argument("--switch-codec", choices=("pcm", "flac", "opus"),
+                        help="codec after the switch (unchanged)")
+    parser.add_argument("--switch-rate", type=int,
+                        help="sample rate after the switch (unchanged)")
+    args = parser.parse_args()
+
+    codecs = {args.codec, args.switch_codec or args.codec}
+    rates = {SR, args.switch_rate or SR}
+    if "opus" in codecs and args.chunk_ms not in OPUS_CONFIG and \
+            args.chunk_ms % 20:
+        parser.error("opus chunks are 10ms or a multiple of 20ms")
+    if "opus" in codecs and not rates <= set(OPUS_RATES):
+        parser.error("opus sample rate must be one of %s" % (OPUS_RATES,))
+    if any(r * args.chunk_ms % 1000 for r in rates):
+        parser.error("chunks must hold whole frames")
+    if (args.switch_ms is not None) and (args.switch_ms % args.chunk_ms):
+        parser.error("--switch-ms must be a multiple of --chunk-ms")
+
+    with open(args.out, "wb") as f:
+        f.write(MAGIC + bytes([VERSION, RECORD.size, 0, 0]))
+        for arrival, msg in synth(args):
+            for pos in range(0, len(msg), TCP_MSS):
+                piece = msg[pos:pos + TCP_MSS]
+                f.write(RECORD.pack(arrival, len(piece)) + piece)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Collect [Performance] results of the component tests and compare them.
+
+The performance tests in components/*/test print one line per result, the
+format of IDF's TEST_PERFORMANCE_LESS_THAN:
+
+    [Performance][FLAC_DECODE_CYCLES]: 612345 cycles
+
+This turns the serial log of a test run into JSON and, given a baseline from
+an earlier run, fails if a result got worse by more than --tolerance percent:
+
+    idf.py -p /dev/ttyUSB0 monitor | tee perf.log
+    tools/perf_report.py perf.log --out perf.json
+    tools/perf_report.py perf.log --baseline perf.json --tolerance 5
+
+Results in MB/s are better if larger, all others if smaller. Worst cases
+(*_MAX) depend on interrupts and cache state, they are only checked with
+--check-max.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+LINE = re.compile(r"\[Performance\]\[(\w+)\]:\s*(-?[\d.]+)\s*(\S*)")
+HIGHER_IS_BETTER = ("MB/s",)
+
+
+def parse(lines):
+    results = {}
+    for line in lines:
+        m = LINE.search(line)
+        if m:
+            results[m.group(1)] = {"value": float(m.group(2)),
+                                   "unit": m.group(3)}
+    return results
+
+
+def compare(results, baseline, tolerance, check_max):
+    """rows of name, baseline, value, change in percent, regressed"""
+    rows = []
+    for name in sorted(results):
+        value = results[name]["value"]
+        if name not in baseline or baseline[name]["value"] == 0:
+            rows.append((name, None, value, None, False))
+            continue
+
+        base = baseline[name]["value"]
+        change = 100.0 * (value - base) / base
+        if results[name]["unit"] in HIGHER_IS_BETTER:
+            regressed = change < -tolerance
+        else:
+            regressed = change > tolerance
+        if name.endswith("_MAX") and not check_max:
+            regressed = False
+        rows.append((name, base, value, change, regressed))
+    return rows
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log", nargs="*",
+                    help="test logs, stdin if none are given")
+    ap.add_argument("--out", help="write results as JSON to this file")
+    ap.add_argument("--baseline", help="JSON of an earlier run")
+    ap.add_argument("--tolerance", type=float, default=5.0,
+                    help="allowed change in percent (default 5)")
+    ap.add_argument("--check-max", action="store_true",
+                    help="fail on regressed worst cases too")
+    args = ap.parse_args()
+
+    lines = []
+    if args.log:
+        for path in args.log:
+            with open(path, errors="replace") as f:
+                lines.extend(f)
+    else:
+        lines = sys.stdin.readlines()
+
+    results = parse(lines)
+    if not results:
+        print("no [Performance] results found", file=sys.stderr)
+        return 1
+
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+            f.write("\n")
+
+    if not args.baseline:
+        if not args.out:
+            json.dump(results, sys.stdout, indent=2, sort_keys=True)
+            print()
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    failed = 0
+    print(f"{'result':40} {'baseline':>12} {'now':>12} {'change':>8}")
+    for name, base, value, change, regressed in compare(
+            results, baseline, args.tolerance, args.check_max):
+        if base is None:
+            print(f"{name:40} {'-':>12} {value:12.0f} {'new':>8}")
+            continue
+        mark = "  REGRESSED" if regressed else ""
+        print(f"{name:40} {base:12.0f} {value:12.0f} {change:+7.1f}%{mark}")
+        failed += regressed
+
+    for name in sorted(set(baseline) - set(results)):
+        print(f"{name:40} {baseline[name]['value']:12.0f} {'-':>12} "
+              f"{'missing':>8}")
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
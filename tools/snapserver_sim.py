@@ -0,0 +1,397 @@
+#!/usr/bin/env python3
+"""Snapserver stand-in with network impairments for sync benchmarks.
+
+Speaks enough of the snapcast binary protocol for snapclient: takes the
+client's hello, sends server settings and a PCM codec header, streams wire
+chunks and answers time requests. The stream is 48kHz 16bit stereo, frame k
+holds k & 0xffff on the left and k >> 16 on the right channel, all clients
+get the same timeline.
+
+Messages to the client and time requests from it are delayed by a fixed
+latency plus exponentially distributed jitter, TCP keeps the order. Wire
+chunks can be swapped in bursts, delivery can stall periodically and the
+server clock can drift against CLOCK_MONOTONIC. --client gives the client
+with that HostName its own impairments, the others get the global ones.
+
+--ref writes what tools/sync_report.py needs to tell when each frame should
+have been played:
+
+    tools/snapserver_sim.py --jitter-ms 5 --drift-ppm 40 --ref ref.json &
+    build-host/snapclient-host --playout-log po.bin --duration 120
+    tools/sync_report.py ref.json po.bin
+"""
+
+import argparse
+import copy
+import heapq
+import json
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+BASE = struct.Struct("<HHHiiiiI")
+
+MSG_CODEC_HEADER = 1
+MSG_WIRE_CHUNK = 2
+MSG_SERVER_SETTINGS = 3
+MSG_TIME = 4
+MSG_HELLO = 5
+
+SR = 48000
+CHANNELS = 2
+BITS = 16
+
+
+def mono_us():
+    return time.monotonic_ns() // 1000
+
+
+def tv(us):
+    return us // 1000000, us % 1000000
+
+
+class ServerClock:
+    """server time in µs, runs drift_ppm faster than CLOCK_MONOTONIC"""
+
+    def __init__(self, drift_ppm):
+        self.base = mono_us()
+        self.rate = 1 + drift_ppm * 1e-6
+
+    def now(self, mono=None):
+        if mono is None:
+            mono = mono_us()
+        return self.base + int((mono - self.base) * self.rate)
+
+    def to_mono(self, server_us):
+        return self.base + int((server_us - self.base) / self.rate)
+
+
+class Impairment:
+    """delivery times of one direction of one connection"""
+
+    def __init__(self, args, seed):
+        self.latency = args.latency_ms * 1000
+        self.jitter = args.jitter_ms * 1000
+        self.stall_every = args.stall_every_s * 1000000
+        self.stall = args.stall_ms * 1000
+        self.reorder = args.reorder
+        self.reorder_burst = args.reorder_burst
+        self.random = random.Random(seed)
+        self.last = 0
+        self.next_stall = mono_us() + self.stall_every
+
+    def deliver_at(self, now):
+        t = now + self.latency
+        if self.jitter > 0:
+            t += int(self.random.expovariate(1 / self.jitter))
+
+        if self.stall_every > 0:
+            if now >= self.next_stall + self.stall:
+                self.next_stall += self.stall_every
+            if now >= self.next_stall:
+                t = max(t, self.next_stall + self.stall + self.latency)
+
+        # one TCP connection, nothing overtakes
+        self.last = max(self.last, t)
+        return self.last
+
+    def reorder_burst_len(self):
+        """number of chunk pairs to swap, starting with this chunk"""
+        if self.reorder > 0 and self.random.random() < self.reorder:
+            return self.reorder_burst
+        return 0
+
+
+class Client:
+    def __init__(self, server, sock, addr, seed):
+        self.server = server
+        self.sock = sock
+        self.addr = addr
+        self.name = f"{addr[0]}:{addr[1]}"
+        self.seed = seed
+        self.down = Impairment(server.args, seed)
+        self.up = Impairment(server.args, seed + 1)
+        self.lock = threading.Condition()
+        self.queue = []  # (time, seq, action, data)
+        self.seq = 0
+        self.closed = False
+        self.streaming = False
+        self.held = None
+        self.swaps = 0
+
+    def push(self, direction, action, data):
+        with self.lock:
+            at = direction.deliver_at(mono_us())
+            heapq.heappush(self.queue, (at, self.seq, action, data))
+            self.seq += 1
+            self.lock.notify()
+
+    def send(self, msg_type, payload, refers=0):
+        """server sends now, the client gets it after the impairment"""
+        msg = BASE.pack(msg_type, 0, refers, *tv(self.server.clock.now()),
+                        0, 0, len(payload)) + payload
+        self.push(self.down, "send", msg)
+
+    def send_chunk(self, payload):
+        if self.held is not None:
+            held, self.held = self.held, None
+            self.send(MSG_WIRE_CHUNK, payload)
+            self.send(MSG_WIRE_CHUNK, held)
+            return
+
+        if self.swaps == 0:
+            self.swaps = self.down.reorder_burst_len()
+        if self.swaps > 0:
+            self.swaps -= 1
+            self.held = payload
+            return
+
+        self.send(MSG_WIRE_CHUNK, payload)
+
+    def writer(self):
+        clock = self.server.clock
+        while True:
+            with self.lock:
+                while not self.closed and (
+                        not self.queue or self.queue[0][0] > mono_us()):
+                    timeout = None
+                    if self.queue:
+                        timeout = (self.queue[0][0] - mono_us()) / 1e6
+                    self.lock.wait(timeout)
+                if self.closed:
+                    return
+                _, _, action, data = heapq.heappop(self.queue)
+
+            if action == "time":
+                # request reached the server now
+                mid, client_sent = data
+                latency = clock.now() - client_sent
+                self.send(MSG_TIME, struct.pack("<ii", *tv(latency)), mid)
+                continue
+
+            try:
+                self.sock.sendall(data)
+            except OSError:
+                self.close()
+                return
+
+    def reader(self):
+        try:
+            while True:
+                hdr = self.recv_all(BASE.size)
+                msg_type, mid, _, sec, usec, _, _, size = BASE.unpack(hdr)
+                payload = self.recv_all(size)
+
+                if msg_type == MSG_HELLO:
+                    hello = json.loads(payload[4:])
+                    self.name = hello.get("HostName", self.name)
+                    print(f"{self.name}: hello from {self.addr[0]}",
+                          flush=True)
+                    profile = self.server.profiles.get(self.name)
+                    if profile is not None:
+                        # nothing is queued before the stream starts
+                        self.down = Impairment(profile, self.seed)
+                        self.up = Impairment(profile, self.seed + 1)
+                    self.server.start(self)
+                elif msg_type == MSG_TIME:
+                    self.push(self.up, "time", (mid, sec * 1000000 + usec))
+        except (OSError, EOFError, ValueError):
+            pass
+
+        print(f"{self.name}: disconnected", flush=True)
+        self.close()
+
+    def recv_all(self, n):
+        data = b""
+        while len(data) < n:
+            d = self.sock.recv(n - len(data))
+            if not d:
+                raise EOFError
+            data += d
+        return data
+
+    def close(self):
+        with self.lock:
+            self.closed = True
+            self.lock.notify()
+        self.server.remove(self)
+        try:
+            self.sock.close()
+        except OSError:
+            pass
+
+
+class Server:
+    def __init__(self, args):
+        self.args = args
+        self.profiles = client_profiles(args)
+        self.clock = ServerClock(args.drift_ppm)
+        self.clients = []
+        self.lock = threading.Lock()
+        self.frames = SR * args.chunk_ms // 1000
+        # timestamp of frame 0, stream starts with the server
+        self.start_us = self.clock.now()
+
+    def reference(self):
+        return {
+            "clock_base_us": self.clock.base,
+            "drift_ppm": self.args.drift_ppm,
+            "stream_start_us": self.start_us,
+            "buffer_ms": self.args.buffer_ms,
+            "sample_rate": SR,
+            "chunk_ms": self.args.chunk_ms,
+        }
+
+    def start(self, client):
+        settings = json.dumps({"bufferMs": self.args.buffer_ms,
+                               "latency": 0, "muted": False,
+                               "volume": 100}).encode()
+        fmt = struct.pack("<HHIIHH", 1, CHANNELS, SR,
+                          SR * CHANNELS * BITS // 8, CHANNELS * BITS // 8,
+                          BITS)
+        wav = (b"RIFF" + struct.pack("<I", 36) + b"WAVEfmt " +
+               struct.pack("<I", len(fmt)) + fmt + b"data" +
+               struct.pack("<I", 0))
+
+        with self.lock:
+            client.send(MSG_SERVER_SETTINGS,
+                        struct.pack("<I", len(settings)) + settings)
+            client.send(MSG_CODEC_HEADER,
+                        struct.pack("<I", 3) + b"pcm" +
+                        struct.pack("<I", len(wav)) + wav)
+            client.streaming = True
+
+    def remove(self, client):
+        with self.lock:
+            if client in self.clients:
+                self.clients.remove(client)
+
+    def accept(self, sock):
+        seed = self.args.seed
+        while True:
+            conn, addr = sock.accept()
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            client = Client(self, conn, addr, seed)
+            seed += 2
+            with self.lock:
+                self.clients.append(client)
+            threading.Thread(target=client.writer, daemon=True).start()
+            threading.Thread(target=client.reader, daemon=True).start()
+
+    def stream(self):
+        """produce chunks in server time, each one when it is complete"""
+        chunk_us = self.args.chunk_ms * 1000
+        n = 0
+        while True:
+            ts = self.start_us + n * self.frames * 1000000 // SR
+            due = self.clock.to_mono(ts + chunk_us)
+            wait = due - mono_us()
+            if wait > 0:
+                time.sleep(wait / 1e6)
+
+            pcm = bytearray()
+            for k in range(n * self.frames, (n + 1) * self.frames):
+                pcm += struct.pack("<HH", k & 0xffff, (k >> 16) & 0xffff)
+            payload = struct.pack("<ii", *tv(ts)) + \
+                struct.pack("<I", len(pcm)) + bytes(pcm)
+
+            with self.lock:
+                for client in self.clients:
+                    if client.streaming:
+                        client.send_chunk(payload)
+            n += 1
+
+
+def add_impairment_args(parser):
+    parser.add_argument("--latency-ms", type=float, default=1,
+                        help="one way delay (%(default)s)")
+    parser.add_argument("--jitter-ms", type=float, default=0,
+                        help="mean of exponential extra delay")
+    parser.add_argument("--reorder", type=float, default=0,
+                        help="probability a chunk starts a reorder burst")
+    parser.add_argument("--reorder-burst", type=int, default=4,
+                        help="chunk pairs swapped per burst (%(default)s)")
+    parser.add_argument("--stall-every-s", type=float, default=0,
+                        help="stall delivery periodically")
+    parser.add_argument("--stall-ms", type=float, default=200,
+                        help="length of a stall (%(default)s)")
+
+
+IMPAIRMENTS = ("latency_ms", "jitter_ms", "reorder", "reorder_burst",
+               "stall_every_s", "stall_ms")
+
+
+def parse_profile(spec):
+    """NAME:key=value,... to (NAME, {key: value})"""
+    name, _, params = spec.partition(":")
+    if not name:
+        raise ValueError(f"client profile without name: {spec}")
+    values = {}
+    for param in filter(None, params.split(",")):
+        key, sep, value = param.partition("=")
+        key = key.strip().replace("-", "_")
+        if not sep or key not in IMPAIRMENTS:
+            raise ValueError(f"unknown impairment in {spec}: {param}")
+        values[key] = int(value) if key == "reorder_burst" else float(value)
+    return name, values
+
+
+def client_profiles(args):
+    """impairment args per HostName, global ones overridden by --client"""
+    profiles = {}
+    for spec in args.client or []:
+        name, values = parse_profile(spec)
+        profile = copy.copy(args)
+        for key, value in values.items():
+            setattr(profile, key, value)
+        profiles[name] = profile
+    return profiles
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=1704,
+                        help="stream port (%(default)s)")
+    parser.add_argument("--bind", default="127.0.0.1",
+                        help="address to listen on (%(default)s)")
+    parser.add_argument("--buffer-ms", type=int, default=1000,
+                        help="server buffer (%(default)s)")
+    parser.add_argument("--chunk-ms", type=int, default=20,
+                        help="wire chunk duration (%(default)s)")
+    parser.add_argument("--drift-ppm", type=float, default=0,
+                        help="server clock error")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="random seed of impairments (%(default)s)")
+    parser.add_argument("--ref", help="write reference timeline here")
+    parser.add_argument("--client", action="append", metavar="NAME:K=V,..",
+                        help="impairments of one client, e.g. "
+                        "kitchen:latency_ms=5,jitter_ms=2")
+    add_impairment_args(parser)
+    args = parser.parse_args()
+
+    try:
+        server = Server(args)
+    except ValueError as e:
+        sys.exit(str(e))
+    if args.ref:
+        with open(args.ref, "w") as f:
+            json.dump(server.reference(), f, indent=2)
+
+    sock = socket.socket()
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind((args.bind, args.port))
+    sock.listen()
+    print(f"listening on {args.bind}:{args.port}", flush=True)
+
+    threading.Thread(target=server.accept, args=(sock,), daemon=True).start()
+    try:
+        server.stream()
+    except KeyboardInterrupt:
+        sys.exit(0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,396 @@
+#!/usr/bin/env python3
+"""Inter-client sync benchmark of host builds against tools/snapserver_sim.py.
+
+Starts one stand-in server and N host clients, each with its own DAC drift
+and network impairments, lets them play for --duration seconds and compares
+their playout logs: for frames every --step-ms of the stream the spread of
+the play times over all clients is the skew a listener hears between rooms.
+
+    tools/sync_bench.py --clients 3 --duration 60 --build build-host
+    tools/sync_bench.py --build build-host --build build-apll \\
+        --client dac_ppm=-80,latency_ms=8,jitter_ms=3 \\
+        --client dac_ppm=20,wander_ppm=5 --client dac_ppm=60
+
+Every --build runs with the same clients, seeds and server, so builds
+configured with other CONFIG_USE_SAMPLE_INSERTION, sync controller, median
+lengths or SHORT_OFFSET / MINI_OFFSET (see host/CMakeLists.txt) compare
+directly.
+Clients without --client get DAC errors spread evenly within
+--dac-spread-ppm and the global impairments.
+
+Skew percentiles are taken from --settle-s on, the table shows how skew
+develops in windows of --window-s. Each client's own error against the
+reference is reported like tools/sync_report.py does.
+"""
+
+import argparse
+import bisect
+import json
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+import snapserver_sim
+import sync_report
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+
+CLIENT_KEYS = ("dac_ppm", "wander_ppm", "wander_period_s")
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def parse_client(spec):
+    """key=value,... to (client settings, server impairments)"""
+    client, net = {}, {}
+    for param in filter(None, spec.split(",")):
+        key, sep, value = param.partition("=")
+        key = key.strip().replace("-", "_")
+        if not sep:
+            raise ValueError(f"missing value in {spec}: {param}")
+        if key in CLIENT_KEYS:
+            client[key] = float(value)
+        elif key in snapserver_sim.IMPAIRMENTS:
+            net[key] = value
+        else:
+            raise ValueError(f"unknown key in {spec}: {key}")
+    return client, net
+
+
+def clients(args):
+    """name, client settings and server impairments of every client"""
+    n = max(args.clients, len(args.client or []))
+    out = []
+    for i in range(n):
+        if args.client and i < len(args.client):
+            client, net = parse_client(args.client[i])
+        else:
+            client, net = {}, {}
+        if "dac_ppm" not in client:
+            spread = args.dac_spread_ppm
+            client["dac_ppm"] = (-spread + 2 * spread * i / (n - 1)
+                                 if n > 1 else 0)
+        out.append((f"client{i + 1}", client, net))
+    return out
+
+
+def build_options(build):
+    """sync related overrides in the CMake cache of a build"""
+    names = ["CONFIG_USE_SAMPLE_INSERTION", "CONFIG_USE_SOFT_RESYNC",
+             "CONFIG_SYNC_CONTROLLER_PI", "LATENCY_MEDIAN_FILTER_LEN",
+             "SHORT_BUFFER_LEN", "MINI_BUFFER_LEN", "SHORT_OFFSET",
+             "MINI_OFFSET"]
+    options = {}
+    try:
+        with open(os.path.join(build, "CMakeCache.txt")) as f:
+            for line in f:
+                name, _, value = line.strip().partition("=")
+                name = name.split(":")[0]
+                if name in names and value:
+                    options[name] = value
+    except OSError:
+        pass
+    return options
+
+
+def server_cmd(args, port, ref, profiles):
+    cmd = [sys.executable, os.path.join(TOOLS, "snapserver_sim.py"),
+           "--port", str(port), "--ref", ref,
+           "--buffer-ms", str(args.buffer_ms),
+           "--chunk-ms", str(args.chunk_ms),
+           "--drift-ppm", str(args.drift_ppm),
+           "--seed", str(args.seed)]
+    for key in snapserver_sim.IMPAIRMENTS:
+        cmd += ["--" + key.replace("_", "-"), str(getattr(args, key))]
+    for name, _, net in profiles:
+        if net:
+            cmd += ["--client", name + ":" +
+                    ",".join(f"{k}={v}" for k, v in net.items())]
+    return cmd
+
+
+def client_cmd(binary, port, i, name, client, log, duration):
+    cmd = [binary, "--server", "127.0.0.1", "--port", str(port),
+           "--name", name, "--instance", str(i + 1),
+           "--dac-ppm", str(client["dac_ppm"]),
+           "--playout-log", log, "--duration", str(duration)]
+    if "wander_ppm" in client:
+        cmd += ["--dac-wander-ppm", str(client["wander_ppm"])]
+    if "wander_period_s" in client:
+        cmd += ["--dac-wander-period", str(client["wander_period_s"])]
+    return cmd
+
+
+def wait_listening(port, proc, timeout=5):
+    end = time.monotonic() + timeout
+    while time.monotonic() < end:
+        if proc.poll() is not None:
+            raise RuntimeError("server exited")
+        try:
+            socket.create_connection(("127.0.0.1", port), 0.2).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    raise RuntimeError("server doesn't listen")
+
+
+def run(args, build, profiles, out):
+    """run server and clients once, paths of reference and playout logs"""
+    binary = os.path.join(build, "snapclient-host")
+    if not os.access(binary, os.X_OK):
+        raise RuntimeError(f"{binary} not found")
+
+    port = args.port or free_port()
+    ref = os.path.join(out, "ref.json")
+    logs = [os.path.join(out, f"{name}.bin") for name, _, _ in profiles]
+
+    with open(os.path.join(out, "server.log"), "w") as slog:
+        server = subprocess.Popen(server_cmd(args, port, ref, profiles),
+                                  stdout=slog, stderr=subprocess.STDOUT)
+        procs = []
+        try:
+            wait_listening(port, server)
+            for i, (name, client, _) in enumerate(profiles):
+                clog = open(os.path.join(out, f"{name}.log"), "w")
+                procs.append(subprocess.Popen(
+                    client_cmd(binary, port, i, name, client, logs[i],
+                               args.duration),
+                    stdout=clog, stderr=subprocess.STDOUT))
+                clog.close()
+            for proc in procs:
+                proc.wait(timeout=args.duration + 30)
+        finally:
+            for proc in procs:
+                if proc.poll() is None:
+                    proc.kill()
+            server.terminate()
+            server.wait()
+
+    for proc, (name, _, _) in zip(procs, profiles):
+        if proc.returncode != 0:
+            raise RuntimeError(f"{name} exited with {proc.returncode}, "
+                               f"see {out}/{name}.log")
+
+    return ref, logs
+
+
+class Timeline:
+    """play time of stream frames from the descriptors of one client"""
+
+    def __init__(self, ref, records):
+        desc = []
+        for t_ns, rate_hz, frames, sr, _, flags, _, first in records:
+            k = sync_report.frame_index(first)
+            if sr != ref["sample_rate"] or flags & sync_report.FLAG_STALE \
+                    or k == 0:
+                continue
+            desc.append((k, frames, t_ns, rate_hz))
+        # frames played twice after a jump back count once, last wins
+        desc.sort(key=lambda d: d[0])
+        self.desc = desc
+        self.starts = [d[0] for d in desc]
+
+    def first(self):
+        return self.starts[0] if self.starts else None
+
+    def last(self):
+        return self.desc[-1][0] + self.desc[-1][1] if self.desc else None
+
+    def play_ns(self, k):
+        i = bisect.bisect_right(self.starts, k) - 1
+        if i < 0:
+            return None
+        k0, frames, t_ns, rate_hz = self.desc[i]
+        if k >= k0 + frames:
+            return None
+        return t_ns + (k - k0) * 1e9 / rate_hz
+
+
+def skew(ref, timelines, names, step_ms, settle_s, window_s):
+    sr = ref["sample_rate"]
+    firsts = [tl.first() for tl in timelines]
+    lasts = [tl.last() for tl in timelines]
+    if None in firsts or len(timelines) < 2:
+        return None
+
+    k_first, k_last = max(firsts), min(lasts)
+    step = sr * step_ms // 1000
+    samples = []  # (stream s, spread µs, offsets from median µs)
+    for k in range(k_first, k_last, step):
+        times = [tl.play_ns(k) for tl in timelines]
+        if None in times:
+            continue
+        med = sorted(times)[len(times) // 2]
+        samples.append(((k - k_first) / sr,
+                        (max(times) - min(times)) / 1000,
+                        [(t - med) / 1000 for t in times]))
+
+    def stats(values):
+        return {"samples": len(values),
+                "p50_us": sync_report.percentile(values, 0.5),
+                "p95_us": sync_report.percentile(values, 0.95),
+                "p99_us": sync_report.percentile(values, 0.99),
+                "max_us": max(values) if values else None}
+
+    settled = [s for s in samples if s[0] >= settle_s]
+    result = {"step_ms": step_ms, "settle_s": settle_s}
+    result.update(stats([s[1] for s in settled]))
+
+    result["clients"] = {}
+    for i, name in enumerate(names):
+        offs = [s[2][i] for s in settled]
+        result["clients"][name] = {
+            "offset_p50_us": sync_report.percentile(offs, 0.5),
+            "abs_offset_p99_us": sync_report.percentile(
+                [abs(o) for o in offs], 0.99),
+        }
+
+    windows = []
+    if samples:
+        n = int(samples[-1][0] // window_s) + 1
+        for w in range(n):
+            values = [s[1] for s in samples
+                      if w * window_s <= s[0] < (w + 1) * window_s]
+            if values:
+                windows.append(dict(start_s=w * window_s, **stats(values)))
+    result["windows"] = windows
+
+    return result
+
+
+def bench(args, build, profiles, out):
+    ref_path, logs = run(args, build, profiles, out)
+    ref = sync_report.load_ref(ref_path)
+
+    names = [name for name, _, _ in profiles]
+    result = {"build": build, "options": build_options(build),
+              "clients": {}}
+    timelines = []
+    for (name, client, net), log in zip(profiles, logs):
+        records = sync_report.load_playout(log)
+        r = sync_report.analyze(ref, records, args.within_us, args.hold_s)
+        r["profile"] = dict(client, **net)
+        result["clients"][name] = r
+        timelines.append(Timeline(ref, records))
+    result["skew"] = skew(ref, timelines, names, args.step_ms,
+                          args.settle_s, args.window_s)
+
+    return result
+
+
+def us(v):
+    return "-" if v is None else f"{v:.0f}us"
+
+
+def print_result(r):
+    opts = " ".join(f"{k}={v}" for k, v in r["options"].items())
+    print(f"{r['build']}: {opts or 'defaults'}")
+    for name, c in r["clients"].items():
+        profile = ",".join(f"{k}={v}" for k, v in c["profile"].items())
+        sync_report.print_report(f"  {name} ({profile})", c)
+
+    s = r["skew"]
+    if s is None:
+        print("  no common frames, no skew")
+        return
+    print(f"  skew from {s['settle_s']}s on, {s['samples']} frames: "
+          f"p50 {us(s['p50_us'])}, p95 {us(s['p95_us'])}, "
+          f"p99 {us(s['p99_us'])}, max {us(s['max_us'])}")
+    for name, c in s["clients"].items():
+        print(f"    {name}: offset from median p50 "
+              f"{us(c['offset_p50_us'])}, |offset| p99 "
+              f"{us(c['abs_offset_p99_us'])}")
+    print("  window       p50      p99      max")
+    for w in s["windows"]:
+        print(f"  {w['start_s']:5.0f}s {us(w['p50_us']):>8} "
+              f"{us(w['p99_us']):>8} {us(w['max_us']):>8}")
+
+
+def print_summary(results):
+    print("build                     skew p50      p95      p99      max")
+    for r in results:
+        s = r["skew"] or {}
+        print(f"{r['build'][-24:]:24} {us(s.get('p50_us')):>9} "
+              f"{us(s.get('p95_us')):>8} {us(s.get('p99_us')):>8} "
+              f"{us(s.get('max_us')):>8}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--build", action="append",
+                        help="host build directory, repeat to compare "
+                        "(build-host)")
+    parser.add_argument("--clients", type=int, default=3,
+                        help="number of clients (%(default)s)")
+    parser.add_argument("--client", action="append", metavar="K=V,..",
+                        help="settings of next client: dac_ppm, wander_ppm, "
+                        "wander_period_s and impairments like latency_ms")
+    parser.add_argument("--dac-spread-ppm", type=float, default=50,
+                        help="DAC error range of default clients "
+                        "(%(default)s)")
+    parser.add_argument("--duration", type=float, default=60,
+                        help="seconds to play (%(default)s)")
+    parser.add_argument("--port", type=int, default=0,
+                        help="server port, free one if 0")
+    parser.add_argument("--buffer-ms", type=int, default=1000,
+                        help="server buffer (%(default)s)")
+    parser.add_argument("--chunk-ms", type=int, default=20,
+                        help="wire chunk duration (%(default)s)")
+    parser.add_argument("--drift-ppm", type=float, default=0,
+                        help="server clock error")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="random seed of impairments (%(default)s)")
+    snapserver_sim.add_impairment_args(parser)
+    parser.add_argument("--step-ms", type=int, default=10,
+                        help="stream time between compared frames "
+                        "(%(default)s)")
+    parser.add_argument("--settle-s", type=float, default=10,
+                        help="skip stream start for skew (%(default)s)")
+    parser.add_argument("--window-s", type=float, default=10,
+                        help="skew over time in windows of (%(default)s)")
+    parser.add_argument("--within-us", type=float, default=500,
+                        help="error bound for convergence (%(default)s)")
+    parser.add_argument("--hold-s", type=float, default=5,
+                        help="time error has to stay within (%(default)s)")
+    parser.add_argument("--out", help="keep logs here instead of a temp dir")
+    parser.add_argument("--json", action="store_true",
+                        help="print machine readable result")
+    args = parser.parse_args()
+
+    try:
+        profiles = clients(args)
+    except ValueError as e:
+        sys.exit(str(e))
+
+    results = []
+    for n, build in enumerate(args.build or ["build-host"]):
+        with tempfile.TemporaryDirectory() as tmp:
+            out = tmp
+            if args.out:
+                out = os.path.join(args.out, str(n))
+                os.makedirs(out, exist_ok=True)
+            try:
+                results.append(bench(args, build, profiles, out))
+            except (OSError, ValueError, RuntimeError,
+                    subprocess.TimeoutExpired) as e:
+                sys.exit(f"{build}: {e}")
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+        return
+
+    for r in results:
+        print_result(r)
+    if len(results) > 1:
+        print_summary(results)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Sync accuracy of a host build playout log against tools/snapserver_sim.py.
+
+Every played DMA descriptor in the log tells which frame was played when. The
+reference written by the server's --ref says when it should have been, so the
+playout error is known for every descriptor:
+
+    tools/sync_report.py ref.json playout.bin
+    tools/sync_report.py --json ref.json playout.bin
+
+Convergence is the time from the first played frame until the error stays
+within --within-us for --hold-s seconds, percentiles are taken from there
+on, or over everything if that never happens. Hard resyncs are restarts of
+I2S, underruns are descriptors played without new data and jumps are
+discontinuities in the played frames of more than two frames, smaller ones
+come from sample insertion.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"SCPO"
+VERSION = 1
+RECORD = struct.Struct("<qdIIBBHI")
+FLAG_START = 0x01
+FLAG_STALE = 0x02
+
+
+def load_ref(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def load_playout(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if len(data) < 8 or data[:4] != MAGIC:
+        raise ValueError(f"{path} is no playout log")
+    if data[4] != VERSION or data[5] != RECORD.size:
+        raise ValueError(f"{path}: unsupported version {data[4]}")
+
+    return [RECORD.unpack_from(data, off)
+            for off in range(8, len(data) - RECORD.size + 1, RECORD.size)]
+
+
+def frame_index(first):
+    """samples are stored with halfwords swapped for the ESP32 I2S"""
+    return (first >> 16) | ((first & 0xffff) << 16)
+
+
+def expected_ns(ref, k):
+    """CLOCK_MONOTONIC at which frame k should be played"""
+    server_us = (ref["stream_start_us"] + k * 1e6 / ref["sample_rate"] +
+                 ref["buffer_ms"] * 1000)
+    rate = 1 + ref["drift_ppm"] * 1e-6
+    mono_us = ref["clock_base_us"] + (server_us - ref["clock_base_us"]) / rate
+    return mono_us * 1000
+
+
+def errors(ref, records):
+    """(t_ns, error in µs) of every descriptor holding stream frames"""
+    out = []
+    for t_ns, _, _, sr, _, flags, _, first in records:
+        k = frame_index(first)
+        if sr != ref["sample_rate"] or flags & FLAG_STALE or k == 0:
+            continue
+        out.append((t_ns, (t_ns - expected_ns(ref, k)) / 1000))
+    return out
+
+
+def events(records):
+    hard = underruns = jumps = inserts = 0
+    prev = None
+    playing = False
+    for _, _, frames, _, _, flags, _, first in records:
+        k = frame_index(first)
+        # silence before the first chunk doesn't count
+        if not playing:
+            if flags & FLAG_STALE or k == 0:
+                continue
+            playing = True
+            flags &= ~FLAG_START
+        if flags & FLAG_START:
+            hard += 1
+            prev = None
+        if flags & FLAG_STALE:
+            underruns += 1
+            prev = None
+            continue
+
+        if prev is not None and k != 0:
+            step = k - prev
+            if abs(step) > 2:
+                jumps += 1
+            elif step != 0:
+                inserts += 1
+        prev = k + frames if k != 0 else None
+
+    return {"hard_resyncs": hard, "underruns": underruns,
+            "jumps": jumps, "insertions": inserts}
+
+
+def convergence(errs, within_us, hold_s):
+    """index and time in s of first error starting hold_s within bounds"""
+    hold_ns = hold_s * 1e9
+    start = None
+    for i, (t_ns, err) in enumerate(errs):
+        if abs(err) > within_us:
+            start = None
+            continue
+        if start is None:
+            start = i
+        if t_ns - errs[start][0] >= hold_ns:
+            return start, (errs[start][0] - errs[0][0]) / 1e9
+    return None, None
+
+
+def percentile(values, q):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(int(q * len(values)), len(values) - 1)]
+
+
+def analyze(ref, records, within_us=500, hold_s=5):
+    errs = errors(ref, records)
+    result = {"descriptors": len(records), "frames_checked": len(errs)}
+    result.update(events(records))
+
+    idx, conv_s = convergence(errs, within_us, hold_s)
+    result["converged"] = idx is not None
+    result["convergence_s"] = conv_s
+    result["within_us"] = within_us
+
+    steady = [e for _, e in errs[idx or 0:]]
+    abs_steady = [abs(e) for e in steady]
+    for name, q in (("p1", 0.01), ("p50", 0.5), ("p99", 0.99)):
+        result[f"error_{name}_us"] = percentile(steady, q)
+    for name, q in (("p50", 0.5), ("p95", 0.95), ("p99", 0.99)):
+        result[f"abs_error_{name}_us"] = percentile(abs_steady, q)
+    result["abs_error_max_us"] = max(abs_steady) if abs_steady else None
+
+    return result
+
+
+def print_report(name, r):
+    def us(v):
+        return "-" if v is None else f"{v:.0f}us"
+
+    print(f"{name}: {r['frames_checked']} of {r['descriptors']} "
+          "descriptors checked")
+    if r["converged"]:
+        print(f"  converged within {r['within_us']}us after "
+              f"{r['convergence_s']:.2f}s")
+    else:
+        print(f"  never within {r['within_us']}us")
+    print(f"  error p1 {us(r['error_p1_us'])}, p50 {us(r['error_p50_us'])}, "
+          f"p99 {us(r['error_p99_us'])}")
+    print(f"  |error| p50 {us(r['abs_error_p50_us'])}, "
+          f"p95 {us(r['abs_error_p95_us'])}, "
+          f"p99 {us(r['abs_error_p99_us'])}, "
+          f"max {us(r['abs_error_max_us'])}")
+    print(f"  hard resyncs {r['hard_resyncs']}, underruns {r['underruns']}, "
+          f"jumps {r['jumps']}, insertions {r['insertions']}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("ref", help="reference of tools/snapserver_sim.py")
+    parser.add_argument("playout", help="playout log of the host build")
+    parser.add_argument("--within-us", type=float, default=500,
+                        help="error bound for convergence (%(default)s)")
+    parser.add_argument("--hold-s", type=float, default=5,
+                        help="time error has to stay within (%(default)s)")
+    parser.add_argument("--json", action="store_true",
+                        help="print machine readable result")
+    args = parser.parse_args()
+
+    try:
+        result = analyze(load_ref(args.ref), load_playout(args.playout),
+                         args.within_us, args.hold_s)
+    except (OSError, ValueError) as e:
+        sys.exit(str(e))
+
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        print_report(args.playout, result)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""Decode a snapclient binary trace dump.
+
+Download the dump from the client's UI http server and decode it:
+
+    curl -o snapclient.trace http://<client>:8000/trace
+    tools/trace_decode.py snapclient.trace
+
+Event descriptions (level, tag, format) are part of the dump, so this doesn't
+need to be updated if events are added to trace.c.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"SCTR"
+VERSION = 1
+RECORD = struct.Struct("<IHBBq4i")
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+
+
+def parse(data):
+    if len(data) < 8 or data[:4] != MAGIC:
+        raise ValueError("not a snapclient trace dump")
+
+    version, rec_size, cores, evt_cnt = data[4:8]
+    if version != VERSION or rec_size != RECORD.size:
+        raise ValueError(
+            f"unsupported dump version {version}, record size {rec_size}")
+
+    pos = 8
+    events = {}
+    for _ in range(evt_cnt):
+        evt_id, level, tag_len, fmt_len = data[pos:pos + 4]
+        pos += 4
+        tag = data[pos:pos + tag_len].decode()
+        pos += tag_len
+        fmt = data[pos:pos + fmt_len].decode()
+        pos += fmt_len
+        events[evt_id] = (level, tag, fmt)
+
+    records = []
+    for off in range(pos, len(data) - RECORD.size + 1, RECORD.size):
+        seq, evt_id, core, _, ts_us, *args = RECORD.unpack_from(data, off)
+        records.append((ts_us, core, seq, evt_id, args))
+    records.sort()
+
+    return cores, events, records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", nargs="?", help="dump file, stdin if omitted")
+    args = parser.parse_args()
+
+    if args.dump:
+        with open(args.dump, "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    try:
+        cores, events, records = parse(data)
+    except ValueError as e:
+        sys.exit(f"error: {e}")
+
+    for ts_us, core, seq, evt_id, evt_args in records:
+        level, tag, fmt = events.get(evt_id, (2, "?", f"event {evt_id}"))
+        # %ld of the C format strings is a valid conversion in Python
+        nargs = fmt.count("%") - 2 * fmt.count("%%")
+        try:
+            msg = fmt % tuple(evt_args[:nargs])
+        except (TypeError, ValueError):
+            msg = f"{fmt} {evt_args}"
+        print(f"{ts_us / 1e6:12.6f} core {core} #{seq:<6} "
+              f"{LEVELS.get(level, '?')} {tag}: {msg}")
+
+
+if __name__ == "__main__":
+    main()